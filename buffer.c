@@ -129,3 +129,24 @@ buffer_printf(buffer_type *buffer, const char *format, ...)
 	buffer->_position += written;
 	return written;
 }
+
+void
+buffer_print_string(buffer_type *buffer, const char *str)
+{
+	size_t len = strlen(str);
+	buffer_reserve(buffer, len);
+	buffer_write(buffer, str, len);
+}
+
+void
+buffer_print_u32(buffer_type *buffer, uint32_t number)
+{
+	char digits[10];
+	size_t i = sizeof(digits);
+	do {
+		digits[--i] = '0' + number % 10;
+		number /= 10;
+	} while (number);
+	buffer_reserve(buffer, sizeof(digits) - i);
+	buffer_write(buffer, digits + i, sizeof(digits) - i);
+}
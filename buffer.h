@@ -411,4 +411,18 @@ buffer_read_u64(buffer_type *buffer)
 int buffer_printf(buffer_type *buffer, const char *format, ...)
 	ATTR_FORMAT(printf, 2, 3);
 
+/*
+ * Print the string to the buffer, increasing the capacity if required.
+ * The same as buffer_printf with "%s", but without the format parse
+ * and without the terminating '\0'.
+ */
+void buffer_print_string(buffer_type *buffer, const char *str);
+
+/*
+ * Print the number in decimal to the buffer, increasing the capacity
+ * if required. The same as buffer_printf with "%lu", without the
+ * terminating '\0'.
+ */
+void buffer_print_u32(buffer_type *buffer, uint32_t number);
+
 #endif /* _BUFFER_H_ */
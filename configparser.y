@@ -68,10 +68,15 @@ extern config_parser_state_type* cfg_parser;
 %token VAR_RRL_IPV4_PREFIX_LENGTH VAR_RRL_IPV6_PREFIX_LENGTH
 %token VAR_RRL_WHITELIST_RATELIMIT VAR_RRL_WHITELIST
 %token VAR_ZONEFILES_CHECK VAR_ZONEFILES_WRITE VAR_LOG_TIME_ASCII
+%token VAR_ZONEFILES_WRITE_WORKERS
 %token VAR_ROUND_ROBIN VAR_ZONESTATS VAR_REUSEPORT VAR_VERSION
 %token VAR_MAX_REFRESH_TIME VAR_MIN_REFRESH_TIME
 %token VAR_MAX_RETRY_TIME VAR_MIN_RETRY_TIME
-%token VAR_MULTI_MASTER_CHECK VAR_MINIMAL_RESPONSES
+%token VAR_MULTI_MASTER_CHECK VAR_MINIMAL_RESPONSES VAR_ZONEFILES_WATCH
+%token VAR_TLS_SERVICE_KEY VAR_TLS_SERVICE_PEM VAR_TLS_PORT
+%token VAR_TLS_TICKET_ROTATE VAR_TLS_KTLS
+%token VAR_PROXY_PROTOCOL_PORT VAR_PROXY_PROTOCOL_ALLOW
+%token VAR_ADAPTIVE_UDP_SIZE VAR_XFRD_IXFR_COST
 
 %%
 toplevelvars: /* empty */ | toplevelvars toplevelvar ;
@@ -101,9 +106,14 @@ content_server: server_ip_address | server_ip_transparent | server_debug_mode |
 	server_rrl_size | server_rrl_ratelimit | server_rrl_slip | 
 	server_rrl_ipv4_prefix_length | server_rrl_ipv6_prefix_length | server_rrl_whitelist_ratelimit |
 	server_zonefiles_check | server_do_ip4 | server_do_ip6 |
-	server_zonefiles_write | server_log_time_ascii | server_round_robin |
+	server_zonefiles_write | server_zonefiles_write_workers |
+	server_log_time_ascii | server_round_robin |
 	server_reuseport | server_version | server_ip_freebind |
-	server_minimal_responses;
+	server_minimal_responses | server_zonefiles_watch |
+	server_tls_service_key | server_tls_service_pem | server_tls_port |
+	server_tls_ticket_rotate | server_tls_ktls |
+	server_proxy_protocol_port | server_proxy_protocol_allow |
+	server_adaptive_udp_size | server_xfrd_ixfr_cost;
 server_ip_address: VAR_IP_ADDRESS STRING 
 	{ 
 		OUTYY(("P(server_ip_address:%s)\n", $2)); 
@@ -502,6 +512,89 @@ server_zonefiles_check: VAR_ZONEFILES_CHECK STRING
 		else cfg_parser->opt->zonefiles_check = (strcmp($2, "yes")==0);
 	}
 	;
+server_zonefiles_watch: VAR_ZONEFILES_WATCH STRING 
+	{ 
+		OUTYY(("P(server_zonefiles_watch:%s)\n", $2)); 
+		if(strcmp($2, "yes") != 0 && strcmp($2, "no") != 0)
+			yyerror("expected yes or no.");
+		else cfg_parser->opt->zonefiles_watch = (strcmp($2, "yes")==0);
+	}
+	;
+server_tls_service_key: VAR_TLS_SERVICE_KEY STRING
+	{ 
+		OUTYY(("P(server_tls_service_key:%s)\n", $2)); 
+		cfg_parser->opt->tls_service_key = region_strdup(cfg_parser->opt->region, $2);
+	}
+	;
+server_tls_service_pem: VAR_TLS_SERVICE_PEM STRING
+	{ 
+		OUTYY(("P(server_tls_service_pem:%s)\n", $2)); 
+		cfg_parser->opt->tls_service_pem = region_strdup(cfg_parser->opt->region, $2);
+	}
+	;
+server_tls_port: VAR_TLS_PORT STRING
+	{ 
+		OUTYY(("P(server_tls_port:%s)\n", $2)); 
+		if(atoi($2) <= 0 || atoi($2) > 65535)
+			yyerror("port number expected");
+		else cfg_parser->opt->tls_port = region_strdup(cfg_parser->opt->region, $2);
+	}
+	;
+server_tls_ticket_rotate: VAR_TLS_TICKET_ROTATE STRING
+	{ 
+		OUTYY(("P(server_tls_ticket_rotate:%s)\n", $2)); 
+		if(atoi($2) == 0 && strcmp($2, "0") != 0)
+			yyerror("number expected");
+		else cfg_parser->opt->tls_ticket_rotate = atoi($2);
+	}
+	;
+server_tls_ktls: VAR_TLS_KTLS STRING
+	{ 
+		OUTYY(("P(server_tls_ktls:%s)\n", $2)); 
+		if(strcmp($2, "yes") != 0 && strcmp($2, "no") != 0)
+			yyerror("expected yes or no.");
+		else cfg_parser->opt->tls_ktls = (strcmp($2, "yes")==0);
+	}
+	;
+server_proxy_protocol_port: VAR_PROXY_PROTOCOL_PORT STRING
+	{ 
+		OUTYY(("P(server_proxy_protocol_port:%s)\n", $2)); 
+		if(atoi($2) <= 0 || atoi($2) > 65535)
+			yyerror("port number expected");
+		else {
+			struct proxy_protocol_port_list* elem = (struct
+				proxy_protocol_port_list*)region_alloc_zero(
+				cfg_parser->opt->region, sizeof(*elem));
+			elem->port = atoi($2);
+			elem->next = cfg_parser->opt->proxy_protocol_port;
+			cfg_parser->opt->proxy_protocol_port = elem;
+		}
+	}
+	;
+server_proxy_protocol_allow: VAR_PROXY_PROTOCOL_ALLOW STRING
+	{ 
+		acl_options_type* acl = parse_acl_info(cfg_parser->opt->region, $2, "NOKEY");
+		OUTYY(("P(server_proxy_protocol_allow:%s)\n", $2)); 
+		acl->next = cfg_parser->opt->proxy_protocol_allow;
+		cfg_parser->opt->proxy_protocol_allow = acl;
+	}
+	;
+server_adaptive_udp_size: VAR_ADAPTIVE_UDP_SIZE STRING
+	{ 
+		OUTYY(("P(server_adaptive_udp_size:%s)\n", $2)); 
+		if(strcmp($2, "yes") != 0 && strcmp($2, "no") != 0)
+			yyerror("expected yes or no.");
+		else cfg_parser->opt->adaptive_udp_size = (strcmp($2, "yes")==0);
+	}
+	;
+server_xfrd_ixfr_cost: VAR_XFRD_IXFR_COST STRING
+	{ 
+		OUTYY(("P(server_xfrd_ixfr_cost:%s)\n", $2)); 
+		if(strcmp($2, "yes") != 0 && strcmp($2, "no") != 0)
+			yyerror("expected yes or no.");
+		else cfg_parser->opt->xfrd_ixfr_cost = (strcmp($2, "yes")==0);
+	}
+	;
 server_zonefiles_write: VAR_ZONEFILES_WRITE STRING 
 	{ 
 		OUTYY(("P(server_zonefiles_write:%s)\n", $2)); 
@@ -510,6 +603,14 @@ server_zonefiles_write: VAR_ZONEFILES_WRITE STRING
 		else cfg_parser->opt->zonefiles_write = atoi($2);
 	}
 	;
+server_zonefiles_write_workers: VAR_ZONEFILES_WRITE_WORKERS STRING 
+	{ 
+		OUTYY(("P(server_zonefiles_write_workers:%s)\n", $2)); 
+		if(atoi($2) == 0 && strcmp($2, "0") != 0)
+			yyerror("number expected");
+		else cfg_parser->opt->zonefiles_write_workers = atoi($2);
+	}
+	;
 
 rcstart: VAR_REMOTE_CONTROL
 	{
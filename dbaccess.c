@@ -283,13 +283,18 @@ namedb_zone_create(namedb_type* db, const dname_type* dname,
 void
 namedb_zone_delete(namedb_type* db, zone_type* zone)
 {
+	/* a lazily deleted zone is already removed from the zonetree, and
+	 * its apex can be the apex of a new zone by now */
+	int detached = (zone->node == NULL);
 	/* RRs and UDB and NSEC3 and so on must be already deleted */
-	radix_delete(db->zonetree, zone->node);
+	if(!detached)
+		radix_delete(db->zonetree, zone->node);
 
 	/* see if apex can be deleted */
 	if(zone->apex) {
 		zone->apex->usage --;
-		zone->apex->is_apex = 0;
+		if(!detached)
+			zone->apex->is_apex = 0;
 		if(zone->apex->usage == 0) {
 			/* delete the apex, possibly */
 			domain_table_deldomain(db, zone->apex);
@@ -438,6 +443,7 @@ namedb_open (const char* filename, struct nsd_options* opt)
 	db->zonetree = radix_tree_create(db->region);
 	db->diff_skip = 0;
 	db->diff_pos = 0;
+	db->zone_delete = NULL;
 	zonec_setup_parser(db);
 
 	if (gettimeofday(&(db->diff_timestamp), NULL) != 0) {
@@ -569,6 +575,8 @@ namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
 	}
 
 	assert(parser);
+	/* zones above or below that are being deleted must be gone */
+	delete_zone_finish(nsd->db, domain_dname(zone->apex));
 	/* wipe zone from memory */
 #ifdef NSEC3
 	nsec3_hash_tree_clear(zone);
@@ -623,6 +631,8 @@ namedb_read_zonefile(struct nsd* nsd, struct zone* zone, udb_base* taskudb,
 	} else {
 		VERBOSITY(1, (LOG_INFO, "zone %s read with success",
 			zone->opts->name));
+		nsd->reload_timing.zones++;
+		nsd->reload_timing.rrs += zonec_num_rrs();
 		zone->is_ok = 1;
 		zone->is_changed = 0;
 		/* store zone into udb */
@@ -660,6 +670,7 @@ void namedb_check_zonefile(struct nsd* nsd, udb_base* taskudb,
 	/* find zone to go with it, or create it */
 	zone = namedb_find_zone(nsd->db, dname);
 	if(!zone) {
+		delete_zone_finish(nsd->db, dname);
 		zone = namedb_zone_create(nsd->db, dname, zopt);
 	}
 	namedb_read_zonefile(nsd, zone, taskudb, last_task);
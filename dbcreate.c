@@ -11,8 +11,10 @@
 
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <poll.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
@@ -26,6 +28,8 @@
 
 /* pathname directory separator character */
 #define PATHSEP '/'
+/* size of the output buffer of a zone file that is written */
+#define ZONEFILE_WRITE_BUFSIZE (1024*1024)
 
 /** add an rdata (uncompressed) to the destination */
 static size_t
@@ -249,27 +253,46 @@ static int
 write_to_zonefile(zone_type* zone, const char* filename, const char* logs)
 {
 	time_t now = time(0);
+	char* buf;
 	FILE *out = fopen(filename, "w");
 	if(!out) {
 		log_msg(LOG_ERR, "cannot write zone %s file %s: %s",
 			zone->opts->name, filename, strerror(errno));
 		return 0;
 	}
+	/* large writes, instead of one per stdio buffer */
+	buf = (char*)xalloc(ZONEFILE_WRITE_BUFSIZE);
+	if(setvbuf(out, buf, _IOFBF, ZONEFILE_WRITE_BUFSIZE) != 0) {
+		free(buf);
+		buf = NULL;
+	}
 	if(!print_header(zone, out, &now, logs)) {
 		fclose(out);
+		free(buf);
 		log_msg(LOG_ERR, "There was an error printing "
 			"the header to zone %s", zone->opts->name);
 		return 0;
 	}
 	if(!print_rrs(out, zone)) {
 		fclose(out);
+		free(buf);
+		return 0;
+	}
+	/* the file contents are on disk before it is renamed into place */
+	if(fflush(out) != 0 || fsync(fileno(out)) != 0) {
+		log_msg(LOG_ERR, "cannot write zone %s to file %s: %s",
+			zone->opts->name, filename, strerror(errno));
+		fclose(out);
+		free(buf);
 		return 0;
 	}
 	if(fclose(out) != 0) {
 		log_msg(LOG_ERR, "cannot write zone %s to file %s: fclose: %s",
 			zone->opts->name, filename, strerror(errno));
+		free(buf);
 		return 0;
 	}
+	free(buf);
 	return 1;
 }
 
@@ -325,97 +348,406 @@ create_path_components(const char* path, int* notexist)
 	return 1;
 }
 
-void
-namedb_write_zonefile(struct nsd* nsd, struct zone_options* zopt)
+/** a zone that is written to its zone file */
+struct zonefile_write {
+	/** the zone, and its name to find it again when the write is done,
+	 * the zone may be deleted while the file is written */
+	zone_type* zone;
+	const dname_type* apex;
+	/** the zone file, and the file that is written and renamed to it */
+	char* zfile;
+	char* bakfile;
+	/** the log string for the header of the file */
+	char* logs;
+	/** if the file has been written successfully */
+	int ok;
+};
+
+/** see if the zone has to be written, and fill in the file names.
+ * returns false if it is not written */
+static int
+zonefile_write_prepare(struct nsd* nsd, struct zone_options* zopt,
+	region_type* region, struct zonefile_write* w)
 {
 	const char* zfile;
 	int notexist = 0;
 	zone_type* zone;
+	char logs[4096];
+	udb_ptr zudb;
 	/* if no zone exists, it has no contents or it has no zonefile
 	 * configured, then no need to write data to disk */
 	if(!zopt->pattern->zonefile)
-		return;
+		return 0;
 	zone = namedb_find_zone(nsd->db, (const dname_type*)zopt->node.key);
 	if(!zone || !zone->apex || !zone->soa_rrset)
-		return;
+		return 0;
 	/* write if file does not exist, or if changed */
 	/* so, determine filename, create directory components, check exist*/
 	zfile = config_make_zonefile(zopt, nsd);
 	if(!create_path_components(zfile, &notexist)) {
 		log_msg(LOG_ERR, "could not write zone %s to file %s because "
 			"the path could not be created", zopt->name, zfile);
-		return;
+		return 0;
 	}
 
 	/* if not changed, do not write. */
-	if(notexist || zone->is_changed) {
-		char logs[4096];
-		char bakfile[4096];
-		struct timespec mtime;
-		udb_ptr zudb;
-		if(nsd->db->udb) {
-			if(!udb_zone_search(nsd->db->udb, &zudb,
-				dname_name(domain_dname(zone->apex)),
-				domain_dname(zone->apex)->name_size))
-				return; /* zone does not exist in db */
-		}
-		/* write to zfile~ first, then rename if that works */
-		snprintf(bakfile, sizeof(bakfile), "%s~", zfile);
-		if(nsd->db->udb && ZONE(&zudb)->log_str.data) {
-			udb_ptr s;
-			udb_ptr_new(&s, nsd->db->udb, &ZONE(&zudb)->log_str);
-			strlcpy(logs, (char*)udb_ptr_data(&s), sizeof(logs));
-			udb_ptr_unlink(&s, nsd->db->udb);
-		} else if(zone->logstr) {
-			strlcpy(logs, zone->logstr, sizeof(logs));
-		} else logs[0] = 0;
-		VERBOSITY(1, (LOG_INFO, "writing zone %s to file %s",
-			zone->opts->name, zfile));
-		if(!write_to_zonefile(zone, bakfile, logs)) {
-			if(nsd->db->udb)
-				udb_ptr_unlink(&zudb, nsd->db->udb);
-			(void)unlink(bakfile); /* delete failed file */
-			return; /* error already printed */
-		}
-		if(rename(bakfile, zfile) == -1) {
-			log_msg(LOG_ERR, "rename(%s to %s) failed: %s",
-				bakfile, zfile, strerror(errno));
-			if(nsd->db->udb)
-				udb_ptr_unlink(&zudb, nsd->db->udb);
-			(void)unlink(bakfile); /* delete failed file */
+	if(!notexist && !zone->is_changed)
+		return 0;
+	if(nsd->db->udb) {
+		if(!udb_zone_search(nsd->db->udb, &zudb,
+			dname_name(domain_dname(zone->apex)),
+			domain_dname(zone->apex)->name_size))
+			return 0; /* zone does not exist in db */
+	}
+	if(nsd->db->udb && ZONE(&zudb)->log_str.data) {
+		udb_ptr s;
+		udb_ptr_new(&s, nsd->db->udb, &ZONE(&zudb)->log_str);
+		strlcpy(logs, (char*)udb_ptr_data(&s), sizeof(logs));
+		udb_ptr_unlink(&s, nsd->db->udb);
+	} else if(zone->logstr) {
+		strlcpy(logs, zone->logstr, sizeof(logs));
+	} else logs[0] = 0;
+	if(nsd->db->udb)
+		udb_ptr_unlink(&zudb, nsd->db->udb);
+	w->zone = zone;
+	w->apex = dname_copy(region, domain_dname(zone->apex));
+	w->zfile = region_strdup(region, zfile);
+	/* write to zfile~ first, then rename if that works */
+	w->bakfile = (char*)region_alloc(region, strlen(zfile)+2);
+	snprintf(w->bakfile, strlen(zfile)+2, "%s~", zfile);
+	w->logs = region_strdup(region, logs);
+	w->ok = 0;
+	/* changes from now on are written the next time */
+	zone->is_changed = 0;
+	VERBOSITY(1, (LOG_INFO, "writing zone %s to file %s",
+		zone->opts->name, zfile));
+	return 1;
+}
+
+/** rename the written file into place, and store the new mtime.
+ * The zone was marked as unchanged when the write started, if it changed
+ * since then it is written again later. */
+static void
+zonefile_write_finish(struct nsd* nsd, struct zonefile_write* w)
+{
+	zone_type* zone = namedb_find_zone(nsd->db, w->apex);
+	struct timespec mtime;
+	int notexist = 0;
+	udb_ptr zudb;
+	if(!zone || !zone->apex) {
+		/* the zone was deleted */
+		(void)unlink(w->bakfile);
+		w->ok = 0;
+		return;
+	}
+	if(!w->ok) {
+		(void)unlink(w->bakfile); /* delete failed file */
+		zone->is_changed = 1;
+		return; /* error already printed */
+	}
+	if(rename(w->bakfile, w->zfile) == -1) {
+		log_msg(LOG_ERR, "rename(%s to %s) failed: %s",
+			w->bakfile, w->zfile, strerror(errno));
+		(void)unlink(w->bakfile); /* delete failed file */
+		zone->is_changed = 1;
+		w->ok = 0;
+		return;
+	}
+	/* fetch the mtime of the just created zonefile so we
+	 * do not waste effort reading it back in */
+	if(!file_get_mtime(w->zfile, &mtime, &notexist)) {
+		get_time(&mtime);
+	}
+	if(nsd->db->udb) {
+		if(!udb_zone_search(nsd->db->udb, &zudb,
+			dname_name(domain_dname(zone->apex)),
+			domain_dname(zone->apex)->name_size))
 			return;
-		}
-		zone->is_changed = 0;
-		/* fetch the mtime of the just created zonefile so we
-		 * do not waste effort reading it back in */
-		if(!file_get_mtime(zfile, &mtime, &notexist)) {
-			get_time(&mtime);
-		}
-		if(nsd->db->udb) {
-			ZONE(&zudb)->mtime = (uint64_t)mtime.tv_sec;
-			ZONE(&zudb)->mtime_nsec = (uint64_t)mtime.tv_nsec;
+		ZONE(&zudb)->mtime = (uint64_t)mtime.tv_sec;
+		ZONE(&zudb)->mtime_nsec = (uint64_t)mtime.tv_nsec;
+		if(!zone->is_changed) {
 			ZONE(&zudb)->is_changed = 0;
 			udb_zone_set_log_str(nsd->db->udb, &zudb, NULL);
-			udb_ptr_unlink(&zudb, nsd->db->udb);
-		} else {
-			zone->mtime = mtime;
-			if(zone->filename)
-				region_recycle(nsd->db->region, zone->filename,
-					strlen(zone->filename)+1);
-			zone->filename = region_strdup(nsd->db->region, zfile);
-			if(zone->logstr)
-				region_recycle(nsd->db->region, zone->logstr,
-					strlen(zone->logstr)+1);
+		}
+		udb_ptr_unlink(&zudb, nsd->db->udb);
+	} else {
+		zone->mtime = mtime;
+		if(zone->filename)
+			region_recycle(nsd->db->region, zone->filename,
+				strlen(zone->filename)+1);
+		zone->filename = region_strdup(nsd->db->region, w->zfile);
+		if(zone->logstr && !zone->is_changed) {
+			region_recycle(nsd->db->region, zone->logstr,
+				strlen(zone->logstr)+1);
 			zone->logstr = NULL;
 		}
 	}
 }
 
+/** fsync the directories of the renamed files, once per directory */
+static void
+zonefile_sync_dirs(struct zonefile_write* list, size_t num)
+{
+	char dir[4096], last[4096];
+	size_t i;
+	last[0] = 0;
+	for(i=0; i<num; i++) {
+		char* p;
+		int fd;
+		if(!list[i].ok)
+			continue;
+		strlcpy(dir, list[i].zfile, sizeof(dir));
+		if((p = strrchr(dir, PATHSEP)) != NULL) {
+			if(p == dir)
+				p++;
+			*p = 0;
+		} else	strlcpy(dir, ".", sizeof(dir));
+		/* the zones are sorted, zones in one directory are mostly
+		 * next to each other */
+		if(strcmp(dir, last) == 0)
+			continue;
+		strlcpy(last, dir, sizeof(last));
+		if((fd = open(dir, O_RDONLY)) == -1)
+			continue;
+		if(fsync(fd) != 0)
+			VERBOSITY(2, (LOG_INFO, "fsync %s: %s", dir,
+				strerror(errno)));
+		close(fd);
+	}
+}
+
+/** write the zone files of one worker, every workers-th zone from start.
+ * in the child process the indexes of the written zones are sent over
+ * the pipe. */
+static void
+zonefile_write_worker(struct zonefile_write* list, size_t num,
+	size_t start, size_t workers, int out)
+{
+	size_t i;
+	for(i=start; i<num; i+=workers) {
+		uint32_t idx = (uint32_t)i;
+		list[i].ok = write_to_zonefile(list[i].zone, list[i].bakfile,
+			list[i].logs);
+		if(out != -1 && list[i].ok &&
+			write(out, &idx, sizeof(idx)) != (ssize_t)sizeof(idx))
+			log_msg(LOG_ERR, "zonefile write worker: write: %s",
+				strerror(errno));
+	}
+}
+
+/** the zone files that are written by forked workers, the reload and
+ * the main process continue, and collect the results of the workers */
+struct zonefile_writes {
+	region_type* region;
+	struct zonefile_write* list;
+	size_t num;
+	/** the worker processes, and the read end of the pipe of each worker,
+	 * the fd is -1 when the worker is done */
+	size_t workers;
+	pid_t* pids;
+	int* fds;
+};
+
+/** start the forked workers, the zones of the workers that could not be
+ * started are written by this process */
+static void
+zonefile_write_start(struct zonefile_writes* zw)
+{
+	size_t i;
+	zw->pids = (pid_t*)xalloc_array_zero(zw->workers, sizeof(pid_t));
+	zw->fds = (int*)xalloc_array_zero(zw->workers, sizeof(int));
+	for(i=0; i<zw->workers; i++) {
+		int sv[2];
+		zw->pids[i] = -1;
+		zw->fds[i] = -1;
+		if(pipe(sv) == -1) {
+			log_msg(LOG_ERR, "zonefile write: pipe: %s",
+				strerror(errno));
+			continue;
+		}
+		zw->pids[i] = fork();
+		switch(zw->pids[i]) {
+		case -1:
+			log_msg(LOG_ERR, "zonefile write: fork: %s",
+				strerror(errno));
+			close(sv[0]);
+			close(sv[1]);
+			break;
+		case 0:
+			/* child */
+			close(sv[0]);
+			zonefile_write_worker(zw->list, zw->num, i,
+				zw->workers, sv[1]);
+			close(sv[1]);
+			_exit(0);
+		default:
+			close(sv[1]);
+			if(fcntl(sv[0], F_SETFL, O_NONBLOCK) == -1)
+				log_msg(LOG_ERR, "zonefile write: fcntl: %s",
+					strerror(errno));
+			zw->fds[i] = sv[0];
+			break;
+		}
+	}
+	for(i=0; i<zw->workers; i++) {
+		if(zw->pids[i] == -1)
+			zonefile_write_worker(zw->list, zw->num, i,
+				zw->workers, -1);
+	}
+}
+
+/** read the results of a worker, returns false when the worker is done */
+static int
+zonefile_write_read(struct zonefile_writes* zw, size_t i)
+{
+	uint32_t idx;
+	ssize_t r;
+	while((r = read(zw->fds[i], &idx, sizeof(idx))) != 0) {
+		if(r == -1) {
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK)
+				return 1;
+			log_msg(LOG_ERR, "zonefile write: read: %s",
+				strerror(errno));
+			break;
+		}
+		if(r == (ssize_t)sizeof(idx) && idx < zw->num)
+			zw->list[idx].ok = 1;
+	}
+	close(zw->fds[i]);
+	zw->fds[i] = -1;
+	/* the main loop may have reaped the worker already */
+	while(waitpid(zw->pids[i], NULL, 0) == -1) {
+		if(errno != EINTR) {
+			if(errno != ECHILD)
+				log_msg(LOG_ERR, "zonefile write: waitpid: %s",
+					strerror(errno));
+			break;
+		}
+	}
+	return 0;
+}
+
+/** free the zone file writes */
+static void
+zonefile_writes_delete(struct zonefile_writes* zw)
+{
+	free(zw->pids);
+	free(zw->fds);
+	free(zw->list);
+	region_destroy(zw->region);
+	free(zw);
+}
+
+void
+namedb_write_zonefiles_collect(struct nsd* nsd, int block)
+{
+	struct zonefile_writes* zw = nsd->zonefile_writes;
+	size_t i, busy;
+	if(!zw)
+		return;
+	do {
+		busy = 0;
+		for(i=0; i<zw->workers; i++) {
+			struct pollfd pfd;
+			if(zw->fds[i] == -1)
+				continue;
+			if(block) {
+				memset(&pfd, 0, sizeof(pfd));
+				pfd.fd = zw->fds[i];
+				pfd.events = POLLIN;
+				if(poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+					log_msg(LOG_ERR, "zonefile write: "
+						"poll: %s", strerror(errno));
+					block = 0;
+				}
+			}
+			if(zonefile_write_read(zw, i))
+				busy++;
+		}
+	} while(busy && block);
+	if(busy)
+		return;
+	for(i=0; i<zw->num; i++)
+		zonefile_write_finish(nsd, &zw->list[i]);
+	zonefile_sync_dirs(zw->list, zw->num);
+	VERBOSITY(1, (LOG_INFO, "zone files written: %u",
+		(unsigned)zw->num));
+	nsd->zonefile_writes = NULL;
+	zonefile_writes_delete(zw);
+}
+
+void
+namedb_write_zonefiles_forget(struct nsd* nsd)
+{
+	struct zonefile_writes* zw = nsd->zonefile_writes;
+	size_t i;
+	if(!zw)
+		return;
+	for(i=0; i<zw->workers; i++) {
+		if(zw->fds[i] != -1)
+			close(zw->fds[i]);
+	}
+	for(i=0; i<zw->num; i++) {
+		zone_type* zone = namedb_find_zone(nsd->db, zw->list[i].apex);
+		if(zone)
+			zone->is_changed = 1;
+	}
+	nsd->zonefile_writes = NULL;
+	zonefile_writes_delete(zw);
+}
+
+void
+namedb_write_zonefile(struct nsd* nsd, struct zone_options* zopt)
+{
+	region_type* region;
+	struct zonefile_write w;
+	/* the zone may be in the files that are being written */
+	namedb_write_zonefiles_collect(nsd, 1);
+	region = region_create(xalloc, free);
+	if(zonefile_write_prepare(nsd, zopt, region, &w)) {
+		w.ok = write_to_zonefile(w.zone, w.bakfile, w.logs);
+		zonefile_write_finish(nsd, &w);
+		zonefile_sync_dirs(&w, 1);
+	}
+	region_destroy(region);
+}
+
 void
 namedb_write_zonefiles(struct nsd* nsd, struct nsd_options* options)
 {
+	struct zonefile_writes* zw;
+	size_t max = 0, i;
 	struct zone_options* zo;
+	namedb_write_zonefiles_collect(nsd, 1);
+	zw = (struct zonefile_writes*)xalloc_zero(sizeof(*zw));
+	zw->region = region_create(xalloc, free);
 	RBTREE_FOR(zo, struct zone_options*, options->zone_options) {
-		namedb_write_zonefile(nsd, zo);
+		if(zw->num == max) {
+			max = max?max*2:64;
+			zw->list = (struct zonefile_write*)xrealloc(zw->list,
+				max*sizeof(*zw->list));
+		}
+		if(zonefile_write_prepare(nsd, zo, zw->region,
+			&zw->list[zw->num]))
+			zw->num++;
+	}
+	/* the workers write from a snapshot of the zone data, and this
+	 * process continues, the files are renamed into place when they
+	 * are collected */
+	zw->workers = (size_t)options->zonefiles_write_workers;
+	if(zw->workers > zw->num)
+		zw->workers = zw->num;
+	if(zw->workers > 0) {
+		zonefile_write_start(zw);
+		nsd->zonefile_writes = zw;
+		namedb_write_zonefiles_collect(nsd, 0);
+		return;
 	}
+	zonefile_write_worker(zw->list, zw->num, 0, 1, -1);
+	for(i=0; i<zw->num; i++)
+		zonefile_write_finish(nsd, &zw->list[i]);
+	zonefile_sync_dirs(zw->list, zw->num);
+	zonefile_writes_delete(zw);
 }
@@ -403,6 +403,9 @@ debug_find_rr_num(rrset_type* rrset, uint16_t type, uint16_t klass,
 	}
 }
 
+/* index of the large RRsets, while the xfr is applied */
+static struct rr_index* diff_rr_index = NULL;
+
 static int
 find_rr_num(rrset_type* rrset, uint16_t type, uint16_t klass,
 	rdata_atom_type *rdatas, ssize_t rdata_num, int add)
@@ -410,6 +413,16 @@ find_rr_num(rrset_type* rrset, uint16_t type, uint16_t klass,
 	int i, rd;
 	char* reason;
 
+	if(diff_rr_index && rrset->rr_count >= RR_INDEX_MIN &&
+		type != TYPE_SOA) {
+		i = rr_index_find(diff_rr_index, rrset, klass, rdatas,
+			rdata_num);
+		if(i != -1 || add)
+			return i;
+		/* log why rr cannot be found */
+		debug_find_rr_num(rrset, type, klass, rdatas, rdata_num);
+		return -1;
+	}
 	for(i=0; i < rrset->rr_count; ++i) {
 		if(rrset->rrs[i].type == type &&
 		   rrset->rrs[i].klass == klass &&
@@ -623,6 +636,127 @@ rrset_lower_usage(namedb_type* db, rrset_type* rrset)
 		rr_lower_usage(db, &rrset->rrs[i]);
 }
 
+/* delete the rrset, that has its last RR removed, from the domain */
+static void
+delete_empty_rrset(namedb_type* db, domain_type* domain, rrset_type* rrset,
+	zone_type* zone, uint16_t type)
+{
+	/* delete entire rrset */
+	rrset_delete(db, domain, rrset);
+	/* check if domain is now nonexisting (or parents) */
+	rrset_zero_nonexist_check(domain, NULL);
+#ifdef NSEC3
+	/* cleanup nsec3 */
+	nsec3_delete_rrset_trigger(db, domain, zone, type);
+#else
+	(void)zone; (void)type;
+#endif
+	/* see if the domain can be deleted (and inspect parents) */
+	domain_table_deldomain(db, domain);
+}
+
+/* delete an RR from the rrset of the domain.  With keep_empty the rrset
+ * stays when its last RR is removed, the caller adds RRs to it or
+ * deletes it with delete_empty_rrset */
+static int
+delete_RR_rrset(namedb_type* db, domain_type* domain, rrset_type* rrset,
+	const dname_type* dname, uint16_t type, uint16_t klass,
+	buffer_type* packet, size_t rdatalen, zone_type *zone,
+	region_type* temp_region, udb_ptr* udbz, int* softfail,
+	int keep_empty)
+{
+	/* find the RR in the rrset */
+	domain_table_type *temptable;
+	rdata_atom_type *rdatas;
+	ssize_t rdata_num;
+	int rrnum;
+	temptable = domain_table_create(temp_region);
+	/* This will ensure that the dnames in rdata are
+	 * normalized, conform RFC 4035, section 6.2
+	 */
+	rdata_num = rdata_wireformat_to_rdata_atoms(
+		temp_region, temptable, type, rdatalen, packet, &rdatas);
+	if(rdata_num == -1) {
+		log_msg(LOG_ERR, "diff: bad rdata for %s",
+			dname_to_string(dname,0));
+		return 0;
+	}
+	rrnum = find_rr_num(rrset, type, klass, rdatas, rdata_num, 0);
+	if(rrnum == -1 && type == TYPE_SOA && domain == zone->apex
+		&& rrset->rr_count != 0)
+		rrnum = 0; /* replace existing SOA if no match */
+	if(rrnum == -1) {
+		log_msg(LOG_WARNING, "diff: RR <%s, %s> does not exist",
+			dname_to_string(dname,0), rrtype_to_string(type));
+		*softfail = 1;
+		return 1; /* not fatal error */
+	}
+	/* delete the normalized RR from the udb */
+	if(db->udb)
+		udb_del_rr(db->udb, udbz, &rrset->rrs[rrnum]);
+#ifdef NSEC3
+	/* process triggers for RR deletions */
+	nsec3_delete_rr_trigger(db, &rrset->rrs[rrnum], zone, udbz);
+#endif
+	/* the index hashes the domain names of the RR */
+	if(diff_rr_index)
+		rr_index_del(diff_rr_index, rrset, rrnum);
+	/* lower usage (possibly deleting other domains, and thus
+	 * invalidating the current RR's domain pointers) */
+	rr_lower_usage(db, &rrset->rrs[rrnum]);
+	if(rrset->rr_count == 1 && keep_empty) {
+		/* an RR is added next, the rrset stays */
+		add_rdata_to_recyclebin(db, &rrset->rrs[0]);
+		region_recycle(db->region, rrset->rrs, sizeof(rr_type));
+		rrset->rrs = NULL;
+		rrset->rr_count = 0;
+	} else if(rrset->rr_count == 1) {
+		delete_empty_rrset(db, domain, rrset, zone, type);
+	} else {
+		/* swap out the bad RR and decrease the count */
+		rr_type* rrs_orig = rrset->rrs;
+		add_rdata_to_recyclebin(db, &rrset->rrs[rrnum]);
+		if(rrnum < rrset->rr_count-1)
+			rrset->rrs[rrnum] = rrset->rrs[rrset->rr_count-1];
+		memset(&rrset->rrs[rrset->rr_count-1], 0, sizeof(rr_type));
+		/* realloc the rrs array one smaller */
+		rrset->rrs = region_alloc_array_init(db->region, rrs_orig,
+			(rrset->rr_count-1), sizeof(rr_type));
+		if(!rrset->rrs) {
+			log_msg(LOG_ERR, "out of memory, %s:%d", __FILE__, __LINE__);
+			exit(1);
+		}
+		region_recycle(db->region, rrs_orig,
+			sizeof(rr_type) * rrset->rr_count);
+#ifdef NSEC3
+		if(type == TYPE_NSEC3PARAM && zone->nsec3_param) {
+			/* fixup nsec3_param pointer to same RR */
+			assert(zone->nsec3_param >= rrs_orig &&
+				zone->nsec3_param <=
+				rrs_orig+rrset->rr_count);
+			/* last moved to rrnum, others at same index*/
+			if(zone->nsec3_param == &rrs_orig[
+				rrset->rr_count-1])
+				zone->nsec3_param = &rrset->rrs[rrnum];
+			else
+				zone->nsec3_param =
+					(void*)zone->nsec3_param
+					-(void*)rrs_orig +
+					(void*)rrset->rrs;
+		}
+#endif /* NSEC3 */
+		rrset->rr_count --;
+#ifdef NSEC3
+		/* for type nsec3, the domain may have become a
+		 * 'normal' domain with its remaining data now */
+		if(type == TYPE_NSEC3)
+			nsec3_rrsets_changed_add_prehash(db, domain,
+				zone);
+#endif /* NSEC3 */
+	}
+	return 1;
+}
+
 int
 delete_RR(namedb_type* db, const dname_type* dname,
 	uint16_t type, uint16_t klass,
@@ -646,136 +780,43 @@ delete_RR(namedb_type* db, const dname_type* dname,
 		buffer_skip(packet, rdatalen);
 		*softfail = 1;
 		return 1; /* not fatal error */
-	} else {
-		/* find the RR in the rrset */
-		domain_table_type *temptable;
-		rdata_atom_type *rdatas;
-		ssize_t rdata_num;
-		int rrnum;
-		temptable = domain_table_create(temp_region);
-		/* This will ensure that the dnames in rdata are
-		 * normalized, conform RFC 4035, section 6.2
-		 */
-		rdata_num = rdata_wireformat_to_rdata_atoms(
-			temp_region, temptable, type, rdatalen, packet, &rdatas);
-		if(rdata_num == -1) {
-			log_msg(LOG_ERR, "diff: bad rdata for %s",
-				dname_to_string(dname,0));
-			return 0;
-		}
-		rrnum = find_rr_num(rrset, type, klass, rdatas, rdata_num, 0);
-		if(rrnum == -1 && type == TYPE_SOA && domain == zone->apex
-			&& rrset->rr_count != 0)
-			rrnum = 0; /* replace existing SOA if no match */
-		if(rrnum == -1) {
-			log_msg(LOG_WARNING, "diff: RR <%s, %s> does not exist",
-				dname_to_string(dname,0), rrtype_to_string(type));
-			*softfail = 1;
-			return 1; /* not fatal error */
-		}
-		/* delete the normalized RR from the udb */
-		if(db->udb)
-			udb_del_rr(db->udb, udbz, &rrset->rrs[rrnum]);
-#ifdef NSEC3
-		/* process triggers for RR deletions */
-		nsec3_delete_rr_trigger(db, &rrset->rrs[rrnum], zone, udbz);
-#endif
-		/* lower usage (possibly deleting other domains, and thus
-		 * invalidating the current RR's domain pointers) */
-		rr_lower_usage(db, &rrset->rrs[rrnum]);
-		if(rrset->rr_count == 1) {
-			/* delete entire rrset */
-			rrset_delete(db, domain, rrset);
-			/* check if domain is now nonexisting (or parents) */
-			rrset_zero_nonexist_check(domain, NULL);
-#ifdef NSEC3
-			/* cleanup nsec3 */
-			nsec3_delete_rrset_trigger(db, domain, zone, type);
-#endif
-			/* see if the domain can be deleted (and inspect parents) */
-			domain_table_deldomain(db, domain);
-		} else {
-			/* swap out the bad RR and decrease the count */
-			rr_type* rrs_orig = rrset->rrs;
-			add_rdata_to_recyclebin(db, &rrset->rrs[rrnum]);
-			if(rrnum < rrset->rr_count-1)
-				rrset->rrs[rrnum] = rrset->rrs[rrset->rr_count-1];
-			memset(&rrset->rrs[rrset->rr_count-1], 0, sizeof(rr_type));
-			/* realloc the rrs array one smaller */
-			rrset->rrs = region_alloc_array_init(db->region, rrs_orig,
-				(rrset->rr_count-1), sizeof(rr_type));
-			if(!rrset->rrs) {
-				log_msg(LOG_ERR, "out of memory, %s:%d", __FILE__, __LINE__);
-				exit(1);
-			}
-			region_recycle(db->region, rrs_orig,
-				sizeof(rr_type) * rrset->rr_count);
-#ifdef NSEC3
-			if(type == TYPE_NSEC3PARAM && zone->nsec3_param) {
-				/* fixup nsec3_param pointer to same RR */
-				assert(zone->nsec3_param >= rrs_orig &&
-					zone->nsec3_param <=
-					rrs_orig+rrset->rr_count);
-				/* last moved to rrnum, others at same index*/
-				if(zone->nsec3_param == &rrs_orig[
-					rrset->rr_count-1])
-					zone->nsec3_param = &rrset->rrs[rrnum];
-				else
-					zone->nsec3_param =
-						(void*)zone->nsec3_param
-						-(void*)rrs_orig +
-						(void*)rrset->rrs;
-			}
-#endif /* NSEC3 */
-			rrset->rr_count --;
-#ifdef NSEC3
-			/* for type nsec3, the domain may have become a
-			 * 'normal' domain with its remaining data now */
-			if(type == TYPE_NSEC3)
-				nsec3_rrsets_changed_add_prehash(db, domain,
-					zone);
-#endif /* NSEC3 */
-		}
 	}
-	return 1;
+	return delete_RR_rrset(db, domain, rrset, dname, type, klass, packet,
+		rdatalen, zone, temp_region, udbz, softfail, 0);
 }
 
-int
-add_RR(namedb_type* db, const dname_type* dname,
+/* create the rrset for the type at the domain */
+static rrset_type*
+add_rrset(namedb_type* db, domain_type* domain, zone_type* zone)
+{
+	rrset_type* rrset = region_alloc(db->region, sizeof(rrset_type));
+	if(!rrset) {
+		log_msg(LOG_ERR, "out of memory, %s:%d", __FILE__, __LINE__);
+		exit(1);
+	}
+	rrset->zone = zone;
+	rrset->rrs = 0;
+	rrset->rr_count = 0;
+	domain_add_rrset(domain, rrset);
+	return rrset;
+}
+
+/* add an RR to the rrset of the domain, rrset_added if the rrset has
+ * just been created for it */
+static int
+add_RR_rrset(namedb_type* db, domain_type* domain, rrset_type* rrset,
+	int rrset_added, const dname_type* dname,
 	uint16_t type, uint16_t klass, uint32_t ttl,
 	buffer_type* packet, size_t rdatalen, zone_type *zone, udb_ptr* udbz,
 	int* softfail)
 {
-	domain_type* domain;
-	rrset_type* rrset;
 	rdata_atom_type *rdatas;
 	rr_type *rrs_old;
 	ssize_t rdata_num;
 	int rrnum;
-#ifdef NSEC3
-	int rrset_added = 0;
+#ifndef NSEC3
+	(void)rrset_added;
 #endif
-	domain = domain_table_find(db->domains, dname);
-	if(!domain) {
-		/* create the domain */
-		domain = domain_table_insert(db->domains, dname);
-	}
-	rrset = domain_find_rrset(domain, zone, type);
-	if(!rrset) {
-		/* create the rrset */
-		rrset = region_alloc(db->region, sizeof(rrset_type));
-		if(!rrset) {
-			log_msg(LOG_ERR, "out of memory, %s:%d", __FILE__, __LINE__);
-			exit(1);
-		}
-		rrset->zone = zone;
-		rrset->rrs = 0;
-		rrset->rr_count = 0;
-		domain_add_rrset(domain, rrset);
-#ifdef NSEC3
-		rrset_added = 1;
-#endif
-	}
 
 	/* dnames in rdata are normalized, conform RFC 4035,
 	 * Section 6.2
@@ -820,6 +861,8 @@ add_RR(namedb_type* db, const dname_type* dname,
 	rrset->rrs[rrset->rr_count - 1].type = type;
 	rrset->rrs[rrset->rr_count - 1].klass = klass;
 	rrset->rrs[rrset->rr_count - 1].rdata_count = rdata_num;
+	if(diff_rr_index)
+		rr_index_add(diff_rr_index, rrset);
 
 	/* see if it is a SOA */
 	if(domain == zone->apex) {
@@ -860,6 +903,308 @@ add_RR(namedb_type* db, const dname_type* dname,
 	return 1;
 }
 
+int
+add_RR(namedb_type* db, const dname_type* dname,
+	uint16_t type, uint16_t klass, uint32_t ttl,
+	buffer_type* packet, size_t rdatalen, zone_type *zone, udb_ptr* udbz,
+	int* softfail)
+{
+	domain_type* domain;
+	rrset_type* rrset;
+	int rrset_added = 0;
+	domain = domain_table_find(db->domains, dname);
+	if(!domain) {
+		/* create the domain */
+		domain = domain_table_insert(db->domains, dname);
+	}
+	rrset = domain_find_rrset(domain, zone, type);
+	if(!rrset) {
+		rrset = add_rrset(db, domain, zone);
+		rrset_added = 1;
+	}
+	return add_RR_rrset(db, domain, rrset, rrset_added, dname, type,
+		klass, ttl, packet, rdatalen, zone, udbz, softfail);
+}
+
+/* an RR of the IXFR in the batch */
+struct ixfr_batch_rr {
+	const dname_type* owner;
+	/* uncompressed rdata */
+	uint8_t* rdata;
+	/* position in the IXFR */
+	uint32_t seq;
+	uint32_t ttl;
+	uint16_t type;
+	uint16_t klass;
+	uint16_t rdatalen;
+	uint8_t del;
+};
+
+struct ixfr_batch {
+	/* the owner names and rdata */
+	region_type* region;
+	/* for parsing the rdata */
+	region_type* temp;
+	struct ixfr_batch_rr* rrs;
+	size_t num, size;
+	uint32_t seq;
+};
+
+struct ixfr_batch*
+ixfr_batch_create(void)
+{
+	struct ixfr_batch* batch = (struct ixfr_batch*)xalloc_zero(
+		sizeof(*batch));
+	batch->region = region_create(xalloc, free);
+	batch->temp = region_create(xalloc, free);
+	return batch;
+}
+
+void
+ixfr_batch_delete(struct ixfr_batch* batch)
+{
+	if(!batch)
+		return;
+	region_destroy(batch->region);
+	region_destroy(batch->temp);
+	free(batch->rrs);
+	free(batch);
+}
+
+int
+ixfr_batch_full(struct ixfr_batch* batch)
+{
+	return batch->num >= IXFR_BATCH_MAX;
+}
+
+/* true if the rdata of the type has domain names, that can be compressed */
+static int
+rdata_has_dname(uint16_t type)
+{
+	const rrtype_descriptor_type *descriptor =
+		rrtype_descriptor_by_type(type);
+	uint32_t i;
+	for(i=0; i<descriptor->maximum; i++) {
+		if(descriptor->wireformat[i] == RDATA_WF_COMPRESSED_DNAME ||
+			descriptor->wireformat[i] ==
+			RDATA_WF_UNCOMPRESSED_DNAME)
+			return 1;
+	}
+	return 0;
+}
+
+int
+ixfr_batch_add(struct ixfr_batch* batch, const dname_type* dname,
+	uint16_t type, uint16_t klass, uint32_t ttl, buffer_type* packet,
+	size_t rdatalen, int del)
+{
+	struct ixfr_batch_rr* rr;
+	domain_table_type* temptable;
+	rdata_atom_type* rdatas;
+	ssize_t rdata_num;
+	rr_type tmp;
+	uint8_t rdata[MAX_RDLENGTH];
+	size_t len;
+
+	if(!rdata_has_dname(type)) {
+		/* RRSIG, NSEC3 and the like are copied as they are */
+		if(rdatalen > sizeof(rdata))
+			return 0;
+		buffer_read(packet, rdata, rdatalen);
+		len = rdatalen;
+	} else {
+		/* the packet compresses the names in the rdata, store it
+		 * uncompressed */
+		temptable = domain_table_create(batch->temp);
+		rdata_num = rdata_wireformat_to_rdata_atoms(batch->temp,
+			temptable, type, rdatalen, packet, &rdatas);
+		if(rdata_num == -1) {
+			log_msg(LOG_ERR, "diff: bad rdata for %s",
+				dname_to_string(dname,0));
+			return 0;
+		}
+		memset(&tmp, 0, sizeof(tmp));
+		tmp.type = type;
+		tmp.rdatas = rdatas;
+		tmp.rdata_count = rdata_num;
+		len = rr_marshal_rdata(&tmp, rdata, sizeof(rdata));
+		region_free_all(batch->temp);
+	}
+
+	if(batch->num == batch->size) {
+		batch->size = batch->size?batch->size*2:1024;
+		batch->rrs = (struct ixfr_batch_rr*)xrealloc(batch->rrs,
+			batch->size*sizeof(*batch->rrs));
+	}
+	rr = &batch->rrs[batch->num++];
+	rr->owner = dname_copy(batch->region, dname);
+	rr->rdata = (uint8_t*)region_alloc_init(batch->region, rdata, len);
+	rr->rdatalen = (uint16_t)len;
+	rr->seq = batch->seq++;
+	rr->ttl = ttl;
+	rr->type = type;
+	rr->klass = klass;
+	rr->del = (uint8_t)del;
+	return 1;
+}
+
+/* sort by owner and type, and keep the IXFR order for an rrset */
+static int
+ixfr_batch_rr_cmp(const void* x, const void* y)
+{
+	const struct ixfr_batch_rr* a = (const struct ixfr_batch_rr*)x;
+	const struct ixfr_batch_rr* b = (const struct ixfr_batch_rr*)y;
+	int c;
+	if(a->owner != b->owner && (c=dname_compare(a->owner, b->owner))!=0)
+		return c;
+	if(a->type != b->type)
+		return a->type < b->type ? -1 : 1;
+	if(a->seq != b->seq)
+		return a->seq < b->seq ? -1 : 1;
+	return 0;
+}
+
+/* compare the RRs that the pointers point to */
+static int
+ixfr_batch_rr_ptr_cmp(const void* x, const void* y)
+{
+	return ixfr_batch_rr_cmp(*(struct ixfr_batch_rr* const*)x,
+		*(struct ixfr_batch_rr* const*)y);
+}
+
+/* the runs that are merged, with more of them, it is sorted as a whole */
+#define IXFR_BATCH_RUNS 64
+
+/* sort the RRs, merge the runs that are in order already; the parts of
+ * an IXFR are mostly sorted, the deletions and additions of a delta.
+ * Returns the array of the RRs in sorted order. */
+static struct ixfr_batch_rr**
+ixfr_batch_sort(struct ixfr_batch* batch)
+{
+	size_t n = batch->num, nruns = 0, i, r;
+	struct ixfr_batch_rr** a = (struct ixfr_batch_rr**)xalloc_array_zero(
+		n, sizeof(*a));
+	struct ixfr_batch_rr** b, **t;
+	/* the start of every run, and n at the end */
+	size_t* runs = (size_t*)xalloc_array_zero(n+1, sizeof(size_t));
+	for(i=0; i<n; i++)
+		a[i] = &batch->rrs[i];
+	runs[nruns++] = 0;
+	for(i=1; i<n; i++) {
+		if(ixfr_batch_rr_cmp(a[i-1], a[i]) > 0)
+			runs[nruns++] = i;
+	}
+	runs[nruns] = n;
+	if(nruns == 1) {
+		free(runs);
+		return a;
+	} else if(nruns > IXFR_BATCH_RUNS) {
+		/* not in order, sort it all */
+		free(runs);
+		qsort(a, n, sizeof(*a), ixfr_batch_rr_ptr_cmp);
+		return a;
+	}
+	b = (struct ixfr_batch_rr**)xalloc_array_zero(n, sizeof(*b));
+	while(nruns > 1) {
+		size_t nnew = 0;
+		for(r=0; r<nruns; r+=2) {
+			size_t x = runs[r], xe = runs[r+1], y, ye, o = runs[r];
+			runs[nnew++] = runs[r];
+			if(r+1 == nruns) {
+				/* the last run has no partner */
+				memcpy(&b[x], &a[x], (xe-x)*sizeof(*a));
+				continue;
+			}
+			y = xe;
+			ye = runs[r+2];
+			while(x < xe && y < ye) {
+				if(ixfr_batch_rr_cmp(a[x], a[y]) <= 0)
+					b[o++] = a[x++];
+				else	b[o++] = a[y++];
+			}
+			memcpy(&b[o], &a[x], (xe-x)*sizeof(*a));
+			o += xe-x;
+			memcpy(&b[o], &a[y], (ye-y)*sizeof(*a));
+		}
+		runs[nnew] = n;
+		nruns = nnew;
+		t = a; a = b; b = t;
+	}
+	free(b);
+	free(runs);
+	return a;
+}
+
+int
+ixfr_batch_apply(namedb_type* db, struct ixfr_batch* batch,
+	zone_type* zone, udb_ptr* udbz, int* softfail)
+{
+	struct ixfr_batch_rr** sorted;
+	size_t i, j, k;
+	if(batch->num == 0)
+		return 1;
+	sorted = ixfr_batch_sort(batch);
+	for(i=0; i<batch->num; i=j) {
+		const dname_type* owner = sorted[i]->owner;
+		uint16_t type = sorted[i]->type;
+		domain_type* domain;
+		rrset_type* rrset = NULL;
+		for(j=i+1; j<batch->num && sorted[j]->type == type &&
+			dname_compare(sorted[j]->owner, owner) == 0; j++)
+			;
+		/* look up the rrset once for its changes */
+		domain = domain_table_find(db->domains, owner);
+		if(domain)
+			rrset = domain_find_rrset(domain, zone, type);
+		for(k=i; k<j; k++) {
+			struct ixfr_batch_rr* rr = sorted[k];
+			buffer_type packet;
+			buffer_create_from(&packet, rr->rdata, rr->rdatalen);
+			if(rr->del) {
+				if(!domain || !rrset) {
+					log_msg(LOG_WARNING, "diff: %s %s does "
+						"not exist", domain?"rrset":
+						"domain", dname_to_string(
+						owner,0));
+					*softfail = 1;
+					continue;
+				}
+				if(!delete_RR_rrset(db, domain, rrset, owner,
+					type, rr->klass, &packet, rr->rdatalen,
+					zone, batch->temp, udbz, softfail, 1)) {
+					region_free_all(batch->temp);
+					free(sorted);
+					return 0;
+				}
+				region_free_all(batch->temp);
+			} else {
+				int rrset_added = 0;
+				if(!domain)
+					domain = domain_table_insert(
+						db->domains, owner);
+				if(!rrset) {
+					rrset = add_rrset(db, domain, zone);
+					rrset_added = 1;
+				}
+				if(!add_RR_rrset(db, domain, rrset,
+					rrset_added, owner, type, rr->klass,
+					rr->ttl, &packet, rr->rdatalen, zone,
+					udbz, softfail)) {
+					free(sorted);
+					return 0;
+				}
+			}
+		}
+		/* the rrset has lost its RRs and got none back */
+		if(rrset && rrset->rr_count == 0)
+			delete_empty_rrset(db, domain, rrset, zone, type);
+	}
+	free(sorted);
+	batch->num = 0;
+	region_free_all(batch->region);
+	return 1;
+}
+
 static zone_type*
 find_or_create_zone(namedb_type* db, const dname_type* zone_name,
 	struct nsd_options* opt, const char* zstr, const char* patname)
@@ -870,6 +1215,9 @@ find_or_create_zone(namedb_type* db, const dname_type* zone_name,
 	if(zone) {
 		return zone;
 	}
+	/* a zone that is being deleted at that name, or above or below,
+	 * is freed before the new zone is created */
+	delete_zone_finish(db, zone_name);
 	zopt = zone_options_find(opt, zone_name);
 	if(!zopt) {
 		/* if _implicit_ then insert as _part_of_config */
@@ -905,6 +1253,9 @@ delete_zone_rrs(namedb_type* db, zone_type* zone)
 	rrset_type *rrset;
 	domain_type *domain = zone->apex, *next;
 	int nonexist_check = 0;
+	/* the rrsets in the index are deleted */
+	if(diff_rr_index)
+		rr_index_clear(diff_rr_index);
 	/* go through entire tree below the zone apex (incl subzones) */
 	while(domain && domain_is_subdomain(domain, zone->apex))
 	{
@@ -959,13 +1310,164 @@ delete_zone_rrs(namedb_type* db, zone_type* zone)
 	assert(zone->is_secure == 0);
 }
 
+/** a deleted zone, detached from the zonetree, that is freed in steps */
+struct zone_delete {
+	/* next in the queue */
+	struct zone_delete* next;
+	/* the zone, its apex is kept because of the usage by the zone */
+	zone_type* zone;
+	/* name of the domain to continue with, NULL at the start of a pass */
+	dname_type* cursor;
+	/* pass 0 deletes rrsets, pass 1 does the nonexist check */
+	int pass;
+	/* if domains with zero rrsets were left, for the nonexist check */
+	int nonexist_check;
+};
+
+void
+delete_zone_lazy(namedb_type* db, zone_type* zone)
+{
+	struct zone_delete* zd, **p;
+	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "lazy delete zone %s",
+		domain_to_string(zone->apex)));
+	/* remove from the zonetree, and for domain_find_zone */
+	radix_delete(db->zonetree, zone->node);
+	zone->node = NULL;
+	zone->apex->is_apex = 0;
+	zone->opts = NULL;
+
+	zd = (struct zone_delete*)region_alloc_zero(db->region, sizeof(*zd));
+	zd->zone = zone;
+	/* append at the end, the queue is short */
+	for(p = &db->zone_delete; *p; p = &(*p)->next)
+		;
+	*p = zd;
+}
+
+/** set cursor to continue with domain, or NULL if at the end of a pass */
+static void
+zone_delete_set_cursor(namedb_type* db, struct zone_delete* zd,
+	domain_type* domain)
+{
+	if(zd->cursor)
+		region_recycle(db->region, zd->cursor,
+			dname_total_size(zd->cursor));
+	zd->cursor = NULL;
+	if(domain)
+		zd->cursor = (dname_type*)dname_copy(db->region,
+			domain_dname(domain));
+}
+
+/** find the domain to continue with, by name, the domains can have been
+ * deleted or added in between the steps */
+static domain_type*
+zone_delete_get_cursor(namedb_type* db, struct zone_delete* zd)
+{
+	domain_type* closest_match, *closest_encloser;
+	if(!zd->cursor)
+		return zd->zone->apex;
+	if(domain_table_search(db->domains, zd->cursor, &closest_match,
+		&closest_encloser))
+		return closest_match;
+	return domain_next(closest_match);
+}
+
+/** visit at most budget domains of a queued zone, returns number visited,
+ * the pass is incremented when it is done */
+static size_t
+zone_delete_walk(namedb_type* db, struct zone_delete* zd, size_t budget)
+{
+	zone_type* zone = zd->zone;
+	domain_type* domain = zone_delete_get_cursor(db, zd), *next;
+	domain_type* ce = NULL; /* for speeding up has_data_below */
+	rrset_type* rrset;
+	size_t count = 0;
+	while(domain && domain_is_subdomain(domain, zone->apex)) {
+		if(count == budget) {
+			zone_delete_set_cursor(db, zd, domain);
+			return count;
+		}
+		count++;
+		if(zd->pass == 0) {
+			/* like delete_zone_rrs */
+			while((rrset = domain_find_any_rrset(domain, zone))) {
+				rrset_lower_usage(db, rrset);
+				rrset_delete(db, domain, rrset);
+				if(domain->rrsets == 0)
+					zd->nonexist_check = 1;
+			}
+			next = domain_next(domain);
+			domain_table_deldomain(db, domain);
+		} else {
+			if(domain->is_existing)
+				ce = rrset_zero_nonexist_check(domain, ce);
+			next = domain_next(domain);
+		}
+		domain = next;
+	}
+	zone_delete_set_cursor(db, zd, NULL);
+	zd->pass++;
+	if(zd->pass == 1 && !zd->nonexist_check)
+		zd->pass++;
+	return count;
+}
+
+/** remove the first zone from the queue and free it */
+static void
+zone_delete_done(namedb_type* db)
+{
+	struct zone_delete* zd = db->zone_delete;
+	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "lazy delete zone %s done",
+		domain_to_string(zd->zone->apex)));
+	db->zone_delete = zd->next;
+	namedb_zone_delete(db, zd->zone);
+	region_recycle(db->region, zd, sizeof(*zd));
+}
+
+int
+delete_zone_step(namedb_type* db, size_t budget)
+{
+	size_t count = 0;
+	while(db->zone_delete && count < budget) {
+		count += zone_delete_walk(db, db->zone_delete, budget-count);
+		if(db->zone_delete->pass >= 2)
+			zone_delete_done(db);
+	}
+	return db->zone_delete != NULL;
+}
+
+void
+delete_zone_finish(namedb_type* db, const dname_type* dname)
+{
+	struct zone_delete* zd, **p;
+	if(!db->zone_delete)
+		return;
+	p = &db->zone_delete;
+	while((zd = *p) != NULL) {
+		const dname_type* apex = domain_dname(zd->zone->apex);
+		if(dname && !dname_is_subdomain(apex, dname) &&
+			!dname_is_subdomain(dname, apex)) {
+			p = &zd->next;
+			continue;
+		}
+		/* move it to the front of the queue and complete it */
+		*p = zd->next;
+		zd->next = db->zone_delete;
+		db->zone_delete = zd;
+		while(zd->pass < 2)
+			(void)zone_delete_walk(db, zd, (size_t)-1);
+		zone_delete_done(db);
+		p = &db->zone_delete;
+	}
+}
+
 /* return value 0: syntaxerror,badIXFR, 1:OK, 2:done_and_skip_it */
 static int
 apply_ixfr(namedb_type* db, FILE *in, const char* zone, uint32_t serialno,
 	struct nsd_options* opt, uint32_t seq_nr, uint32_t seq_total,
 	int* is_axfr, int* delete_mode, int* rr_count,
 	udb_ptr* udbz, struct zone** zone_res, const char* patname, int* bytes,
-	int* softfail)
+	int* softfail, struct ixfr_batch* batch)
 {
 	uint32_t msglen, checklen, pkttype;
 	int qcount, ancount, counter;
@@ -1207,6 +1709,22 @@ apply_ixfr(namedb_type* db, FILE *in, const char* zone, uint32_t serialno,
 		DEBUG(DEBUG_XFRD,2, (LOG_INFO, "xfr %s RR dname is %s type %s",
 			*delete_mode?"del":"add",
 			dname_to_string(dname,0), rrtype_to_string(type)));
+		if(!*is_axfr && type != TYPE_SOA && type != TYPE_NSEC3 &&
+			type != TYPE_NSEC3PARAM) {
+			/* applied per rrset, after the parts are read; the
+			 * NSEC3 chain and parameters are updated per RR */
+			if(ixfr_batch_full(batch) && !ixfr_batch_apply(db,
+				batch, zone_db, udbz, softfail)) {
+				region_destroy(region);
+				return 0;
+			}
+			if(!ixfr_batch_add(batch, dname, type, klass, ttl,
+				packet, rrlen, *delete_mode)) {
+				region_destroy(region);
+				return 0;
+			}
+			continue;
+		}
 		if(*delete_mode) {
 			/* delete this rr */
 			if(!*is_axfr && type == TYPE_SOA && counter==ancount-1
@@ -1327,8 +1845,13 @@ apply_ixfr_for_zone(nsd_type* nsd, zone_type* zonedb, FILE* in,
 		int is_axfr=0, delete_mode=0, rr_count=0, softfail=0;
 		const dname_type* apex = domain_dname_const(zonedb->apex);
 		udb_ptr z;
+		region_type* index_region;
+		struct ixfr_batch* batch;
+		struct timespec apply_start, apply_end;
 
 		DEBUG(DEBUG_XFRD,1, (LOG_INFO, "processing xfr: %s", zone_buf));
+		/* zones above or below that are being deleted must be gone */
+		delete_zone_finish(nsd->db, apex);
 		if(nsd->db->udb) {
 			if(udb_base_get_userflags(nsd->db->udb) != 0) {
 				log_msg(LOG_ERR, "database corrupted, cannot update");
@@ -1350,6 +1873,13 @@ apply_ixfr_for_zone(nsd_type* nsd, zone_type* zonedb, FILE* in,
 			/* set the udb dirty until we are finished applying changes */
 			udb_base_set_userflags(nsd->db->udb, 1);
 		}
+		NSD_PROBE4(ixfr__apply__start, zone_buf, old_serial, new_serial,
+			num_parts);
+		get_time(&apply_start);
+		/* index the large rrsets for the RR lookups */
+		index_region = region_create(xalloc, free);
+		diff_rr_index = rr_index_create(index_region);
+		batch = ixfr_batch_create();
 		/* read and apply all of the parts */
 		for(i=0; i<num_parts; i++) {
 			int ret;
@@ -1357,7 +1887,11 @@ apply_ixfr_for_zone(nsd_type* nsd, zone_type* zonedb, FILE* in,
 			ret = apply_ixfr(nsd->db, in, zone_buf, new_serial, opt,
 				i, num_parts, &is_axfr, &delete_mode,
 				&rr_count, (nsd->db->udb?&z:NULL), &zonedb,
-				patname_buf, &num_bytes, &softfail);
+				patname_buf, &num_bytes, &softfail, batch);
+			if(ret == 1 && i == num_parts-1 && !ixfr_batch_apply(
+				nsd->db, batch, zonedb, (nsd->db->udb?&z:NULL),
+				&softfail))
+				ret = 0;
 			if(ret == 0) {
 				log_msg(LOG_ERR, "bad ixfr packet part %d in diff file for %s", (int)i, zone_buf);
 				xfrd_unlink_xfrfile(nsd, xfrfilenr);
@@ -1367,6 +1901,9 @@ apply_ixfr_for_zone(nsd_type* nsd, zone_type* zonedb, FILE* in,
 				break;
 			}
 		}
+		ixfr_batch_delete(batch);
+		diff_rr_index = NULL;
+		region_destroy(index_region);
 		if(nsd->db->udb)
 			udb_base_set_userflags(nsd->db->udb, 0);
 		/* read the final log_str: but do not fail on it */
@@ -1378,6 +1915,8 @@ apply_ixfr_for_zone(nsd_type* nsd, zone_type* zonedb, FILE* in,
 #ifdef NSEC3
 		if(zonedb) prehash_zone(nsd->db, zonedb);
 #endif /* NSEC3 */
+		get_time(&apply_end);
+		timespec_subtract(&apply_end, &apply_start);
 		zonedb->is_changed = 1;
 		if(nsd->db->udb) {
 			ZONE(&z)->is_changed = 1;
@@ -1398,6 +1937,15 @@ apply_ixfr_for_zone(nsd_type* nsd, zone_type* zonedb, FILE* in,
 					strlen(zonedb->filename)+1);
 			zonedb->filename = NULL;
 		}
+		NSD_PROBE4(ixfr__apply__done, zone_buf, new_serial, rr_count,
+			is_axfr);
+		nsd->reload_timing.zones++;
+		nsd->reload_timing.rrs += rr_count;
+		if(taskudb && apply_end.tv_sec >= 0)
+			task_new_xfr_timing(taskudb, last_task,
+				domain_dname(zonedb->apex), is_axfr, rr_count,
+				(uint64_t)apply_end.tv_sec*1000000
+				+ (uint64_t)apply_end.tv_nsec/1000);
 		if(softfail && taskudb && !is_axfr) {
 			log_msg(LOG_ERR, "Failed to apply IXFR cleanly "
 				"(deletes nonexistent RRs, adds existing RRs). "
@@ -1633,6 +2181,74 @@ void* task_new_stat_info(udb_base* udb, udb_ptr* last, struct nsdst* stat,
 }
 #endif /* BIND8_STATS */
 
+void task_new_mem_info(udb_base* udb, udb_ptr* last, const dname_type* zone,
+	uint32_t id)
+{
+	udb_ptr e;
+	DEBUG(DEBUG_IPC,1, (LOG_INFO, "add task mem_info"));
+	if(!task_create_new_elem(udb, last, &e, sizeof(struct task_list_d) +
+		(zone?dname_total_size(zone):0), zone)) {
+		log_msg(LOG_ERR, "tasklist: out of space, cannot add mem_info");
+		return;
+	}
+	TASKLIST(&e)->task_type = task_mem_info;
+	TASKLIST(&e)->yesno = (zone!=NULL);
+	TASKLIST(&e)->oldserial = id;
+	udb_ptr_unlink(&e, udb);
+}
+
+void task_new_mem_report(udb_base* udb, udb_ptr* last, const char* text,
+	size_t len, uint32_t id)
+{
+	udb_ptr e;
+	DEBUG(DEBUG_IPC,1, (LOG_INFO, "add task mem_report"));
+	if(!task_create_new_elem(udb, last, &e, sizeof(struct task_list_d) +
+		len + 1, NULL)) {
+		log_msg(LOG_ERR, "tasklist: out of space, cannot add "
+			"mem_report");
+		return;
+	}
+	TASKLIST(&e)->task_type = task_mem_report;
+	TASKLIST(&e)->oldserial = id;
+	memmove(TASKLIST(&e)->zname, text, len);
+	((char*)TASKLIST(&e)->zname)[len] = 0;
+	udb_ptr_unlink(&e, udb);
+}
+
+void task_new_reload_timing(udb_base* udb, udb_ptr* last,
+	struct reload_timing* timing)
+{
+	udb_ptr e;
+	DEBUG(DEBUG_IPC,1, (LOG_INFO, "add task reload_timing"));
+	if(!task_create_new_elem(udb, last, &e, sizeof(struct task_list_d) +
+		sizeof(*timing), NULL)) {
+		log_msg(LOG_ERR, "tasklist: out of space, cannot add "
+			"reload_timing");
+		return;
+	}
+	TASKLIST(&e)->task_type = task_reload_timing;
+	memcpy(TASKLIST(&e)->zname, timing, sizeof(*timing));
+	udb_ptr_unlink(&e, udb);
+}
+
+void task_new_xfr_timing(udb_base* udb, udb_ptr* last,
+	const dname_type* zone, int is_axfr, uint32_t rr_count, uint64_t usec)
+{
+	udb_ptr e;
+	DEBUG(DEBUG_IPC,1, (LOG_INFO, "add task xfr_timing"));
+	if(!task_create_new_elem(udb, last, &e, sizeof(struct task_list_d) +
+		dname_total_size(zone), zone)) {
+		log_msg(LOG_ERR, "tasklist: out of space, cannot add "
+			"xfr_timing");
+		return;
+	}
+	TASKLIST(&e)->task_type = task_xfr_timing;
+	TASKLIST(&e)->oldserial = rr_count;
+	TASKLIST(&e)->newserial = (is_axfr?1:0);
+	TASKLIST(&e)->yesno = usec;
+	udb_ptr_unlink(&e, udb);
+}
+
 void
 task_new_add_zone(udb_base* udb, udb_ptr* last, const char* zone,
 	const char* pattern, unsigned zonestatid)
@@ -1906,9 +2522,11 @@ task_process_del_zone(struct nsd* nsd, struct task_list_d* task)
 		return;
 
 #ifdef NSEC3
+	/* the precompile is cleared now, while the apex marks the zone */
 	nsec3_hash_tree_clear(zone);
-#endif
-	delete_zone_rrs(nsd->db, zone);
+	nsec3_clear_precompile(nsd->db, zone);
+	zone->nsec3_param = NULL;
+#endif /* NSEC3 */
 	if(nsd->db->udb) {
 		udb_ptr udbz;
 		if(udb_zone_search(nsd->db->udb, &udbz, dname_name(task->zname),
@@ -1917,14 +2535,11 @@ task_process_del_zone(struct nsd* nsd, struct task_list_d* task)
 			udb_ptr_unlink(&udbz, nsd->db->udb);
 		}
 	}
-#ifdef NSEC3
-	nsec3_clear_precompile(nsd->db, zone);
-	zone->nsec3_param = NULL;
-#endif /* NSEC3 */
 
-	/* remove from zonetree, apex, soa */
+	/* remove from zonetree, the domains, rrsets and the zone itself
+	 * are freed later with delete_zone_step */
 	zopt = zone->opts;
-	namedb_zone_delete(nsd->db, zone);
+	delete_zone_lazy(nsd->db, zone);
 	/* remove from options (zone_list already edited by xfrd) */
 	zone_options_delete(nsd->options, zopt);
 }
@@ -2037,6 +2652,110 @@ task_process_apply_xfr(struct nsd* nsd, udb_base* udb, udb_ptr *last_task,
 }
 
 
+/** print count and bytes of a type of structure */
+static void
+mem_info_use(buffer_type* out, const char* prefix, const char* name,
+	struct mem_use* u)
+{
+	buffer_printf(out, "%smem.%s.count=%lu\n", prefix, name,
+		(unsigned long)u->count);
+	buffer_printf(out, "%smem.%s.bytes=%lu\n", prefix, name,
+		(unsigned long)u->bytes);
+}
+
+/** print the memory use per type of structure */
+static void
+mem_info_print(buffer_type* out, const char* prefix, struct namedb_mem* m)
+{
+	mem_info_use(out, prefix, "zone", &m->zone);
+	mem_info_use(out, prefix, "domain", &m->domain);
+	mem_info_use(out, prefix, "nsec3", &m->nsec3);
+	mem_info_use(out, prefix, "rrset", &m->rrset);
+	mem_info_use(out, prefix, "rr", &m->rr);
+	mem_info_use(out, prefix, "rdata", &m->rdata);
+	mem_info_use(out, prefix, "rdata_data", &m->rdata_data);
+}
+
+static void
+task_process_mem_info(struct nsd* nsd, udb_base* udb, udb_ptr* last_task,
+	struct task_list_d* task)
+{
+	region_type* region = region_create(xalloc, free);
+	buffer_type* out = buffer_create(region, 4096);
+	namedb_type* db = nsd->db;
+	struct namedb_mem total, m;
+	struct radnode* n;
+	struct mem_use tree;
+	size_t used;
+	DEBUG(DEBUG_IPC,1, (LOG_INFO, "mem_info task"));
+
+	memset(&total, 0, sizeof(total));
+	if(task->yesno) {
+		zone_type* zone = namedb_find_zone(db, task->zname);
+		if(zone) {
+			namedb_mem_zone(&total, zone);
+			mem_info_print(out, "", &total);
+		} else	buffer_printf(out, "error zone not in memory\n");
+		task_new_mem_report(udb, last_task, (char*)buffer_begin(out),
+			buffer_position(out), task->oldserial);
+		region_destroy(region);
+		return;
+	}
+
+	/* the region allocator, alignment waste and the recycle bin */
+	buffer_printf(out, "mem.region.bytes=%lu\n",
+		(unsigned long)region_get_mem(db->region));
+	buffer_printf(out, "mem.region.unused=%lu\n",
+		(unsigned long)region_get_mem_unused(db->region));
+	buffer_printf(out, "mem.region.recycle=%lu\n",
+		(unsigned long)region_get_recycle_size(db->region));
+	used = region_get_mem_unused(db->region) +
+		region_get_recycle_size(db->region);
+
+	/* lookup structures and tables */
+#ifdef USE_RADIX_TREE
+	tree.bytes = radix_tree_mem(db->domains->nametree, &tree.count);
+	mem_info_use(out, "", "nametree", &tree);
+	used += tree.bytes;
+#endif
+	tree.bytes = radix_tree_mem(db->zonetree, &tree.count);
+	mem_info_use(out, "", "zonetree", &tree);
+	used += tree.bytes;
+	/* every server process has a compression table */
+	buffer_printf(out, "mem.compresstable.bytes=%lu\n",
+		(unsigned long)(sizeof(uint16_t) * (domain_table_count(
+		db->domains) + 1 + EXTRA_DOMAIN_NUMBERS) * nsd->child_count));
+	if(db->udb) {
+		buffer_printf(out, "mem.udb.data=%lu\n", (unsigned long)
+			db->udb->alloc->disk->stat_data);
+		buffer_printf(out, "mem.udb.overhead=%lu\n", (unsigned long)
+			(db->udb->alloc->disk->stat_alloc -
+			db->udb->alloc->disk->stat_data));
+	}
+
+	/* per zone, and the total over the zones */
+	for(n = radix_first(db->zonetree); n; n = radix_next(n)) {
+		zone_type* zone = (zone_type*)n->elem;
+		char prefix[MAXDOMAINLEN*5+8];
+		memset(&m, 0, sizeof(m));
+		namedb_mem_zone(&m, zone);
+		namedb_mem_add(&total, &m);
+		/* the zone name ends in a '.', that separates the prefix */
+		snprintf(prefix, sizeof(prefix), "%s", domain_to_string(
+			zone->apex));
+		mem_info_print(out, prefix, &m);
+	}
+	mem_info_print(out, "", &total);
+	used += namedb_mem_bytes(&total);
+	/* domains above the zones, and other data of the region */
+	buffer_printf(out, "mem.other.bytes=%lu\n", (unsigned long)
+		(region_get_mem(db->region) > used ?
+		region_get_mem(db->region) - used : 0));
+	task_new_mem_report(udb, last_task, (char*)buffer_begin(out),
+		buffer_position(out), task->oldserial);
+	region_destroy(region);
+}
+
 void task_process_in_reload(struct nsd* nsd, udb_base* udb, udb_ptr *last_task,
         udb_ptr* task)
 {
@@ -2082,6 +2801,9 @@ void task_process_in_reload(struct nsd* nsd, udb_base* udb, udb_ptr *last_task,
 	case task_apply_xfr:
 		task_process_apply_xfr(nsd, udb, last_task, task);
 		break;
+	case task_mem_info:
+		task_process_mem_info(nsd, udb, last_task, TASKLIST(task));
+		break;
 	default:
 		log_msg(LOG_WARNING, "unhandled task in reload type %d",
 			(int)TASKLIST(task)->task_type);
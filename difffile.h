@@ -15,6 +15,7 @@
 #include "udb.h"
 struct nsd;
 struct nsdst;
+struct reload_timing;
 
 #define DIFF_PART_XXFR ('X'<<24 | 'X'<<16 | 'F'<<8 | 'R')
 #define DIFF_PART_XFRF ('X'<<24 | 'F'<<16 | 'R'<<8 | 'F')
@@ -42,6 +43,20 @@ int diff_read_str(FILE* in, char* buf, size_t len);
 
 /* delete the RRs for a zone from memory */
 void delete_zone_rrs(namedb_type* db, zone_type* zone);
+
+/* number of domains visited by one step of the lazy zone delete */
+#define DELETE_ZONE_STEP 10000
+/* detach the zone from the zonetree and queue it for delete_zone_step,
+ * the zone is no longer found by lookups.  The names of the zone keep
+ * their rrsets until they are visited, the reload completes the queue
+ * with delete_zone_finish before it serves queries */
+void delete_zone_lazy(namedb_type* db, zone_type* zone);
+/* free memory of the queued zones, visit at most budget domains.
+ * returns true if work remains in the queue */
+int delete_zone_step(namedb_type* db, size_t budget);
+/* complete the queued deletes of zones that overlap with the name,
+ * the zone at the name, above it or below it. If NULL, all of them */
+void delete_zone_finish(namedb_type* db, const dname_type* dname);
 /* delete an RR */
 int delete_RR(namedb_type* db, const dname_type* dname,
 	uint16_t type, uint16_t klass,
@@ -53,6 +68,27 @@ int add_RR(namedb_type* db, const dname_type* dname,
 	buffer_type* packet, size_t rdatalen, zone_type *zone,
 	struct udb_ptr* udbz, int* softfail);
 
+/* The RRs of an IXFR are collected in a batch, and applied sorted by
+ * owner and type, so that the changes of an rrset are applied together,
+ * and an rrset that has all its RRs replaced is not deleted and created
+ * again, with the NSEC3 updates for that. */
+struct ixfr_batch;
+/* number of RRs after which the batch is applied, to limit memory */
+#define IXFR_BATCH_MAX 1048576
+struct ixfr_batch* ixfr_batch_create(void);
+void ixfr_batch_delete(struct ixfr_batch* batch);
+/* true if the batch has to be applied before more RRs are added */
+int ixfr_batch_full(struct ixfr_batch* batch);
+/* add an RR to the batch, del for a deletion, the rdata is read from
+ * the packet.  Returns 0 on bad rdata */
+int ixfr_batch_add(struct ixfr_batch* batch, const dname_type* dname,
+	uint16_t type, uint16_t klass, uint32_t ttl, buffer_type* packet,
+	size_t rdatalen, int del);
+/* apply the RRs of the batch to the zone, in IXFR order per rrset, and
+ * empty the batch.  Returns 0 on a fatal error */
+int ixfr_batch_apply(namedb_type* db, struct ixfr_batch* batch,
+	zone_type* zone, struct udb_ptr* udbz, int* softfail);
+
 /* task udb structure */
 struct task_list_d {
 	/** next task in list */
@@ -88,13 +124,24 @@ struct task_list_d {
 		/** options change */
 		task_opt_change,
 		/** zonestat increment */
-		task_zonestat_inc
+		task_zonestat_inc,
+		/** memory use report, for a zone if zname is present */
+		task_mem_info,
+		/** result of the memory use report, text in zname */
+		task_mem_report,
+		/** timing of the reload phases, struct reload_timing in zname */
+		task_reload_timing,
+		/** apply time of a transfer, for the IXFR and AXFR cost */
+		task_xfr_timing
 	} task_type;
 	uint32_t size; /* size of this struct */
 
 	/** soainfo: zonename dname, soaRR wireform */
 	/** expire: zonename, boolyesno */
 	/** apply_xfr: zonename, serials, yesno is filenamecounter */
+	/** xfr_timing: zonename, oldserial is the number of RRs, newserial
+	 * is 1 for AXFR, yesno is the apply time in usec */
+	/** mem_info, mem_report: oldserial is the id of the request */
 	uint32_t oldserial, newserial;
 	/** general variable.  for some used to see if zname is present. */
 	uint64_t yesno;
@@ -126,6 +173,15 @@ void task_new_add_pattern(udb_base* udb, udb_ptr* last,
 void task_new_del_pattern(udb_base* udb, udb_ptr* last, const char* name);
 void task_new_opt_change(udb_base* udb, udb_ptr* last, struct nsd_options* opt);
 void task_new_zonestat_inc(udb_base* udb, udb_ptr* last, unsigned sz);
+void task_new_mem_info(udb_base* udb, udb_ptr* last, const dname_type* zone,
+	uint32_t id);
+void task_new_mem_report(udb_base* udb, udb_ptr* last, const char* text,
+	size_t len, uint32_t id);
+void task_new_reload_timing(udb_base* udb, udb_ptr* last,
+	struct reload_timing* timing);
+void task_new_xfr_timing(udb_base* udb, udb_ptr* last,
+	const struct dname* zone, int is_axfr, uint32_t rr_count,
+	uint64_t usec);
 int task_new_apply_xfr(udb_base* udb, udb_ptr* last, const dname_type* zone,
 	uint32_t old_serial, uint32_t new_serial, uint64_t filenumber);
 void task_process_in_reload(struct nsd* nsd, udb_base* udb, udb_ptr *last_task,
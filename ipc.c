@@ -12,6 +12,7 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <sys/socket.h>
 #include "ipc.h"
 #include "buffer.h"
 #include "xfrd-tcp.h"
@@ -19,7 +20,12 @@
 #include "namedb.h"
 #include "xfrd.h"
 #include "xfrd-notify.h"
+#include "xfrd-watch.h"
 #include "difffile.h"
+#include "packet.h"
+
+/* NOTIFY datagrams that xfrd reads in one go */
+#define XFRD_NOTIFY_BATCH_READS 64
 
 /* attempt to send NSD_STATS command to child fd */
 static void send_stat_to_child(struct main_ipc_handler_data* data, int fd);
@@ -35,6 +41,7 @@ ipc_child_quit(struct nsd* nsd)
 {
 	/* call shutdown and quit routines */
 	nsd->mode = NSD_QUIT;
+	child_notify_flush(nsd);
 #ifdef	BIND8_STATS
 	bind8_stats(nsd);
 #endif /* BIND8_STATS */
@@ -109,6 +116,115 @@ child_handle_parent_command(int fd, short event, void* arg)
 	}
 }
 
+/* pass a NOTIFY record to xfrd via server_main, blocking */
+static int
+child_notify_relay(struct nsd* nsd, uint8_t* rec)
+{
+	sig_atomic_t mode = NSD_PASS_TO_XFRD;
+	int s = nsd->this_child->parent_fd;
+	if(s == -1)
+		return 0;
+	/* the record has the length and acl numbers in network order */
+	if(!write_socket(s, &mode, sizeof(mode)) ||
+		!write_socket(s, rec, sizeof(uint16_t)) ||
+		!write_socket(s, rec+NOTIFY_REC_HDR, read_uint16(rec)) ||
+		!write_socket(s, rec+sizeof(uint16_t), 2*sizeof(uint32_t)))
+		return 0;
+	return 1;
+}
+
+static void
+child_notify_write(int ATTR_UNUSED(fd), short ATTR_UNUSED(event), void* arg)
+{
+	struct nsd* nsd = (struct nsd*)arg;
+	nsd->notify_batch->write_added = 0;
+	child_notify_flush(nsd);
+}
+
+void
+child_notify_init(struct nsd* nsd, struct event_base* base)
+{
+	struct notify_batch* b;
+	if(nsd->xfrd_notify_fd == -1 && nsd->this_child->parent_fd == -1)
+		return; /* NOTIFYs cannot be passed to xfrd */
+	b = (struct notify_batch*)region_alloc_zero(nsd->region, sizeof(*b));
+	b->max = NOTIFY_BATCH_SIZE;
+	if(nsd->xfrd_notify_fd != -1) {
+		b->write_handler = (struct event*)region_alloc_zero(
+			nsd->region, sizeof(*b->write_handler));
+		event_set(b->write_handler, nsd->xfrd_notify_fd, EV_WRITE,
+			child_notify_write, nsd);
+		if(event_base_set(base, b->write_handler) != 0)
+			log_msg(LOG_ERR, "nsd notify: event_base_set failed");
+	}
+	nsd->notify_batch = b;
+}
+
+void
+child_notify_flush(struct nsd* nsd)
+{
+	struct notify_batch* b = nsd->notify_batch;
+	size_t len, rec;
+	if(!b)
+		return;
+	while(b->len > 0 && nsd->xfrd_notify_fd != -1) {
+		/* whole records, up to the datagram size */
+		len = 0;
+		while(len < b->len) {
+			rec = NOTIFY_REC_HDR + read_uint16(b->data+len);
+			if(len != 0 && len + rec > b->max)
+				break;
+			len += rec;
+		}
+		if(send(nsd->xfrd_notify_fd, b->data, len, 0) == -1) {
+			if(errno == EINTR)
+				continue;
+			if(errno == EAGAIN || errno == EWOULDBLOCK ||
+				errno == ENOBUFS) {
+				/* xfrd is busy, wait until it reads */
+				if(!b->write_added && b->write_handler) {
+					if(event_add(b->write_handler, NULL) != 0)
+						log_msg(LOG_ERR, "nsd notify: "
+							"event_add failed");
+					else	b->write_added = 1;
+				}
+				return;
+			}
+			if(errno == EMSGSIZE && len > NOTIFY_REC_HDR +
+				read_uint16(b->data)) {
+				/* the socket wants smaller datagrams */
+				b->max = len/2;
+				continue;
+			}
+			log_msg(LOG_ERR, "error in IPC notify server2xfrd, %s, "
+				"passing notifies via main", strerror(errno));
+			if(b->write_added) {
+				event_del(b->write_handler);
+				b->write_added = 0;
+			}
+			close(nsd->xfrd_notify_fd);
+			nsd->xfrd_notify_fd = -1;
+			break;
+		}
+		memmove(b->data, b->data+len, b->len-len);
+		b->len -= len;
+	}
+	if(b->len > 0) {
+		/* no socket to xfrd, for instance after it was restarted */
+		for(len = 0; len < b->len;
+			len += NOTIFY_REC_HDR + read_uint16(b->data+len)) {
+			if(!child_notify_relay(nsd, b->data+len))
+				log_msg(LOG_ERR, "error in IPC notify "
+					"server2main, %s", strerror(errno));
+		}
+		b->len = 0;
+	}
+	if(b->write_added) {
+		event_del(b->write_handler);
+		b->write_added = 0;
+	}
+}
+
 void
 parent_handle_xfrd_command(netio_type *ATTR_UNUSED(netio),
 		      netio_handler_type *handler,
@@ -262,6 +378,8 @@ stats_add(struct nsdst* total, struct nsdst* s)
 	total->qudp6 += s->qudp6;
 	total->ctcp += s->ctcp;
 	total->ctcp6 += s->ctcp6;
+	total->ctls += s->ctls;
+	total->ctls6 += s->ctls6;
 	for(i=0; i<sizeof(total->rcode)/sizeof(stc_type); i++)
 		total->rcode[i] += s->rcode[i];
 	for(i=0; i<sizeof(total->opcode)/sizeof(stc_type); i++)
@@ -275,6 +393,11 @@ stats_add(struct nsdst* total, struct nsdst* s)
 	total->ednserr += s->ednserr;
 	total->raxfr += s->raxfr;
 	total->nona += s->nona;
+	total->udpsize_udp_retry += s->udpsize_udp_retry;
+	total->udpsize_tcp_retry += s->udpsize_tcp_retry;
+	total->udpsize_lowered += s->udpsize_lowered;
+	total->udpsize_raised += s->udpsize_raised;
+	total->udpsize_truncated += s->udpsize_truncated;
 
 	total->db_disk = s->db_disk;
 	total->db_mem = s->db_mem;
@@ -293,6 +416,8 @@ stats_subtract(struct nsdst* total, struct nsdst* s)
 	total->qudp6 -= s->qudp6;
 	total->ctcp -= s->ctcp;
 	total->ctcp6 -= s->ctcp6;
+	total->ctls -= s->ctls;
+	total->ctls6 -= s->ctls6;
 	for(i=0; i<sizeof(total->rcode)/sizeof(stc_type); i++)
 		total->rcode[i] -= s->rcode[i];
 	for(i=0; i<sizeof(total->opcode)/sizeof(stc_type); i++)
@@ -306,6 +431,11 @@ stats_subtract(struct nsdst* total, struct nsdst* s)
 	total->ednserr -= s->ednserr;
 	total->raxfr -= s->raxfr;
 	total->nona -= s->nona;
+	total->udpsize_udp_retry -= s->udpsize_udp_retry;
+	total->udpsize_tcp_retry -= s->udpsize_tcp_retry;
+	total->udpsize_lowered -= s->udpsize_lowered;
+	total->udpsize_raised -= s->udpsize_raised;
+	total->udpsize_truncated -= s->udpsize_truncated;
 }
 
 #define FINAL_STATS_TIMEOUT 10 /* seconds */
@@ -637,6 +767,42 @@ xfrd_send_stats(xfrd_state_type* xfrd)
 	xfrd->need_to_send_stats = 0;
 }
 
+void
+xfrd_handle_notify_batch(int fd, short event, void* ATTR_UNUSED(arg))
+{
+	uint8_t data[NOTIFY_BATCH_SIZE];
+	buffer_type packet;
+	ssize_t len;
+	size_t pos;
+	uint16_t sz;
+	int i;
+	if(!(event & EV_READ))
+		return;
+	/* a number of datagrams, then the other events get their turn */
+	for(i=0; i<XFRD_NOTIFY_BATCH_READS; i++) {
+		if((len = recv(fd, data, sizeof(data), 0)) == -1) {
+			if(errno != EINTR && errno != EAGAIN &&
+				errno != EWOULDBLOCK)
+				log_msg(LOG_ERR, "xfrd: recv notify: %s",
+					strerror(errno));
+			return;
+		}
+		for(pos = 0; pos + NOTIFY_REC_HDR <= (size_t)len;
+			pos += NOTIFY_REC_HDR + sz) {
+			sz = read_uint16(data+pos);
+			if(pos + NOTIFY_REC_HDR + sz > (size_t)len)
+				break;
+			if(sz < QHEADERSZ)
+				continue;
+			buffer_create_from(&packet, data+pos+NOTIFY_REC_HDR, sz);
+			xfrd_handle_passed_packet(&packet,
+				(int)read_uint32(data+pos+sizeof(uint16_t)),
+				(int)read_uint32(data+pos+sizeof(uint16_t)+
+				sizeof(uint32_t)));
+		}
+	}
+}
+
 void
 xfrd_handle_ipc(int ATTR_UNUSED(fd), short event, void* arg)
 {
@@ -770,8 +936,7 @@ xfrd_handle_ipc_read(struct event* handler, xfrd_state_type* xfrd)
 	case NSD_RELOAD_REQ:
 		DEBUG(DEBUG_IPC,1, (LOG_INFO, "xfrd: ipc recv RELOAD_REQ"));
 		/* make reload happen, right away, and schedule file check */
-		task_new_check_zonefiles(xfrd->nsd->task[xfrd->nsd->mytask],
-			xfrd->last_task, NULL);
+		xfrd_watch_check_zonefiles(xfrd);
 		xfrd_set_reload_now(xfrd);
 		break;
 	case NSD_RELOAD:
@@ -18,6 +18,7 @@ struct xfrd_tcp;
 struct xfrd_state;
 struct nsdst;
 struct event;
+struct event_base;
 
 /*
  * Data for the server_main IPC handler 
@@ -50,6 +51,29 @@ struct ipc_handler_conn_data
 	struct xfrd_tcp	*conn;
 };
 
+/* size of the datagram with NOTIFY records from a server process to xfrd */
+#define NOTIFY_BATCH_SIZE 16384
+/* NOTIFY record header: uint16 packet length, uint32 acl_num and
+ * uint32 acl_xfr, in network order, followed by the packet */
+#define NOTIFY_REC_HDR (sizeof(uint16_t)+2*sizeof(uint32_t))
+
+/*
+ * NOTIFYs accepted by a server process, that are sent to xfrd after the
+ * queries that have been read are answered.  A NOTIFY for a zone replaces
+ * the one that is pending for the same zone.
+ */
+struct notify_batch
+{
+	/* event that waits until the socket to xfrd is writable */
+	struct event	*write_handler;
+	int		write_added;
+	/* datagram size, lowered if the socket does not allow it */
+	size_t		max;
+	/* records in data */
+	size_t		len;
+	uint8_t		data[NOTIFY_BATCH_SIZE];
+};
+
 /*
  * Routine used by server_main.
  * Handle a command received from the xfrdaemon processes.
@@ -78,12 +102,32 @@ void parent_handle_child_command(netio_type *netio,
  */
 void child_handle_parent_command(int fd, short event, void* arg);
 
+/*
+ * Routine used by server_child.
+ * Create the NOTIFY batch, for the event base of the server process.
+ */
+void child_notify_init(struct nsd* nsd, struct event_base* base);
+
+/*
+ * Routine used by server_child.
+ * Send the pending NOTIFY records to xfrd.  If xfrd is busy they are kept
+ * until the socket is writable, if the socket to xfrd has failed they are
+ * passed via server_main.
+ */
+void child_notify_flush(struct nsd* nsd);
+
 /*
  * Routine used by xfrd
  * Handle interprocess communication with parent process, read and write.
  */
 void xfrd_handle_ipc(int fd, short event, void* arg);
 
+/*
+ * Routine used by xfrd
+ * Read the NOTIFY records that the server processes send to xfrd.
+ */
+void xfrd_handle_notify_batch(int fd, short event, void* arg);
+
 /* check if all children have exited in an orderly fashion and set mode */
 void parent_check_all_children_exited(struct nsd* nsd);
 
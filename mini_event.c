@@ -37,7 +37,7 @@
 /**
  * \file
  * fake libevent implementation. Less broad in functionality, and only
- * supports select(2).
+ * supports epoll(7) and select(2).
  */
 
 #include "config.h"
@@ -58,8 +58,13 @@
 #include <signal.h>
 #include "mini_event.h"
 #include "util.h"
+#include "region-allocator.h"
+#ifdef MINI_EVENT_EPOLL
+#include <sys/epoll.h>
+#include <unistd.h>
+#endif
 
-/** compare events in tree, based on timevalue, ptr for uniqueness */
+/** compare events in heap, based on timevalue, ptr for uniqueness */
 int
 mini_ev_cmp(const void* a, const void* b)
 {
@@ -93,6 +98,78 @@ settime(struct event_base* base)
 	return 0;
 }
 
+/** put event at position i in the heap */
+static void
+heap_set(struct event_base* base, int i, struct event* ev)
+{
+	base->heap[i] = ev;
+	ev->heap_idx = i;
+}
+
+/** move event at position i up in the heap, to its place */
+static void
+heap_up(struct event_base* base, int i)
+{
+	struct event* ev = base->heap[i];
+	while(i > 0 && mini_ev_cmp(ev, base->heap[(i-1)/2]) < 0) {
+		heap_set(base, i, base->heap[(i-1)/2]);
+		i = (i-1)/2;
+	}
+	heap_set(base, i, ev);
+}
+
+/** move event at position i down in the heap, to its place */
+static void
+heap_down(struct event_base* base, int i)
+{
+	struct event* ev = base->heap[i];
+	int c;
+	while((c = 2*i+1) < base->heap_num) {
+		if(c+1 < base->heap_num &&
+			mini_ev_cmp(base->heap[c+1], base->heap[c]) < 0)
+			c++;
+		if(mini_ev_cmp(base->heap[c], ev) >= 0)
+			break;
+		heap_set(base, i, base->heap[c]);
+		i = c;
+	}
+	heap_set(base, i, ev);
+}
+
+/** insert event in the timeout heap */
+static int
+heap_insert(struct event_base* base, struct event* ev)
+{
+	if(base->heap_num == base->heap_cap) {
+		int cap = base->heap_cap?base->heap_cap*2:64;
+		struct event** h = (struct event**)realloc(base->heap,
+			sizeof(struct event*)*(size_t)cap);
+		if(!h)
+			return -1;
+		base->heap = h;
+		base->heap_cap = cap;
+	}
+	heap_set(base, base->heap_num++, ev);
+	heap_up(base, ev->heap_idx);
+	return 0;
+}
+
+/** remove event from the timeout heap */
+static void
+heap_remove(struct event_base* base, struct event* ev)
+{
+	int i = ev->heap_idx;
+	if(i < 0 || i >= base->heap_num || base->heap[i] != ev)
+		return;
+	ev->heap_idx = -1;
+	if(i == --base->heap_num)
+		return;
+	heap_set(base, i, base->heap[base->heap_num]);
+	if(i > 0 && mini_ev_cmp(base->heap[i], base->heap[(i-1)/2]) < 0)
+		heap_up(base, i);
+	else	heap_down(base, i);
+}
+
 /** create event base */
 void *
 event_init(time_t* time_secs, struct timeval* time_tv)
@@ -102,6 +179,9 @@ event_init(time_t* time_secs, struct timeval* time_tv)
 	if(!base)
 		return NULL;
 	memset(base, 0, sizeof(*base));
+#ifdef MINI_EVENT_EPOLL
+	base->epfd = -1;
+#endif
 	base->region = region_create(xalloc, free);
 	if(!base->region) {
 		free(base);
@@ -113,13 +193,20 @@ event_init(time_t* time_secs, struct timeval* time_tv)
 		event_base_free(base);
 		return NULL;
 	}
-	base->times = rbtree_create(base->region, mini_ev_cmp);
-	if(!base->times) {
+	base->capfd = MAX_FDS;
+#ifdef MINI_EVENT_EPOLL
+	base->epfd = epoll_create(MAX_EPOLL_EVENTS);
+	if(base->epfd == -1) {
 		event_base_free(base);
 		return NULL;
 	}
-	base->capfd = MAX_FDS;
-#ifdef FD_SETSIZE
+	base->ready = (struct epoll_event*)calloc(MAX_EPOLL_EVENTS,
+		sizeof(struct epoll_event));
+	if(!base->ready) {
+		event_base_free(base);
+		return NULL;
+	}
+#elif defined(FD_SETSIZE)
 	if((int)FD_SETSIZE < base->capfd)
 		base->capfd = (int)FD_SETSIZE;
 #endif
@@ -134,7 +221,7 @@ event_init(time_t* time_secs, struct timeval* time_tv)
 		event_base_free(base);
 		return NULL;
 	}
-#ifndef S_SPLINT_S
+#if !defined(S_SPLINT_S) && !defined(MINI_EVENT_EPOLL)
 	FD_ZERO(&base->reads);
 	FD_ZERO(&base->writes);
 #endif
@@ -148,11 +235,15 @@ event_get_version(void)
 	return "mini-event-"PACKAGE_VERSION;
 }
 
-/** get polling method, select */
+/** get polling method, epoll or select */
 const char *
 event_get_method(void)
 {
+#ifdef MINI_EVENT_EPOLL
+	return "epoll";
+#else
 	return "select";
+#endif
 }
 
 /** call timeouts handlers, and return how long to wait for next one or -1 */
@@ -166,8 +257,8 @@ handle_timeouts(struct event_base* base, struct timeval* now,
 	wait->tv_sec = (time_t)-1;
 #endif
 
-	while((rbnode_type*)(p = (struct event*)rbtree_first(base->times))
-		!=RBTREE_NULL) {
+	while(base->heap_num > 0) {
+		p = base->heap[0];
 #ifndef S_SPLINT_S
 		if(p->ev_timeout.tv_sec > now->tv_sec ||
 			(p->ev_timeout.tv_sec==now->tv_sec && 
@@ -187,13 +278,95 @@ handle_timeouts(struct event_base* base, struct timeval* now,
 #endif
 		/* event times out, remove it */
 		tofired = 1;
-		(void)rbtree_delete(base->times, p);
+		heap_remove(base, p);
 		p->ev_flags &= ~EV_TIMEOUT;
 		(*p->ev_callback)(p->ev_fd, EV_TIMEOUT, p->ev_arg);
 	}
 	return tofired;
 }
 
+#ifdef MINI_EVENT_EPOLL
+/** call epoll_wait and callbacks for that */
+static int
+handle_select(struct event_base* base, struct timeval* wait)
+{
+	int ret, i, fd, ms = -1;
+	struct event* ev;
+
+#ifndef S_SPLINT_S
+	if(wait->tv_sec > 86400) {
+		/* wake up daily, the int for the wait does not overflow */
+		ms = 86400*1000;
+	} else if(wait->tv_sec!=(time_t)-1) {
+		/* round up, so that the timeout has expired when we wake */
+		ms = (int)wait->tv_sec*1000 + (int)(wait->tv_usec+999)/1000;
+	}
+#endif
+	if((ret = epoll_wait(base->epfd, base->ready, MAX_EPOLL_EVENTS, ms))
+		== -1) {
+		ret = errno;
+		if(settime(base) < 0)
+			return -1;
+		errno = ret;
+		if(ret == EAGAIN || ret == EINTR)
+			return 0;
+		return -1;
+	}
+	if(settime(base) < 0)
+		return -1;
+
+	/* event_add and event_del for an fd clear it from the ready fds,
+	 * like the select version does */
+	base->ready_num = ret;
+	for(i=0; i<ret; i++) {
+		short bits = 0;
+		uint32_t e = base->ready[i].events;
+		fd = base->ready[i].data.fd;
+		if(fd < 0 || fd >= base->capfd || !(ev = base->fds[fd]))
+			continue;
+		if((e & (EPOLLIN|EPOLLERR|EPOLLHUP)))
+			bits |= EV_READ;
+		if((e & (EPOLLOUT|EPOLLERR|EPOLLHUP)))
+			bits |= EV_WRITE;
+		bits &= ev->ev_flags;
+		if(bits) {
+			base->ready_cur = i;
+			(*ev->ev_callback)(ev->ev_fd, bits, ev->ev_arg);
+		}
+	}
+	base->ready_num = 0;
+	return 0;
+}
+
+/** remove the fd from the ready fds that are not handled yet */
+static void
+ready_clear(struct event_base* base, int fd)
+{
+	int i;
+	for(i=base->ready_cur+1; i<base->ready_num; i++)
+		if(base->ready[i].data.fd == fd)
+			base->ready[i].data.fd = -1;
+}
+
+/** grow the fds array so that it can hold the fd */
+static int
+fds_grow(struct event_base* base, int fd)
+{
+	int cap = base->capfd;
+	struct event** f;
+	while(cap <= fd)
+		cap *= 2;
+	f = (struct event**)realloc(base->fds, sizeof(struct event*)*
+		(size_t)cap);
+	if(!f)
+		return -1;
+	memset(f+base->capfd, 0, sizeof(struct event*)*
+		(size_t)(cap-base->capfd));
+	base->fds = f;
+	base->capfd = cap;
+	return 0;
+}
+#else /* !MINI_EVENT_EPOLL */
 /** call select and callbacks for that */
 static int
 handle_select(struct event_base* base, struct timeval* wait)
@@ -244,6 +417,7 @@ handle_select(struct event_base* base, struct timeval* wait)
 	}
 	return 0;
 }
+#endif /* MINI_EVENT_EPOLL */
 
 /** run select once */
 int
@@ -304,8 +478,12 @@ event_base_free(struct event_base* base)
 {
 	if(!base)
 		return;
-	if(base->times)
-		free(base->times);
+#ifdef MINI_EVENT_EPOLL
+	if(base->epfd != -1)
+		close(base->epfd);
+	free(base->ready);
+#endif
+	free(base->heap);
 	if(base->fds)
 		free(base->fds);
 	if(base->signals)
@@ -319,7 +497,7 @@ void
 event_set(struct event* ev, int fd, short bits, 
 	void (*cb)(int, short, void *), void* arg)
 {
-	ev->node.key = ev;
+	ev->heap_idx = -1;
 	ev->ev_fd = fd;
 	ev->ev_flags = bits;
 	ev->ev_callback = cb;
@@ -342,9 +520,32 @@ event_add(struct event* ev, struct timeval* tv)
 {
 	if(ev->added)
 		event_del(ev);
+#ifdef MINI_EVENT_EPOLL
+	if(ev->ev_fd >= ev->ev_base->capfd && fds_grow(ev->ev_base,
+		ev->ev_fd) < 0)
+		return -1;
+#else
 	if(ev->ev_fd != -1 && ev->ev_fd >= ev->ev_base->capfd)
 		return -1;
+#endif
 	if( (ev->ev_flags&(EV_READ|EV_WRITE)) && ev->ev_fd != -1) {
+#ifdef MINI_EVENT_EPOLL
+		struct epoll_event e;
+		memset(&e, 0, sizeof(e));
+		if(ev->ev_flags&EV_READ)
+			e.events |= EPOLLIN;
+		if(ev->ev_flags&EV_WRITE)
+			e.events |= EPOLLOUT;
+		e.data.fd = ev->ev_fd;
+		/* the fd may still be registered, by an event for the fd
+		 * that was not deleted, or it may have been closed since */
+		if(epoll_ctl(ev->ev_base->epfd, EPOLL_CTL_ADD, ev->ev_fd, &e)
+			== -1 && (errno != EEXIST || epoll_ctl(ev->ev_base->epfd,
+			EPOLL_CTL_MOD, ev->ev_fd, &e) == -1))
+			return -1;
+		ready_clear(ev->ev_base, ev->ev_fd);
+		ev->ev_base->fds[ev->ev_fd] = ev;
+#else
 		ev->ev_base->fds[ev->ev_fd] = ev;
 		if(ev->ev_flags&EV_READ) {
 			FD_SET(FD_SET_T ev->ev_fd, &ev->ev_base->reads);
@@ -354,6 +555,7 @@ event_add(struct event* ev, struct timeval* tv)
 		}
 		FD_SET(FD_SET_T ev->ev_fd, &ev->ev_base->content);
 		FD_CLR(FD_SET_T ev->ev_fd, &ev->ev_base->ready);
+#endif /* MINI_EVENT_EPOLL */
 		if(ev->ev_fd > ev->ev_base->maxfd)
 			ev->ev_base->maxfd = ev->ev_fd;
 	}
@@ -362,12 +564,13 @@ event_add(struct event* ev, struct timeval* tv)
 		struct timeval* now = ev->ev_base->time_tv;
 		ev->ev_timeout.tv_sec = tv->tv_sec + now->tv_sec;
 		ev->ev_timeout.tv_usec = tv->tv_usec + now->tv_usec;
-		while(ev->ev_timeout.tv_usec > 1000000) {
+		while(ev->ev_timeout.tv_usec >= 1000000) {
 			ev->ev_timeout.tv_usec -= 1000000;
 			ev->ev_timeout.tv_sec++;
 		}
 #endif
-		(void)rbtree_insert(ev->ev_base->times, &ev->node);
+		if(heap_insert(ev->ev_base, ev) < 0)
+			return -1;
 	}
 	ev->added = 1;
 	return 0;
@@ -379,14 +582,25 @@ event_del(struct event* ev)
 {
 	if(ev->ev_fd != -1 && ev->ev_fd >= ev->ev_base->capfd)
 		return -1;
-	if((ev->ev_flags&EV_TIMEOUT))
-		(void)rbtree_delete(ev->ev_base->times, &ev->node);
+	if(ev->heap_idx != -1)
+		heap_remove(ev->ev_base, ev);
 	if((ev->ev_flags&(EV_READ|EV_WRITE)) && ev->ev_fd != -1) {
+#ifdef MINI_EVENT_EPOLL
+		if(ev->ev_base->fds[ev->ev_fd] == ev) {
+			/* fails if the fd is already closed, that also
+			 * removed it from the epoll set */
+			(void)epoll_ctl(ev->ev_base->epfd, EPOLL_CTL_DEL,
+				ev->ev_fd, NULL);
+			ev->ev_base->fds[ev->ev_fd] = NULL;
+			ready_clear(ev->ev_base, ev->ev_fd);
+		}
+#else
 		ev->ev_base->fds[ev->ev_fd] = NULL;
 		FD_CLR(FD_SET_T ev->ev_fd, &ev->ev_base->reads);
 		FD_CLR(FD_SET_T ev->ev_fd, &ev->ev_base->writes);
 		FD_CLR(FD_SET_T ev->ev_fd, &ev->ev_base->ready);
 		FD_CLR(FD_SET_T ev->ev_fd, &ev->ev_base->content);
+#endif /* MINI_EVENT_EPOLL */
 	}
 	ev->added = 0;
 	return 0;
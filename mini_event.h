@@ -36,17 +36,20 @@
 /**
  * \file
  * This file implements part of the event(3) libevent api.
- * The back end is only select. Max number of fds is limited.
+ * The back end is epoll where available, otherwise select.
+ * With select the max number of fds is limited.
  * Max number of signals is limited, one handler per signal only.
  * And one handler per fd.
  *
- * Although limited to select() and a max (1024) open fds, it
- * is efficient:
- * o dispatch call caches fd_sets to use. 
- * o handler calling takes time ~ to the number of fds.
- * o timeouts are stored in a redblack tree, sorted, so take log(n).
- * Timeouts are only accurate to the second (no subsecond accuracy).
- * To avoid cpu hogging, fractional timeouts are rounded up to a whole second.
+ * It is efficient:
+ * o with epoll, the fds are registered when added, and the dispatch
+ *   call handles only the fds that are ready.  The number of fds is not
+ *   limited, the fd array grows when needed.
+ * o with select (max 1024 open fds), the dispatch call caches fd_sets
+ *   to use, handler calling takes time ~ to the number of fds.
+ * o timeouts are stored in a binary heap, sorted, so take log(n).
+ * To avoid cpu hogging, fractional timeouts are rounded up to a whole
+ * millisecond for epoll.
  */
 
 #ifndef MINI_EVENT_H
@@ -59,6 +62,12 @@ struct region;
 #define HAVE_EVENT_BASE_FREE
 #endif 
 
+#ifdef HAVE_SYS_EPOLL_H
+/** use epoll, instead of select */
+#define MINI_EVENT_EPOLL 1
+struct epoll_event;
+#endif
+
 /** event timeout */
 #define EV_TIMEOUT	0x01
 /** event fd readable */
@@ -70,25 +79,40 @@ struct region;
 /** event must persist */
 #define EV_PERSIST	0x10
 
-/* needs our redblack tree */
-#include "rbtree.h"
-
-/** max number of file descriptors to support */
+/** max number of file descriptors to support with select, and the
+ * initial size of the fd array with epoll */
 #define MAX_FDS 1024
+/** max number of ready fds that one epoll_wait returns */
+#define MAX_EPOLL_EVENTS 128
 /** max number of signals to support */
 #define MAX_SIG 32
 
 /** event base */
 struct event_base
 {
-	/** sorted by timeout (absolute), ptr */
-	rbtree_type* times;
+	/** heap of the events with a timeout, sorted by timeout (absolute)
+	 * with the first to expire at the start, array of heap_num ptrs */
+	struct event** heap;
+	/** number of events in the heap */
+	int heap_num;
+	/** capacity - size of the heap array */
+	int heap_cap;
 	/** array of 0 - maxfd of ptr to event for it */
 	struct event** fds;
 	/** max fd in use */
 	int maxfd;
 	/** capacity - size of the fds array */
 	int capfd;
+#ifdef MINI_EVENT_EPOLL
+	/** the epoll fd */
+	int epfd;
+	/** the ready fds returned by epoll_wait, handled in a loop */
+	struct epoll_event* ready;
+	/** number of ready fds, 0 if not handling them */
+	int ready_num;
+	/** the index of the ready fd whose callback is called */
+	int ready_cur;
+#else
 	/* fdset for read write, for fds ready, and added */
 	fd_set 
 		/** fds for reading */
@@ -99,6 +123,7 @@ struct event_base
 		ready, 
 		/** ready plus newly added events. */
 		content;
+#endif /* MINI_EVENT_EPOLL */
 	/** array of 0 - maxsig of ptr to event for it */
 	struct event** signals;
 	/** if we need to exit */
@@ -115,8 +140,8 @@ struct event_base
  * Event structure. Has some of the event elements.
  */
 struct event {
-	/** node in timeout rbtree */
-	rbnode_type node;
+	/** position in the timeout heap, or -1 */
+	int heap_idx;
 	/** is event already added */
 	int added;
 
@@ -140,13 +165,13 @@ struct event {
 void *event_init(time_t* time_secs, struct timeval* time_tv);
 /** get version */
 const char *event_get_version(void);
-/** get polling method, select */
+/** get polling method, epoll or select */
 const char *event_get_method(void);
-/** run select in a loop */
+/** run epoll or select in a loop */
 int event_base_dispatch(struct event_base *);
 /** exit that loop */
 int event_base_loopexit(struct event_base *, struct timeval *);
-/** run select once */
+/** run epoll or select once */
 #define EVLOOP_ONCE 1
 int event_base_loop(struct event_base* base, int flags);
 /** free event base. Free events yourself */
@@ -177,7 +202,7 @@ int signal_del(struct event *);
 
 #endif /* USE_MINI_EVENT and not USE_WINSOCK */
 
-/** compare events in tree, based on timevalue, ptr for uniqueness */
+/** compare events in heap, based on timevalue, ptr for uniqueness */
 int mini_ev_cmp(const void* a, const void* b);
 
 #endif /* MINI_EVENT_H */
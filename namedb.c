@@ -19,6 +19,7 @@
 
 #include "namedb.h"
 #include "nsec3.h"
+#include "lookup3.h"
 
 static domain_type *
 allocate_domain_info(domain_table_type* table,
@@ -689,3 +690,370 @@ namedb_lookup(struct namedb* db,
 	return domain_table_search(
 		db->domains, dname, closest_match, closest_encloser);
 }
+
+/* the RRs of an RRset in the rr_index, hash table with linear probe */
+struct rrset_index {
+	/* rbtree node, key is the rrset pointer */
+	rbnode_type node;
+	rrset_type* rrset;
+	/* size of the table is a power of two, more than twice count */
+	uint32_t size, count;
+	struct rrset_index_slot {
+		uint32_t hash;
+		/* RR number plus one, 0 is empty */
+		uint32_t num;
+	} *slots;
+};
+
+struct rr_index {
+	region_type* region;
+	/* tree of rrset_index */
+	rbtree_type* rrsets;
+};
+
+static int
+rr_index_cmp(const void* a, const void* b)
+{
+	if(a == b)
+		return 0;
+	return a < b ? -1 : 1;
+}
+
+struct rr_index*
+rr_index_create(region_type* region)
+{
+	struct rr_index* index = (struct rr_index*)region_alloc(region,
+		sizeof(*index));
+	index->region = region;
+	index->rrsets = rbtree_create(region, rr_index_cmp);
+	return index;
+}
+
+static void
+rrset_index_free(struct rr_index* index, struct rrset_index* r)
+{
+	region_recycle(index->region, r->slots, sizeof(*r->slots)*r->size);
+	region_recycle(index->region, r, sizeof(*r));
+}
+
+void
+rr_index_clear(struct rr_index* index)
+{
+	struct rrset_index* r, *next;
+	r = (struct rrset_index*)rbtree_first(index->rrsets);
+	while((rbnode_type*)r != RBTREE_NULL) {
+		next = (struct rrset_index*)rbtree_next(&r->node);
+		rrset_index_free(index, r);
+		r = next;
+	}
+	index->rrsets->root = RBTREE_NULL;
+	index->rrsets->count = 0;
+}
+
+/* hash the name, lowercase, names compare case insensitive */
+static uint32_t
+rr_index_hash_name(const uint8_t* name, size_t len, uint32_t h)
+{
+	uint8_t buf[MAXDOMAINLEN];
+	size_t i;
+	if(len > sizeof(buf))
+		len = sizeof(buf);
+	for(i=0; i<len; i++)
+		buf[i] = DNAME_NORMALIZE(name[i]);
+	return hashlittle(buf, len, h);
+}
+
+/* the hash of the rdata, equal for RRs that are duplicates */
+static uint32_t
+rr_index_hash(uint16_t type, rdata_atom_type* rdatas, size_t rdata_count)
+{
+	uint32_t h = 0;
+	size_t i;
+	for(i=0; i<rdata_count; i++) {
+		if(rdata_atom_is_domain(type, i)) {
+			const dname_type* d = domain_dname(rdatas[i].domain);
+			h = rr_index_hash_name(dname_name(d), d->name_size, h);
+		} else if(rdata_atom_is_literal_domain(type, i)) {
+			h = rr_index_hash_name(rdata_atom_data(rdatas[i]),
+				rdata_atom_size(rdatas[i]), h);
+		} else {
+			h = hashlittle(rdata_atom_data(rdatas[i]),
+				rdata_atom_size(rdatas[i]), h);
+		}
+	}
+	return h;
+}
+
+/* compare the RR with the rdata, returns true if equal */
+static int
+rr_index_equal(rr_type* rr, uint16_t klass, rdata_atom_type* rdatas,
+	size_t rdata_count)
+{
+	size_t i;
+	if(rr->klass != klass || rr->rdata_count != rdata_count)
+		return 0;
+	for(i=0; i<rdata_count; i++) {
+		if(rdata_atom_is_domain(rr->type, i)) {
+			if(rr->rdatas[i].domain != rdatas[i].domain &&
+				dname_compare(domain_dname(rr->rdatas[i].domain),
+				domain_dname(rdatas[i].domain)) != 0)
+				return 0;
+		} else if(rdata_atom_is_literal_domain(rr->type, i)) {
+			if(rdata_atom_size(rr->rdatas[i]) !=
+				rdata_atom_size(rdatas[i]) ||
+				!dname_equal_nocase(rdata_atom_data(rr->rdatas[i]),
+				rdata_atom_data(rdatas[i]),
+				rdata_atom_size(rdatas[i])))
+				return 0;
+		} else {
+			if(rdata_atom_size(rr->rdatas[i]) !=
+				rdata_atom_size(rdatas[i]) ||
+				memcmp(rdata_atom_data(rr->rdatas[i]),
+				rdata_atom_data(rdatas[i]),
+				rdata_atom_size(rdatas[i])) != 0)
+				return 0;
+		}
+	}
+	return 1;
+}
+
+/* put the RR number in the table, the table has space */
+static void
+rrset_index_insert(struct rrset_index* r, uint32_t hash, uint32_t num)
+{
+	uint32_t i = hash & (r->size-1);
+	while(r->slots[i].num != 0)
+		i = (i+1) & (r->size-1);
+	r->slots[i].hash = hash;
+	r->slots[i].num = num+1;
+	r->count++;
+}
+
+/* make the table size fit the count */
+static void
+rrset_index_resize(struct rr_index* index, struct rrset_index* r,
+	uint32_t count)
+{
+	struct rrset_index_slot* old = r->slots;
+	uint32_t oldsize = r->size, i;
+	uint32_t size = 64;
+	while(size < count*2+2)
+		size *= 2;
+	r->size = size;
+	r->count = 0;
+	r->slots = (struct rrset_index_slot*)region_alloc_array_zero(
+		index->region, size, sizeof(*r->slots));
+	for(i=0; i<oldsize; i++) {
+		if(old[i].num != 0)
+			rrset_index_insert(r, old[i].hash, old[i].num-1);
+	}
+	region_recycle(index->region, old, sizeof(*old)*oldsize);
+}
+
+/* find the index of the rrset, or make it */
+static struct rrset_index*
+rrset_index_get(struct rr_index* index, rrset_type* rrset)
+{
+	struct rrset_index* r = (struct rrset_index*)rbtree_search(
+		index->rrsets, rrset);
+	uint32_t i;
+	if(r)
+		return r;
+	r = (struct rrset_index*)region_alloc_zero(index->region, sizeof(*r));
+	r->node.key = rrset;
+	r->rrset = rrset;
+	rrset_index_resize(index, r, rrset->rr_count);
+	for(i=0; i<rrset->rr_count; i++)
+		rrset_index_insert(r, rr_index_hash(rrset->rrs[i].type,
+			rrset->rrs[i].rdatas, rrset->rrs[i].rdata_count), i);
+	rbtree_insert(index->rrsets, &r->node);
+	return r;
+}
+
+int
+rr_index_find(struct rr_index* index, rrset_type* rrset, uint16_t klass,
+	rdata_atom_type* rdatas, size_t rdata_count)
+{
+	struct rrset_index* r = rrset_index_get(index, rrset);
+	uint32_t hash = rr_index_hash(rrset->rrs[0].type, rdatas, rdata_count);
+	uint32_t i = hash & (r->size-1);
+	while(r->slots[i].num != 0) {
+		if(r->slots[i].hash == hash && rr_index_equal(
+			&rrset->rrs[r->slots[i].num-1], klass, rdatas,
+			rdata_count))
+			return (int)r->slots[i].num-1;
+		i = (i+1) & (r->size-1);
+	}
+	return -1;
+}
+
+void
+rr_index_add(struct rr_index* index, rrset_type* rrset)
+{
+	struct rrset_index* r;
+	rr_type* rr = &rrset->rrs[rrset->rr_count-1];
+	if(rrset->rr_count < RR_INDEX_MIN)
+		return;
+	r = (struct rrset_index*)rbtree_search(index->rrsets, rrset);
+	if(!r) {
+		/* indexes all the RRs, with the new one */
+		(void)rrset_index_get(index, rrset);
+		return;
+	}
+	if((r->count+1)*2+2 > r->size)
+		rrset_index_resize(index, r, r->count+1);
+	rrset_index_insert(r, rr_index_hash(rr->type, rr->rdatas,
+		rr->rdata_count), rrset->rr_count-1);
+}
+
+/* find the slot with the RR number */
+static uint32_t
+rrset_index_slot(struct rrset_index* r, rr_type* rr, uint32_t num)
+{
+	uint32_t i = rr_index_hash(rr->type, rr->rdatas, rr->rdata_count) &
+		(r->size-1);
+	while(r->slots[i].num != num+1) {
+		assert(r->slots[i].num != 0);
+		i = (i+1) & (r->size-1);
+	}
+	return i;
+}
+
+void
+rr_index_del(struct rr_index* index, rrset_type* rrset, int num)
+{
+	struct rrset_index* r = (struct rrset_index*)rbtree_search(
+		index->rrsets, rrset);
+	uint32_t i, j, last = rrset->rr_count-1;
+	if(!r)
+		return;
+	if(rrset->rr_count-1 < RR_INDEX_MIN) {
+		/* too small to index, the caller searches the RRset */
+		(void)rbtree_delete(index->rrsets, rrset);
+		rrset_index_free(index, r);
+		return;
+	}
+	/* remove the slot, and move the next slots back into the gap */
+	i = rrset_index_slot(r, &rrset->rrs[num], num);
+	r->slots[i].num = 0;
+	r->count--;
+	j = i;
+	for(;;) {
+		uint32_t k;
+		j = (j+1) & (r->size-1);
+		if(r->slots[j].num == 0)
+			break;
+		k = r->slots[j].hash & (r->size-1);
+		/* move the slot at j to i, if its home k is not in (i, j] */
+		if((i <= j) ? (i < k && k <= j) : (i < k || k <= j))
+			continue;
+		r->slots[i] = r->slots[j];
+		r->slots[j].num = 0;
+		i = j;
+	}
+	/* the last RR moves into the place of the deleted RR */
+	if((uint32_t)num != last)
+		r->slots[rrset_index_slot(r, &rrset->rrs[last], last)].num =
+			num+1;
+}
+
+/** add the memory of the rrset to m */
+static void
+mem_rrset(struct namedb_mem* m, rrset_type* rrset)
+{
+	uint16_t i;
+	size_t j;
+	m->rrset.count++;
+	m->rrset.bytes += sizeof(rrset_type);
+	m->rr.count += rrset->rr_count;
+	m->rr.bytes += sizeof(rr_type)*rrset->rr_count;
+	for(i=0; i<rrset->rr_count; i++) {
+		rr_type* rr = &rrset->rrs[i];
+		m->rdata.count += rr->rdata_count;
+		m->rdata.bytes += sizeof(rdata_atom_type)*rr->rdata_count;
+		for(j=0; j<rr->rdata_count; j++) {
+			if(rdata_atom_is_domain(rr->type, j))
+				continue;
+			m->rdata_data.count++;
+			m->rdata_data.bytes += sizeof(uint16_t) +
+				rdata_atom_size(rr->rdatas[j]);
+		}
+	}
+}
+
+void
+namedb_mem_zone(struct namedb_mem* m, zone_type* zone)
+{
+	domain_type* domain = zone->apex;
+	domain_type* subzone = NULL;
+	rrset_type* rrset;
+
+	m->zone.count++;
+	m->zone.bytes += sizeof(zone_type);
+	if(zone->soa_nx_rrset)
+		m->zone.bytes += sizeof(rrset_type) + sizeof(rr_type);
+	if(zone->filename)
+		m->zone.bytes += strlen(zone->filename)+1;
+	if(zone->logstr)
+		m->zone.bytes += strlen(zone->logstr)+1;
+#ifdef NSEC3
+	if(zone->nsec3tree) m->zone.bytes += sizeof(rbtree_type);
+	if(zone->hashtree) m->zone.bytes += sizeof(rbtree_type);
+	if(zone->wchashtree) m->zone.bytes += sizeof(rbtree_type);
+	if(zone->dshashtree) m->zone.bytes += sizeof(rbtree_type);
+#endif
+
+	/* the rrsets of the zone are below the apex, also below zone cuts,
+	 * but domains below the apex of another zone are part of that zone */
+	while(domain && domain_is_subdomain(domain, zone->apex)) {
+		if(subzone && !domain_is_subdomain(domain, subzone))
+			subzone = NULL;
+		if(!subzone && domain != zone->apex && domain->is_apex)
+			subzone = domain;
+		if(!subzone) {
+			m->domain.count++;
+			m->domain.bytes += sizeof(domain_type) +
+				dname_total_size(domain_dname(domain));
+#ifdef NSEC3
+			if(domain->nsec3) {
+				m->nsec3.count++;
+				m->nsec3.bytes +=
+					sizeof(struct nsec3_domain_data);
+			}
+#endif
+		}
+		for(rrset = domain->rrsets; rrset; rrset = rrset->next) {
+			if(rrset->zone == zone)
+				mem_rrset(m, rrset);
+		}
+		domain = domain_next(domain);
+	}
+}
+
+/** add up the memory use b to a */
+static void
+mem_use_add(struct mem_use* a, struct mem_use* b)
+{
+	a->count += b->count;
+	a->bytes += b->bytes;
+}
+
+void
+namedb_mem_add(struct namedb_mem* a, struct namedb_mem* b)
+{
+	mem_use_add(&a->zone, &b->zone);
+	mem_use_add(&a->domain, &b->domain);
+	mem_use_add(&a->nsec3, &b->nsec3);
+	mem_use_add(&a->rrset, &b->rrset);
+	mem_use_add(&a->rr, &b->rr);
+	mem_use_add(&a->rdata, &b->rdata);
+	mem_use_add(&a->rdata_data, &b->rdata_data);
+}
+
+size_t
+namedb_mem_bytes(struct namedb_mem* m)
+{
+	return m->zone.bytes + m->domain.bytes + m->nsec3.bytes +
+		m->rrset.bytes + m->rr.bytes + m->rdata.bytes +
+		m->rdata_data.bytes;
+}
@@ -259,6 +259,62 @@ domain_type *domain_previous_existing_child(domain_type* domain);
 
 int zone_is_secure(zone_type* zone);
 
+/*
+ * Index of the RRs of large RRsets by a hash of the rdata, to find an RR
+ * by its rdata without a compare with every RR of the RRset. Used when
+ * RRs are added and deleted in bulk, while a zone file is read and while
+ * IXFRs are applied. RRsets smaller than RR_INDEX_MIN are not indexed,
+ * they are searched by the caller. The index of an RRset is made when
+ * it is first used and must be kept up to date with rr_index_add and
+ * rr_index_del for every change of the RRset while the index exists.
+ */
+#define RR_INDEX_MIN 32
+struct rr_index;
+struct rr_index* rr_index_create(region_type* region);
+/* remove all RRsets from the index, when the RRsets are deleted */
+void rr_index_clear(struct rr_index* index);
+/* find the RR with the rdata in the RRset, rr_count >= RR_INDEX_MIN.
+ * Returns the RR number, or -1 if not found. */
+int rr_index_find(struct rr_index* index, rrset_type* rrset, uint16_t klass,
+	rdata_atom_type* rdatas, size_t rdata_count);
+/* the last RR of the RRset has just been added */
+void rr_index_add(struct rr_index* index, rrset_type* rrset);
+/* RR number num is going to be deleted from the RRset, and the last RR
+ * moves into its place */
+void rr_index_del(struct rr_index* index, rrset_type* rrset, int num);
+
+/* number of objects of a type of structure, and the bytes they use */
+struct mem_use {
+	size_t count;
+	size_t bytes;
+};
+
+/* memory used by the data of a zone in the db region, per type of
+ * structure. Domains are counted for the zone they are part of, rrsets
+ * by their zone pointer. */
+struct namedb_mem {
+	/* zone structure, with NSEC3 trees and strings */
+	struct mem_use zone;
+	/* domains, with their domain name */
+	struct mem_use domain;
+	/* NSEC3 precompile data of the domains */
+	struct mem_use nsec3;
+	/* rrsets */
+	struct mem_use rrset;
+	/* rr arrays of the rrsets, the count is the number of RRs */
+	struct mem_use rr;
+	/* rdata atom arrays of the RRs, the count is the number of atoms */
+	struct mem_use rdata;
+	/* rdata that is not a domain reference, with its length */
+	struct mem_use rdata_data;
+};
+/* add the memory used by the zone to m */
+void namedb_mem_zone(struct namedb_mem* m, zone_type* zone);
+/* add up the memory of b to a */
+void namedb_mem_add(struct namedb_mem* a, struct namedb_mem* b);
+/* bytes in total in the memory use */
+size_t namedb_mem_bytes(struct namedb_mem* m);
+
 static inline dname_type *
 domain_dname(domain_type* domain)
 {
@@ -326,6 +382,8 @@ struct namedb
 	/* if diff_skip=1, diff_pos contains the nsd.diff place to continue */
 	uint8_t		  diff_skip;
 	off_t		  diff_pos;
+	/* deleted zones whose memory is freed in steps by the reload */
+	struct zone_delete* zone_delete;
 };
 
 static inline int rdata_atom_is_domain(uint16_t type, size_t index);
@@ -391,6 +449,13 @@ zone_type* namedb_zone_create(namedb_type* db, const dname_type* dname,
 void namedb_zone_delete(namedb_type* db, zone_type* zone);
 void namedb_write_zonefile(struct nsd* nsd, struct zone_options* zopt);
 void namedb_write_zonefiles(struct nsd* nsd, struct nsd_options* options);
+/** collect the zone files written by the workers started by
+ * namedb_write_zonefiles, if block it waits for all of them.  When the
+ * workers are done the files are renamed into place. */
+void namedb_write_zonefiles_collect(struct nsd* nsd, int block);
+/** forget the zone file workers, in a forked process that does not
+ * collect them; the zones are marked as changed again */
+void namedb_write_zonefiles_forget(struct nsd* nsd);
 int create_dirs(const char* path);
 int file_get_mtime(const char* file, struct timespec* mtime, int* nonexist);
 void allocate_domain_nsec3(domain_table_type *table, domain_type *result);
@@ -366,9 +366,13 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		SERV_GET_BIN(reuseport, o);
 		SERV_GET_BIN(hide_version, o);
 		SERV_GET_BIN(zonefiles_check, o);
+		SERV_GET_BIN(zonefiles_watch, o);
 		SERV_GET_BIN(log_time_ascii, o);
 		SERV_GET_BIN(round_robin, o);
 		SERV_GET_BIN(minimal_responses, o);
+		SERV_GET_BIN(tls_ktls, o);
+		SERV_GET_BIN(adaptive_udp_size, o);
+		SERV_GET_BIN(xfrd_ixfr_cost, o);
 		/* str */
 		SERV_GET_PATH(final, database, o);
 		SERV_GET_STR(identity, o);
@@ -383,6 +387,9 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		SERV_GET_PATH(final, xfrdir, o);
 		SERV_GET_PATH(final, zonelistfile, o);
 		SERV_GET_STR(port, o);
+		SERV_GET_PATH(final, tls_service_key, o);
+		SERV_GET_PATH(final, tls_service_pem, o);
+		SERV_GET_STR(tls_port, o);
 		/* int */
 		SERV_GET_INT(server_count, o);
 		SERV_GET_INT(tcp_count, o);
@@ -404,6 +411,8 @@ config_print_zone(nsd_options_type* opt, const char* k, int s, const char *o,
 		SERV_GET_INT(rrl_whitelist_ratelimit, o);
 #endif
 		SERV_GET_INT(zonefiles_write, o);
+		SERV_GET_INT(zonefiles_write_workers, o);
+		SERV_GET_INT(tls_ticket_rotate, o);
 		/* remote control */
 		SERV_GET_BIN(control_enable, o);
 		SERV_GET_IP(control_interface, control_interface, o);
@@ -469,6 +478,7 @@ void
 config_test_print_server(nsd_options_type* opt)
 {
 	ip_address_option_type* ip;
+	struct proxy_protocol_port_list* pp;
 	key_options_type* key;
 	zone_options_type* zone;
 	pattern_options_type* pat;
@@ -505,6 +515,7 @@ config_test_print_server(nsd_options_type* opt)
 	print_string_var("zonelistfile:", opt->zonelistfile);
 	print_string_var("xfrdir:", opt->xfrdir);
 	printf("\txfrd-reload-timeout: %d\n", opt->xfrd_reload_timeout);
+	printf("\txfrd-ixfr-cost: %s\n", opt->xfrd_ixfr_cost?"yes":"no");
 	printf("\tlog-time-ascii: %s\n", opt->log_time_ascii?"yes":"no");
 	printf("\tround-robin: %s\n", opt->round_robin?"yes":"no");
 	printf("\tminimal-responses: %s\n", opt->minimal_responses?"yes":"no");
@@ -522,7 +533,18 @@ config_test_print_server(nsd_options_type* opt)
 	printf("\trrl-whitelist-ratelimit: %d\n", (int)opt->rrl_whitelist_ratelimit);
 #endif
 	printf("\tzonefiles-check: %s\n", opt->zonefiles_check?"yes":"no");
+	printf("\tzonefiles-watch: %s\n", opt->zonefiles_watch?"yes":"no");
 	printf("\tzonefiles-write: %d\n", opt->zonefiles_write);
+	printf("\tzonefiles-write-workers: %d\n", opt->zonefiles_write_workers);
+	print_string_var("tls-service-key:", opt->tls_service_key);
+	print_string_var("tls-service-pem:", opt->tls_service_pem);
+	print_string_var("tls-port:", opt->tls_port);
+	printf("\ttls-ticket-rotate: %d\n", opt->tls_ticket_rotate);
+	printf("\ttls-ktls: %s\n", opt->tls_ktls?"yes":"no");
+	for(pp = opt->proxy_protocol_port; pp; pp = pp->next)
+		printf("\tproxy-protocol-port: %d\n", pp->port);
+	print_acl_ips("proxy-protocol-allow:", opt->proxy_protocol_allow);
+	printf("\tadaptive-udp-size: %s\n", opt->adaptive_udp_size?"yes":"no");
 
 	printf("\nremote-control:\n");
 	printf("\tcontrol-enable: %s\n", opt->control_enable?"yes":"no");
@@ -641,6 +663,13 @@ additional_checks(nsd_options_type* opt, const char* filename)
 		errors ++;
         }
 
+	if (opt->proxy_protocol_port && !opt->proxy_protocol_allow) {
+		fprintf(stderr, "%s: proxy-protocol-port given, but no "
+			"proxy-protocol-allow for the proxies to trust\n",
+			filename);
+		errors ++;
+	}
+
 	/* not done here: parsing of ip-address. parsing of username. */
 
         if (opt->chroot && opt->chroot[0]) {
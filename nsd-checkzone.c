@@ -13,14 +13,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <time.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
 
 #include "nsd.h"
 #include "options.h"
 #include "util.h"
 #include "zonec.h"
+#include "rbtree.h"
+#include "nsec3.h"
 
 static void error(const char *format, ...) ATTR_FORMAT(printf, 1, 2);
 struct nsd nsd;
@@ -32,7 +40,9 @@ struct nsd nsd;
 static void
 usage (void)
 {
-	fprintf(stderr, "Usage: nsd-checkzone <zone name> <zone file>\n");
+	fprintf(stderr, "Usage: nsd-checkzone [-b] [-j number] <zone name> <zone file>\n");
+	fprintf(stderr, "-b\t\tprint the parse speed, in MB/s and RR/s.\n");
+	fprintf(stderr, "-j number\tparse parts of the zone file in parallel.\n");
 	fprintf(stderr, "Version %s. Report bugs to <%s>.\n",
 		PACKAGE_VERSION, PACKAGE_BUGREPORT);
 }
@@ -51,13 +61,610 @@ error(const char *format, ...)
 	exit(1);
 }
 
+/* zone files smaller than this are parsed in one part */
+#define PART_MIN_SIZE (1024*1024)
+
+/*
+ * A part of the zone file, parsed by a worker process. It starts at a
+ * line with an owner name, outside of parentheses and quoted strings, so
+ * that only the $ORIGIN and $TTL carry over from the text before it.
+ */
+struct zone_part {
+	/* offsets in the zone file text */
+	size_t start, end;
+	/* the line number at the start */
+	unsigned int line;
+	/* the $ORIGIN and $TTL in effect at the start, or NULL */
+	char* origin;
+	char* ttl;
+	/* the worker process and the socket to it */
+	pid_t pid;
+	int fd;
+};
+
+/* result of the parse of a part, sent by the worker */
+struct part_result {
+	uint64_t rrs;
+	uint32_t errors;
+	uint32_t soa;
+	/* size of the list of names that follows */
+	uint32_t size;
+};
+
+/* flags for the names with CNAME or DNAME, checked over all parts */
+#define NAME_CNAME 0x01 /* CNAME at the name */
+#define NAME_DNAME 0x02 /* DNAME at the name */
+#define NAME_OTHER 0x04 /* other data than CNAME at the name */
+#define NAME_BELOW 0x08 /* data below the name */
+
+/* a name with CNAME or DNAME, merged from the parts */
+struct part_name {
+	/* rbtree node, key is the dname */
+	rbnode_type node;
+	const dname_type* dname;
+	uint8_t flags;
+	/* the first part with the CNAME and DNAME, or -1 */
+	int cname_part, dname_part;
+	/* if more parts have the CNAME */
+	int cname_multi;
+	/* the target of the CNAME and DNAME */
+	const dname_type* cname_target;
+	const dname_type* dname_target;
+};
+
+static int
+part_name_cmp(const void* a, const void* b)
+{
+	return dname_compare((const dname_type*)a, (const dname_type*)b);
+}
+
+/* read the zone file into memory */
+static char*
+read_zonefile(const char* fname, size_t* len)
+{
+	struct stat st;
+	char* text;
+	size_t done = 0;
+	int fd = open(fname, O_RDONLY);
+	if(fd == -1) {
+		error("cannot open %s: %s", fname, strerror(errno));
+	}
+	if(fstat(fd, &st) == -1) {
+		error("cannot stat %s: %s", fname, strerror(errno));
+	}
+	*len = (size_t)st.st_size;
+	text = (char*)xalloc(*len + 1);
+	while(done < *len) {
+		ssize_t r = read(fd, text + done, *len - done);
+		if(r == -1 && errno == EINTR)
+			continue;
+		if(r <= 0) {
+			error("cannot read %s: %s", fname,
+				r==0?"file is shorter":strerror(errno));
+		}
+		done += r;
+	}
+	text[*len] = 0;
+	close(fd);
+	return text;
+}
+
+/* the argument of the directive, up to whitespace or comment */
+static char*
+directive_arg(region_type* region, const char* text, size_t i, size_t len)
+{
+	size_t start;
+	char* arg;
+	while(i < len && text[i] != ' ' && text[i] != '\t' && text[i] != '\n')
+		i++; /* skip directive */
+	while(i < len && (text[i] == ' ' || text[i] == '\t'))
+		i++;
+	start = i;
+	while(i < len && text[i] != ' ' && text[i] != '\t' &&
+		text[i] != '\n' && text[i] != '\r' && text[i] != ';') {
+		if(text[i] == '\\' && i+1 < len && text[i+1] != '\n')
+			i++;
+		i++;
+	}
+	arg = (char*)region_alloc(region, i - start + 1);
+	memcpy(arg, text + start, i - start);
+	arg[i - start] = 0;
+	return arg;
+}
+
+/* the new origin for $ORIGIN arg, a relative name is below the origin */
+static char*
+directive_origin(region_type* region, const char* arg, const char* origin)
+{
+	size_t len = strlen(arg), esc = 0;
+	char* result;
+	if(len == 0 || strcmp(arg, "@") == 0)
+		return (char*)origin;
+	/* absolute if it ends in a dot that is not escaped */
+	while(esc+1 < len && arg[len-2-esc] == '\\')
+		esc++;
+	if(arg[len-1] == '.' && esc%2 == 0)
+		return (char*)arg;
+	result = (char*)region_alloc(region, len + strlen(origin) + 2);
+	memcpy(result, arg, len);
+	result[len] = '.';
+	memmove(result + len + 1, origin, strlen(origin) + 1);
+	if(strcmp(origin, ".") == 0)
+		result[len+1] = 0;
+	return result;
+}
+
+/*
+ * Split the zone file text in at most num parts of about the same size.
+ * The parts start at a line with an owner name, outside of parentheses
+ * and quoted strings. Returns the number of parts.
+ */
+static int
+split_zonefile(region_type* region, const char* text, size_t len,
+	const char* origin, struct zone_part* parts, int num)
+{
+	size_t i = 0;
+	int n = 1, paren = 0, quote = 0;
+	unsigned int line = 1;
+	char* cur_origin = (char*)origin;
+	char* cur_ttl = NULL;
+
+	memset(parts, 0, sizeof(*parts)*num);
+	while(i < len) {
+		/* at the start of a line */
+		if(!paren && !quote) {
+			if(text[i] == '$') {
+				if(strncasecmp(text+i, "$ORIGIN", 7) == 0)
+					cur_origin = directive_origin(region,
+						directive_arg(region, text,
+						i, len), cur_origin);
+				else if(strncasecmp(text+i, "$TTL", 4) == 0)
+					cur_ttl = directive_arg(region, text,
+						i, len);
+			} else if(n < num && i >= (size_t)((uint64_t)len*n/num)
+				&& text[i] != ' ' && text[i] != '\t'
+				&& text[i] != ';' && text[i] != '\r'
+				&& text[i] != '\n') {
+				parts[n-1].end = i;
+				parts[n].start = i;
+				parts[n].line = line;
+				parts[n].origin = cur_origin;
+				parts[n].ttl = cur_ttl;
+				n++;
+			}
+		}
+		/* scan the line */
+		while(i < len && text[i] != '\n') {
+			char c = text[i];
+			if(c == '\\') {
+				/* an escaped newline is counted below */
+				if(i+1 < len && text[i+1] != '\n')
+					i++;
+			} else if(quote) {
+				if(c == '"')
+					quote = 0;
+			} else if(c == '"') {
+				quote = 1;
+			} else if(c == ';') {
+				while(i < len && text[i] != '\n')
+					i++;
+				break;
+			} else if(c == '(') {
+				paren++;
+			} else if(c == ')' && paren > 0) {
+				paren--;
+			}
+			i++;
+		}
+		if(i < len) {
+			/* the newline */
+			i++;
+			line++;
+		}
+	}
+	parts[0].line = 1;
+	parts[n-1].end = len;
+	return n;
+}
+
+/* append the dname in wireformat, with length byte, to the buffer */
+static void
+buffer_write_dname(buffer_type* buf, const dname_type* dname)
+{
+	buffer_reserve(buf, 1 + dname->name_size);
+	buffer_write_u8(buf, dname->name_size);
+	buffer_write(buf, dname_name(dname), dname->name_size);
+}
+
+/* read a dname written by buffer_write_dname, NULL on failure */
+static const dname_type*
+buffer_read_dname(region_type* region, buffer_type* buf)
+{
+	uint8_t size;
+	const dname_type* dname;
+	if(!buffer_available(buf, 1))
+		return NULL;
+	size = buffer_read_u8(buf);
+	if(!buffer_available(buf, size))
+		return NULL;
+	dname = dname_make(region, buffer_current(buf), 0);
+	buffer_skip(buf, size);
+	return dname;
+}
+
+/* send the buffer over the socket, with the size in front */
+static void
+part_send(int fd, buffer_type* buf)
+{
+	uint32_t size = buffer_limit(buf);
+	if(!write_socket(fd, &size, sizeof(size)) ||
+		!write_socket(fd, buffer_begin(buf), size)) {
+		error("cannot write to socket: %s", strerror(errno));
+	}
+}
+
+/* receive the buffer over the socket, that was sent with part_send */
+static void
+part_recv(int fd, buffer_type* buf, uint32_t size)
+{
+	buffer_clear(buf);
+	buffer_reserve(buf, size);
+	if(size != 0 && block_read(NULL, fd, buffer_begin(buf), size, -1)
+		!= (ssize_t)size) {
+		error("cannot read from worker");
+	}
+	buffer_set_limit(buf, size);
+}
+
+/*
+ * Worker process: parse the part of the zone file, and send the result
+ * and the list of CNAME and DNAME names to the parent. Then answer
+ * the parent if there is other data at, or data below, the names that
+ * have CNAMEs and DNAMEs in all parts.
+ */
+static void
+part_worker(struct nsd* nsd, zone_type* zone, const char* fname,
+	const char* text, struct zone_part* part, int first)
+{
+	region_type* region = region_create(xalloc, free);
+	buffer_type* buf = buffer_create(region, 4096);
+	struct part_result res;
+	domain_type* domain;
+	uint32_t size;
+	size_t len = part->end - part->start, hdr;
+	unsigned int line = part->line;
+	char* str = (char*)xalloc(len + MAXDOMAINLEN*5 + 64);
+
+	/* the $ORIGIN and $TTL go in front of the text, on their own lines,
+	 * the line numbers are those of the zone file */
+	str[0] = 0;
+	if(!first) {
+		snprintf(str, MAXDOMAINLEN*5 + 64, "$ORIGIN %s\n", part->origin);
+		line--;
+		if(part->ttl) {
+			size_t l = strlen(str);
+			snprintf(str+l, MAXDOMAINLEN*5 + 64 - l, "$TTL %s\n",
+				part->ttl);
+			line--;
+		}
+	}
+	hdr = strlen(str);
+	memmove(str + hdr, text + part->start, len);
+	str[hdr + len] = 0;
+
+	memset(&res, 0, sizeof(res));
+	res.errors = zonec_read_part(fname, zone, str, line);
+	free(str);
+
+	/* count the RRs and list the CNAMEs and DNAMEs */
+	buffer_clear(buf);
+	for(domain = nsd->db->domains->root; domain;
+		domain = domain_next(domain)) {
+		rrset_type* rrset, *cname = NULL, *dname = NULL;
+		uint8_t flags = 0;
+		for(rrset = domain->rrsets; rrset; rrset = rrset->next) {
+			res.rrs += rrset->rr_count;
+			if(rrset_rrtype(rrset) == TYPE_SOA)
+				res.soa += rrset->rr_count;
+			else if(rrset_rrtype(rrset) == TYPE_CNAME) {
+				flags |= NAME_CNAME;
+				cname = rrset;
+			} else if(rrset_rrtype(rrset) == TYPE_DNAME) {
+				flags |= NAME_DNAME;
+				dname = rrset;
+			}
+		}
+		if(!flags)
+			continue;
+		buffer_reserve(buf, 1);
+		buffer_write_u8(buf, flags);
+		buffer_write_dname(buf, domain_dname(domain));
+		if(cname)
+			buffer_write_dname(buf, domain_dname(rdata_atom_domain(
+				cname->rrs[0].rdatas[0])));
+		if(dname)
+			buffer_write_dname(buf, domain_dname(rdata_atom_domain(
+				dname->rrs[0].rdatas[0])));
+	}
+	buffer_flip(buf);
+	res.size = buffer_limit(buf);
+	if(!write_socket(part->fd, &res, sizeof(res)) ||
+		!write_socket(part->fd, buffer_begin(buf), res.size)) {
+		error("cannot write to socket: %s", strerror(errno));
+	}
+
+	/* answer for the names of all parts */
+	if(block_read(NULL, part->fd, &size, sizeof(size), -1) !=
+		(ssize_t)sizeof(size)) {
+		error("cannot read from socket");
+	}
+	part_recv(part->fd, buf, size);
+	while(buffer_remaining(buf) > 0) {
+		uint8_t flags = buffer_read_u8(buf), answer = 0;
+		const dname_type* dname = buffer_read_dname(region, buf);
+		domain_type* match = NULL, *encloser = NULL;
+		if(!dname)
+			error("bad name list from parent");
+		int exact = domain_table_search(nsd->db->domains, dname,
+			&match, &encloser);
+		if(exact && (flags&NAME_CNAME) &&
+			domain_find_non_cname_rrset(match, zone))
+			answer |= NAME_OTHER;
+		/* the data below a DNAME in this part is reported by the
+		 * DNAME check of the part read */
+		if((flags&NAME_DNAME) && !(exact && match &&
+			domain_find_rrset(match, zone, TYPE_DNAME))) {
+			for(domain = domain_next(match); domain &&
+				dname_is_subdomain(domain_dname(domain), dname);
+				domain = domain_next(domain)) {
+#ifdef NSEC3
+				if(domain_has_only_NSEC3(domain, NULL))
+					continue;
+#endif
+				if(domain->is_existing) {
+					answer |= NAME_BELOW;
+					break;
+				}
+			}
+		}
+		if(!write_socket(part->fd, &answer, sizeof(answer)))
+			error("cannot write to socket: %s", strerror(errno));
+	}
+	exit(0);
+}
+
+/* error for the check over all parts */
 static void
-check_zone(struct nsd* nsd, const char* name, const char* fname)
+part_error(unsigned* errors, const char* fname, const char* msg,
+	const dname_type* dname)
+{
+	log_msg(LOG_ERR, "%s: %s at %s", fname, msg,
+		dname_to_string(dname, NULL));
+	(*errors)++;
+}
+
+/* merge the CNAME and DNAME names of part p in the tree */
+static void
+part_merge(region_type* region, rbtree_type* names, buffer_type* buf, int p,
+	unsigned* errors, const char* fname)
+{
+	while(buffer_remaining(buf) > 0) {
+		uint8_t flags = buffer_read_u8(buf);
+		const dname_type* dname = buffer_read_dname(region, buf);
+		const dname_type* cname = NULL, *dname_target = NULL;
+		struct part_name* n;
+		if(dname && (flags&NAME_CNAME))
+			cname = buffer_read_dname(region, buf);
+		if(dname && (flags&NAME_DNAME))
+			dname_target = buffer_read_dname(region, buf);
+		if(!dname || ((flags&NAME_CNAME) && !cname) ||
+			((flags&NAME_DNAME) && !dname_target))
+			error("bad name list from worker");
+		n = (struct part_name*)rbtree_search(names, dname);
+		if(!n) {
+			n = (struct part_name*)region_alloc_zero(region,
+				sizeof(*n));
+			n->node.key = dname;
+			n->dname = dname;
+			n->cname_part = -1;
+			n->dname_part = -1;
+			rbtree_insert(names, &n->node);
+		}
+		if((flags&NAME_CNAME)) {
+			if(n->cname_part == -1) {
+				n->cname_part = p;
+				n->cname_target = cname;
+			} else {
+				n->cname_multi = 1;
+				/* the same CNAME is a duplicate that is
+				 * ignored, like in one zone file */
+				if(dname_compare(n->cname_target, cname) != 0)
+					part_error(errors, fname, "multiple "
+						"CNAMEs at the same name",
+						dname);
+			}
+		}
+		if((flags&NAME_DNAME)) {
+			if(n->dname_part == -1) {
+				n->dname_part = p;
+				n->dname_target = dname_target;
+			} else {
+				if(dname_compare(n->dname_target,
+					dname_target) != 0)
+					part_error(errors, fname, "multiple "
+						"DNAMEs at the same name",
+						dname);
+			}
+		}
+		/* both in one part is reported by the worker for it */
+		if(((n->flags|flags)&(NAME_CNAME|NAME_DNAME)) ==
+			(NAME_CNAME|NAME_DNAME) &&
+			(n->flags&(NAME_CNAME|NAME_DNAME)) !=
+			(NAME_CNAME|NAME_DNAME) &&
+			(flags&(NAME_CNAME|NAME_DNAME)) !=
+			(NAME_CNAME|NAME_DNAME))
+			part_error(errors, fname, "DNAME and CNAME at the "
+				"same name", dname);
+		n->flags |= flags;
+	}
+}
+
+/* the data found by a part is in another part than the first part
+ * with the CNAME, the check within one part is done by the worker */
+static int
+part_other(int first_part, int multi, int p)
+{
+	return first_part != -1 && (first_part != p || multi);
+}
+
+/*
+ * Parse the zone file in parts by forked worker processes, and merge
+ * the results for the checks over the whole zone. Returns the number
+ * of errors.
+ */
+static unsigned
+check_zone_parts(struct nsd* nsd, const char* name, const char* fname,
+	zone_type* zone, int jobs, uint64_t* rrs, size_t* len)
+{
+	region_type* region = region_create(xalloc, free);
+	buffer_type* buf = buffer_create(region, 4096);
+	rbtree_type* names = rbtree_create(region, part_name_cmp);
+	struct zone_part* parts;
+	struct part_name* n;
+	char* text = read_zonefile(fname, len);
+	unsigned errors = 0;
+	uint32_t soa = 0;
+	int i, num;
+
+	parts = (struct zone_part*)region_alloc_array(region, jobs,
+		sizeof(*parts));
+	num = split_zonefile(region, text, *len, region_strdup(region,
+		dname_to_string(domain_dname(zone->apex), NULL)), parts, jobs);
+	VERBOSITY(1, (LOG_INFO, "zone %s parsed in %d parts", name, num));
+	fflush(stdout);
+	fflush(stderr);
+	for(i=0; i<num; i++) {
+		int sv[2];
+		if(socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1)
+			error("socketpair: %s", strerror(errno));
+		parts[i].pid = fork();
+		if(parts[i].pid == -1)
+			error("fork: %s", strerror(errno));
+		if(parts[i].pid == 0) {
+			int j;
+			close(sv[0]);
+			for(j=0; j<i; j++)
+				close(parts[j].fd);
+			parts[i].fd = sv[1];
+			part_worker(nsd, zone, fname, text, &parts[i], i==0);
+		}
+		close(sv[1]);
+		parts[i].fd = sv[0];
+	}
+	free(text);
+
+	/* the results, in order of the parts */
+	for(i=0; i<num; i++) {
+		struct part_result res;
+		if(block_read(NULL, parts[i].fd, &res, sizeof(res), -1) !=
+			(ssize_t)sizeof(res))
+			error("cannot read from worker for part %d", i);
+		part_recv(parts[i].fd, buf, res.size);
+		part_merge(region, names, buf, i, &errors, fname);
+		errors += res.errors;
+		*rrs += res.rrs;
+		soa += res.soa;
+	}
+
+	/* ask the parts for data next to the CNAMEs, and below DNAMEs */
+	buffer_clear(buf);
+	RBTREE_FOR(n, struct part_name*, names) {
+		buffer_reserve(buf, 1);
+		buffer_write_u8(buf, n->flags);
+		buffer_write_dname(buf, n->dname);
+	}
+	buffer_flip(buf);
+	for(i=0; i<num; i++)
+		part_send(parts[i].fd, buf);
+	for(i=0; i<num; i++) {
+		RBTREE_FOR(n, struct part_name*, names) {
+			uint8_t answer;
+			if(block_read(NULL, parts[i].fd, &answer,
+				sizeof(answer), -1) != (ssize_t)sizeof(answer))
+				error("cannot read from worker for part %d",
+					i);
+			if((answer&NAME_OTHER) && part_other(n->cname_part,
+				n->cname_multi, i)) {
+				part_error(&errors, fname, "CNAME and other "
+					"data at the same name", n->dname);
+				n->cname_part = -1; /* report once */
+			}
+			if((answer&NAME_BELOW) && n->dname_part != -1) {
+				part_error(&errors, fname, "DNAME has data "
+					"below it. This is not allowed "
+					"(rfc 2672)", n->dname);
+				n->dname_part = -1;
+			}
+		}
+	}
+	for(i=0; i<num; i++) {
+		int status;
+		close(parts[i].fd);
+		while(waitpid(parts[i].pid, &status, 0) == -1) {
+			if(errno != EINTR)
+				error("waitpid: %s", strerror(errno));
+		}
+		if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			log_msg(LOG_ERR, "worker for part %d failed", i);
+			errors++;
+		}
+	}
+
+	if(soa == 0) {
+		log_msg(LOG_ERR, "zone configured as '%s' has no SOA record.",
+			name);
+		errors++;
+	} else if(soa > 1) {
+		if(zone_is_slave(zone->opts)) {
+			log_msg(LOG_WARNING, "%s: this SOA record was already "
+				"encountered", fname);
+		} else {
+			log_msg(LOG_ERR, "%s: this SOA record was already "
+				"encountered", fname);
+			errors++;
+		}
+	}
+	region_destroy(region);
+	return errors;
+}
+
+/* count the RRs in the zone */
+static uint64_t
+count_rrs(struct nsd* nsd)
+{
+	domain_type* domain;
+	rrset_type* rrset;
+	uint64_t rrs = 0;
+	for(domain = nsd->db->domains->root; domain;
+		domain = domain_next(domain)) {
+		for(rrset = domain->rrsets; rrset; rrset = rrset->next)
+			rrs += rrset->rr_count;
+	}
+	return rrs;
+}
+
+static void
+check_zone(struct nsd* nsd, const char* name, const char* fname, int jobs,
+	int bench)
 {
 	const dname_type* dname;
 	zone_options_type* zo;
 	zone_type* zone;
 	unsigned errors;
+	struct stat st;
+	struct timespec start, end;
+	uint64_t rrs = 0;
+	size_t len = 0;
 
 	/* init*/
 	nsd->db = namedb_open("", nsd->options);
@@ -73,7 +680,30 @@ check_zone(struct nsd* nsd, const char* name, const char* fname)
 	zone = namedb_zone_create(nsd->db, dname, zo);
 
 	/* read the zone */
-	errors = zonec_read(name, fname, zone);
+	get_time(&start);
+	if(jobs > 1 && strcmp(fname, "-") != 0 && stat(fname, &st) == 0 &&
+		st.st_size >= PART_MIN_SIZE) {
+		errors = check_zone_parts(nsd, name, fname, zone, jobs,
+			&rrs, &len);
+	} else {
+		errors = zonec_read(name, fname, zone);
+		if(bench) {
+			rrs = count_rrs(nsd);
+			if(strcmp(fname, "-") != 0 && stat(fname, &st) == 0)
+				len = (size_t)st.st_size;
+		}
+	}
+	get_time(&end);
+	if(bench) {
+		double t = (end.tv_sec - start.tv_sec) +
+			(end.tv_nsec - start.tv_nsec)/1e9;
+		if(t <= 0)
+			t = 1e-9;
+		printf("zone %s: %llu RRs, %llu bytes in %.3f sec, "
+			"%.1f MB/s, %.0f RR/s\n", name,
+			(unsigned long long)rrs, (unsigned long long)len, t,
+			(double)len/(1024.*1024.)/t, (double)rrs/t);
+	}
 	if(errors > 0) {
 		printf("zone %s file %s has %u errors\n", name, fname, errors);
 		exit(1);
@@ -106,14 +736,25 @@ main(int argc, char *argv[])
 {
 	/* Scratch variables... */
 	int c;
+	int bench = 0;
+	int jobs = 1;
 	struct nsd nsd;
 	memset(&nsd, 0, sizeof(nsd));
 
 	log_init("nsd-checkzone");
 
 	/* Parse the command line... */
-	while ((c = getopt(argc, argv, "h")) != -1) {
+	while ((c = getopt(argc, argv, "bhj:")) != -1) {
 		switch (c) {
+		case 'b':
+			bench = 1;
+			break;
+		case 'j':
+			jobs = atoi(optarg);
+			if(jobs < 1) {
+				error("number of jobs must be positive");
+			}
+			break;
 		case 'h':
 			usage();
 			exit(0);
@@ -139,7 +780,7 @@ main(int argc, char *argv[])
 	if (verbosity == 0)
 		verbosity = nsd.options->verbosity;
 
-	check_zone(&nsd, argv[0], argv[1]);
+	check_zone(&nsd, argv[0], argv[1], jobs, bench);
 	region_destroy(nsd.options->region);
 	/* yylex_destroy(); but, not available in all versions of flex */
 
@@ -38,7 +38,8 @@
  *
  * The remote control utility contacts the nsd server over ssl and
  * sends the command, receives the answer, and displays the result
- * from the commandline.
+ * from the commandline.  If the control-interface is a local unix
+ * socket, it connects to that, without ssl.
  */
 
 #include "config.h"
@@ -47,6 +48,9 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <string.h>
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
 #ifdef HAVE_OPENSSL_SSL_H
 #include <openssl/ssl.h>
 #endif
@@ -60,6 +64,22 @@
 #include "tsig.h"
 #include "options.h"
 
+/** the connection to the server, ssl is NULL for a local socket */
+struct remote_conn {
+	/** the ssl stream, or NULL */
+	SSL* ssl;
+	/** the file descriptor */
+	int fd;
+};
+
+/** buffer for reading lines from the server */
+struct read_buf {
+	/** the data */
+	char data[4096];
+	/** position of the unread data and the length of the data */
+	size_t pos, len;
+};
+
 /** Give nsd-control usage, and exit (1). */
 static void
 usage()
@@ -71,6 +91,7 @@ usage()
 	printf("Options:\n");
 	printf("  -c file	config file, default is %s\n", CONFIGFILE);
 	printf("  -s ip[@port]	server address, if omitted config is used.\n");
+	printf("		a path is the local socket of the server.\n");
 	printf("  -h		show this usage help.\n");
 	printf("Commands:\n");
 	printf("  start				start server; runs nsd(8)\n");
@@ -80,8 +101,10 @@ usage()
 	printf("  repattern			the same as reconfig\n");
 	printf("  log_reopen			reopen logfile (for log rotate)\n");
 	printf("  status			display status of server\n");
-	printf("  stats				print statistics\n");
-	printf("  stats_noreset			peek at statistics\n");
+	printf("  stats [name=<glob>]		print statistics\n");
+	printf("  stats_noreset [name=<glob>]	peek at statistics\n");
+	printf("  memory [<zone>]		print memory use per structure and zone\n");
+	printf("  reloadstats			print the time spent in the reload phases\n");
 	printf("  addzone <name> <pattern>	add a new zone\n");
 	printf("  delzone <name>		remove a zone\n");
 	printf("  addzones			add zone list on stdin {name space pattern newline}\n");
@@ -91,7 +114,11 @@ usage()
 	printf("  transfer [<zone>]		try to update slave zones to newer serial\n");
 	printf("  force_transfer [<zone>]	update slave zones with AXFR, no serial check\n");
 	printf("  zonestatus [<zone>]		print state, serial, activity\n");
+	printf("  zonestatus [pattern=<name>] [state=<state>] [name=<glob>]\n");
+	printf("				print the zones that match\n");
 	printf("  serverpid			get pid of server process\n");
+	printf("  session			perform the commands on stdin, one per line,\n");
+	printf("				over one connection\n");
 	printf("  verbosity <number>		change logging detail\n");
 	exit(1);
 }
@@ -142,6 +169,52 @@ setup_ctx(struct nsd_options* cfg)
 	return ctx;
 }
 
+/** contact the server on its local socket */
+static int
+contact_local(const char* svr, int statuscmd)
+{
+#ifdef HAVE_SYS_UN_H
+	struct sockaddr_un usock;
+	int fd;
+	if(strlen(svr) >= sizeof(usock.sun_path)) {
+		fprintf(stderr, "path too long: %s\n", svr);
+		exit(1);
+	}
+	memset(&usock, 0, sizeof(usock));
+	usock.sun_family = AF_UNIX;
+	strlcpy(usock.sun_path, svr, sizeof(usock.sun_path));
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1) {
+		fprintf(stderr, "socket: %s\n", strerror(errno));
+		exit(1);
+	}
+	if(connect(fd, (struct sockaddr*)&usock, (socklen_t)sizeof(usock))
+		< 0) {
+		fprintf(stderr, "error: connect (%s): %s\n", svr,
+			strerror(errno));
+		if((errno == ECONNREFUSED || errno == ENOENT) && statuscmd) {
+			printf("nsd is stopped\n");
+			exit(3);
+		}
+		exit(1);
+	}
+	return fd;
+#else
+	(void)statuscmd;
+	fprintf(stderr, "error: no local sockets on this system, %s\n", svr);
+	exit(1);
+#endif /* HAVE_SYS_UN_H */
+}
+
+/** see if the server to contact is a local socket */
+static int
+server_is_local(const char* svr, struct nsd_options* cfg)
+{
+	if(!svr && cfg->control_interface)
+		svr = cfg->control_interface->address;
+	return svr && svr[0] == '/';
+}
+
 /** contact the server with TCP connect */
 static int
 contact_server(const char* svr, struct nsd_options* cfg, int statuscmd)
@@ -172,6 +245,8 @@ contact_server(const char* svr, struct nsd_options* cfg, int statuscmd)
 			strcmp(svr, "::") == 0)
 			svr = "::1";
 	}
+	if(svr[0] == '/')
+		return contact_local(svr, statuscmd);
 	if(strchr(svr, '@')) {
 		char* ps = strchr(svr, '@');
 		*ps++ = 0;
@@ -257,57 +332,119 @@ setup_ssl(SSL_CTX* ctx, int fd)
 	return ssl;
 }
 
+/** write to the server, exit on failure */
+static void
+remote_write(struct remote_conn* c, const void* buf, size_t len)
+{
+	if(!c->ssl) {
+		size_t at = 0;
+		while(at < len) {
+			ssize_t w = write(c->fd, (const char*)buf+at, len-at);
+			if(w == -1) {
+				if(errno == EINTR)
+					continue;
+				fprintf(stderr, "error: could not write: %s\n",
+					strerror(errno));
+				exit(1);
+			}
+			at += w;
+		}
+		return;
+	}
+	if(SSL_write(c->ssl, buf, (int)len) <= 0)
+		ssl_err("could not SSL_write");
+}
+
+/** read from the server, returns 0 on EOF, exits on failure */
+static size_t
+remote_read(struct remote_conn* c, char* buf, size_t len)
+{
+	int r;
+	if(!c->ssl) {
+		ssize_t n;
+		while((n = read(c->fd, buf, len)) == -1) {
+			if(errno == EINTR)
+				continue;
+			fprintf(stderr, "error: could not read: %s\n",
+				strerror(errno));
+			exit(1);
+		}
+		return (size_t)n;
+	}
+	ERR_clear_error();
+	if((r = SSL_read(c->ssl, buf, (int)len)) <= 0) {
+		if(SSL_get_error(c->ssl, r) == SSL_ERROR_ZERO_RETURN) {
+			/* EOF */
+			return 0;
+		}
+		ssl_err("could not SSL_read");
+	}
+	return (size_t)r;
+}
+
+/** read a line from the server, without the newline, false on EOF */
+static int
+remote_read_line(struct remote_conn* c, struct read_buf* rb, char* line,
+	size_t max)
+{
+	size_t len = 0;
+	while(len+1 < max) {
+		if(rb->pos == rb->len) {
+			rb->pos = 0;
+			rb->len = remote_read(c, rb->data, sizeof(rb->data));
+			if(rb->len == 0) {
+				line[len] = 0;
+				return (len != 0);
+			}
+		}
+		if(rb->data[rb->pos] == '\n') {
+			rb->pos++;
+			break;
+		}
+		line[len++] = rb->data[rb->pos++];
+	}
+	line[len] = 0;
+	return 1;
+}
+
 /** send stdin to server */
 static void
-send_file(SSL* ssl, FILE* in, char* buf, size_t sz)
+send_file(struct remote_conn* c, FILE* in, char* buf, size_t sz)
 {
 	char e[] = {0x04, 0x0a};
 	while(fgets(buf, (int)sz, in)) {
-		if(SSL_write(ssl, buf, (int)strlen(buf)) <= 0)
-			ssl_err("could not SSL_write contents");
+		remote_write(c, buf, strlen(buf));
 	}
 	/* send end-of-file marker */
-	if(SSL_write(ssl, e, (int)sizeof(e)) <= 0)
-		ssl_err("could not SSL_write end-of-file marker");
+	remote_write(c, e, sizeof(e));
 }
 
 /** send command and display result */
 static int
-go_cmd(SSL* ssl, int argc, char* argv[])
+go_cmd(struct remote_conn* c, int argc, char* argv[])
 {
 	char pre[10];
 	const char* space=" ";
 	const char* newline="\n";
 	int was_error = 0, first_line = 1;
-	int r, i;
+	int i;
+	size_t r;
 	char buf[1024];
 	snprintf(pre, sizeof(pre), "NSDCT%d ", NSD_CONTROL_VERSION);
-	if(SSL_write(ssl, pre, (int)strlen(pre)) <= 0)
-		ssl_err("could not SSL_write");
+	remote_write(c, pre, strlen(pre));
 	for(i=0; i<argc; i++) {
-		if(SSL_write(ssl, space, (int)strlen(space)) <= 0)
-			ssl_err("could not SSL_write");
-		if(SSL_write(ssl, argv[i], (int)strlen(argv[i])) <= 0)
-			ssl_err("could not SSL_write");
+		remote_write(c, space, strlen(space));
+		remote_write(c, argv[i], strlen(argv[i]));
 	}
-	if(SSL_write(ssl, newline, (int)strlen(newline)) <= 0)
-		ssl_err("could not SSL_write");
+	remote_write(c, newline, strlen(newline));
 
 	/* send contents to server */
 	if(argc == 1 && (strcmp(argv[0], "addzones") == 0 ||
 		strcmp(argv[0], "delzones") == 0)) {
-		send_file(ssl, stdin, buf, sizeof(buf));
+		send_file(c, stdin, buf, sizeof(buf));
 	}
 
-	while(1) {
-		ERR_clear_error();
-		if((r = SSL_read(ssl, buf, (int)sizeof(buf)-1)) <= 0) {
-			if(SSL_get_error(ssl, r) == SSL_ERROR_ZERO_RETURN) {
-				/* EOF */
-				break;
-			}
-			ssl_err("could not SSL_read");
-		}
+	while((r = remote_read(c, buf, sizeof(buf)-1)) != 0) {
 		buf[r] = 0;
 		printf("%s", buf);
 		if(first_line && strncmp(buf, "error", 5) == 0)
@@ -317,14 +454,93 @@ go_cmd(SSL* ssl, int argc, char* argv[])
 	return was_error;
 }
 
+/** see if the line is the end marker, a line with the end-of-transmission
+ * character */
+static int
+is_end_marker(const char* line)
+{
+	return line[0] == 0x04 && (line[1] == 0 || line[1] == '\n');
+}
+
+/** read the result of a session command, print it with the end marker */
+static int
+read_session_result(struct remote_conn* c, struct read_buf* rb,
+	int* was_error)
+{
+	char line[1100];
+	int first_line = 1;
+	while(remote_read_line(c, rb, line, sizeof(line))) {
+		if(is_end_marker(line)) {
+			printf("%s\n", line);
+			fflush(stdout);
+			return 1;
+		}
+		printf("%s\n", line);
+		if(first_line && strncmp(line, "error", 5) == 0)
+			*was_error = 1;
+		first_line = 0;
+	}
+	return 0;
+}
+
+/** perform the commands from stdin in a session, display the results,
+ * every result ends with the end marker line */
+static int
+go_session(struct remote_conn* c)
+{
+	char pre[10];
+	char buf[1024];
+	struct read_buf rb;
+	int was_error = 0;
+	rb.pos = 0;
+	rb.len = 0;
+	snprintf(pre, sizeof(pre), "NSDCT%d ", NSD_CONTROL_VERSION);
+	remote_write(c, pre, strlen(pre));
+	remote_write(c, "session\n", 8);
+	/* the server acknowledges the session */
+	if(!remote_read_line(c, &rb, buf, sizeof(buf)) ||
+		strcmp(buf, "ok") != 0) {
+		fprintf(stderr, "%s\n", buf);
+		return 1;
+	}
+	if(!remote_read_line(c, &rb, buf, sizeof(buf)) || !is_end_marker(buf)) {
+		fprintf(stderr, "error: bad session start from server\n");
+		return 1;
+	}
+
+	while(fgets(buf, (int)sizeof(buf), stdin)) {
+		char* p = buf;
+		if(strchr(buf, '\n') == NULL)
+			strlcat(buf, "\n", sizeof(buf));
+		remote_write(c, buf, strlen(buf));
+		while(*p == ' ' || *p == '\t')
+			p++;
+		/* the zones for addzones and delzones follow on stdin,
+		 * up to the end marker line */
+		if(strncmp(p, "addzones", 8) == 0 ||
+			strncmp(p, "delzones", 8) == 0) {
+			while(fgets(buf, (int)sizeof(buf), stdin)) {
+				remote_write(c, buf, strlen(buf));
+				if(is_end_marker(buf))
+					break;
+			}
+		}
+		if(!read_session_result(c, &rb, &was_error)) {
+			fprintf(stderr, "error: connection closed\n");
+			return 1;
+		}
+	}
+	return was_error;
+}
+
 /** go ahead and read config, contact server and perform command and display */
 static int
 go(const char* cfgfile, char* svr, int argc, char* argv[])
 {
 	struct nsd_options* opt;
-	int fd, ret;
-	SSL_CTX* ctx;
-	SSL* ssl;
+	int fd, ret, local;
+	SSL_CTX* ctx = NULL;
+	struct remote_conn c;
 
 	/* read config */
 	if(!(opt = nsd_options_create(region_create(xalloc, free)))) {
@@ -338,18 +554,28 @@ go(const char* cfgfile, char* svr, int argc, char* argv[])
 	}
 	if(!opt->control_enable)
 		fprintf(stderr, "warning: control-enable is 'no' in the config file.\n");
-	ctx = setup_ctx(opt);
+	local = server_is_local(svr, opt);
+	if(!local)
+		ctx = setup_ctx(opt);
 
 	/* contact server */
 	fd = contact_server(svr, opt, argc>0&&strcmp(argv[0],"status")==0);
-	ssl = setup_ssl(ctx, fd);
+	c.fd = fd;
+	c.ssl = local?NULL:setup_ssl(ctx, fd);
 
 	/* send command */
-	ret = go_cmd(ssl, argc, argv);
+	if(argc == 1 && strcmp(argv[0], "session") == 0)
+		ret = go_session(&c);
+	else	ret = go_cmd(&c, argc, argv);
 
-	SSL_free(ssl);
+	if(c.ssl) {
+		/* a session is closed by the client, with a close notify */
+		(void)SSL_shutdown(c.ssl);
+		SSL_free(c.ssl);
+	}
 	close(fd);
-	SSL_CTX_free(ctx);
+	if(ctx)
+		SSL_CTX_free(ctx);
 	region_destroy(opt->region);
 	return ret;
 }
@@ -24,6 +24,8 @@
 #include "udb.h"
 #include "udbzone.h"
 #include "util.h"
+#include "xfrd.h"
+#include "xfrd-notify.h"
 
 static void error(const char *format, ...) ATTR_FORMAT(printf, 1, 2);
 struct nsd nsd;
@@ -60,6 +62,8 @@ struct zone_mem {
 	size_t data;
 	/* unused space (in db.region) due to alignment */
 	size_t data_unused;
+	/* free space (in db.region) in the recycle bin */
+	size_t data_recycle;
 	/* udb data allocated */
 	size_t udb_data;
 	/* udb overhead (chunk2**x - data) */
@@ -67,6 +71,10 @@ struct zone_mem {
 
 	/* count of number of domains */
 	size_t domaincount;
+	/* the structures of the zone */
+	struct namedb_mem structs;
+	/* radix tree nodes for the domain names */
+	struct mem_use nametree;
 };
 
 /* total memory structure */
@@ -75,6 +83,8 @@ struct tot_mem {
 	size_t data;
 	/* unused space (in db.region) due to alignment */
 	size_t data_unused;
+	/* free space (in db.region) in the recycle bin */
+	size_t data_recycle;
 	/* udb data allocated */
 	size_t udb_data;
 	/* udb overhead (chunk2**x - data) */
@@ -82,11 +92,20 @@ struct tot_mem {
 
 	/* count of number of domains */
 	size_t domaincount;
+	/* the structures of all zones */
+	struct namedb_mem structs;
+	/* radix tree nodes for the domain names */
+	struct mem_use nametree;
 
 	/* options data */
 	size_t opt_data;
 	/* unused in options region */
 	size_t opt_unused;
+	/* number of zones and secondary zones */
+	size_t zonecount;
+	size_t slavecount;
+	/* xfrd per zone state (notify and for secondaries transfer state) */
+	size_t xfrd;
 	/* dname compression table */
 	size_t compresstable;
 #ifdef RATELIMIT
@@ -101,10 +120,16 @@ struct tot_mem {
 };
 
 static void
-account_zone(struct namedb* db, struct zone_mem* zmem)
+account_zone(struct namedb* db, zone_type* zone, struct zone_mem* zmem)
 {
 	zmem->data = region_get_mem(db->region);
 	zmem->data_unused = region_get_mem_unused(db->region);
+	zmem->data_recycle = region_get_recycle_size(db->region);
+	namedb_mem_zone(&zmem->structs, zone);
+#ifdef USE_RADIX_TREE
+	zmem->nametree.bytes = radix_tree_mem(db->domains->nametree,
+		&zmem->nametree.count);
+#endif
 	if(db->udb) {
 		zmem->udb_data = (size_t)db->udb->alloc->disk->stat_data;
 		zmem->udb_overhead = (size_t)(db->udb->alloc->disk->stat_alloc -
@@ -129,11 +154,34 @@ pretty_mem(size_t x, const char* s)
 		buf[9], buf[10], buf[11], s);
 }
 
+static void
+pretty_use(struct mem_use* u, const char* s)
+{
+	char buf[80];
+	snprintf(buf, sizeof(buf), "%s (%lu)", s, (unsigned long)u->count);
+	pretty_mem(u->bytes, buf);
+}
+
+static void
+print_structs(struct namedb_mem* m, struct mem_use* nametree)
+{
+	pretty_use(&m->zone, "  zone structures");
+	pretty_use(&m->domain, "  domains");
+	pretty_use(nametree, "  name tree nodes");
+	pretty_use(&m->nsec3, "  nsec3 precompile");
+	pretty_use(&m->rrset, "  rrsets");
+	pretty_use(&m->rr, "  rrs");
+	pretty_use(&m->rdata, "  rdata atoms");
+	pretty_use(&m->rdata_data, "  rdata data");
+}
+
 static void
 print_zone_mem(struct zone_mem* z)
 {
 	pretty_mem(z->data, "zone data");
+	print_structs(&z->structs, &z->nametree);
 	pretty_mem(z->data_unused, "zone unused space (due to alignment)");
+	pretty_mem(z->data_recycle, "zone free space in recycle bin");
 	pretty_mem(z->udb_data, "data in nsd.db");
 	pretty_mem(z->udb_overhead, "overhead in nsd.db");
 }
@@ -141,8 +189,21 @@ print_zone_mem(struct zone_mem* z)
 static void
 account_total(struct nsd_options* opt, struct tot_mem* t)
 {
+	struct zone_options* zo;
 	t->opt_data = region_get_mem(opt->region);
 	t->opt_unused = region_get_mem_unused(opt->region);
+	t->zonecount = opt->zone_options->count;
+	RBTREE_FOR(zo, struct zone_options*, opt->zone_options) {
+		if(zone_is_slave(zo))
+			t->slavecount++;
+	}
+	/* every zone has notify state, secondaries have transfer state,
+	 * the tsig state for a transfer is only allocated while it runs.
+	 * The SOA names are interned and shared, and not counted.  This is
+	 * computed from the struct sizes, make bench-zonemem measures it */
+	t->xfrd = t->zonecount * (sizeof(struct notify_zone) +
+		sizeof(struct xfrd_soa)) + t->slavecount *
+		sizeof(struct xfrd_zone);
 	t->compresstable = sizeof(uint16_t) *
 		(t->domaincount + 1 + EXTRA_DOMAIN_NUMBERS);
 	t->compresstable *= opt->server_count;
@@ -154,7 +215,7 @@ account_total(struct nsd_options* opt, struct tot_mem* t)
 #endif
 
 	t->ram = t->data + t->data_unused + t->opt_data + t->opt_unused +
-		t->compresstable;
+		t->compresstable + t->xfrd;
 #ifdef RATELIMIT
 	t->ram += t->rrl;
 #endif
@@ -166,15 +227,25 @@ print_tot_mem(struct tot_mem* t)
 {
 	printf("\ntotal\n");
 	pretty_mem(t->data, "data");
+	print_structs(&t->structs, &t->nametree);
 	pretty_mem(t->data_unused, "unused space (due to alignment)");
+	pretty_mem(t->data_recycle, "free space in recycle bin");
 	pretty_mem(t->opt_data, "options");
 	pretty_mem(t->opt_unused, "options unused space (due to alignment)");
+	pretty_mem(t->xfrd, "xfrd zone state");
 	pretty_mem(t->compresstable, "name table (depends on servercount)");
 #ifdef RATELIMIT
 	pretty_mem(t->rrl, "RRL table (depends on servercount)");
 #endif
 	pretty_mem(t->udb_data, "data in nsd.db");
 	pretty_mem(t->udb_overhead, "overhead in nsd.db");
+	if(t->zonecount != 0) {
+		printf("\nper zone overhead (%u zones, %u secondary)\n",
+			(unsigned)t->zonecount, (unsigned)t->slavecount);
+		pretty_mem((t->opt_data+t->opt_unused)/t->zonecount,
+			"options per zone");
+		pretty_mem(t->xfrd/t->zonecount, "xfrd state per zone");
+	}
 	printf("\nsummary\n");
 
 	pretty_mem(t->ram, "ram usage (excl space for buffers)");
@@ -186,6 +257,10 @@ add_mem(struct tot_mem* t, struct zone_mem* z)
 {
 	t->data += z->data;
 	t->data_unused += z->data_unused;
+	t->data_recycle += z->data_recycle;
+	namedb_mem_add(&t->structs, &z->structs);
+	t->nametree.count += z->nametree.count;
+	t->nametree.bytes += z->nametree.bytes;
 	t->udb_data += z->udb_data;
 	t->udb_overhead += z->udb_overhead;
 	t->domaincount += z->domaincount;
@@ -218,7 +293,7 @@ check_zone_mem(const char* tf, const char* df, struct zone_options* zo,
 	namedb_read_zonefile(&nsd, zone, taskudb, &last_task);
 
 	/* account the memory for this zone */
-	account_zone(db, &zmem);
+	account_zone(db, zone, &zmem);
 
 	/* pretty print the memory for this zone */
 	print_zone_mem(&zmem);
@@ -620,6 +620,13 @@ main(int argc, char *argv[])
 		error("could not read zonelist file %s\n",
 			nsd.options->zonelistfile);
 	}
+	/* store the parsed zonelist for the next start */
+	zone_list_write_snapshot(nsd.options);
+	if(nsd.options->proxy_protocol_port &&
+		!nsd.options->proxy_protocol_allow) {
+		error("proxy-protocol-port needs proxy-protocol-allow for the "
+			"proxies to trust");
+	}
 	if(nsd.options->do_ip4 && !nsd.options->do_ip6) {
 		hints[0].ai_family = AF_INET;
 	}
@@ -967,6 +974,12 @@ main(int argc, char *argv[])
 		if(!(nsd.rc = daemon_remote_create(nsd.options)))
 			error("could not perform remote control setup");
 	}
+	if(nsd.options->tls_service_key && nsd.options->tls_service_key[0]) {
+		/* read the tls-port keys while superuser, outside chroot */
+		if(!(nsd.tls_ctx = server_tls_ctx_create(&nsd)))
+			error("could not set up tls-service-key %s",
+				nsd.options->tls_service_key);
+	}
 #endif /* HAVE_SSL */
 
 	/* Unless we're debugging, fork... */
@@ -1124,6 +1137,8 @@ main(int argc, char *argv[])
 #endif /* USE_ZONE_STATS */
 
 	if(nsd.server_kind == NSD_SERVER_MAIN) {
+		/* the other processes queue their log messages for main */
+		log_queue_init();
 		server_prepare_xfrd(&nsd);
 		/* xfrd forks this before reading database, so it does not get
 		 * the memory size of the database */
@@ -90,14 +90,52 @@ typedef	unsigned long stc_type;
 #endif /* BIND8_STATS */
 
 #ifdef USE_ZONE_STATS
+/* The zonestat arrays have for every zonestat id an entry per child, so
+ * the children do not write to the same counters and cache lines.  The
+ * entries are padded to the cache line size, the totals are summed when
+ * they are printed. */
+#define ZONESTAT_CACHELINE 64
+#define ZONESTAT_ENTRY_SIZE ((sizeof(struct nsdst)+ZONESTAT_CACHELINE-1) \
+	/ ZONESTAT_CACHELINE * ZONESTAT_CACHELINE)
+/* the entry of a child for a zonestat id in the zonestat array */
+#define ZONESTAT_ENTRY(nsd, arr, id, child) ((struct nsdst*)((char*)(arr) \
+	+ ((size_t)(id)*(nsd)->zonestatnumchild + (child)) * \
+	ZONESTAT_ENTRY_SIZE))
+/* size in bytes of a zonestat array with num zonestat ids */
+#define ZONESTAT_SIZE(nsd, num) ((size_t)(num)*(nsd)->zonestatnumchild* \
+	ZONESTAT_ENTRY_SIZE)
+/* the entry of this child for the zone */
+#define ZONESTAT_CHILD(nsd, zone) ZONESTAT_ENTRY((nsd), (nsd)->zonestatnow, \
+	(zone)->zonestatid, (nsd)->this_child->child_num)
+/* Every entry has a mark byte, set by the child before it first writes
+ * the entry.  The sums read only the marked entries, so the pages of idle
+ * entries are not touched and stay unallocated in the sparse files.
+ * Entries past the end of the marks are always read. */
+#define ZONESTAT_MARK_MAX ((size_t)1<<24)
+#define ZONESTAT_INDEX(nsd, id, child) \
+	((size_t)(id)*(nsd)->zonestatnumchild + (child))
+#define ZONESTAT_CHILD_INDEX(nsd, zone) ZONESTAT_INDEX((nsd), \
+	(zone)->zonestatid, (nsd)->this_child->child_num)
+/* if the entry of the child in zonestat array idx can have counts */
+#define ZONESTAT_WRITTEN(nsd, idx, id, child) (!(nsd)->zonestatmark[idx] \
+	|| ZONESTAT_INDEX((nsd), (id), (child)) >= ZONESTAT_MARK_MAX \
+	|| (nsd)->zonestatmark[idx][ZONESTAT_INDEX((nsd), (id), (child))])
+/* mark the entry of this child for the zone, the mark is read first, so
+ * that the shared page is only written once */
+#define ZONESTAT_MARK(nsd, zone) ( \
+	((nsd)->zonestatmarknow && \
+	ZONESTAT_CHILD_INDEX(nsd, zone) < ZONESTAT_MARK_MAX && \
+	!(nsd)->zonestatmarknow[ZONESTAT_CHILD_INDEX(nsd, zone)]) ? \
+		((nsd)->zonestatmarknow[ZONESTAT_CHILD_INDEX(nsd, zone)] = 1) \
+		: 0)
 /* increment zone statistic, checks if zone-nonNULL and zone array bounds */
 #define ZTATUP(nsd, zone, stc) ( \
 	(zone && zone->zonestatid < nsd->zonestatsizenow) ? \
-		nsd->zonestatnow[zone->zonestatid].stc++ \
+		(ZONESTAT_MARK(nsd, zone), ZONESTAT_CHILD(nsd, zone)->stc++) \
 		: 0)
 #define	ZTATUP2(nsd, zone, stc, i) ( \
 	(zone && zone->zonestatid < nsd->zonestatsizenow) ? \
-		(nsd->zonestatnow[zone->zonestatid].stc[(i) <= (LASTELEM(nsd->zonestatnow[zone->zonestatid].stc) - 1) ? i : LASTELEM(nsd->zonestatnow[zone->zonestatid].stc)]++ ) \
+		(ZONESTAT_MARK(nsd, zone), ZONESTAT_CHILD(nsd, zone)->stc[(i) <= (LASTELEM(ZONESTAT_CHILD(nsd, zone)->stc) - 1) ? i : LASTELEM(ZONESTAT_CHILD(nsd, zone)->stc)]++ ) \
 		: 0)
 #else /* USE_ZONE_STATS */
 #define	ZTATUP(nsd, zone, stc) /* Nothing */
@@ -150,6 +188,39 @@ struct nsd_child
 #endif
 };
 
+/* phases of a reload that are timed */
+enum reload_phase {
+	reload_phase_fork = 0,	/* fork of the reload from server_main */
+	reload_phase_tasks,	/* reload_process_tasks, zone reads, xfrs */
+	reload_phase_compact,	/* udb_compact */
+	reload_phase_sync,	/* udb_base_sync */
+	reload_phase_compression, /* initialize_dname_compression_tables */
+	reload_phase_children,	/* server_start_children */
+	reload_phase_quitsync,	/* QUIT_SYNC handshake with the old main */
+	reload_phase_stats,	/* reload_do_stats */
+	reload_phase_total,	/* from before the fork until done */
+	RELOAD_PHASES
+};
+
+/* duration of the phases of a reload in usec, and what it applied */
+struct reload_timing {
+	uint64_t phase[RELOAD_PHASES];
+	/* zones read from zonefile or changed by transfer */
+	uint64_t zones;
+	/* RRs read from zonefiles and in the transfers */
+	uint64_t rrs;
+};
+
+/* histogram buckets for the reload phases, bucket i counts the durations
+ * below 2^i msec, the last bucket also the longer ones */
+#define RELOAD_HIST_BUCKETS 18
+/* reload timing of all reloads since start, kept by xfrd */
+struct reload_stats {
+	uint64_t count;
+	struct reload_timing last, sum, max;
+	uint64_t hist[RELOAD_PHASES][RELOAD_HIST_BUCKETS];
+};
+
 /* NSD configuration and run-time variables */
 typedef struct nsd nsd_type;
 struct	nsd
@@ -186,7 +257,16 @@ struct	nsd
 	struct udb_base* task[2];
 	int mytask; /* the base used by this process */
 	struct netio_handler* xfrd_listener;
+	/* datagram socket to pass NOTIFY batches to xfrd, write end in
+	 * main and the server processes, read end in xfrd, or -1 */
+	int xfrd_notify_fd;
+	/* NOTIFYs queued in a server process for xfrd */
+	struct notify_batch* notify_batch;
 	struct daemon_remote* rc;
+#ifdef HAVE_SSL
+	/* SSL_CTX for the DNS over TLS service, or NULL */
+	void* tls_ctx;
+#endif
 
 	/* Configuration */
 	const char		*dbfile;
@@ -237,10 +317,16 @@ struct	nsd
 		stc_type qclass[4];	/* Class IN or Class CH or other */
 		stc_type qudp, qudp6;	/* Number of queries udp and udp6 */
 		stc_type ctcp, ctcp6;	/* Number of tcp and tcp6 connections */
+		stc_type ctls, ctls6;	/* Of those, over tls and tls6 */
 		stc_type rcode[17], opcode[6]; /* Rcodes & opcodes */
 		/* Dropped, truncated, queries for nonconfigured zone, tx errors */
 		stc_type dropped, truncated, wrongzone, txerr, rxerr;
 		stc_type edns, ednserr, raxfr, nona;
+		/* adaptive-udp-size: retries over UDP after a large answer
+		 * and over TCP after a truncated one, caps set and lifted,
+		 * answers truncated while capped */
+		stc_type udpsize_udp_retry, udpsize_tcp_retry;
+		stc_type udpsize_lowered, udpsize_raised, udpsize_truncated;
 		uint64_t db_disk, db_mem;
 	} st;
 	/* per zone stats, each an array per zone-stat-idx, stats per zone is
@@ -255,7 +341,17 @@ struct	nsd
 	size_t zonestatsize[2], zonestatdesired, zonestatsizenow;
 	/* current zonestat array to use */
 	struct nsdst* zonestatnow;
+	/* number of children in the zonestat arrays, entries per id */
+	size_t zonestatnumchild;
+	/* marks of the written entries of the zonestat arrays, shared,
+	 * NULL if not available, and the marks of the current array */
+	uint8_t* zonestatmark[2];
+	uint8_t* zonestatmarknow;
 #endif /* BIND8_STATS */
+	/* timing of the reload, collected by the reload process */
+	struct reload_timing reload_timing;
+	/* the zone files that forked workers are writing, NULL if none */
+	struct zonefile_writes* zonefile_writes;
 	/* ratelimit for errors, time value */
 	time_t err_limit_time;
 	/* ratelimit for errors, packet count */
@@ -280,6 +376,10 @@ void server_main(struct nsd *nsd);
 void server_child(struct nsd *nsd);
 void server_shutdown(struct nsd *nsd);
 void server_close_all_sockets(struct nsd_socket sockets[], size_t n);
+#ifdef HAVE_SSL
+/* setup the SSL_CTX for the tls-port, NULL on failure */
+void* server_tls_ctx_create(struct nsd *nsd);
+#endif
 struct event_base* nsd_child_event_base(void);
 /* extra domain numbers for temporary domains */
 #define EXTRA_DOMAIN_NUMBERS 1024
@@ -10,11 +10,18 @@
 #include <string.h>
 #include <stdio.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 #include "options.h"
 #include "query.h"
 #include "tsig.h"
 #include "difffile.h"
 #include "rrl.h"
+#include "lookup3.h"
 
 #include "configyyrename.h"
 #include "configparser.h"
@@ -97,10 +104,21 @@ nsd_options_create(region_type* region)
 #  endif
 #endif
 	opt->zonefiles_check = 1;
+	opt->zonefiles_watch = 0;
 	if(opt->database == NULL || opt->database[0] == 0)
 		opt->zonefiles_write = ZONEFILES_WRITE_INTERVAL;
 	else	opt->zonefiles_write = 0;
+	opt->zonefiles_write_workers = ZONEFILES_WRITE_WORKERS;
 	opt->xfrd_reload_timeout = 1;
+	opt->xfrd_ixfr_cost = 1;
+	opt->tls_service_key = NULL;
+	opt->tls_service_pem = NULL;
+	opt->tls_port = TLS_PORT;
+	opt->tls_ticket_rotate = 3600;
+	opt->tls_ktls = 0;
+	opt->proxy_protocol_port = NULL;
+	opt->proxy_protocol_allow = NULL;
+	opt->adaptive_udp_size = 0;
 	opt->control_enable = 0;
 	opt->control_interface = NULL;
 	opt->control_port = NSD_CONTROL_PORT;
@@ -297,6 +315,8 @@ void options_zonestatnames_create(struct nsd_options* opt)
 }
 
 #define ZONELIST_HEADER "# NSD zone list\n# name pattern\n"
+static int zone_list_snapshot_read(struct nsd_options* opt);
+
 static int
 comp_zonebucket(const void* a, const void* b)
 {
@@ -370,6 +390,8 @@ parse_zone_list_file(struct nsd_options* opt)
 	opt->zonelist = NULL;
 	opt->zonefree_number = 0;
 	opt->zonelist_off = 0;
+	opt->zonelist_snapshot_current = 0;
+	opt->zonelist_batch = 0;
 
 	/* try to open the zonelist file, an empty or nonexist file is OK */
 	opt->zonelist = fopen(opt->zonelistfile, "r+");
@@ -391,6 +413,19 @@ parse_zone_list_file(struct nsd_options* opt)
 		return 0;
 	}
 
+	/* if the binary snapshot matches the file, load that and skip the
+	 * text parse of every line */
+	if(zone_list_snapshot_read(opt))
+		return 1;
+	if(fseeko(opt->zonelist, (off_t)strlen(ZONELIST_HEADER), SEEK_SET)
+		== -1) {
+		log_msg(LOG_ERR, "fseeko(%s): %s", opt->zonelistfile,
+			strerror(errno));
+		fclose(opt->zonelist);
+		opt->zonelist = NULL;
+		return 0;
+	}
+
 	/* read entries in file */
 	while(fgets(buf, sizeof(buf), opt->zonelist)) {
 		/* skip comments and empty lines */
@@ -443,6 +478,17 @@ zone_options_delete(struct nsd_options* opt, struct zone_options* zone)
 	region_recycle(opt->region, zone, sizeof(*zone));
 }
 
+/* flush the zonelist file, unless a batch of changes is in progress */
+static void
+zone_list_flush(struct nsd_options* opt)
+{
+	if(opt->zonelist_batch)
+		return;
+	if(fflush(opt->zonelist) != 0) {
+		log_msg(LOG_ERR, "fflush %s: %s", opt->zonelistfile, strerror(errno));
+	}
+}
+
 /* add a new zone to the zonelist */
 struct zone_options*
 zone_list_add(struct nsd_options* opt, const char* zname, const char* pname)
@@ -456,6 +502,7 @@ zone_list_add(struct nsd_options* opt, const char* zname, const char* pname)
 		linesize, 0);
 	if(!zone)
 		return NULL;
+	opt->zonelist_snapshot_current = 0;
 
 	/* use free entry or append to file or create new file */
 	if(!opt->zonelist || opt->zonelist_off == 0) {
@@ -497,9 +544,7 @@ zone_list_add(struct nsd_options* opt, const char* zname, const char* pname)
 		opt->zonelist_off = ftello(opt->zonelist);
 		if(opt->zonelist_off == -1)
 			log_msg(LOG_ERR, "ftello(%s): %s", opt->zonelistfile, strerror(errno));
-		if(fflush(opt->zonelist) != 0) {
-			log_msg(LOG_ERR, "fflush %s: %s", opt->zonelistfile, strerror(errno));
-		}
+		zone_list_flush(opt);
 		return zone;
 	}
 	b = (struct zonelist_bucket*)rbtree_search(opt->zonefree,
@@ -525,9 +570,7 @@ zone_list_add(struct nsd_options* opt, const char* zname, const char* pname)
 			return NULL;
 		}
 		opt->zonelist_off += linesize;
-		if(fflush(opt->zonelist) != 0) {
-			log_msg(LOG_ERR, "fflush %s: %s", opt->zonelistfile, strerror(errno));
-		}
+		zone_list_flush(opt);
 		return zone;
 	}
 	/* reuse empty spot */
@@ -550,9 +593,7 @@ zone_list_add(struct nsd_options* opt, const char* zname, const char* pname)
 		zone_options_delete(opt, zone);
 		return NULL;
 	}
-	if(fflush(opt->zonelist) != 0) {
-		log_msg(LOG_ERR, "fflush %s: %s", opt->zonelistfile, strerror(errno));
-	}
+	zone_list_flush(opt);
 
 	/* snip off and recycle element */
 	b->list = e->next;
@@ -576,17 +617,43 @@ zone_list_del(struct nsd_options* opt, struct zone_options* zone)
 	}
 	fprintf(opt->zonelist, "del");
 	zone_list_free_insert(opt, zone->linesize, zone->off);
+	opt->zonelist_snapshot_current = 0;
 
 	/* remove zone_options */
 	zone_options_delete(opt, zone);
 
-	/* see if we need to compact: it is going to halve the zonelist */
-	if(opt->zonefree_number > opt->zone_options->count) {
+	/* see if we need to compact: it is going to halve the zonelist,
+	 * for a batch that is done once at the end of the batch */
+	if(!opt->zonelist_batch &&
+		opt->zonefree_number > opt->zone_options->count) {
 		zone_list_compact(opt);
 	} else {
-		if(fflush(opt->zonelist) != 0) {
-			log_msg(LOG_ERR, "fflush %s: %s", opt->zonelistfile, strerror(errno));
-		}
+		zone_list_flush(opt);
+	}
+}
+
+/* start a batch of zone_list_add and zone_list_del calls */
+void
+zone_list_batch_begin(struct nsd_options* opt)
+{
+	opt->zonelist_batch = 1;
+}
+
+/* end a batch of changes, the file is compacted if needed, and written
+ * to disk once for the whole batch */
+void
+zone_list_batch_end(struct nsd_options* opt)
+{
+	opt->zonelist_batch = 0;
+	if(!opt->zonelist)
+		return;
+	if(opt->zonefree_number > opt->zone_options->count)
+		zone_list_compact(opt);
+	if(fflush(opt->zonelist) != 0) {
+		log_msg(LOG_ERR, "fflush %s: %s", opt->zonelistfile, strerror(errno));
+	}
+	if(fsync(fileno(opt->zonelist)) != 0) {
+		log_msg(LOG_ERR, "fsync %s: %s", opt->zonelistfile, strerror(errno));
 	}
 }
 /* postorder delete of zonelist free space tree */
@@ -686,6 +753,7 @@ zone_list_compact(struct nsd_options* opt)
 	/* finish */
 	opt->zonelist = out;
 	opt->zonelist_off = off;
+	opt->zonelist_snapshot_current = 0;
 }
 
 /* close zonelist file */
@@ -1253,6 +1321,433 @@ pattern_options_unmarshal(region_type* r, struct buffer* b)
 	return p;
 }
 
+/*
+ * The zonelist snapshot is a binary image of the parsed zonelist file,
+ * stored in <zonelistfile>.bin.  It has the zone entries in tree order,
+ * with their wireformat names, so that a start with a large zonelist
+ * does not need to parse text and dnames and insert into the tree one
+ * zone at a time.  It is keyed on the size, mtime and a hash of the
+ * contents of the zonelist file, if those do not match, or the patterns
+ * that are used no longer exist, the text file is parsed instead.
+ * All numbers are in network order.
+ */
+#define ZONELIST_SNAP_MAGIC 0x4e53445aU /* "NSDZ" */
+#define ZONELIST_SNAP_VERSION 1
+/* length of the fixed header, the body hash covers everything after
+ * the magic, version and body hash fields. */
+#define ZONELIST_SNAP_HDR (4+4+4+8+8+8+4+8+4+8+8)
+#define ZONELIST_SNAP_HASHED 12
+
+/* pattern name to index in the snapshot, used while writing it */
+struct zonelist_snap_pat {
+	rbnode_type node; /* key is pattern name */
+	uint32_t id;
+};
+
+/* create the snapshot filename */
+static void
+zone_list_snapshot_name(struct nsd_options* opt, char* buf, size_t len,
+	const char* suffix)
+{
+	snprintf(buf, len, "%s.bin%s", opt->zonelistfile, suffix);
+}
+
+/* hash the contents of the zonelist file, leaves the file at EOF */
+static int
+zone_list_hash_file(FILE* in, uint32_t* hash)
+{
+	char buf[65536];
+	size_t n;
+	uint32_t h = 0;
+	if(fseeko(in, 0, SEEK_SET) == -1)
+		return 0;
+	while((n = fread(buf, 1, sizeof(buf), in)) > 0)
+		h = hashlittle(buf, n, h);
+	if(ferror(in))
+		return 0;
+	*hash = h;
+	return 1;
+}
+
+/* get size and mtime of the open zonelist file */
+static int
+zone_list_file_stat(FILE* in, uint64_t* size, uint64_t* sec, uint64_t* nsec)
+{
+	struct stat s;
+	if(fstat(fileno(in), &s) != 0)
+		return 0;
+	*size = (uint64_t)s.st_size;
+	*sec = (uint64_t)s.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIMENSEC
+	*nsec = (uint64_t)s.st_mtimensec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC)
+	*nsec = (uint64_t)s.st_mtim.tv_nsec;
+#else
+	*nsec = 0;
+#endif
+	return 1;
+}
+
+void
+zone_list_write_snapshot(struct nsd_options* opt)
+{
+	char fname[1024], tmpname[1024];
+	uint64_t size, sec, nsec, zone_count = 0, free_count = 0;
+	uint32_t hash, pat_count = 0;
+	region_type* tmp;
+	rbtree_type* pats;
+	buffer_type* b;
+	struct zone_options* zone;
+	struct zonelist_snap_pat* sp = NULL;
+	struct zonelist_bucket* bucket;
+	struct zonelist_free* e;
+	FILE* out;
+
+	if(!opt->zonelist || opt->zonelist_snapshot_current)
+		return;
+	if(fflush(opt->zonelist) != 0 ||
+		!zone_list_file_stat(opt->zonelist, &size, &sec, &nsec) ||
+		!zone_list_hash_file(opt->zonelist, &hash)) {
+		VERBOSITY(1, (LOG_WARNING, "zonelist snapshot: cannot read "
+			"%s: %s", opt->zonelistfile, strerror(errno)));
+		return;
+	}
+	tmp = region_create(xalloc, free);
+	pats = rbtree_create(tmp, rbtree_strcmp);
+	b = buffer_create(tmp, 65536);
+
+	/* header, counts and body hash are filled in at the end */
+	marshal_u32(b, ZONELIST_SNAP_MAGIC);
+	marshal_u32(b, ZONELIST_SNAP_VERSION);
+	marshal_u32(b, 0);
+	marshal_u64(b, size);
+	marshal_u64(b, sec);
+	marshal_u64(b, nsec);
+	marshal_u32(b, hash);
+	marshal_u64(b, (uint64_t)opt->zonelist_off);
+	marshal_u32(b, 0);
+	marshal_u64(b, 0);
+	marshal_u64(b, 0);
+
+	/* the patterns in use by zonelist zones */
+	RBTREE_FOR(zone, struct zone_options*, opt->zone_options) {
+		size_t len;
+		if(zone->part_of_config)
+			continue;
+		if(sp && sp->node.key == zone->pattern->pname)
+			continue;
+		sp = (struct zonelist_snap_pat*)rbtree_search(pats,
+			zone->pattern->pname);
+		if(sp)
+			continue;
+		sp = (struct zonelist_snap_pat*)region_alloc_zero(tmp,
+			sizeof(*sp));
+		sp->node.key = zone->pattern->pname;
+		sp->id = pat_count++;
+		rbtree_insert(pats, &sp->node);
+		len = strlen(zone->pattern->pname);
+		marshal_u32(b, (uint32_t)len);
+		buffer_reserve(b, len+1);
+		buffer_write(b, zone->pattern->pname, len+1);
+	}
+	/* the zones, in tree order */
+	sp = NULL;
+	RBTREE_FOR(zone, struct zone_options*, opt->zone_options) {
+		size_t len, dlen;
+		if(zone->part_of_config)
+			continue;
+		if(!sp || sp->node.key != zone->pattern->pname)
+			sp = (struct zonelist_snap_pat*)rbtree_search(pats,
+				zone->pattern->pname);
+		marshal_u32(b, sp->id);
+		marshal_u32(b, (uint32_t)zone->linesize);
+		marshal_u64(b, (uint64_t)zone->off);
+		len = strlen(zone->name);
+		marshal_u32(b, (uint32_t)len);
+		buffer_reserve(b, len+1);
+		buffer_write(b, zone->name, len+1);
+		dlen = dname_total_size((const dname_type*)zone->node.key);
+		marshal_u32(b, (uint32_t)dlen);
+		buffer_reserve(b, dlen);
+		buffer_write(b, zone->node.key, dlen);
+		zone_count++;
+	}
+	/* the free space in the zonelist file */
+	RBTREE_FOR(bucket, struct zonelist_bucket*, opt->zonefree) {
+		for(e = bucket->list; e; e = e->next) {
+			marshal_u32(b, (uint32_t)bucket->linesize);
+			marshal_u64(b, (uint64_t)e->off);
+			free_count++;
+		}
+	}
+	buffer_write_u32_at(b, ZONELIST_SNAP_HDR-4-8-8, pat_count);
+	buffer_write_u64_at(b, ZONELIST_SNAP_HDR-8-8, zone_count);
+	buffer_write_u64_at(b, ZONELIST_SNAP_HDR-8, free_count);
+	buffer_flip(b);
+	buffer_write_u32_at(b, 8, hashlittle(buffer_at(b,
+		ZONELIST_SNAP_HASHED), buffer_limit(b)-ZONELIST_SNAP_HASHED, 0));
+
+	/* write to a temp file and rename it into place */
+	zone_list_snapshot_name(opt, fname, sizeof(fname), "");
+	zone_list_snapshot_name(opt, tmpname, sizeof(tmpname), "~");
+	out = fopen(tmpname, "w");
+	if(!out) {
+		VERBOSITY(1, (LOG_WARNING, "zonelist snapshot: could not "
+			"open %s: %s", tmpname, strerror(errno)));
+		region_destroy(tmp);
+		return;
+	}
+	if(fwrite(buffer_begin(b), 1, buffer_limit(b), out) != buffer_limit(b)
+		|| fclose(out) != 0) {
+		VERBOSITY(1, (LOG_WARNING, "zonelist snapshot: could not "
+			"write %s: %s", tmpname, strerror(errno)));
+		(void)unlink(tmpname);
+		region_destroy(tmp);
+		return;
+	}
+	if(rename(tmpname, fname) == -1) {
+		VERBOSITY(1, (LOG_WARNING, "zonelist snapshot: rename(%s to "
+			"%s) failed: %s", tmpname, fname, strerror(errno)));
+		(void)unlink(tmpname);
+		region_destroy(tmp);
+		return;
+	}
+	region_destroy(tmp);
+	opt->zonelist_snapshot_current = 1;
+	VERBOSITY(3, (LOG_INFO, "zonelist snapshot %s written with %u zones",
+		fname, (unsigned)zone_count));
+}
+
+#ifdef HAVE_MMAP
+/* read a counted string from the snapshot, returns it in place, or NULL */
+static const char*
+zone_list_snapshot_str(buffer_type* b)
+{
+	uint32_t len;
+	const char* s;
+	if(!buffer_available(b, 4))
+		return NULL;
+	len = buffer_read_u32(b);
+	if(!buffer_available(b, (size_t)len+1) ||
+		buffer_current(b)[len] != 0)
+		return NULL;
+	s = (const char*)buffer_current(b);
+	buffer_skip(b, (ssize_t)len+1);
+	return s;
+}
+
+/* read a zone entry from the snapshot, returns false if malformed */
+static int
+zone_list_snapshot_zone(buffer_type* b, uint32_t pat_count, uint32_t* patid,
+	uint32_t* linesize, uint64_t* off, const char** name,
+	const dname_type** dname)
+{
+	uint32_t dlen;
+	if(!buffer_available(b, 4+4+8))
+		return 0;
+	*patid = buffer_read_u32(b);
+	*linesize = buffer_read_u32(b);
+	*off = buffer_read_u64(b);
+	if(*patid >= pat_count || *linesize == 0 || *linesize > 1024)
+		return 0;
+	if(!(*name = zone_list_snapshot_str(b)))
+		return 0;
+	if(!buffer_available(b, 4))
+		return 0;
+	dlen = buffer_read_u32(b);
+	if(dlen < sizeof(dname_type) || !buffer_available(b, dlen))
+		return 0;
+	*dname = (const dname_type*)buffer_current(b);
+	if(dname_total_size(*dname) != dlen || (*dname)->name_size == 0 ||
+		(*dname)->label_count == 0)
+		return 0;
+	buffer_skip(b, (ssize_t)dlen);
+	return 1;
+}
+
+/* check the zone and free entries of the snapshot, before anything is
+ * created from them, so a bad snapshot does not leave partial results */
+static int
+zone_list_snapshot_check(buffer_type* b, uint32_t pat_count,
+	uint64_t zone_count, uint64_t free_count)
+{
+	const dname_type* prev = NULL;
+	uint64_t i;
+	for(i=0; i<zone_count; i++) {
+		uint32_t patid, linesize;
+		uint64_t off;
+		const char* name;
+		const dname_type* dname;
+		if(!zone_list_snapshot_zone(b, pat_count, &patid, &linesize,
+			&off, &name, &dname))
+			return 0;
+		/* the tree is built from this order */
+		if(prev && dname_compare(prev, dname) >= 0)
+			return 0;
+		prev = dname;
+	}
+	if(!buffer_available(b, (size_t)free_count*(4+8)))
+		return 0;
+	return buffer_remaining(b) == (size_t)free_count*(4+8);
+}
+
+/* create zone options from the (checked) snapshot, merged with the zones
+ * already in the tree from the config file */
+static void
+zone_list_snapshot_load(struct nsd_options* opt, buffer_type* b,
+	struct pattern_options** pats, uint64_t zone_count,
+	uint64_t free_count)
+{
+	rbnode_type** nodes = (rbnode_type**)xmallocarray(
+		(size_t)zone_count + opt->zone_options->count + 1,
+		sizeof(rbnode_type*));
+	rbnode_type* cfg = rbtree_first(opt->zone_options);
+	size_t n = 0;
+	uint64_t i;
+	for(i=0; i<zone_count; i++) {
+		uint32_t patid, linesize;
+		uint64_t off;
+		const char* name;
+		const dname_type* dname;
+		struct zone_options* zone;
+		(void)zone_list_snapshot_zone(b, UINT32_MAX, &patid, &linesize,
+			&off, &name, &dname);
+		/* config file zones sort before this one */
+		while(cfg != RBTREE_NULL && dname_compare(
+			(const dname_type*)cfg->key, dname) < 0) {
+			nodes[n++] = cfg;
+			cfg = rbtree_next(cfg);
+		}
+		if(cfg != RBTREE_NULL && dname_compare(
+			(const dname_type*)cfg->key, dname) == 0) {
+			log_msg(LOG_ERR, "bad domain name or duplicate zone "
+				"'%s' pattern %s", name, pats[patid]->pname);
+			continue;
+		}
+		zone = zone_options_create(opt->region);
+		zone->part_of_config = 0;
+		zone->name = region_strdup(opt->region, name);
+		zone->linesize = (int)linesize;
+		zone->off = (off_t)off;
+		zone->pattern = pats[patid];
+		zone->node.key = region_alloc_init(opt->region, dname,
+			dname_total_size(dname));
+		nodes[n++] = &zone->node;
+	}
+	while(cfg != RBTREE_NULL) {
+		nodes[n++] = cfg;
+		cfg = rbtree_next(cfg);
+	}
+	rbtree_build_sorted(opt->zone_options, nodes, n);
+	free(nodes);
+
+	for(i=0; i<free_count; i++) {
+		int linesize = (int)buffer_read_u32(b);
+		off_t off = (off_t)buffer_read_u64(b);
+		zone_list_free_insert(opt, linesize, off);
+	}
+}
+#endif /* HAVE_MMAP */
+
+/* read the zonelist from the snapshot, if it is current for the open
+ * zonelist file.  Returns false if the text file has to be parsed. */
+static int
+zone_list_snapshot_read(struct nsd_options* opt)
+{
+#ifdef HAVE_MMAP
+	char fname[1024];
+	struct stat s;
+	void* map;
+	int fd, result = 0;
+	buffer_type b;
+	uint64_t size, sec, nsec, zonelist_off, zone_count, free_count;
+	uint32_t hash, pat_count, i;
+	struct pattern_options** pats = NULL;
+
+	zone_list_snapshot_name(opt, fname, sizeof(fname), "");
+	fd = open(fname, O_RDONLY);
+	if(fd == -1)
+		return 0;
+	if(fstat(fd, &s) != 0 || s.st_size < ZONELIST_SNAP_HDR) {
+		close(fd);
+		return 0;
+	}
+	map = mmap(NULL, (size_t)s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		VERBOSITY(1, (LOG_WARNING, "zonelist snapshot: mmap %s: %s",
+			fname, strerror(errno)));
+		return 0;
+	}
+	buffer_create_from(&b, map, (size_t)s.st_size);
+	if(buffer_read_u32(&b) != ZONELIST_SNAP_MAGIC ||
+		buffer_read_u32(&b) != ZONELIST_SNAP_VERSION ||
+		buffer_read_u32(&b) != hashlittle(buffer_at(&b,
+		ZONELIST_SNAP_HASHED), buffer_limit(&b)-ZONELIST_SNAP_HASHED,
+		0)) {
+		VERBOSITY(2, (LOG_INFO, "zonelist snapshot %s is corrupt, "
+			"ignored", fname));
+		munmap(map, (size_t)s.st_size);
+		return 0;
+	}
+	/* is the snapshot for the current zonelist file */
+	if(!zone_list_file_stat(opt->zonelist, &size, &sec, &nsec) ||
+		buffer_read_u64(&b) != size || buffer_read_u64(&b) != sec ||
+		buffer_read_u64(&b) != nsec ||
+		!zone_list_hash_file(opt->zonelist, &hash) ||
+		buffer_read_u32(&b) != hash) {
+		VERBOSITY(2, (LOG_INFO, "zonelist snapshot %s is stale, "
+			"ignored", fname));
+		munmap(map, (size_t)s.st_size);
+		return 0;
+	}
+	zonelist_off = buffer_read_u64(&b);
+	pat_count = buffer_read_u32(&b);
+	zone_count = buffer_read_u64(&b);
+	free_count = buffer_read_u64(&b);
+
+	/* lookup the patterns, they come from the config file */
+	if(pat_count <= buffer_remaining(&b)) {
+		pats = (struct pattern_options**)xmallocarray(
+			(size_t)pat_count+1, sizeof(*pats));
+		for(i=0; i<pat_count; i++) {
+			const char* pname = zone_list_snapshot_str(&b);
+			if(!pname || !(pats[i]=pattern_options_find(opt,
+				pname))) {
+				VERBOSITY(2, (LOG_INFO, "zonelist snapshot %s: "
+					"pattern %s not found, ignored", fname,
+					pname?pname:"<malformed>"));
+				break;
+			}
+		}
+		if(i == pat_count) {
+			size_t zones_pos = buffer_position(&b);
+			if(zone_list_snapshot_check(&b, pat_count, zone_count,
+				free_count)) {
+				buffer_set_position(&b, zones_pos);
+				zone_list_snapshot_load(opt, &b, pats,
+					zone_count, free_count);
+				opt->zonelist_off = (off_t)zonelist_off;
+				opt->zonelist_snapshot_current = 1;
+				result = 1;
+				VERBOSITY(2, (LOG_INFO, "read %u zones from "
+					"zonelist snapshot %s",
+					(unsigned)zone_count, fname));
+			} else {
+				VERBOSITY(2, (LOG_INFO, "zonelist snapshot %s "
+					"is malformed, ignored", fname));
+			}
+		}
+		free(pats);
+	}
+	munmap(map, (size_t)s.st_size);
+	return result;
+#else
+	(void)opt;
+	return 0;
+#endif /* HAVE_MMAP */
+}
+
 struct key_options*
 key_options_create(region_type* region)
 {
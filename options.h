@@ -46,6 +46,10 @@ struct nsd_options {
 	FILE* zonelist;
 	/* last offset in file (or 0 if none) */
 	off_t zonelist_off;
+	/* if the zonelist snapshot file is up to date with the zonelist */
+	int zonelist_snapshot_current;
+	/* if a batch of changes is made, the file is flushed at the end */
+	int zonelist_batch;
 
 	/* tree of zonestat names and their id values, entries are struct
 	 * zonestatname with malloced key=stringname. The number of items
@@ -89,12 +93,34 @@ struct nsd_options {
 	const char* zonelistfile;
 	const char* nsid;
 	int xfrd_reload_timeout;
+	/** abort an IXFR for AXFR if that is cheaper to apply */
+	int xfrd_ixfr_cost;
 	int zonefiles_check;
+	int zonefiles_watch;
 	int zonefiles_write;
+	/** number of processes that write the zone files */
+	int zonefiles_write_workers;
 	int log_time_ascii;
 	int round_robin;
 	int minimal_responses;
 	int reuseport;
+	/** private key file for the TLS service, NULL if no TLS service */
+	char* tls_service_key;
+	/** certificate (chain) file for the TLS service */
+	char* tls_service_pem;
+	/** the port of the ip-addresses that serve TLS */
+	const char* tls_port;
+	/** seconds between rotations of the session ticket key, 0 is no
+	 * session tickets */
+	int tls_ticket_rotate;
+	/** hand the record encryption to the kernel (kTLS) */
+	int tls_ktls;
+	/** ports of the ip-addresses that expect a PROXYv2 header */
+	struct proxy_protocol_port_list* proxy_protocol_port;
+	/** the proxies that are trusted to send the PROXYv2 header */
+	struct acl_options* proxy_protocol_allow;
+	/** cap the UDP answer size for prefixes that lose large answers */
+	int adaptive_udp_size;
 
         /** remote control section. enable toggle. */
 	int control_enable;
@@ -133,6 +159,14 @@ struct ip_address_option {
 	char* address;
 };
 
+/*
+ * List of ports with the PROXY protocol.
+ */
+struct proxy_protocol_port_list {
+	struct proxy_protocol_port_list* next;
+	int port;
+};
+
 /*
  * Pattern of zone options, used to contain options for zone(s).
  */
@@ -178,12 +212,14 @@ struct zone_options {
 
 	/* is apex of the zone */
 	const char* name;
-	/* if not part of config, the offset and linesize of zonelist entry */
-	off_t off;
-	int linesize;
 	/* pattern for the zone options, if zone is part_of_config, this is
 	 * a anonymous pattern created in-place */
 	struct pattern_options* pattern;
+	/* if not part of config, the offset and linesize of zonelist entry */
+	off_t off;
+	/* the small fields are together, so there is no padding between
+	 * them, this struct exists for every zone */
+	int linesize;
 	/* zone is fixed into the main config, not in zonelist, cannot delete */
 	uint8_t part_of_config;
 };
@@ -254,6 +290,8 @@ struct zonelist_bucket {
 
 /* default zonefile write interval if database is "", in seconds */
 #define ZONEFILES_WRITE_INTERVAL 3600
+/* default number of processes that write the zone files */
+#define ZONEFILES_WRITE_WORKERS 4
 
 struct zonestatname {
 	rbnode_type node; /* key is malloced string with cooked zonestat name */
@@ -330,7 +368,13 @@ struct zone_options* zone_list_zone_insert(struct nsd_options* opt,
 	const char* nm, const char* patnm, int linesize, off_t off);
 void zone_list_del(struct nsd_options* opt, struct zone_options* zone);
 void zone_list_compact(struct nsd_options* opt);
+/* batch of zonelist changes, the file is flushed and synced at the end */
+void zone_list_batch_begin(struct nsd_options* opt);
+void zone_list_batch_end(struct nsd_options* opt);
 void zone_list_close(struct nsd_options* opt);
+/* write the binary snapshot of the zonelist, that is used to speed up
+ * parse_zone_list_file, if it is not up to date. */
+void zone_list_write_snapshot(struct nsd_options* opt);
 
 /* create zonestat name tree , for initially created zones */
 void options_zonestatnames_create(struct nsd_options* opt);
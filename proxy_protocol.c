@@ -0,0 +1,94 @@
+/*
+ * proxy_protocol.c -- PROXY protocol version 2 header parsing.
+ *
+ * Copyright (c) 2026, NLnet Labs. All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+
+#include "config.h"
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "proxy_protocol.h"
+
+/* version 2 in the high nibble, the command in the low nibble */
+#define PP2_VERSION 0x20
+#define PP2_CMD_LOCAL 0x0
+#define PP2_CMD_PROXY 0x1
+/* address family in the high nibble, transport in the low nibble */
+#define PP2_AF_INET 0x1
+#define PP2_AF_INET6 0x2
+/* lengths of the address blocks, source and destination address and
+ * port, for the families */
+#define PP2_ADDR_INET_LEN 12
+#define PP2_ADDR_INET6_LEN 36
+
+size_t
+proxy_protocol_header_size(const uint8_t* buf)
+{
+	if(memcmp(buf, PP2_SIG, PP2_SIG_LEN) != 0)
+		return 0;
+	if((buf[12] & 0xf0) != PP2_VERSION)
+		return 0;
+	return PP2_HEADER_SIZE + (((size_t)buf[14]<<8) | (size_t)buf[15]);
+}
+
+int
+proxy_protocol_parse(const uint8_t* buf, size_t len, void* addr,
+	socklen_t addrsize, socklen_t* addrlen)
+{
+	const uint8_t* a = buf + PP2_HEADER_SIZE;
+	size_t alen;
+	*addrlen = 0;
+	if(len < PP2_HEADER_SIZE || proxy_protocol_header_size(buf) != len)
+		return 0;
+	alen = len - PP2_HEADER_SIZE;
+	switch(buf[12] & 0x0f) {
+	case PP2_CMD_LOCAL:
+		return 1;
+	case PP2_CMD_PROXY:
+		break;
+	default:
+		return 0;
+	}
+	/* the address blocks are followed by TLVs, that are not used */
+	switch(buf[13] >> 4) {
+	case PP2_AF_INET: {
+		struct sockaddr_in sin;
+		if(alen < PP2_ADDR_INET_LEN || addrsize < sizeof(sin))
+			return 0;
+		memset(&sin, 0, sizeof(sin));
+		sin.sin_family = AF_INET;
+		memcpy(&sin.sin_addr, a, 4);
+		memcpy(&sin.sin_port, a+8, 2);
+		memcpy(addr, &sin, sizeof(sin));
+		*addrlen = sizeof(sin);
+		return 1;
+	}
+#ifdef INET6
+	case PP2_AF_INET6: {
+		struct sockaddr_in6 sin6;
+		if(alen < PP2_ADDR_INET6_LEN || addrsize < sizeof(sin6))
+			return 0;
+		memset(&sin6, 0, sizeof(sin6));
+		sin6.sin6_family = AF_INET6;
+		memcpy(&sin6.sin6_addr, a, 16);
+		memcpy(&sin6.sin6_port, a+32, 2);
+		memcpy(addr, &sin6, sizeof(sin6));
+		*addrlen = sizeof(sin6);
+		return 1;
+	}
+#else
+	case PP2_AF_INET6:
+		/* the client address cannot be stored, do not answer it
+		 * as if it came from the proxy */
+		return 0;
+#endif
+	default:
+		/* unspecified or unix socket, keep the peer address */
+		return 1;
+	}
+}
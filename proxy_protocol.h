@@ -0,0 +1,44 @@
+/*
+ * proxy_protocol.h -- PROXY protocol version 2 header parsing.
+ *
+ * Copyright (c) 2026, NLnet Labs. All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+
+#ifndef PROXY_PROTOCOL_H
+#define PROXY_PROTOCOL_H
+
+/*
+ * A load balancer in front of the server puts the PROXY protocol
+ * header before the DNS message on UDP, and at the start of the stream
+ * on TCP.  It carries the address of the client.
+ * See https://www.haproxy.org/download/2.9/doc/proxy-protocol.txt
+ */
+
+/* the fixed part: signature, version and command, family, length */
+#define PP2_HEADER_SIZE 16
+/* the signature at the start of the header */
+#define PP2_SIG "\r\n\r\n\0\r\nQUIT\n"
+#define PP2_SIG_LEN 12
+
+/*
+ * Size of the header that starts with the fixed part in buf, of
+ * PP2_HEADER_SIZE bytes.  Returns 0 if it is not a version 2 header.
+ */
+size_t proxy_protocol_header_size(const uint8_t* buf);
+
+/*
+ * Parse the header of len bytes in buf, that is the full header size.
+ * For a PROXY command with an IPv4 or IPv6 source, the source address
+ * and port are stored in addr, that has addrsize space, and addrlen is
+ * set to its length.  For the LOCAL command, that the proxy uses for its
+ * own health checks, and for other address families addrlen is set to
+ * 0, the address of the peer stays in use.  Returns 0 if the header is
+ * malformed, or has an address that does not fit in addr.
+ */
+int proxy_protocol_parse(const uint8_t* buf, size_t len, void* addr,
+	socklen_t addrsize, socklen_t* addrlen);
+
+#endif /* PROXY_PROTOCOL_H */
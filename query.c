@@ -36,6 +36,9 @@
 #include "options.h"
 #include "nsec3.h"
 #include "tsig.h"
+#include "ipc.h"
+#include "lookup3.h"
+#include "udpsize.h"
 
 /* [Bug #253] Adding unnecessary NS RRset may lead to undesired truncation.
  * This function determines if the final response packet needs the NS RRset
@@ -218,7 +221,9 @@ query_reset(query_type *q, size_t maxlen, int is_tcp)
 	 */
 	region_free_all(q->region);
 	q->addrlen = sizeof(q->addr);
+	q->is_proxied = 0;
 	q->maxlen = maxlen;
+	q->maxlen_capped = 0;
 	q->reserved_space = 0;
 	buffer_clear(q->packet);
 	edns_init_record(&q->edns);
@@ -404,6 +409,49 @@ process_tsig(struct query* q)
 	return NSD_RC_OK;
 }
 
+/*
+ * Queue a NOTIFY for xfrd in the batch of the server process.  A pending
+ * NOTIFY for the same zone is replaced.  Returns false if the batch is
+ * full because xfrd does not keep up, the master retries the NOTIFY.
+ */
+static int
+notify_batch_add(struct notify_batch* b, struct query* query,
+	uint32_t acl_num, uint32_t acl_xfr)
+{
+	const uint8_t* name = dname_name(query->qname);
+	size_t namelen = query->qname->name_size;
+	size_t sz = buffer_limit(query->packet);
+	size_t pos, rec, i;
+	uint8_t* p;
+
+	for(pos = 0; pos < b->len; pos += rec) {
+		p = b->data + pos;
+		rec = NOTIFY_REC_HDR + read_uint16(p);
+		if(read_uint16(p) < QHEADERSZ + namelen)
+			continue;
+		/* the qname follows the header, uncompressed */
+		for(i = 0; i < namelen; i++) {
+			if(tolower(name[i]) !=
+				tolower(p[NOTIFY_REC_HDR + QHEADERSZ + i]))
+				break;
+		}
+		if(i == namelen) {
+			memmove(p, p + rec, b->len - pos - rec);
+			b->len -= rec;
+			break;
+		}
+	}
+	if(b->len + NOTIFY_REC_HDR + sz > sizeof(b->data))
+		return 0;
+	p = b->data + b->len;
+	write_uint16(p, sz);
+	write_uint32(p + sizeof(uint16_t), acl_num);
+	write_uint32(p + sizeof(uint16_t) + sizeof(uint32_t), acl_xfr);
+	memcpy(p + NOTIFY_REC_HDR, buffer_begin(query->packet), sz);
+	b->len += NOTIFY_REC_HDR + sz;
+	return 1;
+}
+
 /*
  * Check notify acl and forward to xfrd (or return an error).
  */
@@ -437,39 +485,26 @@ answer_notify(struct nsd* nsd, struct query *query)
 	if((acl_num = acl_check_incoming(zone_opt->pattern->allow_notify, query,
 		&why)) != -1)
 	{
-		sig_atomic_t mode = NSD_PASS_TO_XFRD;
-		int s = nsd->this_child->parent_fd;
-		uint16_t sz;
-		uint32_t acl_send = htonl(acl_num);
-		uint32_t acl_xfr;
 		size_t pos;
 
 		/* Find priority candidate for request XFR. -1 if no match */
 		acl_num_xfr = acl_check_incoming(
 			zone_opt->pattern->request_xfr, query, NULL);
 
-		acl_xfr = htonl(acl_num_xfr);
-
 		assert(why);
 		DEBUG(DEBUG_XFRD,1, (LOG_INFO, "got notify %s passed acl %s %s",
 			dname_to_string(query->qname, NULL),
 			why->ip_address_spec,
 			why->nokey?"NOKEY":
 			(why->blocked?"BLOCKED":why->key_name)));
-		sz = buffer_limit(query->packet);
-		if(buffer_limit(query->packet) > MAX_PACKET_SIZE)
+		if(!nsd->notify_batch)
 			return query_error(query, NSD_RC_SERVFAIL);
-		/* forward to xfrd for processing
-		   Note. Blocking IPC I/O, but acl is OK. */
-		sz = htons(sz);
-		if(!write_socket(s, &mode, sizeof(mode)) ||
-			!write_socket(s, &sz, sizeof(sz)) ||
-			!write_socket(s, buffer_begin(query->packet),
-				buffer_limit(query->packet)) ||
-			!write_socket(s, &acl_send, sizeof(acl_send)) ||
-			!write_socket(s, &acl_xfr, sizeof(acl_xfr))) {
-			log_msg(LOG_ERR, "error in IPC notify server2main, %s",
-				strerror(errno));
+		/* forward to xfrd for processing, after this batch of
+		   queries is answered */
+		if(!notify_batch_add(nsd->notify_batch, query,
+			(uint32_t)acl_num, (uint32_t)acl_num_xfr)) {
+			VERBOSITY(2, (LOG_INFO, "notify for %s dropped, xfrd "
+				"is busy", dname_to_string(query->qname, NULL)));
 			return query_error(query, NSD_RC_SERVFAIL);
 		}
 		if(verbosity >= 1) {
@@ -752,14 +787,123 @@ add_rrset(struct query   *query,
 }
 
 
+/*
+ * Cache of the synthesized CNAMEs for DNAME answers, in the server
+ * process.  It stores the rewritten name, the lookup of it in the
+ * namedb and the names for the temporary domains, keyed on the DNAME
+ * rrset and the name that is rewritten.  The domain pointers stay valid
+ * because the server processes are forked anew after a reload, the
+ * cache is also flushed if the db changes.  A name hashes to a set of
+ * two slots, a new entry goes in the first slot and moves the entry
+ * that was there to the second slot.  The memory is freed when the
+ * cache is flushed, at the start of a query, so the names are not
+ * freed while they are in use for an answer.
+ */
+#define DNAME_CACHE_SIZE 1024 /* number of slots, a power of two */
+#define DNAME_CACHE_MEMORY (4*1024*1024) /* flush when it uses more */
+
+struct dname_synth {
+	/* the DNAME rrset that is followed, NULL for an empty slot */
+	rrset_type* rrset;
+	/* the name that is rewritten, it is compared case sensitive,
+	 * so that the answer has the case of the query */
+	const dname_type* from;
+	/* the rewritten name, the target of the CNAME */
+	const dname_type* to;
+	/* closest encloser of the rewritten name in the namedb */
+	domain_type* to_closest_encloser;
+	/* names of the temporary domains, below the DNAME owner down to
+	 * from, and then below to_closest_encloser down to to. */
+	const dname_type** names;
+};
+
+static struct dname_synth dname_cache[DNAME_CACHE_SIZE];
+static region_type* dname_cache_region = NULL;
+static namedb_type* dname_cache_db = NULL;
+
+/* empty the DNAME cache if it is full, or if the db has changed */
+static void
+dname_cache_check(namedb_type* db)
+{
+	if(dname_cache_db == db && region_get_mem(dname_cache_region)
+		< DNAME_CACHE_MEMORY)
+		return;
+	if(!dname_cache_region)
+		dname_cache_region = region_create(xalloc, free);
+	else	region_free_all(dname_cache_region);
+	memset(dname_cache, 0, sizeof(dname_cache));
+	dname_cache_db = db;
+}
+
+/* the set of two slots for the name */
+static struct dname_synth*
+dname_cache_set(rrset_type* rrset, const dname_type* from)
+{
+	uint32_t h = hashlittle(dname_name(from), from->name_size,
+		(uint32_t)(size_t)rrset);
+	return &dname_cache[h & (DNAME_CACHE_SIZE-2)];
+}
+
+static int
+dname_cache_match(struct dname_synth* s, rrset_type* rrset,
+	const dname_type* from)
+{
+	return s->rrset == rrset && s->from->name_size == from->name_size &&
+		memcmp(dname_name(s->from), dname_name(from),
+		from->name_size) == 0;
+}
+
+/* find the synthesized CNAME, or NULL */
+static struct dname_synth*
+dname_cache_lookup(rrset_type* rrset, const dname_type* from)
+{
+	struct dname_synth* s = dname_cache_set(rrset, from);
+	if(dname_cache_match(&s[0], rrset, from))
+		return &s[0];
+	if(dname_cache_match(&s[1], rrset, from))
+		return &s[1];
+	return NULL;
+}
+
+/* store the synthesized CNAME, returns NULL if the cache is full */
+static struct dname_synth*
+dname_cache_insert(rrset_type* rrset, const dname_type* from,
+	const dname_type* to, domain_type* src,
+	domain_type* to_closest_encloser)
+{
+	struct dname_synth* s;
+	int i, nfrom, nto;
+	if(region_get_mem(dname_cache_region) >= DNAME_CACHE_MEMORY)
+		return NULL;
+	s = dname_cache_set(rrset, from);
+	s[1] = s[0];
+	nfrom = from->label_count - domain_dname(src)->label_count;
+	nto = to->label_count - domain_dname(to_closest_encloser)->label_count;
+	s->rrset = rrset;
+	s->from = dname_copy(dname_cache_region, from);
+	s->to = dname_copy(dname_cache_region, to);
+	s->to_closest_encloser = to_closest_encloser;
+	s->names = (const dname_type**)region_alloc_array(dname_cache_region,
+		nfrom + nto + 1, sizeof(dname_type*));
+	for(i=0; i<nfrom; i++)
+		s->names[i] = dname_partial_copy(dname_cache_region, from,
+			domain_dname(src)->label_count + i + 1);
+	for(i=0; i<nto; i++)
+		s->names[nfrom+i] = dname_partial_copy(dname_cache_region, to,
+			domain_dname(to_closest_encloser)->label_count + i + 1);
+	return s;
+}
+
 /* returns 0 on error, or the domain number for to_name.
    from_name is changes to to_name by the DNAME rr.
    DNAME rr is from src to dest.
-   closest encloser encloses the to_name. */
+   closest encloser encloses the to_name.
+   names are the names for the temporary domains from the cache, or NULL
+   to copy them from from_name and to_name. */
 static size_t
 query_synthesize_cname(struct query* q, struct answer* answer, const dname_type* from_name,
 	const dname_type* to_name, domain_type* src, domain_type* to_closest_encloser,
-	domain_type** to_closest_match, uint32_t ttl)
+	domain_type** to_closest_match, uint32_t ttl, const dname_type** names)
 {
 	/* add temporary domains for from_name and to_name and all
 	   their (not allocated yet) parents */
@@ -771,9 +915,10 @@ query_synthesize_cname(struct query* q, struct answer* answer, const dname_type*
 
 	/* allocate source part */
 	domain_type* lastparent = src;
+	int nfrom = from_name->label_count - domain_dname(src)->label_count;
 	assert(q && answer && from_name && to_name && src && to_closest_encloser);
 	assert(to_closest_match);
-	for(i=0; i < from_name->label_count - domain_dname(src)->label_count; i++)
+	for(i=0; i < nfrom; i++)
 	{
 		domain_type* newdom = query_get_tempdomain(q);
 		if(!newdom)
@@ -785,9 +930,10 @@ query_synthesize_cname(struct query* q, struct answer* answer, const dname_type*
 #else
 		newdom->node.key
 #endif
-			= dname_partial_copy(q->region,
+			= names?names[i]:dname_partial_copy(q->region,
 			from_name, domain_dname(src)->label_count + i + 1);
-		if(dname_compare(domain_dname(newdom), q->qname) == 0) {
+		if(domain_dname(newdom)->label_count == q->qname->label_count
+			&& dname_compare(domain_dname(newdom), q->qname) == 0) {
 			/* 0 good for query name, otherwise new number */
 			newdom->number = 0;
 		}
@@ -812,7 +958,7 @@ query_synthesize_cname(struct query* q, struct answer* answer, const dname_type*
 #else
 		newdom->node.key
 #endif
-			= dname_partial_copy(q->region,
+			= names?names[nfrom+i]:dname_partial_copy(q->region,
 			to_name, domain_dname(to_closest_encloser)->label_count + i + 1);
 		DEBUG(DEBUG_QUERY,2, (LOG_INFO, "created temp domain dest %d. %s nr %d", i,
 			domain_to_string(newdom), (int)newdom->number));
@@ -1074,21 +1220,32 @@ answer_authoritative(struct nsd   *nsd,
 		added = add_rrset(q, answer, ANSWER_SECTION, closest_encloser, rrset);
 		if(added) {
 			domain_type* src = closest_encloser;
-			const dname_type* newname = dname_replace(q->region, name,
-				domain_dname(src), domain_dname(dest));
+			struct dname_synth* s = dname_cache_lookup(rrset, name);
+			const dname_type* newname;
 			size_t newnum = 0;
 			zone_type* origzone = q->zone;
 			++q->cname_count;
-			if(!newname) { /* newname too long */
-				RCODE_SET(q->packet, RCODE_YXDOMAIN);
-				return;
+			if(s) {
+				newname = s->to;
+				closest_encloser = s->to_closest_encloser;
+			} else {
+				newname = dname_replace(q->region, name,
+					domain_dname(src), domain_dname(dest));
+				if(!newname) { /* newname too long */
+					RCODE_SET(q->packet, RCODE_YXDOMAIN);
+					return;
+				}
+				/* follow the DNAME */
+				(void)namedb_lookup(nsd->db, newname, &closest_match,
+					&closest_encloser);
+				s = dname_cache_insert(rrset, name, newname, src,
+					closest_encloser);
 			}
 			DEBUG(DEBUG_QUERY,2, (LOG_INFO, "->result is %s", dname_to_string(newname, NULL)));
-			/* follow the DNAME */
-			exact = namedb_lookup(nsd->db, newname, &closest_match, &closest_encloser);
 			/* synthesize CNAME record */
 			newnum = query_synthesize_cname(q, answer, name, newname,
-				src, closest_encloser, &closest_match, rrset->rrs[0].ttl);
+				src, closest_encloser, &closest_match, rrset->rrs[0].ttl,
+				s?s->names:NULL);
 			if(!newnum) {
 				/* could not synthesize the CNAME. */
 				/* return previous CNAMEs to make resolver recurse for us */
@@ -1298,6 +1455,7 @@ answer_query(struct nsd *nsd, struct query *q)
 	answer_type answer;
 
 	answer_init(&answer);
+	dname_cache_check(nsd->db);
 
 	exact = namedb_lookup(nsd->db, q->qname, &closest_match, &closest_encloser);
 
@@ -1466,6 +1624,7 @@ query_process(query_type *q, nsd_type *nsd)
 		 * Thus RCODE = NOERROR = NSD_RC_OK. */
 		return query_error(q, NSD_RC_OK);
 	}
+	udpsize_query(nsd, q);
 
 	query_prepare_response(q);
 
@@ -1556,4 +1715,6 @@ query_add_optional(query_type *q, nsd_type *nsd)
 			}
 		}
 	}
+	if(!q->tcp)
+		udpsize_answer(nsd, q);
 }
@@ -43,10 +43,25 @@ struct query {
 #endif
 	socklen_t addrlen;
 
+	/*
+	 * With the PROXY protocol, addr is the client address from the
+	 * header, and this is the address of the proxy that the query was
+	 * received from.  UDP answers are sent back to the proxy.
+	 */
+#ifdef INET6
+	struct sockaddr_storage remote_addr;
+#else
+	struct sockaddr_in remote_addr;
+#endif
+	socklen_t remote_addrlen;
+	int is_proxied;
+
 	/*
 	 * Maximum supported query size.
 	 */
 	size_t maxlen;
+	/* maxlen is lowered by adaptive-udp-size for the source prefix */
+	int maxlen_capped;
 
 	/*
 	 * Space reserved for optional records like EDNS.
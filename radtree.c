@@ -58,6 +58,28 @@ void radix_tree_delete(struct radtree* rt)
 	region_recycle(rt->region, rt, sizeof(*rt));
 }
 
+/** add memory of radnodes in postorder recursion */
+static size_t radnode_mem_postorder(struct radnode* n, size_t* nodes)
+{
+	unsigned i;
+	size_t m;
+	if(!n) return 0;
+	m = sizeof(*n) + n->capacity*sizeof(struct radsel);
+	for(i=0; i<n->len; i++) {
+		m += radnode_mem_postorder(n->array[i].node, nodes);
+		m += n->array[i].len;
+	}
+	(*nodes)++;
+	return m;
+}
+
+size_t radix_tree_mem(struct radtree* rt, size_t* nodes)
+{
+	*nodes = 0;
+	if(!rt) return 0;
+	return sizeof(*rt) + radnode_mem_postorder(rt->root, nodes);
+}
+
 /** return last elem-containing node in this subtree (excl self) */
 static struct radnode*
 radnode_last_in_subtree(struct radnode* n)
@@ -88,6 +88,14 @@ void radix_tree_clear(struct radtree* rt);
  */
 void radix_tree_delete(struct radtree* rt);
 
+/**
+ * Memory used by the radix tree, the tree and its nodes.
+ * @param rt: radix tree.
+ * @param nodes: returns the number of nodes, including intermediate nodes.
+ * @return bytes allocated for the tree.
+ */
+size_t radix_tree_mem(struct radtree* rt, size_t* nodes);
+
 
 /**
  * Insert element into radix tree.
@@ -551,3 +551,38 @@ rbtree_previous(rbnode_type *node)
 	}
 	return node;
 }
+
+/* build balanced subtree from nodes[lo..hi), returns its root */
+static rbnode_type *
+rbtree_build_sub(rbnode_type **nodes, size_t lo, size_t hi, size_t depth,
+	size_t reddepth, rbnode_type *parent)
+{
+	size_t mid;
+	rbnode_type *node;
+	if (lo >= hi)
+		return RBTREE_NULL;
+	mid = lo + (hi - lo) / 2;
+	node = nodes[mid];
+	node->parent = parent;
+	/* all levels above the deepest are complete, so only the
+	 * deepest (partial) level is coloured red */
+	node->color = (depth != 0 && depth == reddepth) ? RED : BLACK;
+	node->left = rbtree_build_sub(nodes, lo, mid, depth+1, reddepth, node);
+	node->right = rbtree_build_sub(nodes, mid+1, hi, depth+1, reddepth,
+		node);
+	return node;
+}
+
+void
+rbtree_build_sorted(rbtree_type *rbtree, rbnode_type **nodes, size_t count)
+{
+	size_t reddepth = 0, n = count;
+	/* depth of the deepest level is floor(log2(count)) */
+	while (n > 1) {
+		n >>= 1;
+		reddepth++;
+	}
+	rbtree->root = rbtree_build_sub(nodes, 0, count, 0, reddepth,
+		RBTREE_NULL);
+	rbtree->count = count;
+}
@@ -60,6 +60,11 @@ rbnode_type *rbtree_first(rbtree_type *rbtree);
 rbnode_type *rbtree_last(rbtree_type *rbtree);
 rbnode_type *rbtree_next(rbnode_type *rbtree);
 rbnode_type *rbtree_previous(rbnode_type *rbtree);
+/* replaces the contents of the tree with the nodes in the array, that
+ * must be sorted (strictly ascending) by key.  Builds the tree in O(n)
+ * without key comparisons, for bulk loads of large trees. */
+void rbtree_build_sorted(rbtree_type *rbtree, rbnode_type **nodes,
+	size_t count);
 
 #define	RBTREE_WALK(rbtree, k, d) \
 	for((rbtree)->_node = rbtree_first(rbtree);\
@@ -70,14 +70,74 @@ typedef int (*rdata_to_string_type)(buffer_type *output,
 				    rdata_atom_type rdata,
 				    rr_type *rr);
 
+/*
+ * The converters below write into the buffer directly, after they
+ * reserved the space, and do not use buffer_printf. Writing zone files
+ * calls them for every RR, and the format parse per field is slow.
+ */
+
+/* write the \DDD escape for the octet at p, returns the new end */
+static inline uint8_t *
+decimal_escape(uint8_t *p, uint8_t ch)
+{
+	*p++ = '\\';
+	*p++ = '0' + ch / 100;
+	*p++ = '0' + (ch / 10) % 10;
+	*p++ = '0' + ch % 10;
+	return p;
+}
+
+/* print the character string, in quotes */
+static void
+text_to_string(buffer_type *output, const uint8_t *data, size_t size)
+{
+	uint8_t *p;
+	size_t i;
+
+	buffer_reserve(output, size * 4 + 2);
+	p = buffer_current(output);
+	*p++ = '"';
+	for (i = 0; i < size; ++i) {
+		uint8_t ch = data[i];
+		if (isprint(ch)) {
+			if (ch == '"' || ch == '\\') {
+				*p++ = '\\';
+			}
+			*p++ = ch;
+		} else {
+			p = decimal_escape(p, ch);
+		}
+	}
+	*p++ = '"';
+	buffer_skip(output, p - buffer_current(output));
+}
+
+static void
+hex_to_string(buffer_type *output, const uint8_t *data, size_t size)
+{
+	static const char hexdigits[] = {
+		'0', '1', '2', '3', '4', '5', '6', '7',
+		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+	};
+	size_t i;
+	uint8_t *p;
+
+	buffer_reserve(output, size * 2);
+	p = buffer_current(output);
+	for (i = 0; i < size; ++i) {
+		uint8_t octet = *data++;
+		*p++ = hexdigits[octet >> 4];
+		*p++ = hexdigits[octet & 0x0f];
+	}
+	buffer_skip(output, size * 2);
+}
+
 static int
 rdata_dname_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
-	buffer_printf(output,
-		      "%s",
-		      dname_to_string(domain_dname(rdata_atom_domain(rdata)),
-				      NULL));
+	buffer_print_string(output,
+		dname_to_string(domain_dname(rdata_atom_domain(rdata)), NULL));
 	return 1;
 }
 
@@ -90,31 +150,37 @@ rdata_dns_name_to_string(buffer_type *output, rdata_atom_type rdata,
 	uint8_t length = data[offset];
 	size_t i;
 
+	uint8_t *p;
+
 	while (length > 0)
 	{
+		buffer_reserve(output, length * 4 + 1);
+		p = buffer_current(output);
 		if (offset) /* concat label */
-			buffer_printf(output, ".");
+			*p++ = '.';
 
 		for (i = 1; i <= length; ++i) {
 			uint8_t ch = data[i+offset];
 
 			if (ch=='.' || ch==';' || ch=='(' || ch==')' || ch=='\\') {
-				buffer_printf(output, "\\%c", (char) ch);
+				*p++ = '\\';
+				*p++ = ch;
 			} else if (!isgraph((unsigned char) ch)) {
-				buffer_printf(output, "\\%03u", (unsigned int) ch);
+				p = decimal_escape(p, ch);
 			} else if (isprint((unsigned char) ch)) {
-				buffer_printf(output, "%c", (char) ch);
+				*p++ = ch;
 			} else {
-				buffer_printf(output, "\\%03u", (unsigned int) ch);
+				p = decimal_escape(p, ch);
 			}
 		}
+		buffer_skip(output, p - buffer_current(output));
 		/* next label */
 		offset = offset+length+1;
 		length = data[offset];
 	}
 
 	/* root label */
-	buffer_printf(output, ".");
+	buffer_print_string(output, ".");
 	return 1;
 }
 
@@ -123,22 +189,7 @@ rdata_text_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
 	const uint8_t *data = rdata_atom_data(rdata);
-	uint8_t length = data[0];
-	size_t i;
-
-	buffer_printf(output, "\"");
-	for (i = 1; i <= length; ++i) {
-		char ch = (char) data[i];
-		if (isprint((unsigned char)ch)) {
-			if (ch == '"' || ch == '\\') {
-				buffer_printf(output, "\\");
-			}
-			buffer_printf(output, "%c", ch);
-		} else {
-			buffer_printf(output, "\\%03u", (unsigned) data[i]);
-		}
-	}
-	buffer_printf(output, "\"");
+	text_to_string(output, data + 1, data[0]);
 	return 1;
 }
 
@@ -149,23 +200,12 @@ rdata_texts_to_string(buffer_type *output, rdata_atom_type rdata,
 	uint16_t pos = 0;
 	const uint8_t *data = rdata_atom_data(rdata);
 	uint16_t length = rdata_atom_size(rdata);
-	size_t i;
 
 	while (pos < length && pos + data[pos] < length) {
-		buffer_printf(output, "\"");
-		for (i = 1; i <= data[pos]; ++i) {
-			char ch = (char) data[pos + i];
-			if (isprint((unsigned char)ch)) {
-				if (ch == '"' || ch == '\\') {
-					buffer_printf(output, "\\");
-				}
-				buffer_printf(output, "%c", ch);
-			} else {
-				buffer_printf(output, "\\%03u", (unsigned) data[pos+i]);
-			}
-		}
+		text_to_string(output, data + pos + 1, data[pos]);
 		pos += data[pos]+1;
-		buffer_printf(output, pos < length?"\" ":"\"");
+		if (pos < length)
+			buffer_print_string(output, " ");
 	}
 	return 1;
 }
@@ -176,21 +216,7 @@ rdata_long_text_to_string(buffer_type *output, rdata_atom_type rdata,
 {
 	const uint8_t *data = rdata_atom_data(rdata);
 	uint16_t length = rdata_atom_size(rdata);
-	size_t i;
-
-	buffer_printf(output, "\"");
-	for (i = 0; i < length; ++i) {
-		char ch = (char) data[i];
-		if (isprint((unsigned char)ch)) {
-			if (ch == '"' || ch == '\\') {
-				buffer_printf(output, "\\");
-			}
-			buffer_printf(output, "%c", ch);
-		} else {
-			buffer_printf(output, "\\%03u", (unsigned) data[i]);
-		}
-	}
-	buffer_printf(output, "\"");
+	text_to_string(output, data, length);
 	return 1;
 }
 
@@ -203,10 +229,11 @@ rdata_tag_to_string(buffer_type *output, rdata_atom_type rdata,
 	size_t i;
 	for (i = 1; i <= length; ++i) {
 		char ch = (char) data[i];
-		if (isdigit((unsigned char)ch) || islower((unsigned char)ch))
-			buffer_printf(output, "%c", ch);
-		else	return 0;
+		if (!isdigit((unsigned char)ch) && !islower((unsigned char)ch))
+			return 0;
 	}
+	buffer_reserve(output, length);
+	buffer_write(output, data + 1, length);
 	return 1;
 }
 
@@ -215,7 +242,7 @@ rdata_byte_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
 	uint8_t data = *rdata_atom_data(rdata);
-	buffer_printf(output, "%lu", (unsigned long) data);
+	buffer_print_u32(output, data);
 	return 1;
 }
 
@@ -224,7 +251,7 @@ rdata_short_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
 	uint16_t data = read_uint16(rdata_atom_data(rdata));
-	buffer_printf(output, "%lu", (unsigned long) data);
+	buffer_print_u32(output, data);
 	return 1;
 }
 
@@ -233,7 +260,7 @@ rdata_long_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
 	uint32_t data = read_uint32(rdata_atom_data(rdata));
-	buffer_printf(output, "%lu", (unsigned long) data);
+	buffer_print_u32(output, data);
 	return 1;
 }
 
@@ -241,13 +268,23 @@ static int
 rdata_a_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
-	int result = 0;
-	char str[200];
-	if (inet_ntop(AF_INET, rdata_atom_data(rdata), str, sizeof(str))) {
-		buffer_printf(output, "%s", str);
-		result = 1;
+	const uint8_t *data = rdata_atom_data(rdata);
+	char str[16];
+	char *p = str;
+	int i;
+	/* the same dotted quad as inet_ntop prints */
+	for (i = 0; i < 4; ++i) {
+		if (i)
+			*p++ = '.';
+		if (data[i] >= 100)
+			*p++ = '0' + data[i] / 100;
+		if (data[i] >= 10)
+			*p++ = '0' + (data[i] / 10) % 10;
+		*p++ = '0' + data[i] % 10;
 	}
-	return result;
+	buffer_reserve(output, p - str);
+	buffer_write(output, str, p - str);
+	return 1;
 }
 
 static int
@@ -257,7 +294,7 @@ rdata_aaaa_to_string(buffer_type *output, rdata_atom_type rdata,
 	int result = 0;
 	char str[200];
 	if (inet_ntop(AF_INET6, rdata_atom_data(rdata), str, sizeof(str))) {
-		buffer_printf(output, "%s", str);
+		buffer_print_string(output, str);
 		result = 1;
 	}
 	return result;
@@ -268,12 +305,12 @@ rdata_ilnp64_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
 	uint8_t* data = rdata_atom_data(rdata);
-	uint16_t a1 = read_uint16(data);
-	uint16_t a2 = read_uint16(data+2);
-	uint16_t a3 = read_uint16(data+4);
-	uint16_t a4 = read_uint16(data+6);
-
-	buffer_printf(output, "%.4x:%.4x:%.4x:%.4x", a1, a2, a3, a4);
+	int i;
+	for (i = 0; i < 8; i += 2) {
+		if (i)
+			buffer_print_string(output, ":");
+		hex_to_string(output, data+i, 2);
+	}
 	return 1;
 }
 
@@ -282,15 +319,12 @@ rdata_eui48_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
 	uint8_t* data = rdata_atom_data(rdata);
-	uint8_t a1 = data[0];
-	uint8_t a2 = data[1];
-	uint8_t a3 = data[2];
-	uint8_t a4 = data[3];
-	uint8_t a5 = data[4];
-	uint8_t a6 = data[5];
-
-	buffer_printf(output, "%.2x-%.2x-%.2x-%.2x-%.2x-%.2x",
-		a1, a2, a3, a4, a5, a6);
+	int i;
+	for (i = 0; i < 6; ++i) {
+		if (i)
+			buffer_print_string(output, "-");
+		hex_to_string(output, data+i, 1);
+	}
 	return 1;
 }
 
@@ -299,17 +333,12 @@ rdata_eui64_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
 	uint8_t* data = rdata_atom_data(rdata);
-	uint8_t a1 = data[0];
-	uint8_t a2 = data[1];
-	uint8_t a3 = data[2];
-	uint8_t a4 = data[3];
-	uint8_t a5 = data[4];
-	uint8_t a6 = data[5];
-	uint8_t a7 = data[6];
-	uint8_t a8 = data[7];
-
-	buffer_printf(output, "%.2x-%.2x-%.2x-%.2x-%.2x-%.2x-%.2x-%.2x",
-		a1, a2, a3, a4, a5, a6, a7, a8);
+	int i;
+	for (i = 0; i < 8; ++i) {
+		if (i)
+			buffer_print_string(output, "-");
+		hex_to_string(output, data+i, 1);
+	}
 	return 1;
 }
 
@@ -318,7 +347,7 @@ rdata_rrtype_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
 	uint16_t type = read_uint16(rdata_atom_data(rdata));
-	buffer_printf(output, "%s", rrtype_to_string(type));
+	buffer_print_string(output, rrtype_to_string(type));
 	return 1;
 }
 
@@ -327,7 +356,7 @@ rdata_algorithm_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
 	uint8_t id = *rdata_atom_data(rdata);
-	buffer_printf(output, "%u", (unsigned) id);
+	buffer_print_u32(output, id);
 	return 1;
 }
 
@@ -339,9 +368,9 @@ rdata_certificate_type_to_string(buffer_type *output, rdata_atom_type rdata,
 	lookup_table_type *type
 		= lookup_by_id(dns_certificate_types, id);
 	if (type) {
-		buffer_printf(output, "%s", type->name);
+		buffer_print_string(output, type->name);
 	} else {
-		buffer_printf(output, "%u", (unsigned) id);
+		buffer_print_u32(output, id);
 	}
 	return 1;
 }
@@ -351,7 +380,7 @@ rdata_period_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
 	uint32_t period = read_uint32(rdata_atom_data(rdata));
-	buffer_printf(output, "%lu", (unsigned long) period);
+	buffer_print_u32(output, period);
 	return 1;
 }
 
@@ -359,15 +388,38 @@ static int
 rdata_time_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
-	int result = 0;
-	time_t time = (time_t) read_uint32(rdata_atom_data(rdata));
-	struct tm *tm = gmtime(&time);
-	char buf[15];
-	if (strftime(buf, sizeof(buf), "%Y%m%d%H%M%S", tm)) {
-		buffer_printf(output, "%s", buf);
-		result = 1;
+	uint32_t time = read_uint32(rdata_atom_data(rdata));
+	uint32_t secs = time % 86400;
+	/* the civil date from the days since 1970-01-01, in eras of
+	 * 400 years that start on march 1st, instead of gmtime */
+	uint32_t z = time / 86400 + 719468;
+	uint32_t era = z / 146097;
+	uint32_t doe = z - era * 146097;
+	uint32_t yoe = (doe - doe/1460 + doe/36524 - doe/146096) / 365;
+	uint32_t doy = doe - (365*yoe + yoe/4 - yoe/100);
+	uint32_t mp = (5*doy + 2) / 153;
+	uint32_t day = doy - (153*mp + 2)/5 + 1;
+	uint32_t month = mp < 10 ? mp + 3 : mp - 9;
+	uint32_t year = yoe + era * 400 + (month <= 2);
+	uint32_t fields[6];
+	uint8_t *p;
+	int i;
+	fields[0] = year / 100;
+	fields[1] = year % 100;
+	fields[2] = month;
+	fields[3] = day;
+	fields[4] = secs / 3600;
+	fields[5] = (secs / 60) % 60;
+	buffer_reserve(output, 14);
+	p = buffer_current(output);
+	for (i = 0; i < 6; ++i) {
+		*p++ = '0' + fields[i] / 10;
+		*p++ = '0' + fields[i] % 10;
 	}
-	return result;
+	*p++ = '0' + (secs % 60) / 10;
+	*p++ = '0' + secs % 10;
+	buffer_skip(output, 14);
+	return 1;
 }
 
 static int
@@ -394,34 +446,38 @@ static int
 rdata_base64_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
-	int length;
+	static const char b64[] =
+		"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	const uint8_t *data = rdata_atom_data(rdata);
 	size_t size = rdata_atom_size(rdata);
+	size_t i;
+	uint32_t w;
+	uint8_t *p;
 	if(size == 0)
 		return 1;
-	buffer_reserve(output, size * 2 + 1);
-	length = b64_ntop(rdata_atom_data(rdata), size,
-			  (char *) buffer_current(output), size * 2);
-	if (length > 0) {
-		buffer_skip(output, length);
+	/* the same output as b64_ntop, 3 octets into 4 characters */
+	buffer_reserve(output, (size + 2) / 3 * 4);
+	p = buffer_current(output);
+	for (i = 0; i + 2 < size; i += 3) {
+		w = (data[i] << 16) | (data[i+1] << 8) | data[i+2];
+		p[0] = b64[w >> 18];
+		p[1] = b64[(w >> 12) & 0x3f];
+		p[2] = b64[(w >> 6) & 0x3f];
+		p[3] = b64[w & 0x3f];
+		p += 4;
 	}
-	return length != -1;
-}
-
-static void
-hex_to_string(buffer_type *output, const uint8_t *data, size_t size)
-{
-	static const char hexdigits[] = {
-		'0', '1', '2', '3', '4', '5', '6', '7',
-		'8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
-	};
-	size_t i;
-
-	buffer_reserve(output, size * 2);
-	for (i = 0; i < size; ++i) {
-		uint8_t octet = *data++;
-		buffer_write_u8(output, hexdigits[octet >> 4]);
-		buffer_write_u8(output, hexdigits[octet & 0x0f]);
+	if (i < size) {
+		w = data[i] << 16;
+		if (i + 1 < size)
+			w |= data[i+1] << 8;
+		p[0] = b64[w >> 18];
+		p[1] = b64[(w >> 12) & 0x3f];
+		p[2] = (i + 1 < size) ? b64[(w >> 6) & 0x3f] : '=';
+		p[3] = '=';
+		p += 4;
 	}
+	buffer_skip(output, p - buffer_current(output));
+	return 1;
 }
 
 static int
@@ -438,7 +494,7 @@ rdata_hexlen_to_string(buffer_type *output, rdata_atom_type rdata,
 {
 	if(rdata_atom_size(rdata) <= 1) {
 		/* NSEC3 salt hex can be empty */
-		buffer_printf(output, "-");
+		buffer_print_string(output, "-");
 		return 1;
 	}
 	hex_to_string(output, rdata_atom_data(rdata)+1, rdata_atom_size(rdata)-1);
@@ -449,7 +505,7 @@ static int
 rdata_nsap_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
-	buffer_printf(output, "0x");
+	buffer_print_string(output, "0x");
 	hex_to_string(output, rdata_atom_data(rdata), rdata_atom_size(rdata));
 	return 1;
 }
@@ -538,7 +594,7 @@ rdata_ipsecgateway_to_string(buffer_type *output, rdata_atom_type rdata, rr_type
 	int gateway_type = rdata_atom_data(rr->rdatas[1])[0];
 	switch(gateway_type) {
 	case IPSECKEY_NOGATEWAY:
-		buffer_printf(output, ".");
+		buffer_print_string(output, ".");
 		break;
 	case IPSECKEY_IP4:
 		rdata_a_to_string(output, rdata, rr);
@@ -555,7 +611,7 @@ rdata_ipsecgateway_to_string(buffer_type *output, rdata_atom_type rdata, rr_type
 				region_destroy(temp);
 				return 0;
 			}
-			buffer_printf(output, "%s", dname_to_string(d, NULL));
+			buffer_print_string(output, dname_to_string(d, NULL));
 			region_destroy(temp);
 		}
 		break;
@@ -607,12 +663,16 @@ rdata_nsec_to_string(buffer_type *output, rdata_atom_type rdata,
 		}
 
 		for (i = 0; i < bitmap_size * 8; ++i) {
+			if (bitmap[i / 8] == 0) {
+				/* skip the empty octet */
+				i += 7;
+				continue;
+			}
 			if (get_bit(bitmap, i)) {
-				buffer_printf(output,
-					      "%s%s",
-					      insert_space ? " " : "",
-					      rrtype_to_string(
-						      window * 256 + i));
+				if (insert_space)
+					buffer_print_string(output, " ");
+				buffer_print_string(output,
+					rrtype_to_string(window * 256 + i));
 				insert_space = 1;
 			}
 		}
@@ -639,7 +699,9 @@ rdata_unknown_to_string(buffer_type *output, rdata_atom_type rdata,
 	rr_type* ATTR_UNUSED(rr))
 {
  	uint16_t size = rdata_atom_size(rdata);
- 	buffer_printf(output, "\\# %lu ", (unsigned long) size);
+ 	buffer_print_string(output, "\\# ");
+	buffer_print_u32(output, size);
+	buffer_print_string(output, " ");
 	hex_to_string(output, rdata_atom_data(rdata), size);
 	return 1;
 }
@@ -879,7 +941,9 @@ rdata_atoms_to_unknown_string(buffer_type *output,
 	size_t i;
 	size_t size =
 		rdata_maximum_wireformat_size(descriptor, rdata_count, rdatas);
-	buffer_printf(output, " \\# %lu ", (unsigned long) size);
+	buffer_print_string(output, " \\# ");
+	buffer_print_u32(output, size);
+	buffer_print_string(output, " ");
 	for (i = 0; i < rdata_count; ++i) {
 		if (rdata_atom_is_domain(descriptor->type, i)) {
 			const dname_type *dname =
@@ -903,11 +967,11 @@ print_rdata(buffer_type *output, rrtype_descriptor_type *descriptor,
 
 	for (i = 0; i < record->rdata_count; ++i) {
 		if (i == 0) {
-			buffer_printf(output, "\t");
+			buffer_print_string(output, "\t");
 		} else if (descriptor->type == TYPE_SOA && i == 2) {
-			buffer_printf(output, " (\n\t\t");
+			buffer_print_string(output, " (\n\t\t");
 		} else {
-			buffer_printf(output, " ");
+			buffer_print_string(output, " ");
 		}
 		if (!rdata_atom_to_string(
 			    output,
@@ -919,7 +983,7 @@ print_rdata(buffer_type *output, rrtype_descriptor_type *descriptor,
 		}
 	}
 	if (descriptor->type == TYPE_SOA) {
-		buffer_printf(output, " )");
+		buffer_print_string(output, " )");
 	}
 
 	return 1;
@@ -41,6 +41,8 @@
  * nsd-control tool, or a TLS capable web browser. 
  * The channel is secured using TLSv1, and certificates.
  * Both the server and the client(control tool) have their own keys.
+ * A control-interface that is a path, is a local unix socket, that does not
+ * use TLS, access is controlled with the file permissions.
  */
 #include "config.h"
 #ifdef HAVE_SSL
@@ -74,10 +76,12 @@
 #include "xfrd.h"
 #include "xfrd-notify.h"
 #include "xfrd-tcp.h"
+#include "xfrd-watch.h"
 #include "nsd.h"
 #include "options.h"
 #include "difffile.h"
 #include "ipc.h"
+#include "buffer.h"
 
 #ifdef HAVE_SYS_TYPES_H
 #  include <sys/types.h>
@@ -85,6 +89,15 @@
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
+#ifdef HAVE_SYS_UN_H
+#include <sys/un.h>
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_FNMATCH_H
+#include <fnmatch.h>
+#endif
 
 /** number of seconds timeout on incoming remote control handshake */
 #define REMOTE_CONTROL_TCP_TIMEOUT 120
@@ -97,6 +110,66 @@
  * it omits zeroes for types that have no acronym and unused-rcodes */
 const int inhibit_zero = 1;
 
+/** the end of a command result in a session */
+#define SESSION_END_MARKER "\004\n"
+
+/** number of zones printed in one part of a listing, after that the
+ * event loop runs before the next part is printed */
+#define REMOTE_STREAM_PART 1000
+
+/** max length of a command line, and size of the reads from the
+ * connection */
+#define REMOTE_LINE_MAX 1024
+#define REMOTE_READ_SIZE 4096
+
+/**
+ * the stream a command reads from and prints to. The SSL stream, or the
+ * file descriptor for a local socket, where ssl is NULL.
+ */
+typedef struct remote_stream {
+	/** the ssl stream, or NULL for a local socket */
+	SSL* ssl;
+	/** the file descriptor */
+	int fd;
+	/** the output is collected here, and written when the connection
+	 * is writable */
+	buffer_type* out;
+	/** if not NULL, the lines are read from here, the input that was
+	 * read from the connection, the end of it is like EOF */
+	buffer_type* in;
+} RES;
+
+/** zone state filter values for the zonestatus listing */
+enum rc_zone_state {
+	rc_state_any = 0,
+	rc_state_master,
+	rc_state_ok,
+	rc_state_expired,
+	rc_state_refreshing
+};
+
+/**
+ * A listing that is printed in parts, zonestatus for all zones or the
+ * per zone statistics, so that xfrd services other events in between.
+ */
+struct rc_stream {
+	/** what is listed */
+	enum { rc_stream_zonestatus, rc_stream_zonestat } type;
+	/** region with the listing state */
+	region_type* region;
+	/** key of the last printed element, NULL at the start. The dname
+	 * for zonestatus, the name string for zonestat. */
+	void* last;
+	/** filter on the pattern name, or NULL */
+	char* pattern;
+	/** filter with a glob on the name, or NULL */
+	char* glob;
+	/** filter on the zone state */
+	enum rc_zone_state state;
+	/** for the zone statistics, if they are cleared */
+	int clear;
+};
+
 /**
  * a busy control command connection, SSL state
  * Defined here to keep the definition private, and keep SSL out of the .h
@@ -112,15 +185,35 @@ struct rc_state {
 	struct timeval tval;
 	/** in the handshake part */
 	enum { rc_none, rc_hs_read, rc_hs_write } shake_state;
-	/** the ssl state */
+	/** the ssl state, NULL for a local socket */
 	SSL* ssl;
+	/** if the connection is in session mode, it reads more commands */
+	int in_session;
+	/** the listing that is printed in parts, or NULL */
+	struct rc_stream* stream;
+	/** region with the input and output buffers */
+	region_type* region;
+	/** the input that is read and not processed yet */
+	buffer_type* in;
+	/** the output that is not written yet, and how much of it is */
+	buffer_type* out;
+	size_t out_done;
+	/** if the magic string that starts the connection was read */
+	int got_header;
+	/** if the peer has closed the connection, no more input comes */
+	int read_eof;
+	/** if the command is done, the connection is closed after the
+	 * output is written */
+	int done;
 	/** the rc this is part of */
 	struct daemon_remote* rc;
 	/** stats list next item */
 	struct rc_state* stats_next;
 	/** stats list indicator (0 is not part of stats list, 1 is stats,
-	 * 2 is stats_noreset. */
+	 * 2 is stats_noreset, 3 is in the memory list. */
 	int in_stats_list;
+	/** id of the memory report request, if in the memory list */
+	uint32_t mem_id;
 };
 
 /**
@@ -130,6 +223,10 @@ struct acceptlist {
 	struct acceptlist* next;
 	int event_added;
 	struct event c;
+	/** the remote control this is part of */
+	struct daemon_remote* rc;
+	/** if this is a local unix socket, that does not use TLS */
+	int is_local;
 };
 
 /**
@@ -148,6 +245,11 @@ struct daemon_remote {
 	struct rc_state* busy_list;
 	/** commpoints waiting for stats to complete (also in busy_list) */
 	struct rc_state* stats_list;
+	/** commpoints waiting for the memory report, in order of the
+	 * requests (also in busy_list) */
+	struct rc_state* mem_list;
+	/** id of the last memory report request */
+	uint32_t mem_seq;
 	/** last time stats was reported */
 	struct timeval stats_time, boot_time;
 	/** the SSL context for creating new SSL streams */
@@ -156,30 +258,32 @@ struct daemon_remote {
 
 /** 
  * Print fixed line of text over ssl connection in blocking mode
- * @param ssl: print to
+ * @param ssl: print to, the SSL stream or local socket.
  * @param text: the text.
  * @return false on connection failure.
  */
-static int ssl_print_text(SSL* ssl, const char* text);
+static int ssl_print_text(RES* ssl, const char* text);
 
 /** 
  * printf style printing to the ssl connection
- * @param ssl: the SSL connection to print to. Blocking.
+ * @param ssl: the connection to print to. Blocking.
  * @param format: printf style format string.
  * @return success or false on a network failure.
  */
-static int ssl_printf(SSL* ssl, const char* format, ...)
+static int ssl_printf(RES* ssl, const char* format, ...)
         ATTR_FORMAT(printf, 2, 3);
 
 /**
  * Read until \n is encountered
- * If SSL signals EOF, the string up to then is returned (without \n).
- * @param ssl: the SSL connection to read from. blocking.
+ * If the input ends, the string up to then is returned (without \n).
+ * If the input ends before any text, false is returned.
+ * @param ssl: the input to read from, the lines that were read from the
+ * 	connection.
  * @param buf: buffer to read to.
  * @param max: size of buffer.
  * @return false on connection failure.
  */
-static int ssl_read_line(SSL* ssl, char* buf, size_t max);
+static int ssl_read_line(RES* ssl, char* buf, size_t max);
 
 /** perform the accept of a new remote control connection */
 static void
@@ -189,6 +293,16 @@ remote_accept_callback(int fd, short event, void* arg);
 static void
 remote_control_callback(int fd, short event, void* arg);
 
+/** (re)set the event of the connection to wait for ev, read or write */
+static int
+remote_listen(struct daemon_remote* rc, struct rc_state* s, short ev);
+
+#if defined(BIND8_STATS) && defined(USE_ZONE_STATS)
+/** print the next part of the zone statistics listing, true when done */
+static int
+stream_zonestat(RES* ssl, xfrd_state_type* xfrd, struct rc_stream* st);
+#endif
+
 
 /** ---- end of private defines ---- **/
 
@@ -226,11 +340,79 @@ timeval_subtract(struct timeval* d, const struct timeval* end,
 }
 #endif /* BIND8_STATS */
 
-struct daemon_remote*
-daemon_remote_create(struct nsd_options* cfg)
+/** see if a control-interface is a local unix socket, a path name */
+static int
+remote_is_local(const char* ip)
+{
+	return ip && ip[0] == '/';
+}
+
+/** see if the remote control needs TLS, for one of its interfaces */
+static int
+remote_uses_tls(struct nsd_options* cfg)
+{
+	ip_address_option_type* p;
+	if(!cfg->control_interface)
+		return 1; /* the default localhost interfaces */
+	for(p = cfg->control_interface; p; p = p->next) {
+		if(!remote_is_local(p->address))
+			return 1;
+	}
+	return 0;
+}
+
+/** setup the SSL context with the server certificate and key */
+static int
+remote_setup_ctx(struct daemon_remote* rc, struct nsd_options* cfg)
 {
 	char* s_cert;
 	char* s_key;
+	rc->ctx = SSL_CTX_new(SSLv23_server_method());
+	if(!rc->ctx) {
+		log_crypto_err("could not SSL_CTX_new");
+		return 0;
+	}
+	/* no SSLv2, SSLv3 because has defects */
+	if((SSL_CTX_set_options(rc->ctx, SSL_OP_NO_SSLv2) & SSL_OP_NO_SSLv2)
+		!= SSL_OP_NO_SSLv2){
+		log_crypto_err("could not set SSL_OP_NO_SSLv2");
+		return 0;
+	}
+	if((SSL_CTX_set_options(rc->ctx, SSL_OP_NO_SSLv3) & SSL_OP_NO_SSLv3)
+		!= SSL_OP_NO_SSLv3){
+		log_crypto_err("could not set SSL_OP_NO_SSLv3");
+		return 0;
+	}
+	s_cert = cfg->server_cert_file;
+	s_key = cfg->server_key_file;
+	VERBOSITY(2, (LOG_INFO, "setup SSL certificates"));
+	if (!SSL_CTX_use_certificate_file(rc->ctx,s_cert,SSL_FILETYPE_PEM)) {
+		log_msg(LOG_ERR, "Error for server-cert-file: %s", s_cert);
+		log_crypto_err("Error in SSL_CTX use_certificate_file");
+		return 0;
+	}
+	if(!SSL_CTX_use_PrivateKey_file(rc->ctx,s_key,SSL_FILETYPE_PEM)) {
+		log_msg(LOG_ERR, "Error for server-key-file: %s", s_key);
+		log_crypto_err("Error in SSL_CTX use_PrivateKey_file");
+		return 0;
+	}
+	if(!SSL_CTX_check_private_key(rc->ctx)) {
+		log_msg(LOG_ERR, "Error for server-key-file: %s", s_key);
+		log_crypto_err("Error in SSL_CTX check_private_key");
+		return 0;
+	}
+	if(!SSL_CTX_load_verify_locations(rc->ctx, s_cert, NULL)) {
+		log_crypto_err("Error setting up SSL_CTX verify locations");
+		return 0;
+	}
+	SSL_CTX_set_client_CA_list(rc->ctx, SSL_load_client_CA_file(s_cert));
+	SSL_CTX_set_verify(rc->ctx, SSL_VERIFY_PEER, NULL);
+	return 1;
+}
+
+struct daemon_remote*
+daemon_remote_create(struct nsd_options* cfg)
+{
 	struct daemon_remote* rc = (struct daemon_remote*)xalloc_zero(
 		sizeof(*rc));
 	rc->max_active = 10;
@@ -268,56 +450,16 @@ daemon_remote_create(struct nsd_options* cfg)
 		log_msg(LOG_WARNING, "warning: no entropy, seeding openssl PRNG with time");
 	}
 
-	rc->ctx = SSL_CTX_new(SSLv23_server_method());
-	if(!rc->ctx) {
-		log_crypto_err("could not SSL_CTX_new");
-		free(rc);
-		return NULL;
-	}
-	/* no SSLv2, SSLv3 because has defects */
-	if((SSL_CTX_set_options(rc->ctx, SSL_OP_NO_SSLv2) & SSL_OP_NO_SSLv2)
-		!= SSL_OP_NO_SSLv2){
-		log_crypto_err("could not set SSL_OP_NO_SSLv2");
-		daemon_remote_delete(rc);
-		return NULL;
-	}
-	if((SSL_CTX_set_options(rc->ctx, SSL_OP_NO_SSLv3) & SSL_OP_NO_SSLv3)
-		!= SSL_OP_NO_SSLv3){
-		log_crypto_err("could not set SSL_OP_NO_SSLv3");
-		daemon_remote_delete(rc);
-		return NULL;
-	}
-	s_cert = cfg->server_cert_file;
-	s_key = cfg->server_key_file;
-	VERBOSITY(2, (LOG_INFO, "setup SSL certificates"));
-	if (!SSL_CTX_use_certificate_file(rc->ctx,s_cert,SSL_FILETYPE_PEM)) {
-		log_msg(LOG_ERR, "Error for server-cert-file: %s", s_cert);
-		log_crypto_err("Error in SSL_CTX use_certificate_file");
-		goto setup_error;
-	}
-	if(!SSL_CTX_use_PrivateKey_file(rc->ctx,s_key,SSL_FILETYPE_PEM)) {
-		log_msg(LOG_ERR, "Error for server-key-file: %s", s_key);
-		log_crypto_err("Error in SSL_CTX use_PrivateKey_file");
-		goto setup_error;
-	}
-	if(!SSL_CTX_check_private_key(rc->ctx)) {
-		log_msg(LOG_ERR, "Error for server-key-file: %s", s_key);
-		log_crypto_err("Error in SSL_CTX check_private_key");
-		goto setup_error;
-	}
-	if(!SSL_CTX_load_verify_locations(rc->ctx, s_cert, NULL)) {
-		log_crypto_err("Error setting up SSL_CTX verify locations");
-	setup_error:
+	if(remote_uses_tls(cfg) && !remote_setup_ctx(rc, cfg)) {
 		daemon_remote_delete(rc);
 		return NULL;
 	}
-	SSL_CTX_set_client_CA_list(rc->ctx, SSL_load_client_CA_file(s_cert));
-	SSL_CTX_set_verify(rc->ctx, SSL_VERIFY_PEER, NULL);
 
 	/* and try to open the ports */
 	if(!daemon_remote_open_ports(rc, cfg)) {
 		log_msg(LOG_ERR, "could not open remote control port");
-		goto setup_error;
+		daemon_remote_delete(rc);
+		return NULL;
 	}
 
 	if(gettimeofday(&rc->boot_time, NULL) == -1)
@@ -423,10 +565,70 @@ create_tcp_accept_sock(struct addrinfo* addr, int* noproto)
 	return s;
 }
 
+/** create the local unix socket for the control-interface path */
+static int
+create_local_accept_sock(const char* path)
+{
+#ifdef HAVE_SYS_UN_H
+	int s;
+	struct sockaddr_un usock;
+	if(strlen(path) >= sizeof(usock.sun_path)) {
+		log_msg(LOG_ERR, "control-interface path too long: %s", path);
+		return -1;
+	}
+	memset(&usock, 0, sizeof(usock));
+	usock.sun_family = AF_UNIX;
+	strlcpy(usock.sun_path, path, sizeof(usock.sun_path));
+	if ((s = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+		log_msg(LOG_ERR, "can't create a local socket: %s",
+			strerror(errno));
+		return -1;
+	}
+	/* remove the socket file of a previous run */
+	(void)unlink(path);
+	if (fcntl(s, F_SETFL, O_NONBLOCK) == -1) {
+		log_msg(LOG_ERR, "cannot fcntl local socket: %s",
+			strerror(errno));
+	}
+	if (bind(s, (struct sockaddr *)&usock, (socklen_t)sizeof(usock))
+		!= 0) {
+		log_msg(LOG_ERR, "can't bind local socket %s: %s", path,
+			strerror(errno));
+		close(s);
+		return -1;
+	}
+	if (listen(s, TCP_BACKLOG_REMOTE) == -1) {
+		log_msg(LOG_ERR, "can't listen on %s: %s", path,
+			strerror(errno));
+		close(s);
+		return -1;
+	}
+	/* access is with the file permissions, for the user and group of
+	 * nsd, whatever the umask is */
+	if(chmod(path, (mode_t)(S_IRUSR|S_IWUSR|S_IRGRP|S_IWGRP)) == -1) {
+		log_msg(LOG_ERR, "cannot chmod %s: %s", path,
+			strerror(errno));
+		close(s);
+		return -1;
+	}
+	if(geteuid() == 0 && (nsd.uid || nsd.gid) &&
+		chown(path, nsd.uid, nsd.gid) == -1) {
+		log_msg(LOG_ERR, "cannot chown %u.%u %s: %s",
+			(unsigned)nsd.uid, (unsigned)nsd.gid, path,
+			strerror(errno));
+	}
+	return s;
+#else
+	log_msg(LOG_ERR, "control-interface %s: no local sockets on this "
+		"system", path);
+	return -1;
+#endif /* HAVE_SYS_UN_H */
+}
+
 /**
  * Add and open a new control port
  * @param rc: rc with result list.
- * @param ip: ip str
+ * @param ip: ip str, or path of a local socket.
  * @param nr: port nr
  * @param noproto_is_err: if lack of protocol support is an error.
  * @return false on failure.
@@ -440,6 +642,18 @@ add_open(struct daemon_remote* rc, const char* ip, int nr, int noproto_is_err)
 	int noproto;
 	int fd, r;
 	char port[15];
+	if(remote_is_local(ip)) {
+		if((fd = create_local_accept_sock(ip)) == -1)
+			return 0;
+		hl = (struct acceptlist*)xalloc_zero(sizeof(*hl));
+		hl->next = rc->accept_list;
+		rc->accept_list = hl;
+		hl->c.ev_fd = fd;
+		hl->event_added = 0;
+		hl->rc = rc;
+		hl->is_local = 1;
+		return 1;
+	}
 	snprintf(port, sizeof(port), "%d", nr);
 	port[sizeof(port)-1]=0;
 	memset(&hints, 0, sizeof(hints));
@@ -479,6 +693,7 @@ add_open(struct daemon_remote* rc, const char* ip, int nr, int noproto_is_err)
 
 	hl->c.ev_fd = fd;
 	hl->event_added = 0;
+	hl->rc = rc;
 	return 1;
 }
 
@@ -517,7 +732,7 @@ daemon_remote_attach(struct daemon_remote* rc, struct xfrd_state* xfrd)
 		/* add event */
 		fd = p->c.ev_fd;
 		event_set(&p->c, fd, EV_PERSIST|EV_READ, remote_accept_callback,
-			rc);
+			p);
 		if(event_base_set(xfrd->event_base, &p->c) != 0)
 			log_msg(LOG_ERR, "remote: cannot set event_base");
 		if(event_add(&p->c, NULL) != 0)
@@ -529,7 +744,8 @@ daemon_remote_attach(struct daemon_remote* rc, struct xfrd_state* xfrd)
 static void
 remote_accept_callback(int fd, short event, void* arg)
 {
-	struct daemon_remote *rc = (struct daemon_remote*)arg;
+	struct acceptlist* hl = (struct acceptlist*)arg;
+	struct daemon_remote *rc = hl->rc;
 #ifdef INET6
 	struct sockaddr_storage addr;
 #else
@@ -583,16 +799,21 @@ remote_accept_callback(int fd, short event, void* arg)
 
 	n->tval.tv_sec = REMOTE_CONTROL_TCP_TIMEOUT; 
 	n->tval.tv_usec = 0L;
+	n->region = region_create(xalloc, free);
+	n->in = buffer_create(n->region, REMOTE_READ_SIZE);
+	n->out = buffer_create(n->region, REMOTE_READ_SIZE);
 
 	event_set(&n->c, newfd, EV_PERSIST|EV_TIMEOUT|EV_READ,
 		remote_control_callback, n);
 	if(event_base_set(xfrd->event_base, &n->c) != 0) {
 		log_msg(LOG_ERR, "remote_accept: cannot set event_base");
+		region_destroy(n->region);
 		free(n);
 		goto close_exit;
 	}
 	if(event_add(&n->c, &n->tval) != 0) {
 		log_msg(LOG_ERR, "remote_accept: cannot add event");
+		region_destroy(n->region);
 		free(n);
 		goto close_exit;
 	}
@@ -600,31 +821,45 @@ remote_accept_callback(int fd, short event, void* arg)
 
 	if(2 <= verbosity) {
 		char s[128];
-		addr2str(&addr, s, sizeof(s));
+		if(hl->is_local)
+			strlcpy(s, "local socket", sizeof(s));
+		else	addr2str(&addr, s, sizeof(s));
 		VERBOSITY(2, (LOG_INFO, "new control connection from %s", s));
 	}
 
+	n->rc = rc;
+	if(hl->is_local) {
+		/* no TLS on the local socket, the handshake is skipped */
+		n->shake_state = rc_none;
+		n->ssl = NULL;
+		goto setup_list;
+	}
 	n->shake_state = rc_hs_read;
 	n->ssl = SSL_new(rc->ctx);
 	if(!n->ssl) {
 		log_crypto_err("could not SSL_new");
 		event_del(&n->c);
+		region_destroy(n->region);
 		free(n);
 		goto close_exit;
 	}
 	SSL_set_accept_state(n->ssl);
         (void)SSL_set_mode(n->ssl, SSL_MODE_AUTO_RETRY);
+	/* the output buffer can grow while a write waits to be retried */
+	(void)SSL_set_mode(n->ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 	if(!SSL_set_fd(n->ssl, newfd)) {
 		log_crypto_err("could not SSL_set_fd");
 		event_del(&n->c);
 		SSL_free(n->ssl);
+		region_destroy(n->region);
 		free(n);
 		goto close_exit;
 	}
 
-	n->rc = rc;
+setup_list:
 	n->stats_next = NULL;
 	n->in_stats_list = 0;
+	n->in_session = 0;
 	n->prev = NULL;
 	n->next = rc->busy_list;
 	if(n->next) n->next->prev = n;
@@ -662,7 +897,9 @@ stats_list_remove_elem(struct rc_state** list, struct rc_state* todel)
 static void
 clean_point(struct daemon_remote* rc, struct rc_state* s)
 {
-	if(s->in_stats_list)
+	if(s->in_stats_list == 3)
+		stats_list_remove_elem(&rc->mem_list, s);
+	else if(s->in_stats_list)
 		stats_list_remove_elem(&rc->stats_list, s);
 	state_list_remove_elem(&rc->busy_list, s);
 	rc->active --;
@@ -672,32 +909,30 @@ clean_point(struct daemon_remote* rc, struct rc_state* s)
 		SSL_shutdown(s->ssl);
 		SSL_free(s->ssl);
 	}
+	if(s->stream)
+		region_destroy(s->stream->region);
+	region_destroy(s->region);
 	close(s->c.ev_fd);
 	free(s);
 }
 
 static int
-ssl_print_text(SSL* ssl, const char* text)
+ssl_print_text(RES* ssl, const char* text)
 {
-	int r;
-	if(!ssl) 
-		return 0;
-	ERR_clear_error();
-	if((r=SSL_write(ssl, text, (int)strlen(text))) <= 0) {
-		if(SSL_get_error(ssl, r) == SSL_ERROR_ZERO_RETURN) {
-			VERBOSITY(2, (LOG_WARNING, "in SSL_write, peer "
-				"closed connection"));
-			return 0;
-		}
-		log_crypto_err("could not SSL_write");
+	size_t len;
+	if(!ssl || !ssl->out)
 		return 0;
-	}
+	/* collect the output, it is written when the connection is
+	 * writable */
+	len = strlen(text);
+	buffer_reserve(ssl->out, len);
+	buffer_write(ssl->out, text, len);
 	return 1;
 }
 
 /** print text over the ssl connection */
 static int
-ssl_print_vmsg(SSL* ssl, const char* format, va_list args)
+ssl_print_vmsg(RES* ssl, const char* format, va_list args)
 {
 	char msg[1024];
 	vsnprintf(msg, sizeof(msg), format, args);
@@ -706,7 +941,7 @@ ssl_print_vmsg(SSL* ssl, const char* format, va_list args)
 
 /** printf style printing to the ssl connection */
 static int
-ssl_printf(SSL* ssl, const char* format, ...)
+ssl_printf(RES* ssl, const char* format, ...)
 {
 	va_list args;
 	int ret;
@@ -717,22 +952,18 @@ ssl_printf(SSL* ssl, const char* format, ...)
 }
 
 static int
-ssl_read_line(SSL* ssl, char* buf, size_t max)
+ssl_read_line(RES* ssl, char* buf, size_t max)
 {
-	int r;
 	size_t len = 0;
-	if(!ssl)
+	if(!ssl || !ssl->in)
 		return 0;
 	while(len < max) {
-		ERR_clear_error();
-		if((r=SSL_read(ssl, buf+len, 1)) <= 0) {
-			if(SSL_get_error(ssl, r) == SSL_ERROR_ZERO_RETURN) {
-				buf[len] = 0;
-				return 1;
-			}
-			log_crypto_err("could not SSL_read");
-			return 0;
+		if(buffer_remaining(ssl->in) == 0) {
+			/* the end of the input that was read */
+			buf[len] = 0;
+			return (len != 0);
 		}
+		buf[len] = (char)buffer_read_u8(ssl->in);
 		if(buf[len] == '\n') {
 			/* return string without \n */
 			buf[len] = 0;
@@ -757,14 +988,14 @@ skipwhite(char* str)
 
 /** send the OK to the control client */
 static void
-send_ok(SSL* ssl)
+send_ok(RES* ssl)
 {
 	(void)ssl_printf(ssl, "ok\n");
 }
 
 /** get zone argument (if any) or NULL, false on error */
 static int
-get_zone_arg(SSL* ssl, xfrd_state_type* xfrd, char* arg,
+get_zone_arg(RES* ssl, xfrd_state_type* xfrd, char* arg,
 	struct zone_options** zo)
 {
 	const dname_type* dname;
@@ -790,7 +1021,7 @@ get_zone_arg(SSL* ssl, xfrd_state_type* xfrd, char* arg,
 
 /** do the stop command */
 static void
-do_stop(SSL* ssl, xfrd_state_type* xfrd)
+do_stop(RES* ssl, xfrd_state_type* xfrd)
 {
 	xfrd->need_to_send_shutdown = 1;
 
@@ -803,7 +1034,7 @@ do_stop(SSL* ssl, xfrd_state_type* xfrd)
 
 /** do the log_reopen command, it only needs reload_now */
 static void
-do_log_reopen(SSL* ssl, xfrd_state_type* xfrd)
+do_log_reopen(RES* ssl, xfrd_state_type* xfrd)
 {
 	xfrd_set_reload_now(xfrd);
 	send_ok(ssl);
@@ -811,20 +1042,22 @@ do_log_reopen(SSL* ssl, xfrd_state_type* xfrd)
 
 /** do the reload command */
 static void
-do_reload(SSL* ssl, xfrd_state_type* xfrd, char* arg)
+do_reload(RES* ssl, xfrd_state_type* xfrd, char* arg)
 {
 	struct zone_options* zo;
 	if(!get_zone_arg(ssl, xfrd, arg, &zo))
 		return;
-	task_new_check_zonefiles(xfrd->nsd->task[xfrd->nsd->mytask],
-		xfrd->last_task, zo?(const dname_type*)zo->node.key:NULL);
+	if(zo)
+		task_new_check_zonefiles(xfrd->nsd->task[xfrd->nsd->mytask],
+			xfrd->last_task, (const dname_type*)zo->node.key);
+	else	xfrd_watch_check_zonefiles(xfrd);
 	xfrd_set_reload_now(xfrd);
 	send_ok(ssl);
 }
 
 /** do the write command */
 static void
-do_write(SSL* ssl, xfrd_state_type* xfrd, char* arg)
+do_write(RES* ssl, xfrd_state_type* xfrd, char* arg)
 {
 	struct zone_options* zo;
 	if(!get_zone_arg(ssl, xfrd, arg, &zo))
@@ -837,7 +1070,7 @@ do_write(SSL* ssl, xfrd_state_type* xfrd, char* arg)
 
 /** do the notify command */
 static void
-do_notify(SSL* ssl, xfrd_state_type* xfrd, char* arg)
+do_notify(RES* ssl, xfrd_state_type* xfrd, char* arg)
 {
 	struct zone_options* zo;
 	if(!get_zone_arg(ssl, xfrd, arg, &zo))
@@ -862,7 +1095,7 @@ do_notify(SSL* ssl, xfrd_state_type* xfrd, char* arg)
 
 /** do the transfer command */
 static void
-do_transfer(SSL* ssl, xfrd_state_type* xfrd, char* arg)
+do_transfer(RES* ssl, xfrd_state_type* xfrd, char* arg)
 {
 	struct zone_options* zo;
 	xfrd_zone_type* zone;
@@ -903,7 +1136,7 @@ force_transfer_zone(xfrd_zone_type* zone)
 
 /** do the force transfer command */
 static void
-do_force_transfer(SSL* ssl, xfrd_state_type* xfrd, char* arg)
+do_force_transfer(RES* ssl, xfrd_state_type* xfrd, char* arg)
 {
 	struct zone_options* zo;
 	xfrd_zone_type* zone;
@@ -927,11 +1160,11 @@ do_force_transfer(SSL* ssl, xfrd_state_type* xfrd, char* arg)
 }
 
 static int
-print_soa_status(SSL* ssl, const char* str, xfrd_soa_type* soa, time_t acq)
+print_soa_status(RES* ssl, const char* str, uint32_t serial, time_t acq)
 {
 	if(acq) {
 		if(!ssl_printf(ssl, "	%s: \"%u since %s\"\n", str,
-			(unsigned)ntohl(soa->serial), xfrd_pretty_time(acq)))
+			(unsigned)ntohl(serial), xfrd_pretty_time(acq)))
 			return 0;
 	} else {
 		if(!ssl_printf(ssl, "	%s: none\n", str))
@@ -942,7 +1175,7 @@ print_soa_status(SSL* ssl, const char* str, xfrd_soa_type* soa, time_t acq)
 
 /** print zonestatus for one domain */
 static int
-print_zonestatus(SSL* ssl, xfrd_state_type* xfrd, struct zone_options* zo)
+print_zonestatus(RES* ssl, xfrd_state_type* xfrd, struct zone_options* zo)
 {
 	xfrd_zone_type* xz = (xfrd_zone_type*)rbtree_search(xfrd->zones,
 		(const dname_type*)zo->node.key);
@@ -975,17 +1208,24 @@ print_zonestatus(SSL* ssl, xfrd_state_type* xfrd, struct zone_options* zo)
 		(xz->state == xfrd_zone_ok)?"ok":(
 		(xz->state == xfrd_zone_expired)?"expired":"refreshing")))
 		return 0;
-	if(!print_soa_status(ssl, "served-serial", &xz->soa_nsd,
+	if(!print_soa_status(ssl, "served-serial", xz->soa_nsd.serial,
 		xz->soa_nsd_acquired))
 		return 0;
-	if(!print_soa_status(ssl, "commit-serial", &xz->soa_disk,
+	if(!print_soa_status(ssl, "commit-serial", xz->soa_disk.serial,
 		xz->soa_disk_acquired))
 		return 0;
 	if(xz->round_num != -1) {
-		if(!print_soa_status(ssl, "notified-serial", &xz->soa_notified,
+		if(!print_soa_status(ssl, "notified-serial",
+			xz->soa_notified_serial,
 			xz->soa_notified_acquired))
 			return 0;
 	}
+	if(xz->ixfr_cost != 0 || xz->axfr_cost != 0) {
+		if(!ssl_printf(ssl, "	apply-cost: \"ixfr %u nsec per RR, "
+			"axfr %u msec\"\n", (unsigned)xz->ixfr_cost,
+			(unsigned)(xz->axfr_cost/1000)))
+			return 0;
+	}
 
 	/* UDP */
 	if(xz->udp_waiting) {
@@ -1010,26 +1250,180 @@ print_zonestatus(SSL* ssl, xfrd_state_type* xfrd, struct zone_options* zo)
 	return 1;
 }
 
+/** create the state for a listing that is printed in parts */
+static struct rc_stream*
+stream_create(int type)
+{
+	region_type* region = region_create(xalloc, free);
+	struct rc_stream* st = (struct rc_stream*)region_alloc_zero(region,
+		sizeof(*st));
+	st->type = type;
+	st->region = region;
+	st->state = rc_state_any;
+	return st;
+}
+
+/** delete the listing state */
+static void
+stream_delete(struct rc_stream* st)
+{
+	if(st)
+		region_destroy(st->region);
+}
+
+/** the state of the zone, as printed by zonestatus */
+static enum rc_zone_state
+zone_state(xfrd_state_type* xfrd, struct zone_options* zo)
+{
+	xfrd_zone_type* xz = (xfrd_zone_type*)rbtree_search(xfrd->zones,
+		(const dname_type*)zo->node.key);
+	if(!xz)
+		return rc_state_master;
+	if(xz->state == xfrd_zone_ok)
+		return rc_state_ok;
+	if(xz->state == xfrd_zone_expired)
+		return rc_state_expired;
+	return rc_state_refreshing;
+}
+
+/** parse the filters of a listing, pattern=<name> state=<state> and
+ * name=<glob>, only the name filter is there for the statistics.
+ * returns false on error, that is printed */
+static int
+parse_stream_filter(RES* ssl, char* arg, struct rc_stream* st, int zones)
+{
+	char* tok;
+	while(*(arg = skipwhite(arg))) {
+		tok = arg;
+		while(*arg && !isspace((unsigned char)*arg))
+			arg++;
+		if(*arg)
+			*arg++ = 0;
+		if(zones && strncmp(tok, "pattern=", 8) == 0) {
+			st->pattern = region_strdup(st->region, tok+8);
+		} else if(zones && strncmp(tok, "state=", 6) == 0) {
+			if(strcmp(tok+6, "master") == 0)
+				st->state = rc_state_master;
+			else if(strcmp(tok+6, "ok") == 0)
+				st->state = rc_state_ok;
+			else if(strcmp(tok+6, "expired") == 0)
+				st->state = rc_state_expired;
+			else if(strcmp(tok+6, "refreshing") == 0)
+				st->state = rc_state_refreshing;
+			else {
+				(void)ssl_printf(ssl, "error unknown state "
+					"'%s'\n", tok+6);
+				return 0;
+			}
+		} else if(strncmp(tok, "name=", 5) == 0) {
+#ifdef HAVE_FNMATCH_H
+			st->glob = region_strdup(st->region, tok+5);
+#else
+			(void)ssl_printf(ssl, "error no glob support on this "
+				"system\n");
+			return 0;
+#endif
+		} else {
+			(void)ssl_printf(ssl, "error unknown filter '%s'\n",
+				tok);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/** see if the name matches the glob filter of the listing */
+static int
+stream_glob_match(struct rc_stream* st, const char* name)
+{
+#ifdef HAVE_FNMATCH_H
+	if(st->glob && fnmatch(st->glob, name, 0) != 0)
+		return 0;
+#else
+	(void)st; (void)name;
+#endif
+	return 1;
+}
+
+/** see if the zone matches the filters of the zonestatus listing */
+static int
+zonestatus_match(xfrd_state_type* xfrd, struct zone_options* zo,
+	struct rc_stream* st)
+{
+	if(st->pattern && strcmp(st->pattern, zo->pattern->pname) != 0)
+		return 0;
+	if(st->state != rc_state_any && st->state != zone_state(xfrd, zo))
+		return 0;
+	return stream_glob_match(st, zo->name);
+}
+
+/** find the element after the last printed element of the listing, the
+ * tree can have changed in between the parts */
+static rbnode_type*
+stream_next(rbtree_type* tree, struct rc_stream* st)
+{
+	rbnode_type* n = NULL;
+	if(!st->last)
+		return rbtree_first(tree);
+	(void)rbtree_find_less_equal(tree, st->last, &n);
+	if(!n)
+		return rbtree_first(tree);
+	return rbtree_next(n);
+}
+
+/** print the next part of the zonestatus listing, true when done */
+static int
+stream_zonestatus(RES* ssl, xfrd_state_type* xfrd, struct rc_stream* st)
+{
+	rbnode_type* n, *last = NULL;
+	int num = 0;
+	for(n = stream_next(xfrd->nsd->options->zone_options, st);
+		n != RBTREE_NULL && num < REMOTE_STREAM_PART;
+		n = rbtree_next(n)) {
+		struct zone_options* zo = (struct zone_options*)n;
+		num++;
+		last = n;
+		if(!zonestatus_match(xfrd, zo, st))
+			continue;
+		(void)print_zonestatus(ssl, xfrd, zo);
+	}
+	if(n == RBTREE_NULL)
+		return 1;
+	/* continue after this zone in the next part */
+	if(st->last)
+		region_recycle(st->region, st->last, dname_total_size(
+			(const dname_type*)st->last));
+	st->last = (void*)dname_copy(st->region,
+		(const dname_type*)last->key);
+	return 0;
+}
+
 /** do the zonestatus command */
 static void
-do_zonestatus(SSL* ssl, xfrd_state_type* xfrd, char* arg)
+do_zonestatus(RES* ssl, xfrd_state_type* xfrd, char* arg,
+	struct rc_state* rs)
 {
 	struct zone_options* zo;
-	if(!get_zone_arg(ssl, xfrd, arg, &zo))
+	struct rc_stream* st;
+	if(arg[0] && !strchr(arg, '=')) {
+		/* one zone */
+		if(!get_zone_arg(ssl, xfrd, arg, &zo))
+			return;
+		(void)print_zonestatus(ssl, xfrd, zo);
 		return;
-	if(zo) (void)print_zonestatus(ssl, xfrd, zo);
-	else {
-		RBTREE_FOR(zo, struct zone_options*,
-			xfrd->nsd->options->zone_options) {
-			if(!print_zonestatus(ssl, xfrd, zo))
-				return;
-		}
 	}
+	/* all zones, that match the filters, printed in parts */
+	st = stream_create(rc_stream_zonestatus);
+	if(!parse_stream_filter(ssl, arg, st, 1)) {
+		stream_delete(st);
+		return;
+	}
+	rs->stream = st;
 }
 
 /** do the verbosity command */
 static void
-do_verbosity(SSL* ssl, char* str)
+do_verbosity(RES* ssl, char* str)
 {
 	int val = atoi(str);
 	if(strcmp(str, "") == 0) {
@@ -1049,7 +1443,7 @@ do_verbosity(SSL* ssl, char* str)
 
 /** find second argument, modifies string */
 static int
-find_arg2(SSL* ssl, char* arg, char** arg2)
+find_arg2(RES* ssl, char* arg, char** arg2)
 {
 	char* as = strrchr(arg, ' ');
 	if(as) {
@@ -1067,7 +1461,7 @@ find_arg2(SSL* ssl, char* arg, char** arg2)
 
 /** do the status command */
 static void
-do_status(SSL* ssl, xfrd_state_type* xfrd)
+do_status(RES* ssl, xfrd_state_type* xfrd)
 {
 	if(!ssl_printf(ssl, "version: %s\n", PACKAGE_VERSION))
 		return;
@@ -1084,9 +1478,26 @@ do_status(SSL* ssl, xfrd_state_type* xfrd)
 
 /** do the stats command */
 static void
-do_stats(struct daemon_remote* rc, int peek, struct rc_state* rs)
+do_stats(RES* ssl, struct daemon_remote* rc, int peek, struct rc_state* rs,
+	char* arg)
 {
 #ifdef BIND8_STATS
+#ifdef USE_ZONE_STATS
+	/* the zone statistics are printed in parts after the totals */
+	struct rc_stream* st = stream_create(rc_stream_zonestat);
+	if(!parse_stream_filter(ssl, arg, st, 0)) {
+		stream_delete(st);
+		return;
+	}
+	st->clear = !peek;
+	rs->stream = st;
+#else
+	if(*arg) {
+		(void)ssl_printf(ssl, "error no zone statistics enabled at "
+			"compile time\n");
+		return;
+	}
+#endif /* USE_ZONE_STATS */
 	/* queue up to get stats after a reload is done (to gather statistics
 	 * from the servers) */
 	assert(!rs->in_stats_list);
@@ -1100,11 +1511,44 @@ do_stats(struct daemon_remote* rc, int peek, struct rc_state* rs)
 	/* force a reload */
 	xfrd_set_reload_now(xfrd);
 #else
-	(void)rc; (void)peek;
-	(void)ssl_printf(rs->ssl, "error no stats enabled at compile time\n");
+	(void)rc; (void)peek; (void)rs; (void)arg;
+	(void)ssl_printf(ssl, "error no stats enabled at compile time\n");
 #endif /* BIND8_STATS */
 }
 
+/** do the memory command */
+static void
+do_memory(RES* ssl, struct daemon_remote* rc, struct rc_state* rs,
+	char* arg)
+{
+	struct rc_state** p;
+	struct zone_options* zo;
+	xfrd_state_type* xfrd = rc->xfrd;
+	if(!get_zone_arg(ssl, xfrd, arg, &zo))
+		return;
+	/* the reload counts the memory and the report is printed after it,
+	 * the id finds this connection when the report comes back */
+	rs->mem_id = ++rc->mem_seq;
+	task_new_mem_info(xfrd->nsd->task[xfrd->nsd->mytask],
+		xfrd->last_task, zo?(const dname_type*)zo->node.key:NULL,
+		rs->mem_id);
+	assert(!rs->in_stats_list);
+	rs->in_stats_list = 3;
+	rs->stats_next = NULL;
+	for(p = &rc->mem_list; *p; p = &(*p)->stats_next)
+		;
+	*p = rs;
+	/* no reads while waiting for the reload, but time out if the
+	 * reload fails and the report does not come */
+	if(!remote_listen(rc, rs, 0)) {
+		stats_list_remove_elem(&rc->mem_list, rs);
+		rs->in_stats_list = 0;
+		(void)ssl_printf(ssl, "error cannot wait for the report\n");
+		return;
+	}
+	xfrd_set_reload_now(xfrd);
+}
+
 /** see if we have more zonestatistics entries and it has to be incremented */
 static void
 zonestat_inc_ifneeded(xfrd_state_type* xfrd)
@@ -1119,9 +1563,10 @@ zonestat_inc_ifneeded(xfrd_state_type* xfrd)
 #endif /* USE_ZONE_STATS */
 }
 
-/** perform the addzone command for one zone */
+/** perform the addzone command for one zone, the caller schedules the
+ * reload */
 static int
-perform_addzone(SSL* ssl, xfrd_state_type* xfrd, char* arg)
+perform_addzone(RES* ssl, xfrd_state_type* xfrd, char* arg)
 {
 	const dname_type* dname;
 	struct zone_options* zopt;
@@ -1171,20 +1616,20 @@ perform_addzone(SSL* ssl, xfrd_state_type* xfrd, char* arg)
 	task_new_add_zone(xfrd->nsd->task[xfrd->nsd->mytask],
 		xfrd->last_task, arg, arg2,
 		getzonestatid(xfrd->nsd->options, zopt));
-	zonestat_inc_ifneeded(xfrd);
-	xfrd_set_reload_now(xfrd);
 	/* add to xfrd - notify (for master and slaves) */
 	init_notify_send(xfrd->notify_zones, xfrd->region, zopt);
 	/* add to xfrd - slave */
 	if(zone_is_slave(zopt)) {
 		xfrd_init_slave_zone(xfrd, zopt);
 	}
+	xfrd_watch_add_zone(xfrd->watch, zopt);
 	return 1;
 }
 
-/** perform the delzone command for one zone */
+/** perform the delzone command for one zone, the caller schedules the
+ * reload */
 static int
-perform_delzone(SSL* ssl, xfrd_state_type* xfrd, char* arg)
+perform_delzone(RES* ssl, xfrd_state_type* xfrd, char* arg)
 {
 	const dname_type* dname;
 	struct zone_options* zopt;
@@ -1219,12 +1664,12 @@ perform_delzone(SSL* ssl, xfrd_state_type* xfrd, char* arg)
 	/* create deletion task */
 	task_new_del_zone(xfrd->nsd->task[xfrd->nsd->mytask],
 		xfrd->last_task, dname);
-	xfrd_set_reload_now(xfrd);
 	/* delete it in xfrd */
 	if(zone_is_slave(zopt)) {
 		xfrd_del_slave_zone(xfrd, dname);
 	}
 	xfrd_del_notify(xfrd, dname);
+	xfrd_watch_del_zone(xfrd->watch, zopt);
 	/* delete from config */
 	zone_list_del(xfrd->nsd->options, zopt);
 
@@ -1234,63 +1679,178 @@ perform_delzone(SSL* ssl, xfrd_state_type* xfrd, char* arg)
 
 /** do the addzone command */
 static void
-do_addzone(SSL* ssl, xfrd_state_type* xfrd, char* arg)
+do_addzone(RES* ssl, xfrd_state_type* xfrd, char* arg)
 {
 	if(!perform_addzone(ssl, xfrd, arg))
 		return;
+	zonestat_inc_ifneeded(xfrd);
+	xfrd_set_reload_now(xfrd);
 	send_ok(ssl);
 }
 
 /** do the delzone command */
 static void
-do_delzone(SSL* ssl, xfrd_state_type* xfrd, char* arg)
+do_delzone(RES* ssl, xfrd_state_type* xfrd, char* arg)
 {
 	if(!perform_delzone(ssl, xfrd, arg))
 		return;
+	xfrd_set_reload_now(xfrd);
 	send_ok(ssl);
 }
 
-/** do the addzones command */
-static void
-do_addzones(SSL* ssl, xfrd_state_type* xfrd)
+/** line of input for the addzones and delzones commands */
+struct bulk_line {
+	/** next in list */
+	struct bulk_line* next;
+	/** the input line */
+	char* line;
+};
+
+/** check a line for the addzones command, before anything is changed */
+static int
+check_addzone(RES* ssl, xfrd_state_type* xfrd, region_type* region,
+	char* line)
+{
+	char* arg = region_strdup(region, line);
+	char* arg2 = NULL;
+	if(!find_arg2(ssl, arg, &arg2))
+		return 0;
+	if(!rbtree_search(xfrd->nsd->options->patterns, arg2)) {
+		(void)ssl_printf(ssl, "error pattern %s does not exist\n",
+			arg2);
+		return 0;
+	}
+	if(!dname_parse(region, arg)) {
+		(void)ssl_printf(ssl, "error cannot parse zone name\n");
+		return 0;
+	}
+	return 1;
+}
+
+/** check a line for the delzones command, before anything is changed */
+static int
+check_delzone(RES* ssl, xfrd_state_type* xfrd, region_type* region,
+	char* line)
+{
+	struct zone_options* zopt;
+	const dname_type* dname = dname_parse(region, line);
+	if(!dname) {
+		(void)ssl_printf(ssl, "error cannot parse zone name\n");
+		return 0;
+	}
+	zopt = zone_options_find(xfrd->nsd->options, dname);
+	if(zopt && zopt->part_of_config) {
+		(void)ssl_printf(ssl, "error zone defined in nsd.conf, "
+			"cannot delete it in this manner: remove it from "
+			"nsd.conf yourself and repattern\n");
+		return 0;
+	}
+	return 1;
+}
+
+/** read all input lines for addzones or delzones, and check them.
+ * returns the list of lines, in order, or NULL if nothing is to be done,
+ * because of an error or an empty input. The failures are counted. */
+static struct bulk_line*
+read_bulk_lines(RES* ssl, xfrd_state_type* xfrd, region_type* region,
+	int (*check)(RES*, xfrd_state_type*, region_type*, char*),
+	int* fail)
 {
 	char buf[2048];
-	int num = 0;
+	struct bulk_line* first = NULL, *last = NULL, *b;
+	*fail = 0;
 	while(ssl_read_line(ssl, buf, sizeof(buf))) {
 		if(buf[0] == 0x04 && buf[1] == 0)
 			break; /* end of transmission */
-		if(!perform_addzone(ssl, xfrd, buf)) {
-			if(!ssl_printf(ssl, "error for input line '%s'\n", 
+		/* the input is read until the end, also after errors */
+		if(!(*check)(ssl, xfrd, region, buf)) {
+			if(!ssl_printf(ssl, "error for input line '%s'\n",
 				buf))
-				return;
+				return NULL;
+			(*fail)++;
+			continue;
+		}
+		b = (struct bulk_line*)region_alloc(region, sizeof(*b));
+		b->next = NULL;
+		b->line = region_strdup(region, buf);
+		if(last) last->next = b;
+		else first = b;
+		last = b;
+	}
+	if(*fail)
+		return NULL;
+	return first;
+}
+
+/** do the addzones command. All lines are checked before zones are
+ * added, the zonelist is written to disk once and one reload is done */
+static void
+do_addzones(RES* ssl, xfrd_state_type* xfrd)
+{
+	region_type* region = region_create(xalloc, free);
+	struct bulk_line* list, *b;
+	int num = 0, fail = 0;
+	list = read_bulk_lines(ssl, xfrd, region, &check_addzone, &fail);
+	if(fail) {
+		(void)ssl_printf(ssl, "error %d lines failed, no zones "
+			"added\n", fail);
+		region_destroy(region);
+		return;
+	}
+	zone_list_batch_begin(xfrd->nsd->options);
+	for(b = list; b; b = b->next) {
+		/* perform_addzone modifies the string, print a copy */
+		char* line = region_strdup(region, b->line);
+		if(!perform_addzone(ssl, xfrd, b->line)) {
+			if(!ssl_printf(ssl, "error for input line '%s'\n", 
+				line))
+				break;
 		} else {
-			if(!ssl_printf(ssl, "added: %s\n", buf))
-				return;
+			if(!ssl_printf(ssl, "added: %s\n", line))
+				break;
 			num++;
 		}
 	}
+	zone_list_batch_end(xfrd->nsd->options);
+	if(num > 0) {
+		zonestat_inc_ifneeded(xfrd);
+		xfrd_set_reload_now(xfrd);
+	}
+	region_destroy(region);
 	(void)ssl_printf(ssl, "added %d zones\n", num);
 }
 
-/** do the delzones command */
+/** do the delzones command. All lines are checked before zones are
+ * removed, the zonelist is written to disk once and one reload is done */
 static void
-do_delzones(SSL* ssl, xfrd_state_type* xfrd)
+do_delzones(RES* ssl, xfrd_state_type* xfrd)
 {
-	char buf[2048];
-	int num = 0;
-	while(ssl_read_line(ssl, buf, sizeof(buf))) {
-		if(buf[0] == 0x04 && buf[1] == 0)
-			break; /* end of transmission */
-		if(!perform_delzone(ssl, xfrd, buf)) {
+	region_type* region = region_create(xalloc, free);
+	struct bulk_line* list, *b;
+	int num = 0, fail = 0;
+	list = read_bulk_lines(ssl, xfrd, region, &check_delzone, &fail);
+	if(fail) {
+		(void)ssl_printf(ssl, "error %d lines failed, no zones "
+			"deleted\n", fail);
+		region_destroy(region);
+		return;
+	}
+	zone_list_batch_begin(xfrd->nsd->options);
+	for(b = list; b; b = b->next) {
+		if(!perform_delzone(ssl, xfrd, b->line)) {
 			if(!ssl_printf(ssl, "error for input line '%s'\n", 
-				buf))
-				return;
+				b->line))
+				break;
 		} else {
-			if(!ssl_printf(ssl, "removed: %s\n", buf))
-				return;
+			if(!ssl_printf(ssl, "removed: %s\n", b->line))
+				break;
 			num++;
 		}
 	}
+	zone_list_batch_end(xfrd->nsd->options);
+	if(num > 0)
+		xfrd_set_reload_now(xfrd);
+	region_destroy(region);
 	(void)ssl_printf(ssl, "deleted %d zones\n", num);
 }
 
@@ -1374,12 +1934,12 @@ remove_cfgzone(xfrd_state_type* xfrd, const char* pname)
 	/* create deletion task */
 	task_new_del_zone(xfrd->nsd->task[xfrd->nsd->mytask],
 		xfrd->last_task, dname);
-	xfrd_set_reload_now(xfrd);
 	/* delete it in xfrd */
 	if(zone_is_slave(zopt)) {
 		xfrd_del_slave_zone(xfrd, dname);
 	}
 	xfrd_del_notify(xfrd, dname);
+	xfrd_watch_del_zone(xfrd->watch, zopt);
 
 	/* delete from zoneoptions */
 	zone_options_delete(xfrd->nsd->options, zopt);
@@ -1420,6 +1980,7 @@ add_cfgzone(xfrd_state_type* xfrd, const char* pname)
 	if(zone_is_slave(zopt)) {
 		xfrd_init_slave_zone(xfrd, zopt);
 	}
+	xfrd_watch_add_zone(xfrd->watch, zopt);
 }
 
 /** remove pattern and add task so that reload does too */
@@ -1652,7 +2213,7 @@ repat_options(xfrd_state_type* xfrd, struct nsd_options* newopt)
 static void
 print_ssl_cfg_err(void* arg, const char* str)
 {
-	SSL** ssl = (SSL**)arg;
+	RES** ssl = (RES**)arg;
 	if(!*ssl) return;
 	if(!ssl_printf(*ssl, "%s", str))
 		*ssl = NULL; /* failed, stop printing */
@@ -1660,7 +2221,7 @@ print_ssl_cfg_err(void* arg, const char* str)
 
 /** do the repattern command: reread config file and apply keys, patterns */
 static void
-do_repattern(SSL* ssl, xfrd_state_type* xfrd)
+do_repattern(RES* ssl, xfrd_state_type* xfrd)
 {
 	region_type* region = region_create(xalloc, free);
 	struct nsd_options* opt;
@@ -1693,6 +2254,8 @@ do_repattern(SSL* ssl, xfrd_state_type* xfrd)
 	repat_keys(xfrd, opt);
 	repat_patterns(xfrd, opt);
 	repat_options(xfrd, opt);
+	/* the zone files of changed patterns can be different */
+	xfrd_watch_reset(xfrd->watch);
 	zonestat_inc_ifneeded(xfrd);
 	send_ok(ssl);
 	region_destroy(region);
@@ -1700,11 +2263,66 @@ do_repattern(SSL* ssl, xfrd_state_type* xfrd)
 
 /** do the serverpid command: printout pid of server process */
 static void
-do_serverpid(SSL* ssl, xfrd_state_type* xfrd)
+do_serverpid(RES* ssl, xfrd_state_type* xfrd)
 {
 	(void)ssl_printf(ssl, "%u\n", (unsigned)xfrd->reload_pid);
 }
 
+/** names of the reload phases, in the order of enum reload_phase */
+static const char* reload_phase_names[RELOAD_PHASES] = {
+	"fork", "tasks", "compact", "sync", "compression", "children",
+	"quitsync", "stats", "total"
+};
+
+/** print usec duration as seconds */
+static int
+print_usec(RES* ssl, const char* name, const char* kind, uint64_t usec)
+{
+	return ssl_printf(ssl, "reload.%s.%s=%u.%6.6u\n", name, kind,
+		(unsigned)(usec/1000000), (unsigned)(usec%1000000));
+}
+
+/** do the reloadstats command: print the timing of the reload phases */
+static void
+do_reloadstats(RES* ssl, xfrd_state_type* xfrd)
+{
+	struct reload_stats* s = xfrd->reload_stats;
+	int i, b;
+	if(!s) {
+		(void)ssl_printf(ssl, "reload.count=0\n");
+		return;
+	}
+	if(!ssl_printf(ssl, "reload.count=%u\n", (unsigned)s->count))
+		return;
+	if(!ssl_printf(ssl, "reload.zones.last=%llu\n"
+		"reload.zones.max=%llu\n" "reload.zones.total=%llu\n"
+		"reload.rrs.last=%llu\n" "reload.rrs.max=%llu\n"
+		"reload.rrs.total=%llu\n",
+		(unsigned long long)s->last.zones,
+		(unsigned long long)s->max.zones,
+		(unsigned long long)s->sum.zones,
+		(unsigned long long)s->last.rrs,
+		(unsigned long long)s->max.rrs,
+		(unsigned long long)s->sum.rrs))
+		return;
+	for(i=0; i<RELOAD_PHASES; i++) {
+		const char* nm = reload_phase_names[i];
+		if(!print_usec(ssl, nm, "last", s->last.phase[i]) ||
+		   !print_usec(ssl, nm, "avg", s->sum.phase[i]/s->count) ||
+		   !print_usec(ssl, nm, "max", s->max.phase[i]))
+			return;
+		for(b=0; b<RELOAD_HIST_BUCKETS; b++) {
+			if(s->hist[i][b] == 0)
+				continue;
+			if(!ssl_printf(ssl, "reload.%s.hist.%s%ums=%u\n", nm,
+				(b==RELOAD_HIST_BUCKETS-1?"ge":"lt"),
+				(unsigned)(b==RELOAD_HIST_BUCKETS-1?(1<<(b-1)):
+				(1<<b)), (unsigned)s->hist[i][b]))
+				return;
+		}
+	}
+}
+
 /** check for name with end-of-string, space or tab after it */
 static int
 cmdcmp(char* p, const char* cmd, size_t len)
@@ -1714,7 +2332,7 @@ cmdcmp(char* p, const char* cmd, size_t len)
 
 /** execute a remote control command */
 static void
-execute_cmd(struct daemon_remote* rc, SSL* ssl, char* cmd, struct rc_state* rs)
+execute_cmd(struct daemon_remote* rc, RES* ssl, char* cmd, struct rc_state* rs)
 {
 	char* p = skipwhite(cmd);
 	/* compare command */
@@ -1727,9 +2345,11 @@ execute_cmd(struct daemon_remote* rc, SSL* ssl, char* cmd, struct rc_state* rs)
 	} else if(cmdcmp(p, "status", 6)) {
 		do_status(ssl, rc->xfrd);
 	} else if(cmdcmp(p, "stats_noreset", 13)) {
-		do_stats(rc, 1, rs);
+		do_stats(ssl, rc, 1, rs, skipwhite(p+13));
 	} else if(cmdcmp(p, "stats", 5)) {
-		do_stats(rc, 0, rs);
+		do_stats(ssl, rc, 0, rs, skipwhite(p+5));
+	} else if(cmdcmp(p, "memory", 6)) {
+		do_memory(ssl, rc, rs, skipwhite(p+6));
 	} else if(cmdcmp(p, "log_reopen", 10)) {
 		do_log_reopen(ssl, rc->xfrd);
 	} else if(cmdcmp(p, "addzone", 7)) {
@@ -1747,7 +2367,7 @@ execute_cmd(struct daemon_remote* rc, SSL* ssl, char* cmd, struct rc_state* rs)
 	} else if(cmdcmp(p, "force_transfer", 14)) {
 		do_force_transfer(ssl, rc->xfrd, skipwhite(p+14));
 	} else if(cmdcmp(p, "zonestatus", 10)) {
-		do_zonestatus(ssl, rc->xfrd, skipwhite(p+10));
+		do_zonestatus(ssl, rc->xfrd, skipwhite(p+10), rs);
 	} else if(cmdcmp(p, "verbosity", 9)) {
 		do_verbosity(ssl, skipwhite(p+9));
 	} else if(cmdcmp(p, "repattern", 9)) {
@@ -1756,53 +2376,322 @@ execute_cmd(struct daemon_remote* rc, SSL* ssl, char* cmd, struct rc_state* rs)
 		do_repattern(ssl, rc->xfrd);
 	} else if(cmdcmp(p, "serverpid", 9)) {
 		do_serverpid(ssl, rc->xfrd);
+	} else if(cmdcmp(p, "reloadstats", 11)) {
+		do_reloadstats(ssl, rc->xfrd);
 	} else {
 		(void)ssl_printf(ssl, "error unknown command '%s'\n", p);
 	}
 }
 
-/** handle remote control request */
+/** read the input that is available on the connection, into the input
+ * buffer. At the end of the input, or a read error, read_eof is set. */
 static void
-handle_req(struct daemon_remote* rc, struct rc_state* s, SSL* ssl)
+rc_read(struct rc_state* s)
+{
+	ssize_t r;
+	while(!s->read_eof) {
+		buffer_reserve(s->in, REMOTE_READ_SIZE);
+		if(!s->ssl) {
+			r = read(s->c.ev_fd, buffer_current(s->in),
+				buffer_remaining(s->in));
+			if(r == -1) {
+				if(errno == EINTR)
+					continue;
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+					return; /* wait for more */
+				log_msg(LOG_ERR, "could not read from control "
+					"socket: %s", strerror(errno));
+				s->read_eof = 1;
+				return;
+			}
+		} else {
+			ERR_clear_error();
+			r = SSL_read(s->ssl, buffer_current(s->in),
+				(int)buffer_remaining(s->in));
+			if(r <= 0) {
+				int err = SSL_get_error(s->ssl, r);
+				if(err == SSL_ERROR_WANT_READ ||
+					err == SSL_ERROR_WANT_WRITE)
+					return; /* wait for more */
+				if(err != SSL_ERROR_ZERO_RETURN)
+					log_crypto_err("could not SSL_read");
+				s->read_eof = 1;
+				return;
+			}
+		}
+		if(r == 0)
+			s->read_eof = 1;
+		else	buffer_skip(s->in, r);
+	}
+}
+
+/** see if the text at p, with len bytes, starts with the command */
+static int
+rc_is_cmd(uint8_t* p, size_t len, const char* cmd)
 {
-	int r;
-	char pre[10];
-	char magic[8];
-	char buf[1024];
-	if (fcntl(s->c.ev_fd, F_SETFL, 0) == -1) { /* set blocking */
-		log_msg(LOG_ERR, "cannot fcntl rc: %s", strerror(errno));
+	size_t n = strlen(cmd);
+	while(len > 0 && (*p == ' ' || *p == '\t')) {
+		p++;
+		len--;
 	}
+	return len > n && memcmp(p, cmd, n) == 0 && (p[n] == ' ' ||
+		p[n] == '\t' || p[n] == '\n');
+}
 
-	/* try to read magic UBCT[version]_space_ string */
-	ERR_clear_error();
-	if((r=SSL_read(ssl, magic, (int)sizeof(magic)-1)) <= 0) {
-		if(SSL_get_error(ssl, r) == SSL_ERROR_ZERO_RETURN)
-			return;
-		log_crypto_err("could not SSL_read");
-		return;
+/** see if the input holds a complete request, the header and the command
+ * line, and for addzones and delzones the input lines up to the end of
+ * transmission line. The request is also complete at the end of input.
+ * returns 1 if complete, 0 if more input is needed, -1 on failure. */
+static int
+rc_request_complete(struct rc_state* s)
+{
+	uint8_t* p = buffer_begin(s->in);
+	size_t len = buffer_position(s->in);
+	uint8_t* start = p, *eol, *line;
+	if(!s->got_header) {
+		if(len < 7)
+			return 0;
+		start += 7;
+	}
+	eol = (uint8_t*)memchr(start, '\n', len-(start-p));
+	if(!eol) {
+		if(len-(start-p) >= REMOTE_LINE_MAX) {
+			log_msg(LOG_ERR, "control line too long (%d)",
+				(int)REMOTE_LINE_MAX);
+			return -1;
+		}
+		return s->read_eof && len != (size_t)(start-p);
 	}
+	if(eol-start >= REMOTE_LINE_MAX) {
+		log_msg(LOG_ERR, "control line too long (%d)",
+			(int)REMOTE_LINE_MAX);
+		return -1;
+	}
+	if(!rc_is_cmd(start, eol-start+1, "addzones") &&
+		!rc_is_cmd(start, eol-start+1, "delzones"))
+		return 1;
+	/* look for the end of transmission line after the command */
+	line = eol+1;
+	while(line < p+len) {
+		if(line+1 < p+len && line[0] == 0x04 && line[1] == '\n')
+			return 1;
+		eol = (uint8_t*)memchr(line, '\n', len-(line-p));
+		if(!eol)
+			break;
+		line = eol+1;
+	}
+	return s->read_eof;
+}
+
+/** handle the request, or the session command, that is in the input
+ * buffer. The output is collected in the output buffer. */
+static void
+rc_handle_input(struct daemon_remote* rc, struct rc_state* s)
+{
+	char pre[10];
+	char magic[8];
+	char buf[REMOTE_LINE_MAX];
+	size_t rest;
+	RES res;
+	res.ssl = s->ssl;
+	res.fd = s->c.ev_fd;
+	res.out = s->out;
+	res.in = s->in;
+	buffer_flip(s->in);
+
+	if(s->in_session) {
+		/* the next command of the session */
+		if(!ssl_read_line(&res, buf, sizeof(buf))) {
+			s->done = 1;
+			goto keep_rest;
+		}
+		VERBOSITY(3, (LOG_INFO, "control session cmd: %s", buf));
+		execute_cmd(rc, &res, buf, s);
+		/* the stats are printed after the reload, and long listings
+		 * in parts, and then the session continues */
+		if(!s->in_stats_list && !s->stream)
+			(void)ssl_print_text(&res, SESSION_END_MARKER);
+		goto keep_rest;
+	}
+
+	/* the connection is done after this request, or it starts a
+	 * session */
+	s->done = 1;
+	/* the magic NSDCT[version]_space_ string */
+	buffer_read(s->in, magic, 7);
 	magic[7] = 0;
-	if( r != 7 || strncmp(magic, "NSDCT", 5) != 0) {
+	s->got_header = 1;
+	if(strncmp(magic, "NSDCT", 5) != 0) {
 		VERBOSITY(2, (LOG_INFO, "control connection has bad header"));
 		/* probably wrong tool connected, ignore it completely */
-		return;
+		goto keep_rest;
 	}
 
 	/* read the command line */
-	if(!ssl_read_line(ssl, buf, sizeof(buf))) {
-		return;
+	if(!ssl_read_line(&res, buf, sizeof(buf))) {
+		goto keep_rest;
 	}
 	snprintf(pre, sizeof(pre), "NSDCT%d ", NSD_CONTROL_VERSION);
 	if(strcmp(magic, pre) != 0) {
 		VERBOSITY(2, (LOG_INFO, "control connection had bad "
 			"version %s, cmd: %s", magic, buf));
-		ssl_printf(ssl, "error version mismatch\n");
-		return;
+		ssl_printf(&res, "error version mismatch\n");
+		goto keep_rest;
 	}
 	VERBOSITY(2, (LOG_INFO, "control cmd: %s", buf));
 
+	/* the session keeps the connection open for more commands */
+	if(cmdcmp(skipwhite(buf), "session", 7)) {
+		s->in_session = 1;
+		s->done = 0;
+		if(ssl_printf(&res, "ok\n"))
+			(void)ssl_print_text(&res, SESSION_END_MARKER);
+		VERBOSITY(3, (LOG_INFO, "remote control session started"));
+		goto keep_rest;
+	}
+
 	/* figure out what to do */
-	execute_cmd(rc, ssl, buf, s);
+	execute_cmd(rc, &res, buf, s);
+
+keep_rest:
+	/* the input after this request is for the next command */
+	rest = buffer_remaining(s->in);
+	memmove(buffer_begin(s->in), buffer_current(s->in), rest);
+	buffer_clear(s->in);
+	buffer_set_position(s->in, rest);
+}
+
+/** write the output buffer to the connection, as much as can be written.
+ * returns 1 if all is written, 2 if it has to wait for the socket to be
+ * writable, and 0 on failure. */
+static int
+rc_flush(struct rc_state* s)
+{
+	size_t len = buffer_position(s->out);
+	while(s->out_done < len) {
+		ssize_t r;
+		if(!s->ssl) {
+			r = write(s->c.ev_fd, buffer_at(s->out, s->out_done),
+				len - s->out_done);
+			if(r == -1) {
+				if(errno == EINTR)
+					continue;
+				if(errno == EAGAIN || errno == EWOULDBLOCK)
+					return 2;
+				log_msg(LOG_ERR, "could not write to control "
+					"socket: %s", strerror(errno));
+				return 0;
+			}
+		} else {
+			ERR_clear_error();
+			r = SSL_write(s->ssl, buffer_at(s->out, s->out_done),
+				(int)(len - s->out_done));
+			if(r <= 0) {
+				int err = SSL_get_error(s->ssl, r);
+				if(err == SSL_ERROR_WANT_WRITE ||
+					err == SSL_ERROR_WANT_READ)
+					return 2;
+				if(err == SSL_ERROR_ZERO_RETURN) {
+					VERBOSITY(2, (LOG_WARNING, "in "
+						"SSL_write, peer closed "
+						"connection"));
+					return 0;
+				}
+				log_crypto_err("could not SSL_write");
+				return 0;
+			}
+		}
+		s->out_done += r;
+	}
+	buffer_clear(s->out);
+	s->out_done = 0;
+	return 1;
+}
+
+/** (re)set the event of the connection to wait for ev, read or write.
+ * returns false on failure. */
+static int
+remote_listen(struct daemon_remote* rc, struct rc_state* s, short ev)
+{
+	if(s->event_added)
+		event_del(&s->c);
+	s->event_added = 0;
+	event_set(&s->c, s->c.ev_fd, EV_PERSIST|EV_TIMEOUT|ev,
+		remote_control_callback, s);
+	if(event_base_set(rc->xfrd->event_base, &s->c) != 0) {
+		log_msg(LOG_ERR, "remote control: cannot set event_base");
+		return 0;
+	}
+	if(event_add(&s->c, &s->tval) != 0) {
+		log_msg(LOG_ERR, "remote control: cannot add event");
+		return 0;
+	}
+	s->event_added = 1;
+	return 1;
+}
+
+/** continue with the connection: write the output, handle the requests
+ * that are read, and wait for the socket when it would block.
+ * returns false if the connection is done. */
+static int
+rc_next(struct daemon_remote* rc, struct rc_state* s)
+{
+	int r;
+	while(1) {
+		if(s->in_stats_list)
+			return 1; /* waits for the stats after the reload */
+		if((r=rc_flush(s)) == 0)
+			return 0;
+		/* a long listing is printed when the socket is writable */
+		if(r == 2 || s->stream)
+			return remote_listen(rc, s, EV_WRITE);
+		if(s->done) {
+			VERBOSITY(3, (LOG_INFO, "remote control operation "
+				"completed"));
+			return 0;
+		}
+		if((r=rc_request_complete(s)) == -1)
+			return 0;
+		if(r == 0) {
+			if(s->read_eof)
+				return 0;
+			/* wait for the rest of the request, or the next
+			 * command of the session, that restarts the idle
+			 * timeout */
+			return remote_listen(rc, s, EV_READ);
+		}
+		rc_handle_input(rc, s);
+	}
+}
+
+/** print the next part of the long listing of the connection into the
+ * output buffer. The next part is made after this one is written, the
+ * xfrd event loop continues in between the parts. returns false on
+ * error */
+static int
+stream_part(struct daemon_remote* rc, struct rc_state* s)
+{
+	struct rc_stream* st = s->stream;
+	int done = 1;
+	RES res;
+	res.ssl = s->ssl;
+	res.fd = s->c.ev_fd;
+	res.out = s->out;
+	res.in = NULL;
+	if(st->type == rc_stream_zonestatus)
+		done = stream_zonestatus(&res, rc->xfrd, st);
+#if defined(BIND8_STATS) && defined(USE_ZONE_STATS)
+	else if(st->type == rc_stream_zonestat)
+		done = stream_zonestat(&res, rc->xfrd, st);
+#endif
+	if(!done)
+		return 1;
+	s->stream = NULL;
+	stream_delete(st);
+	VERBOSITY(3, (LOG_INFO, "remote control listing printed"));
+	if(s->in_session)
+		return ssl_print_text(&res, SESSION_END_MARKER);
+	return 1;
 }
 
 static void
@@ -1812,10 +2701,21 @@ remote_control_callback(int fd, short event, void* arg)
 	struct daemon_remote* rc = s->rc;
 	int r;
 	if( (event&EV_TIMEOUT) ) {
-		log_msg(LOG_ERR, "remote control timed out");
+		if(s->in_session)
+			VERBOSITY(2, (LOG_INFO, "remote control session "
+				"idle timeout"));
+		else if(s->in_stats_list == 3)
+			log_msg(LOG_ERR, "remote control: no memory report, "
+				"timed out waiting for the reload");
+		else	log_msg(LOG_ERR, "remote control timed out");
 		clean_point(rc, s);
 		return;
 	}
+	if(!s->ssl || s->shake_state == rc_none) {
+		/* local socket, no handshake and authentication, or the
+		 * handshake is done */
+		goto handle_request;
+	}
 	/* (continue to) setup the SSL connection */
 	ERR_clear_error();
 	r = SSL_do_handshake(s->ssl);
@@ -1877,13 +2777,21 @@ remote_control_callback(int fd, short event, void* arg)
 		return;
 	}
 
-	/* if OK start to actually handle the request */
-	handle_req(rc, s, s->ssl);
-
-	if(!s->in_stats_list) {
-		VERBOSITY(3, (LOG_INFO, "remote control operation completed"));
-		clean_point(rc, s);
+handle_request:
+	if(s->stream && buffer_position(s->out) == 0) {
+		/* the previous part is written, the socket is writable
+		 * for the next part of the listing */
+		if(!stream_part(rc, s)) {
+			clean_point(rc, s);
+			return;
+		}
+	} else {
+		/* read what is available, a request that is not complete
+		 * is continued when more input arrives */
+		rc_read(s);
 	}
+	if(!rc_next(rc, s))
+		clean_point(rc, s);
 }
 
 #ifdef BIND8_STATS
@@ -1902,7 +2810,7 @@ opcode2str(int o)
 
 /** print long number */
 static int
-print_longnum(SSL* ssl, char* desc, uint64_t x)
+print_longnum(RES* ssl, char* desc, uint64_t x)
 {
 	if(x > (uint64_t)1024*1024*1024) {
 		/* more than a Gb */
@@ -1917,7 +2825,7 @@ print_longnum(SSL* ssl, char* desc, uint64_t x)
 
 /* print one block of statistics.  n is name and d is delimiter */
 static void
-print_stat_block(SSL* ssl, char* n, char* d, struct nsdst* st)
+print_stat_block(RES* ssl, char* n, char* d, struct nsdst* st)
 {
 	const char* rcstr[] = {"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN",
 	    "NOTIMP", "REFUSED", "YXDOMAIN", "YXRRSET", "NXRRSET", "NOTAUTH",
@@ -1983,6 +2891,12 @@ print_stat_block(SSL* ssl, char* n, char* d, struct nsdst* st)
 	/* ctcp6 */
 	if(!ssl_printf(ssl, "%s%snum.tcp6=%u\n", n, d, (unsigned)st->ctcp6))
 		return;
+	/* ctls */
+	if(!ssl_printf(ssl, "%s%snum.tls=%u\n", n, d, (unsigned)st->ctls))
+		return;
+	/* ctls6 */
+	if(!ssl_printf(ssl, "%s%snum.tls6=%u\n", n, d, (unsigned)st->ctls6))
+		return;
 
 	/* nona */
 	if(!ssl_printf(ssl, "%s%snum.answer_wo_aa=%u\n", n, d,
@@ -2010,6 +2924,23 @@ print_stat_block(SSL* ssl, char* n, char* d, struct nsdst* st)
 	if(!ssl_printf(ssl, "%s%snum.dropped=%u\n", n, d,
 		(unsigned)st->dropped))
 		return;
+
+	/* adaptive-udp-size */
+	if(!ssl_printf(ssl, "%s%snum.udpsize.udpretry=%u\n", n, d,
+		(unsigned)st->udpsize_udp_retry))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.udpsize.tcpretry=%u\n", n, d,
+		(unsigned)st->udpsize_tcp_retry))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.udpsize.lowered=%u\n", n, d,
+		(unsigned)st->udpsize_lowered))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.udpsize.raised=%u\n", n, d,
+		(unsigned)st->udpsize_raised))
+		return;
+	if(!ssl_printf(ssl, "%s%snum.udpsize.truncated=%u\n", n, d,
+		(unsigned)st->udpsize_truncated))
+		return;
 }
 
 #ifdef USE_ZONE_STATS
@@ -2025,60 +2956,93 @@ resize_zonestat(xfrd_state_type* xfrd, size_t num)
 	xfrd->zonestat_clear_num = num;
 }
 
+/** print the statistics of one zonestat name */
 static void
-zonestat_print(SSL* ssl, xfrd_state_type* xfrd, int clear)
+zonestat_print_one(RES* ssl, xfrd_state_type* xfrd, struct zonestatname* n,
+	int clear)
 {
-	struct zonestatname* n;
+	char* name = (char*)n->node.key;
 	struct nsdst stat0, stat1;
-	RBTREE_FOR(n, struct zonestatname*, xfrd->nsd->options->zonestatnames){
-		char* name = (char*)n->node.key;
-		if(n->id >= xfrd->zonestat_safe)
-			continue; /* newly allocated and reload has not yet
-				done and replied with new size */
-		if(name == NULL || name[0]==0)
-			continue; /* empty name, do not output */
-		/* the statistics are stored in two blocks, during reload
-		 * the newly forked processes get the other block to use,
-		 * these blocks are mmapped and are currently in use to
-		 * add statistics to */
-		memcpy(&stat0, &xfrd->nsd->zonestat[0][n->id], sizeof(stat0));
-		memcpy(&stat1, &xfrd->nsd->zonestat[1][n->id], sizeof(stat1));
-		stats_add(&stat0, &stat1);
-		
-		/* save a copy of current (cumulative) stats in stat1 */
-		memcpy(&stat1, &stat0, sizeof(stat1));
-		/* subtract last total of stats that was 'cleared' */
-		if(n->id < xfrd->zonestat_clear_num &&
-			xfrd->zonestat_clear[n->id])
-			stats_subtract(&stat0, xfrd->zonestat_clear[n->id]);
-		if(clear) {
-			/* extend storage array if needed */
-			if(n->id >= xfrd->zonestat_clear_num) {
-				if(n->id+1 < xfrd->nsd->options->zonestatnames->count)
-					resize_zonestat(xfrd, xfrd->nsd->options->zonestatnames->count);
-				else
-					resize_zonestat(xfrd, n->id+1);
-			}
-			if(!xfrd->zonestat_clear[n->id])
-				xfrd->zonestat_clear[n->id] = xalloc(
-					sizeof(struct nsdst));
-			/* store last total of stats */
-			memcpy(xfrd->zonestat_clear[n->id], &stat1,
-				sizeof(struct nsdst));
+	size_t i;
+	if(n->id >= xfrd->zonestat_safe)
+		return; /* newly allocated and reload has not yet
+			done and replied with new size */
+	if(name == NULL || name[0]==0)
+		return; /* empty name, do not output */
+	/* the statistics are stored in two blocks, during reload
+	 * the newly forked processes get the other block to use,
+	 * these blocks are mmapped and are currently in use to
+	 * add statistics to.  Every child has its own entry, only the
+	 * entries that are marked as written are read, reading the others
+	 * would allocate their pages. */
+	memset(&stat0, 0, sizeof(stat0));
+	for(i=0; i<xfrd->nsd->zonestatnumchild; i++) {
+		if(ZONESTAT_WRITTEN(xfrd->nsd, 0, n->id, i))
+			stats_add(&stat0, ZONESTAT_ENTRY(xfrd->nsd,
+				xfrd->nsd->zonestat[0], n->id, i));
+		if(ZONESTAT_WRITTEN(xfrd->nsd, 1, n->id, i))
+			stats_add(&stat0, ZONESTAT_ENTRY(xfrd->nsd,
+				xfrd->nsd->zonestat[1], n->id, i));
+	}
+	
+	/* save a copy of current (cumulative) stats in stat1 */
+	memcpy(&stat1, &stat0, sizeof(stat1));
+	/* subtract last total of stats that was 'cleared' */
+	if(n->id < xfrd->zonestat_clear_num &&
+		xfrd->zonestat_clear[n->id])
+		stats_subtract(&stat0, xfrd->zonestat_clear[n->id]);
+	if(clear) {
+		/* extend storage array if needed */
+		if(n->id >= xfrd->zonestat_clear_num) {
+			if(n->id+1 < xfrd->nsd->options->zonestatnames->count)
+				resize_zonestat(xfrd, xfrd->nsd->options->zonestatnames->count);
+			else
+				resize_zonestat(xfrd, n->id+1);
 		}
+		if(!xfrd->zonestat_clear[n->id])
+			xfrd->zonestat_clear[n->id] = xalloc(
+				sizeof(struct nsdst));
+		/* store last total of stats */
+		memcpy(xfrd->zonestat_clear[n->id], &stat1,
+			sizeof(struct nsdst));
+	}
 
-		/* stat0 contains the details that we want to print */
-		if(!ssl_printf(ssl, "%s%snum.queries=%u\n", name, ".",
-			(unsigned)(stat0.qudp + stat0.qudp6 + stat0.ctcp +
-				stat0.ctcp6)))
-			return;
-		print_stat_block(ssl, name, ".", &stat0);
+	/* stat0 contains the details that we want to print */
+	if(!ssl_printf(ssl, "%s%snum.queries=%u\n", name, ".",
+		(unsigned)(stat0.qudp + stat0.qudp6 + stat0.ctcp +
+			stat0.ctcp6)))
+		return;
+	print_stat_block(ssl, name, ".", &stat0);
+}
+
+static int
+stream_zonestat(RES* ssl, xfrd_state_type* xfrd, struct rc_stream* st)
+{
+	rbnode_type* n, *last = NULL;
+	int num = 0;
+	for(n = stream_next(xfrd->nsd->options->zonestatnames, st);
+		n != RBTREE_NULL && num < REMOTE_STREAM_PART;
+		n = rbtree_next(n)) {
+		num++;
+		last = n;
+		if(!stream_glob_match(st, (const char*)n->key))
+			continue;
+		zonestat_print_one(ssl, xfrd, (struct zonestatname*)n,
+			st->clear);
 	}
+	if(n == RBTREE_NULL)
+		return 1;
+	/* continue after this name in the next part */
+	if(st->last)
+		region_recycle(st->region, st->last, strlen(
+			(char*)st->last)+1);
+	st->last = (void*)region_strdup(st->region, (const char*)last->key);
+	return 0;
 }
 #endif /* USE_ZONE_STATS */
 
 static void
-print_stats(SSL* ssl, xfrd_state_type* xfrd, struct timeval* now, int clear)
+print_stats(RES* ssl, xfrd_state_type* xfrd, struct timeval* now)
 {
 	size_t i;
 	stc_type total = 0;
@@ -2125,11 +3089,7 @@ print_stats(SSL* ssl, xfrd_state_type* xfrd, struct timeval* now, int clear)
 		return;
 	if(!ssl_printf(ssl, "zone.slave=%u\n", (unsigned)xfrd->zones->count))
 		return;
-#ifdef USE_ZONE_STATS
-	zonestat_print(ssl, xfrd, clear); /* per-zone statistics */
-#else
-	(void)clear;
-#endif
+	/* the per-zone statistics follow in parts */
 }
 
 static void
@@ -2152,25 +3112,68 @@ clear_stats(xfrd_state_type* xfrd)
 void
 daemon_remote_process_stats(struct daemon_remote* rc)
 {
-	struct rc_state* s;
+	struct rc_state* s, *list;
 	struct timeval now;
+	RES res;
 	if(!rc) return;
 	if(gettimeofday(&now, NULL) == -1)
 		log_msg(LOG_ERR, "gettimeofday: %s", strerror(errno));
+	/* take the list, sessions that ask for stats again, wait for the
+	 * next reload */
+	list = rc->stats_list;
+	rc->stats_list = NULL;
 	/* pop one and give it stats */
-	while((s = rc->stats_list)) {
+	while((s = list)) {
 		assert(s->in_stats_list);
-		print_stats(s->ssl, rc->xfrd, &now, (s->in_stats_list == 1));
+		res.ssl = s->ssl;
+		res.fd = s->c.ev_fd;
+		res.out = s->out;
+		res.in = NULL;
+		print_stats(&res, rc->xfrd, &now);
 		if(s->in_stats_list == 1) {
 			clear_stats(rc->xfrd);
 			rc->stats_time = now;
 		}
 		VERBOSITY(3, (LOG_INFO, "remote control stats printed"));
-		rc->stats_list = s->next;
+		list = s->stats_next;
 		s->in_stats_list = 0;
-		clean_point(rc, s);
+		if(!s->stream && s->in_session)
+			(void)ssl_print_text(&res, SESSION_END_MARKER);
+		/* the zone statistics are printed in parts from the
+		 * event loop, or the session continues */
+		if(!rc_next(rc, s))
+			clean_point(rc, s);
 	}
 }
 #endif /* BIND8_STATS */
 
+void
+daemon_remote_process_memory(struct daemon_remote* rc, const char* text,
+	uint32_t id)
+{
+	struct rc_state* s;
+	RES res;
+	if(!rc) return;
+	for(s = rc->mem_list; s; s = s->stats_next)
+		if(s->mem_id == id)
+			break;
+	if(!s) {
+		VERBOSITY(3, (LOG_INFO, "remote control memory report "
+			"dropped, the connection is gone"));
+		return;
+	}
+	stats_list_remove_elem(&rc->mem_list, s);
+	s->in_stats_list = 0;
+	res.ssl = s->ssl;
+	res.fd = s->c.ev_fd;
+	res.out = s->out;
+	res.in = NULL;
+	(void)ssl_print_text(&res, text);
+	VERBOSITY(3, (LOG_INFO, "remote control memory report printed"));
+	if(s->in_session)
+		(void)ssl_print_text(&res, SESSION_END_MARKER);
+	if(!rc_next(rc, s))
+		clean_point(rc, s);
+}
+
 #endif /* HAVE_SSL */
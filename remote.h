@@ -99,4 +99,14 @@ void daemon_remote_attach(struct daemon_remote* rc, struct xfrd_state* xfrd);
  */
 void daemon_remote_process_stats(struct daemon_remote* rc);
 
+/**
+ * Send the memory report to the connection that waits for it
+ * @param rc: state.
+ * @param text: the report.
+ * @param id: id of the request, if that connection has timed out the
+ *	report is dropped.
+ */
+void daemon_remote_process_memory(struct daemon_remote* rc, const char* text,
+	uint32_t id);
+
 #endif /* DAEMON_REMOTE_H */
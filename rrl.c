@@ -330,6 +330,9 @@ rrl_msg(query_type* query, const char* str)
 	size_t d_len;
 	uint64_t s;
 	char address[128];
+	if(str[0] == 'b')
+		NSD_PROBE2(rrl__block, (int)query->qtype, &query->addr);
+	else	NSD_PROBE2(rrl__unblock, (int)query->qtype, &query->addr);
 	if(verbosity < 1) return;
 	addr2str(&query->addr, address, sizeof(address));
 	s = rrl_get_source(query, &c2);
@@ -363,6 +366,9 @@ uint32_t rrl_update(query_type* query, uint32_t hash, uint64_t source,
 	if(b->source != source || b->flags != flags || b->hash != hash) {
 		/* initialise */
 		/* potentially the wrong limit here, used lower nonwhitelim */
+		if(used_to_block(b->rate, b->counter, rrl_ratelimit))
+			NSD_PROBE2(rrl__unblock, (int)query->qtype,
+				&query->addr);
 		if(verbosity >= 1 &&
 			used_to_block(b->rate, b->counter, rrl_ratelimit)) {
 			char address[128];
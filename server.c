@@ -36,10 +36,27 @@
 #endif
 #ifdef HAVE_MMAP
 #include <sys/mman.h>
+#if !defined(MAP_ANON) && defined(MAP_ANONYMOUS)
+#define MAP_ANON MAP_ANONYMOUS
+#endif
 #endif /* HAVE_MMAP */
 #ifdef HAVE_OPENSSL_RAND_H
 #include <openssl/rand.h>
 #endif
+#ifdef HAVE_SSL
+#ifdef HAVE_OPENSSL_SSL_H
+#include <openssl/ssl.h>
+#endif
+#ifdef HAVE_OPENSSL_ERR_H
+#include <openssl/err.h>
+#endif
+#include <openssl/evp.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#else
+#include <openssl/hmac.h>
+#endif
+#endif /* HAVE_SSL */
 #ifndef USE_MINI_EVENT
 #  ifdef HAVE_EVENT_H
 #    include <event.h>
@@ -65,6 +82,8 @@
 #include "remote.h"
 #include "lookup3.h"
 #include "rrl.h"
+#include "proxy_protocol.h"
+#include "udpsize.h"
 
 #define RELOAD_SYNC_TIMEOUT 25 /* seconds */
 
@@ -76,6 +95,8 @@ struct udp_handler_data
 	struct nsd        *nsd;
 	struct nsd_socket *socket;
 	query_type        *query;
+	/* the queries start with a PROXYv2 header */
+	int                proxy_protocol;
 };
 
 struct tcp_accept_handler_data {
@@ -83,6 +104,12 @@ struct tcp_accept_handler_data {
 	struct nsd_socket  *socket;
 	int event_added;
 	struct event       event;
+	/* the connections start with a PROXYv2 header */
+	int proxy_protocol;
+#ifdef HAVE_SSL
+	/* the socket is on the tls-port, the connections use TLS */
+	int tls_accept;
+#endif
 };
 
 /*
@@ -167,6 +194,25 @@ struct tcp_handler_data
 	 * The timeout in msec for this tcp connection
 	 */
 	int	tcp_timeout;
+
+	/*
+	 * The PROXYv2 header is still to be read, it is read into the
+	 * query packet, with bytes_transmitted counting it.
+	 */
+	int	proxy_pending;
+
+#ifdef HAVE_SSL
+	/*
+	 * The TLS connection on the tls-port, or NULL for plain TCP.
+	 * The reads and writes of the handlers go through it, when
+	 * TLS needs the socket in the other direction than the handler
+	 * waits for, tls_want is that direction (EV_READ or EV_WRITE)
+	 * and the handler waits for it.
+	 */
+	SSL*	tls;
+	int	tls_handshake_done;
+	short	tls_want;
+#endif
 };
 
 /*
@@ -367,10 +413,14 @@ server_zonestat_alloc(struct nsd* nsd)
 {
 	size_t num = (nsd->options->zonestatnames->count==0?1:
 			nsd->options->zonestatnames->count);
-	size_t sz = sizeof(struct nsdst)*num;
+	size_t sz;
 	char tmpfile[256];
 	uint8_t z = 0;
 
+	/* an entry for every child, for every zonestat id */
+	nsd->zonestatnumchild = (nsd->child_count==0?1:nsd->child_count);
+	sz = ZONESTAT_SIZE(nsd, num);
+
 	/* file names */
 	nsd->zonestatfname[0] = 0;
 	nsd->zonestatfname[1] = 0;
@@ -381,15 +431,19 @@ server_zonestat_alloc(struct nsd* nsd)
 		nsd->options->xfrdir, (int)getpid(), (unsigned)getpid());
 	nsd->zonestatfname[1] = region_strdup(nsd->region, tmpfile);
 
-	/* file descriptors */
-	nsd->zonestatfd[0] = open(nsd->zonestatfname[0], O_CREAT|O_RDWR, 0600);
+	/* file descriptors, the files are extended with zeroes and the
+	 * pages are only allocated when a child writes to them, so that
+	 * many zonestat names do not use memory for idle entries */
+	nsd->zonestatfd[0] = open(nsd->zonestatfname[0],
+		O_CREAT|O_TRUNC|O_RDWR, 0600);
 	if(nsd->zonestatfd[0] == -1) {
 		log_msg(LOG_ERR, "cannot create %s: %s", nsd->zonestatfname[0],
 			strerror(errno));
 		exit(1);
 	}
-	nsd->zonestatfd[1] = open(nsd->zonestatfname[1], O_CREAT|O_RDWR, 0600);
-	if(nsd->zonestatfd[0] == -1) {
+	nsd->zonestatfd[1] = open(nsd->zonestatfname[1],
+		O_CREAT|O_TRUNC|O_RDWR, 0600);
+	if(nsd->zonestatfd[1] == -1) {
 		log_msg(LOG_ERR, "cannot create %s: %s", nsd->zonestatfname[1],
 			strerror(errno));
 		close(nsd->zonestatfd[0]);
@@ -434,13 +488,24 @@ server_zonestat_alloc(struct nsd* nsd)
 		unlink(nsd->zonestatfname[1]);
 		exit(1);
 	}
-	memset(nsd->zonestat[0], 0, sz);
-	memset(nsd->zonestat[1], 0, sz);
 	nsd->zonestatsize[0] = num;
 	nsd->zonestatsize[1] = num;
 	nsd->zonestatdesired = num;
 	nsd->zonestatsizenow = num;
 	nsd->zonestatnow = nsd->zonestat[0];
+	/* the marks of the written entries, for both arrays, the pages are
+	 * allocated when they are written */
+	nsd->zonestatmark[0] = (uint8_t*)mmap(NULL, ZONESTAT_MARK_MAX*2,
+		PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANON, -1, 0);
+	if(nsd->zonestatmark[0] == MAP_FAILED) {
+		log_msg(LOG_WARNING, "mmap of zonestat marks failed: %s, "
+			"all entries are summed", strerror(errno));
+		nsd->zonestatmark[0] = NULL;
+		nsd->zonestatmark[1] = NULL;
+	} else {
+		nsd->zonestatmark[1] = nsd->zonestatmark[0]+ZONESTAT_MARK_MAX;
+	}
+	nsd->zonestatmarknow = nsd->zonestatmark[0];
 #endif /* HAVE_MMAP */
 }
 
@@ -450,7 +515,7 @@ zonestat_remap(struct nsd* nsd, int idx, size_t sz)
 #ifdef HAVE_MMAP
 #ifdef MREMAP_MAYMOVE
 	nsd->zonestat[idx] = (struct nsdst*)mremap(nsd->zonestat[idx],
-		sizeof(struct nsdst)*nsd->zonestatsize[idx], sz,
+		ZONESTAT_SIZE(nsd, nsd->zonestatsize[idx]), sz,
 		MREMAP_MAYMOVE);
 	if(nsd->zonestat[idx] == MAP_FAILED) {
 		log_msg(LOG_ERR, "mremap failed: %s", strerror(errno));
@@ -458,10 +523,10 @@ zonestat_remap(struct nsd* nsd, int idx, size_t sz)
 	}
 #else /* !HAVE MREMAP */
 	if(msync(nsd->zonestat[idx],
-		sizeof(struct nsdst)*nsd->zonestatsize[idx], MS_ASYNC) != 0)
+		ZONESTAT_SIZE(nsd, nsd->zonestatsize[idx]), MS_ASYNC) != 0)
 		log_msg(LOG_ERR, "msync failed: %s", strerror(errno));
 	if(munmap(nsd->zonestat[idx],
-		sizeof(struct nsdst)*nsd->zonestatsize[idx]) != 0)
+		ZONESTAT_SIZE(nsd, nsd->zonestatsize[idx])) != 0)
 		log_msg(LOG_ERR, "munmap failed: %s", strerror(errno));
 	nsd->zonestat[idx] = (struct nsdst*)mmap(NULL, sz,
 		PROT_READ|PROT_WRITE, MAP_SHARED, nsd->zonestatfd[idx], 0);
@@ -486,7 +551,7 @@ server_zonestat_realloc(struct nsd* nsd)
 		idx = 1;
 	if(nsd->zonestatsize[idx] == nsd->zonestatdesired)
 		return;
-	sz = sizeof(struct nsdst)*nsd->zonestatdesired;
+	sz = ZONESTAT_SIZE(nsd, nsd->zonestatdesired);
 	if(lseek(nsd->zonestatfd[idx], (off_t)sz-1, SEEK_SET) == -1) {
 		log_msg(LOG_ERR, "lseek %s: %s", nsd->zonestatfname[idx],
 			strerror(errno));
@@ -498,12 +563,8 @@ server_zonestat_realloc(struct nsd* nsd)
 		exit(1);
 	}
 	zonestat_remap(nsd, idx, sz);
-	/* zero the newly allocated region */
-	if(nsd->zonestatdesired > nsd->zonestatsize[idx]) {
-		memset(((char*)nsd->zonestat[idx])+sizeof(struct nsdst) *
-			nsd->zonestatsize[idx], 0, sizeof(struct nsdst) *
-			(nsd->zonestatdesired - nsd->zonestatsize[idx]));
-	}
+	/* the file only grows, the new part has been extended with zeroes,
+	 * the id major layout keeps the old entries at their place */
 	nsd->zonestatsize[idx] = nsd->zonestatdesired;
 #endif /* HAVE_MMAP */
 }
@@ -517,9 +578,11 @@ server_zonestat_switch(struct nsd* nsd)
 	if(nsd->zonestatnow == nsd->zonestat[0]) {
 		nsd->zonestatnow = nsd->zonestat[1];
 		nsd->zonestatsizenow = nsd->zonestatsize[1];
+		nsd->zonestatmarknow = nsd->zonestatmark[1];
 	} else {
 		nsd->zonestatnow = nsd->zonestat[0];
 		nsd->zonestatsizenow = nsd->zonestatsize[0];
+		nsd->zonestatmarknow = nsd->zonestatmark[0];
 	}
 }
 #endif /* USE_ZONE_STATS */
@@ -960,6 +1023,8 @@ server_prepare(struct nsd *nsd)
 		nsd->options->rrl_ipv4_prefix_length,
 		nsd->options->rrl_ipv6_prefix_length);
 #endif /* RATELIMIT */
+	if(nsd->options->adaptive_udp_size)
+		udpsize_init();
 
 	/* Open the database... */
 	if ((nsd->db = namedb_open(nsd->dbfile, nsd->options)) == NULL) {
@@ -1027,6 +1092,299 @@ server_close_all_sockets(struct nsd_socket sockets[], size_t n)
 	}
 }
 
+#ifdef HAVE_SSL
+/*
+ * Session ticket keys for the tls-port.  The keys are in shared memory,
+ * the main process rotates them and the server processes use them, so
+ * that a ticket from one server process resumes in all of them.  New
+ * tickets are encrypted with the current key, tickets from the other
+ * keys are accepted and renewed.
+ */
+#define TLS_TICKET_KEYS 3
+struct tls_ticket_keys {
+	/* index of the key for new tickets */
+	volatile uint32_t current;
+	/* time of the last rotation */
+	time_t rotated;
+	struct tls_ticket_key {
+		unsigned char name[16];
+		unsigned char aes_key[32];
+		unsigned char hmac_key[32];
+	} key[TLS_TICKET_KEYS];
+};
+static struct tls_ticket_keys* tls_ticket_keys = NULL;
+
+static void
+log_tls_err(const char* str)
+{
+	char buf[128];
+	unsigned long e;
+	ERR_error_string_n(ERR_get_error(), buf, sizeof(buf));
+	log_msg(LOG_ERR, "%s crypto %s", str, buf);
+	while( (e=ERR_get_error()) ) {
+		ERR_error_string_n(e, buf, sizeof(buf));
+		log_msg(LOG_ERR, "and additionally crypto %s", buf);
+	}
+}
+
+static int
+tls_ticket_key_new(struct tls_ticket_key* k)
+{
+	if(RAND_bytes(k->name, sizeof(k->name)) != 1 ||
+		RAND_bytes(k->aes_key, sizeof(k->aes_key)) != 1 ||
+		RAND_bytes(k->hmac_key, sizeof(k->hmac_key)) != 1) {
+		log_tls_err("tls ticket key: RAND_bytes failed");
+		return 0;
+	}
+	return 1;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int
+tls_ticket_hmac_init(EVP_MAC_CTX* hctx, struct tls_ticket_key* k)
+{
+	OSSL_PARAM params[3];
+	params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY,
+		k->hmac_key, sizeof(k->hmac_key));
+	params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST,
+		"sha256", 0);
+	params[2] = OSSL_PARAM_construct_end();
+	return EVP_MAC_CTX_set_params(hctx, params);
+}
+#else
+static int
+tls_ticket_hmac_init(HMAC_CTX* hctx, struct tls_ticket_key* k)
+{
+	return HMAC_Init_ex(hctx, k->hmac_key, sizeof(k->hmac_key),
+		EVP_sha256(), NULL);
+}
+#endif
+
+/* encrypt a new ticket with the current key, or find the key to decrypt
+ * a ticket with; 1 is ok, 2 is ok and renew the ticket, 0 is a full
+ * handshake and -1 is failure */
+static int
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+tls_ticket_key_cb(SSL* ATTR_UNUSED(ssl), unsigned char* name,
+	unsigned char* iv, EVP_CIPHER_CTX* ctx, EVP_MAC_CTX* hctx, int enc)
+#else
+tls_ticket_key_cb(SSL* ATTR_UNUSED(ssl), unsigned char* name,
+	unsigned char* iv, EVP_CIPHER_CTX* ctx, HMAC_CTX* hctx, int enc)
+#endif
+{
+	uint32_t current = tls_ticket_keys->current % TLS_TICKET_KEYS;
+	struct tls_ticket_key* k;
+	int i;
+	if(enc) {
+		k = &tls_ticket_keys->key[current];
+		if(RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc())) != 1)
+			return -1;
+		memcpy(name, k->name, sizeof(k->name));
+		if(!EVP_EncryptInit_ex(ctx, EVP_aes_256_cbc(), NULL,
+			k->aes_key, iv))
+			return -1;
+		if(!tls_ticket_hmac_init(hctx, k))
+			return -1;
+		return 1;
+	}
+	for(i=0; i<TLS_TICKET_KEYS; i++) {
+		k = &tls_ticket_keys->key[i];
+		if(memcmp(name, k->name, sizeof(k->name)) != 0)
+			continue;
+		if(!tls_ticket_hmac_init(hctx, k))
+			return -1;
+		if(!EVP_DecryptInit_ex(ctx, EVP_aes_256_cbc(), NULL,
+			k->aes_key, iv))
+			return -1;
+		return ((uint32_t)i == current)?1:2;
+	}
+	/* unknown or expired key */
+	return 0;
+}
+
+/* setup the session ticket keys, in shared memory */
+static int
+tls_ticket_keys_create(SSL_CTX* ctx)
+{
+	int i;
+#ifdef HAVE_MMAP
+	tls_ticket_keys = (struct tls_ticket_keys*)mmap(NULL,
+		sizeof(*tls_ticket_keys), PROT_READ|PROT_WRITE,
+		MAP_SHARED|MAP_ANON, -1, 0);
+	if(tls_ticket_keys == MAP_FAILED) {
+		log_msg(LOG_ERR, "tls ticket keys: mmap failed: %s",
+			strerror(errno));
+		tls_ticket_keys = NULL;
+		return 0;
+	}
+#else
+	log_msg(LOG_ERR, "tls ticket keys: no mmap to share them");
+	return 0;
+#endif /* HAVE_MMAP */
+	tls_ticket_keys->current = 0;
+	tls_ticket_keys->rotated = time(NULL);
+	for(i=0; i<TLS_TICKET_KEYS; i++) {
+		if(!tls_ticket_key_new(&tls_ticket_keys->key[i]))
+			return 0;
+	}
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	if(!SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx, tls_ticket_key_cb))
+#else
+	if(!SSL_CTX_set_tlsext_ticket_key_cb(ctx, tls_ticket_key_cb))
+#endif
+	{
+		log_tls_err("tls ticket keys: could not set callback");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Rotate the session ticket keys when tls-ticket-rotate has passed, the
+ * key that is overwritten is the oldest one.  Called by the main process.
+ */
+static void
+server_tls_ticket_rotate(struct nsd* nsd)
+{
+	struct tls_ticket_keys* keys = tls_ticket_keys;
+	time_t now = time(NULL);
+	uint32_t next;
+	if(!keys || now - keys->rotated < nsd->options->tls_ticket_rotate)
+		return;
+	next = (keys->current + 1) % TLS_TICKET_KEYS;
+	if(!tls_ticket_key_new(&keys->key[next]))
+		return;
+	keys->current = next;
+	keys->rotated = now;
+	VERBOSITY(2, (LOG_INFO, "rotated the tls session ticket key"));
+}
+
+void*
+server_tls_ctx_create(struct nsd* nsd)
+{
+	SSL_CTX* ctx;
+	const char* pem = nsd->options->tls_service_pem;
+	const char* key = nsd->options->tls_service_key;
+
+	if(!pem || !pem[0]) {
+		log_msg(LOG_ERR, "tls-service-key is set, but not tls-service-pem");
+		return NULL;
+	}
+#if OPENSSL_VERSION_NUMBER < 0x10100000 || !defined(HAVE_OPENSSL_INIT_SSL)
+	ERR_load_SSL_strings();
+	(void)SSL_library_init();
+#else
+	OPENSSL_init_ssl(0, NULL);
+#endif
+	ctx = SSL_CTX_new(SSLv23_server_method());
+	if(!ctx) {
+		log_tls_err("tls-port: could not SSL_CTX_new");
+		return NULL;
+	}
+	/* DNS over TLS is TLS 1.2 or later (RFC 8310) */
+	if((SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv2) & SSL_OP_NO_SSLv2)
+		!= SSL_OP_NO_SSLv2 ||
+	   (SSL_CTX_set_options(ctx, SSL_OP_NO_SSLv3) & SSL_OP_NO_SSLv3)
+		!= SSL_OP_NO_SSLv3) {
+		log_tls_err("tls-port: could not set SSL_OP_NO_SSLv3");
+		SSL_CTX_free(ctx);
+		return NULL;
+	}
+#ifdef SSL_OP_NO_TLSv1
+	SSL_CTX_set_options(ctx, SSL_OP_NO_TLSv1);
+#endif
+#ifdef SSL_OP_NO_TLSv1_1
+	SSL_CTX_set_options(ctx, SSL_OP_NO_TLSv1_1);
+#endif
+#ifdef SSL_OP_NO_RENEGOTIATION
+	SSL_CTX_set_options(ctx, SSL_OP_NO_RENEGOTIATION);
+#endif
+	/* the tcp handlers continue a write with a copy of the buffer */
+	SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE |
+		SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	if(!SSL_CTX_use_certificate_chain_file(ctx, pem)) {
+		log_msg(LOG_ERR, "tls-port: error for cert file: %s", pem);
+		log_tls_err("tls-port: error in SSL_CTX use_certificate_chain_file");
+		SSL_CTX_free(ctx);
+		return NULL;
+	}
+	if(!SSL_CTX_use_PrivateKey_file(ctx, key, SSL_FILETYPE_PEM)) {
+		log_msg(LOG_ERR, "tls-port: error for private key file: %s",
+			key);
+		log_tls_err("tls-port: error in SSL_CTX use_PrivateKey_file");
+		SSL_CTX_free(ctx);
+		return NULL;
+	}
+	if(!SSL_CTX_check_private_key(ctx)) {
+		log_msg(LOG_ERR, "tls-port: error for key file: %s", key);
+		log_tls_err("tls-port: error in SSL_CTX check_private_key");
+		SSL_CTX_free(ctx);
+		return NULL;
+	}
+
+	/* resumption is with session tickets, that work across the
+	 * server processes, not with a session cache in every process */
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_OFF);
+	if(nsd->options->tls_ticket_rotate <= 0 ||
+		!tls_ticket_keys_create(ctx)) {
+		if(nsd->options->tls_ticket_rotate > 0)
+			log_msg(LOG_WARNING, "tls-port: no session tickets");
+		SSL_CTX_set_options(ctx, SSL_OP_NO_TICKET);
+	}
+
+	if(nsd->options->tls_ktls) {
+#ifdef SSL_OP_ENABLE_KTLS
+		/* OpenSSL sets the kernel TLS ULP on the socket after the
+		 * handshake, if the kernel has it for the cipher */
+		SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#else
+		log_msg(LOG_WARNING, "tls-ktls: not supported by this "
+			"OpenSSL, records are encrypted in the process");
+#endif
+	}
+	return ctx;
+}
+#endif /* HAVE_SSL */
+
+/* the port number of the socket address */
+static int
+sockaddr_port(struct sockaddr* addr)
+{
+	uint16_t port;
+#ifdef INET6
+	if(addr->sa_family == AF_INET6)
+		port = ((struct sockaddr_in6*)addr)->sin6_port;
+	else
+#endif
+		port = ((struct sockaddr_in*)addr)->sin_port;
+	return (int)ntohs(port);
+}
+
+#ifdef HAVE_SSL
+/* see if the address is on the tls-port */
+static int
+using_tls_port(struct sockaddr* addr, const char* tls_port)
+{
+	return sockaddr_port(addr) == atoi(tls_port);
+}
+#endif /* HAVE_SSL */
+
+/* see if the socket is on a proxy-protocol-port */
+static int
+using_proxy_protocol(struct nsd* nsd, struct nsd_socket* sock)
+{
+	struct proxy_protocol_port_list* p;
+	int port;
+	if(!sock->addr)
+		return 0;
+	port = sockaddr_port(sock->addr->ai_addr);
+	for(p = nsd->options->proxy_protocol_port; p; p = p->next) {
+		if(p->port == port)
+			return 1;
+	}
+	return 0;
+}
+
 /*
  * Close the sockets, shutdown the server and exit.
  * Does not return.
@@ -1106,6 +1464,7 @@ server_prepare_xfrd(struct nsd* nsd)
 	nsd->xfrd_listener->user_data = (struct ipc_handler_conn_data*)
 		region_alloc(nsd->region, sizeof(struct ipc_handler_conn_data));
 	nsd->xfrd_listener->fd = -1;
+	nsd->xfrd_notify_fd = -1;
 	((struct ipc_handler_conn_data*)nsd->xfrd_listener->user_data)->nsd =
 		nsd;
 	((struct ipc_handler_conn_data*)nsd->xfrd_listener->user_data)->conn =
@@ -1118,10 +1477,14 @@ server_start_xfrd(struct nsd *nsd, int del_db, int reload_active)
 {
 	pid_t pid;
 	int sockets[2] = {0,0};
+	int notify[2] = {-1,-1};
 	struct ipc_handler_conn_data *data;
 
 	if(nsd->xfrd_listener->fd != -1)
 		close(nsd->xfrd_listener->fd);
+	if(nsd->xfrd_notify_fd != -1)
+		close(nsd->xfrd_notify_fd);
+	nsd->xfrd_notify_fd = -1;
 	if(del_db) {
 		/* recreate taskdb that xfrd was using, it may be corrupt */
 		/* we (or reload) use nsd->mytask, and xfrd uses the other */
@@ -1139,10 +1502,21 @@ server_start_xfrd(struct nsd *nsd, int del_db, int reload_active)
 		log_msg(LOG_ERR, "startxfrd failed on socketpair: %s", strerror(errno));
 		return;
 	}
+	/* NOTIFY channel from the server processes, without it the NOTIFYs
+	 * are passed to xfrd via the server_main process */
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, notify) == -1) {
+		log_msg(LOG_ERR, "startxfrd failed on notify socketpair: %s",
+			strerror(errno));
+		notify[0] = notify[1] = -1;
+	}
 	pid = fork();
 	switch (pid) {
 	case -1:
 		log_msg(LOG_ERR, "fork xfrd failed: %s", strerror(errno));
+		if(notify[0] != -1) {
+			close(notify[0]);
+			close(notify[1]);
+		}
 		break;
 	default:
 		/* PARENT: close first socket, use second one */
@@ -1150,6 +1524,14 @@ server_start_xfrd(struct nsd *nsd, int del_db, int reload_active)
 		if (fcntl(sockets[1], F_SETFL, O_NONBLOCK) == -1) {
 			log_msg(LOG_ERR, "cannot fcntl pipe: %s", strerror(errno));
 		}
+		if(notify[0] != -1) {
+			close(notify[0]);
+			if (fcntl(notify[1], F_SETFL, O_NONBLOCK) == -1) {
+				log_msg(LOG_ERR, "cannot fcntl notify socket: %s",
+					strerror(errno));
+			}
+		}
+		nsd->xfrd_notify_fd = notify[1];
 		if(del_db) xfrd_free_namedb(nsd);
 		/* use other task than I am using, since if xfrd died and is
 		 * restarted, the reload is using nsd->mytask */
@@ -1164,6 +1546,14 @@ server_start_xfrd(struct nsd *nsd, int del_db, int reload_active)
 			log_msg(LOG_ERR, "cannot fcntl pipe: %s", strerror(errno));
 		}
 		nsd->xfrd_listener->fd = sockets[0];
+		if(notify[1] != -1) {
+			close(notify[1]);
+			if (fcntl(notify[0], F_SETFL, O_NONBLOCK) == -1) {
+				log_msg(LOG_ERR, "cannot fcntl notify socket: %s",
+					strerror(errno));
+			}
+		}
+		nsd->xfrd_notify_fd = notify[0];
 		break;
 	}
 	/* server-parent only */
@@ -1352,6 +1742,10 @@ reload_process_tasks(struct nsd* nsd, udb_ptr* last_task, int cmdsocket)
 		/* process task t */
 		/* append results for task t and update last_task */
 		task_process_in_reload(nsd, u, last_task, &t);
+		/* free part of the memory of deleted zones */
+		(void)delete_zone_step(nsd->db, DELETE_ZONE_STEP);
+		/* rename the zone files that have been written */
+		namedb_write_zonefiles_collect(nsd, 0);
 
 		/* go to next */
 		udb_ptr_set_ptr(&t, u, &next);
@@ -1422,31 +1816,59 @@ reload_do_stats(int cmdfd, struct nsd* nsd, udb_ptr* last)
 }
 #endif /* BIND8_STATS */
 
+/** add the time since start to the reload phase, start is set to now */
+static void
+reload_phase_done(struct nsd* nsd, enum reload_phase phase,
+	struct timespec* start)
+{
+	struct timespec now, d;
+	get_time(&now);
+	d = now;
+	timespec_subtract(&d, start);
+	if(d.tv_sec >= 0)
+		nsd->reload_timing.phase[phase] += (uint64_t)d.tv_sec*1000000
+			+ (uint64_t)d.tv_nsec/1000;
+	*start = now;
+}
+
 /*
  * Reload the database, stop parent, re-fork children and continue.
- * as server_main.
+ * as server_main.  The forkstart is the time before the fork, for the
+ * timing of the reload phases.
  */
 static void
 server_reload(struct nsd *nsd, region_type* server_region, netio_type* netio,
-	int cmdsocket)
+	int cmdsocket, struct timespec* forkstart)
 {
 	pid_t mypid;
 	sig_atomic_t cmd = NSD_QUIT_SYNC;
 	int ret;
 	udb_ptr last_task;
 	struct sigaction old_sigchld, ign_sigchld;
+	struct timespec start = *forkstart;
 	/* ignore SIGCHLD from the previous server_main that used this pid */
 	memset(&ign_sigchld, 0, sizeof(ign_sigchld));
 	ign_sigchld.sa_handler = SIG_IGN;
 	sigaction(SIGCHLD, &ign_sigchld, &old_sigchld);
+	memset(&nsd->reload_timing, 0, sizeof(nsd->reload_timing));
+	reload_phase_done(nsd, reload_phase_fork, &start);
 
 	/* see what tasks we got from xfrd */
 	task_remap(nsd->task[nsd->mytask]);
 	udb_ptr_init(&last_task, nsd->task[nsd->mytask]);
 	udb_compact_inhibited(nsd->db->udb, 1);
+	NSD_PROBE(reload__tasks__start);
 	reload_process_tasks(nsd, &last_task, cmdsocket);
+	/* the rest of the deleted zones is freed now, a parent zone would
+	 * answer from their names, and the server processes would keep
+	 * the memory until the next reload */
+	delete_zone_finish(nsd->db, NULL);
+	NSD_PROBE(reload__tasks__done);
+	reload_phase_done(nsd, reload_phase_tasks, &start);
 	udb_compact_inhibited(nsd->db->udb, 0);
 	udb_compact(nsd->db->udb);
+	NSD_PROBE(reload__compact__done);
+	reload_phase_done(nsd, reload_phase_compact, &start);
 
 #ifndef NDEBUG
 	if(nsd_debug_level >= 1)
@@ -1454,8 +1876,10 @@ server_reload(struct nsd *nsd, region_type* server_region, netio_type* netio,
 #endif /* NDEBUG */
 	/* sync to disk (if needed) */
 	udb_base_sync(nsd->db->udb, 0);
+	reload_phase_done(nsd, reload_phase_sync, &start);
 
 	initialize_dname_compression_tables(nsd);
+	reload_phase_done(nsd, reload_phase_compression, &start);
 
 #ifdef BIND8_STATS
 	/* Restart dumping stats if required.  */
@@ -1475,6 +1899,8 @@ server_reload(struct nsd *nsd, region_type* server_region, netio_type* netio,
 		send_children_quit(nsd);
 		exit(1);
 	}
+	NSD_PROBE(reload__children__started);
+	reload_phase_done(nsd, reload_phase_children, &start);
 
 	/* if the parent has quit, we must quit too, poll the fd for cmds */
 	if(block_read(nsd, cmdsocket, &cmd, sizeof(cmd), 0) == sizeof(cmd)) {
@@ -1513,9 +1939,18 @@ server_reload(struct nsd *nsd, region_type* server_region, netio_type* netio,
 		exit(1);
 	}
 	assert(ret==-1 || ret == 0 || cmd == NSD_RELOAD);
+	/* the old main has quit, write the log */
+	log_queue_writer();
+	reload_phase_done(nsd, reload_phase_quitsync, &start);
 #ifdef BIND8_STATS
 	reload_do_stats(cmdsocket, nsd, &last_task);
 #endif
+	reload_phase_done(nsd, reload_phase_stats, &start);
+	/* the total is the time from before the fork until now */
+	start = *forkstart;
+	reload_phase_done(nsd, reload_phase_total, &start);
+	task_new_reload_timing(nsd->task[nsd->mytask], &last_task,
+		&nsd->reload_timing);
 	udb_ptr_unlink(&last_task, nsd->task[nsd->mytask]);
 	task_process_sync(nsd->task[nsd->mytask]);
 #ifdef USE_ZONE_STATS
@@ -1538,6 +1973,7 @@ server_reload(struct nsd *nsd, region_type* server_region, netio_type* netio,
 	/* try to reopen file */
 	if (nsd->file_rotation_ok)
 		log_reopen(nsd->log_filename, 1);
+	NSD_PROBE(reload__done);
 	/* exit reload, continue as new server_main */
 }
 
@@ -1593,7 +2029,7 @@ server_main(struct nsd *nsd)
 	netio_type *netio = netio_create(server_region);
 	netio_handler_type reload_listener;
 	int reload_sockets[2] = {-1, -1};
-	struct timespec timeout_spec;
+	struct timespec timeout_spec, reload_forkstart;
 	int status;
 	pid_t child_pid;
 	pid_t reload_pid = -1;
@@ -1685,6 +2121,11 @@ server_main(struct nsd *nsd)
 			/* timeout to collect processes. In case no sigchild happens. */
 			timeout_spec.tv_sec = 60;
 			timeout_spec.tv_nsec = 0;
+			/* write the queued log messages every second, and
+			 * collect the zone file writes */
+			if((log_queue_active() || nsd->zonefile_writes) &&
+				timeout_spec.tv_sec > 1)
+				timeout_spec.tv_sec = 1;
 
 			/* listen on ports, timeout for collecting terminated children */
 			if(netio_dispatch(netio, &timeout_spec, 0) == -1) {
@@ -1692,6 +2133,11 @@ server_main(struct nsd *nsd)
 					log_msg(LOG_ERR, "netio_dispatch failed: %s", strerror(errno));
 				}
 			}
+			log_queue_flush();
+			namedb_write_zonefiles_collect(nsd, 0);
+#ifdef HAVE_SSL
+			server_tls_ticket_rotate(nsd);
+#endif
 			if(nsd->restart_children) {
 				restart_child_servers(nsd, server_region, netio,
 					&nsd->xfrd_listener->fd);
@@ -1755,6 +2201,8 @@ server_main(struct nsd *nsd)
 			}
 
 			/* Do actual reload */
+			NSD_PROBE(reload__start);
+			get_time(&reload_forkstart);
 			reload_pid = fork();
 			switch (reload_pid) {
 			case -1:
@@ -1762,9 +2210,10 @@ server_main(struct nsd *nsd)
 				break;
 			default:
 				/* PARENT */
+				NSD_PROBE1(reload__fork, (int)reload_pid);
 				close(reload_sockets[0]);
 				server_reload(nsd, server_region, netio,
-					reload_sockets[1]);
+					reload_sockets[1], &reload_forkstart);
 				DEBUG(DEBUG_IPC,2, (LOG_INFO, "Reload exited to become new main"));
 				close(reload_sockets[1]);
 				DEBUG(DEBUG_IPC,2, (LOG_INFO, "Reload closed"));
@@ -1781,6 +2230,10 @@ server_main(struct nsd *nsd)
 				/* CHILD */
 				/* server_main keep running until NSD_QUIT_SYNC
 				 * received from reload. */
+				log_queue_writer();
+				/* the zone file writers are collected by the
+				 * reload, that has the new database */
+				namedb_write_zonefiles_forget(nsd);
 				close(reload_sockets[1]);
 				reload_listener.fd = reload_sockets[0];
 				reload_listener.timeout = NULL;
@@ -1815,6 +2268,8 @@ server_main(struct nsd *nsd)
 			if(reload_listener.fd != -1) {
 				/* acknowledge the quit, to sync reload that we will really quit now */
 				sig_atomic_t cmd = NSD_RELOAD;
+				/* reload writes the log after this */
+				log_queue_flush();
 				DEBUG(DEBUG_IPC,1, (LOG_INFO, "main: ipc ack reload"));
 				if(!write_socket(reload_listener.fd, &cmd, sizeof(cmd))) {
 					log_msg(LOG_ERR, "server_main: "
@@ -1828,6 +2283,9 @@ server_main(struct nsd *nsd)
 			DEBUG(DEBUG_IPC,1, (LOG_INFO, "server_main: shutdown sequence"));
 			/* only quit children after xfrd has acked */
 			send_children_quit(nsd);
+			namedb_write_zonefiles_collect(nsd, 1);
+			if(reload_listener.fd == -1)
+				log_queue_stop();
 
 #if 0 /* OS collects memory pages */
 			region_destroy(server_region);
@@ -1863,6 +2321,8 @@ server_main(struct nsd *nsd)
 	daemon_remote_close(nsd->rc);
 #endif
 	send_children_quit_and_wait(nsd);
+	namedb_write_zonefiles_collect(nsd, 1);
+	log_queue_stop();
 
 	/* Unlink it if possible... */
 	unlinkpid(nsd->pidfile);
@@ -1917,24 +2377,42 @@ server_main(struct nsd *nsd)
 	server_shutdown(nsd);
 }
 
+#ifdef USE_USDT
+/** fire the query done probe, with the qtype, rcode, zone and length */
+static query_state_type
+server_probe_query_done(struct query *query, query_state_type st)
+{
+	NSD_PROBE4(query__done, (int)query->qtype,
+		(st==QUERY_DISCARDED?-1:(int)RCODE(query->packet)),
+		(query->zone?dname_name(domain_dname(query->zone->apex)):NULL),
+		(st==QUERY_DISCARDED?0:(int)buffer_position(query->packet)));
+	return st;
+}
+#define PROBE_QUERY_DONE(q, st) server_probe_query_done(q, st)
+#else
+#define PROBE_QUERY_DONE(q, st) (st)
+#endif /* USE_USDT */
+
 static query_state_type
 server_process_query(struct nsd *nsd, struct query *query)
 {
-	return query_process(query, nsd);
+	NSD_PROBE1(query__start, (int)buffer_limit(query->packet));
+	return PROBE_QUERY_DONE(query, query_process(query, nsd));
 }
 
 static query_state_type
 server_process_query_udp(struct nsd *nsd, struct query *query)
 {
+	NSD_PROBE1(query__start, (int)buffer_limit(query->packet));
 #ifdef RATELIMIT
 	if(query_process(query, nsd) != QUERY_DISCARDED) {
 		if(rrl_process_query(query))
-			return rrl_slip(query);
-		else	return QUERY_PROCESSED;
+			return PROBE_QUERY_DONE(query, rrl_slip(query));
+		else	return PROBE_QUERY_DONE(query, QUERY_PROCESSED);
 	}
-	return QUERY_DISCARDED;
+	return PROBE_QUERY_DONE(query, QUERY_DISCARDED);
 #else
-	return query_process(query, nsd);
+	return PROBE_QUERY_DONE(query, query_process(query, nsd));
 #endif
 }
 
@@ -2010,6 +2488,8 @@ server_child(struct nsd *nsd)
 		if(event_add(handler, NULL) != 0)
 			log_msg(LOG_ERR, "nsd ipcchild: event_add failed");
 	}
+	if (nsd->this_child)
+		child_notify_init(nsd, event_base);
 
 	if(nsd->reuseport) {
 		numifs = nsd->ifs / nsd->reuseport;
@@ -2052,6 +2532,8 @@ server_child(struct nsd *nsd)
 			data->query = udp_query;
 			data->nsd = nsd;
 			data->socket = &nsd->udp[i];
+			data->proxy_protocol = using_proxy_protocol(nsd,
+				&nsd->udp[i]);
 
 			handler = (struct event*) region_alloc(
 				server_region, sizeof(*handler));
@@ -2080,6 +2562,13 @@ server_child(struct nsd *nsd)
 				&tcp_accept_handlers[i-from];
 			data->nsd = nsd;
 			data->socket = &nsd->tcp[i];
+			data->proxy_protocol = using_proxy_protocol(nsd,
+				&nsd->tcp[i]);
+#ifdef HAVE_SSL
+			data->tls_accept = (nsd->tls_ctx && nsd->tcp[i].addr &&
+				using_tls_port(nsd->tcp[i].addr->ai_addr,
+				nsd->options->tls_port));
+#endif
 			event_set(handler, nsd->tcp[i].s, EV_PERSIST|EV_READ,
 				handle_tcp_accept, data);
 			if(event_base_set(event_base, handler) != 0)
@@ -2131,6 +2620,8 @@ server_child(struct nsd *nsd)
 					break;
 				}
 			}
+			/* pass the NOTIFYs from these queries to xfrd */
+			child_notify_flush(nsd);
 		} else if(mode == NSD_QUIT) {
 			/* ignore here, quit */
 		} else {
@@ -2139,6 +2630,7 @@ server_child(struct nsd *nsd)
 			nsd->mode = NSD_RUN;
 		}
 	}
+	child_notify_flush(nsd);
 
 #ifdef	BIND8_STATS
 	bind8_stats(nsd);
@@ -2151,6 +2643,62 @@ server_child(struct nsd *nsd)
 	server_shutdown(nsd);
 }
 
+/* see if the peer of the query is a trusted proxy */
+static int
+proxy_protocol_trusted(struct nsd* nsd, struct query* q)
+{
+	struct acl_options* acl;
+	for(acl = nsd->options->proxy_protocol_allow; acl; acl = acl->next) {
+		if(acl_addr_matches(acl, q))
+			return 1;
+	}
+	if(verbosity >= 2) {
+		char a[48];
+		addr2str(&q->addr, a, sizeof(a));
+		log_msg(LOG_INFO, "proxy protocol from %s, that is not in "
+			"proxy-protocol-allow, dropped", a);
+	}
+	return 0;
+}
+
+/*
+ * Take the PROXYv2 header off the UDP query, that is received from a
+ * trusted proxy.  The client address in the header replaces q->addr,
+ * the address of the proxy is kept for the answer.  Returns 0 if the
+ * query is dropped.
+ */
+static int
+proxy_protocol_udp(struct nsd* nsd, struct query* q)
+{
+	uint8_t* p = buffer_begin(q->packet);
+	size_t len = buffer_limit(q->packet), hdrlen;
+	socklen_t addrlen;
+	if(!proxy_protocol_trusted(nsd, q))
+		return 0;
+	if(len < PP2_HEADER_SIZE ||
+		(hdrlen = proxy_protocol_header_size(p)) == 0 ||
+		hdrlen > len) {
+		VERBOSITY(2, (LOG_WARNING, "no proxy protocol header, "
+			"dropping udp packet"));
+		return 0;
+	}
+	memcpy(&q->remote_addr, &q->addr, sizeof(q->addr));
+	q->remote_addrlen = q->addrlen;
+	if(!proxy_protocol_parse(p, hdrlen, &q->addr, sizeof(q->addr),
+		&addrlen)) {
+		VERBOSITY(2, (LOG_WARNING, "bad proxy protocol header, "
+			"dropping udp packet"));
+		return 0;
+	}
+	if(addrlen != 0) {
+		q->addrlen = addrlen;
+		q->is_proxied = 1;
+	}
+	memmove(p, p+hdrlen, len-hdrlen);
+	buffer_set_limit(q->packet, len-hdrlen);
+	return 1;
+}
+
 #if defined(HAVE_SENDMMSG) && !defined(NONBLOCKING_IS_BROKEN) && defined(HAVE_RECVMMSG)
 static void
 handle_udp(int fd, short event, void* arg)
@@ -2174,6 +2722,7 @@ handle_udp(int fd, short event, void* arg)
 		/* Simply no data available */
 		return;
 	}
+	NSD_PROBE1(udp__batch__start, recvcount);
 	for (i = 0; i < recvcount; i++) {
 	loopstart:
 		received = msgs[i].msg_len;
@@ -2199,6 +2748,19 @@ handle_udp(int fd, short event, void* arg)
 
 		buffer_skip(q->packet, received);
 		buffer_flip(q->packet);
+		if (data->proxy_protocol) {
+			q->addrlen = msgs[i].msg_hdr.msg_namelen;
+			if (!proxy_protocol_udp(data->nsd, q)) {
+				query_reset(queries[i], UDP_MAX_MESSAGE_LEN, 0);
+				iovecs[i].iov_len = buffer_remaining(q->packet);
+				goto swap_drop;
+			}
+			if (q->is_proxied) {
+				/* answer the proxy */
+				msgs[i].msg_hdr.msg_name = &q->remote_addr;
+				msgs[i].msg_hdr.msg_namelen = q->remote_addrlen;
+			}
+		}
 
 		/* Process and answer the query... */
 		if (server_process_query_udp(data->nsd, q) != QUERY_DISCARDED) {
@@ -2230,6 +2792,10 @@ handle_udp(int fd, short event, void* arg)
 			}
 #endif /* BIND8_STATS */
 		} else {
+			if (q->is_proxied) {
+				msgs[i].msg_hdr.msg_name = &q->addr;
+				msgs[i].msg_hdr.msg_namelen = sizeof(q->addr);
+			}
 			query_reset(queries[i], UDP_MAX_MESSAGE_LEN, 0);
 			iovecs[i].iov_len = buffer_remaining(q->packet);
 		swap_drop:
@@ -2269,7 +2835,12 @@ handle_udp(int fd, short event, void* arg)
 		}
 		i += sent;
 	}
+	NSD_PROBE1(udp__batch__done, recvcount);
 	for(i=0; i<recvcount; i++) {
+		if (queries[i]->is_proxied) {
+			msgs[i].msg_hdr.msg_name = &queries[i]->addr;
+			msgs[i].msg_hdr.msg_namelen = sizeof(queries[i]->addr);
+		}
 		query_reset(queries[i], UDP_MAX_MESSAGE_LEN, 0);
 		iovecs[i].iov_len = buffer_remaining(queries[i]->packet);
 	}
@@ -2310,6 +2881,7 @@ handle_udp(int fd, short event, void* arg)
 		/* Simply no data available */
 		return;
 	}
+	NSD_PROBE1(udp__batch__start, recvcount);
 	for (i = 0; i < recvcount; i++) {
 		received = msgs[i].msg_len;
 		msgs[i].msg_hdr.msg_namelen = queries[i]->addrlen;
@@ -2358,7 +2930,8 @@ handle_udp(int fd, short event, void* arg)
 		buffer_flip(q->packet);
 
 		/* Process and answer the query... */
-		if (server_process_query_udp(data->nsd, q) != QUERY_DISCARDED) {
+		if ((!data->proxy_protocol || proxy_protocol_udp(data->nsd, q))
+			&& server_process_query_udp(data->nsd, q) != QUERY_DISCARDED) {
 			if (RCODE(q->packet) == RCODE_OK && !AA(q->packet)) {
 				STATUP(data->nsd, nona);
 				ZTATUP(data->nsd, q->zone, nona);
@@ -2381,7 +2954,10 @@ handle_udp(int fd, short event, void* arg)
 				      buffer_begin(q->packet),
 				      buffer_remaining(q->packet),
 				      0,
+				      q->is_proxied ?
+				      (struct sockaddr *) &q->remote_addr :
 				      (struct sockaddr *) &q->addr,
+				      q->is_proxied ? q->remote_addrlen :
 				      q->addrlen);
 			if (sent == -1) {
 				const char* es = strerror(errno);
@@ -2412,6 +2988,9 @@ handle_udp(int fd, short event, void* arg)
 		query_reset(queries[i], UDP_MAX_MESSAGE_LEN, 0);
 #endif
 	}
+#ifdef HAVE_RECVMMSG
+	NSD_PROBE1(udp__batch__done, recvcount);
+#endif
 #endif
 }
 #endif /* defined(HAVE_SENDMMSG) && !defined(NONBLOCKING_IS_BROKEN) && defined(HAVE_RECVMMSG) */
@@ -2421,6 +3000,14 @@ static void
 cleanup_tcp_handler(struct tcp_handler_data* data)
 {
 	event_del(&data->event);
+#ifdef HAVE_SSL
+	if(data->tls) {
+		if(data->tls_handshake_done)
+			(void)SSL_shutdown(data->tls);
+		SSL_free(data->tls);
+		data->tls = NULL;
+	}
+#endif
 	close(data->event.ev_fd);
 
 	/*
@@ -2441,6 +3028,188 @@ cleanup_tcp_handler(struct tcp_handler_data* data)
 	region_destroy(data->region);
 }
 
+/*
+ * Read the PROXYv2 header at the start of the TCP connection, before the
+ * TLS handshake if any.  It is read with exact sizes, the fixed part and
+ * then the rest, so that no query data is read with it.  Returns 1 when
+ * the header is read and q->addr is the client address, 0 to wait for
+ * more data or when the connection is closed.
+ */
+static int
+tcp_read_proxy_header(struct tcp_handler_data* data, int fd)
+{
+	struct query* q = data->query;
+	uint8_t* p = buffer_begin(q->packet);
+	size_t want = PP2_HEADER_SIZE;
+	ssize_t received;
+	socklen_t addrlen;
+	if (data->bytes_transmitted >= PP2_HEADER_SIZE) {
+		want = proxy_protocol_header_size(p);
+	}
+	received = read(fd, p + data->bytes_transmitted,
+		want - data->bytes_transmitted);
+	if (received == -1) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		VERBOSITY(2, (LOG_WARNING, "failed reading proxy protocol "
+			"header: %s", strerror(errno)));
+		cleanup_tcp_handler(data);
+		return 0;
+	} else if (received == 0) {
+		cleanup_tcp_handler(data);
+		return 0;
+	}
+	data->bytes_transmitted += received;
+	if (data->bytes_transmitted < want)
+		return 0;
+	if (want == PP2_HEADER_SIZE) {
+		want = proxy_protocol_header_size(p);
+		if (want == 0 || want > buffer_capacity(q->packet)) {
+			VERBOSITY(2, (LOG_WARNING, "no proxy protocol header, "
+				"dropping tcp connection"));
+			cleanup_tcp_handler(data);
+			return 0;
+		}
+		if (data->bytes_transmitted < want)
+			return 0;
+	}
+	if (!proxy_protocol_parse(p, want, &q->addr, sizeof(q->addr),
+		&addrlen)) {
+		VERBOSITY(2, (LOG_WARNING, "bad proxy protocol header, "
+			"dropping tcp connection"));
+		cleanup_tcp_handler(data);
+		return 0;
+	}
+	if (addrlen != 0)
+		q->addrlen = addrlen;
+	data->proxy_pending = 0;
+	data->bytes_transmitted = 0;
+	return 1;
+}
+
+#ifdef HAVE_SSL
+/* the length and the packet, for one SSL_write of a TCP answer */
+static uint8_t tls_write_buffer[sizeof(uint16_t) + QIOBUFSZ];
+
+/* wait with the handler CB for the socket to become readable or
+ * writable (DIR) */
+static void
+tcp_handler_wait(struct tcp_handler_data* data, int fd, short dir,
+	void (*cb)(int, short, void*))
+{
+	struct timeval timeout;
+	struct event_base* ev_base = data->event.ev_base;
+	timeout.tv_sec = data->tcp_timeout / 1000;
+	timeout.tv_usec = (data->tcp_timeout % 1000)*1000;
+	event_del(&data->event);
+	event_set(&data->event, fd, EV_PERSIST | dir | EV_TIMEOUT, cb, data);
+	if(event_base_set(ev_base, &data->event) != 0)
+		log_msg(LOG_ERR, "event base set tls failed");
+	if(event_add(&data->event, &timeout) != 0)
+		log_msg(LOG_ERR, "event add tls failed");
+}
+
+/*
+ * Turn the result R of a TLS operation by handler CB, that waits for DIR,
+ * into a read(2) or write(2) result.  If TLS wants the other direction,
+ * the handler waits for that, with errno EAGAIN.
+ */
+static ssize_t
+tls_result(struct tcp_handler_data* data, int fd, int r, short dir,
+	void (*cb)(int, short, void*))
+{
+	short want;
+	if(r > 0) {
+		if(data->tls_want) {
+			data->tls_want = 0;
+			tcp_handler_wait(data, fd, dir, cb);
+		}
+		return r;
+	}
+	switch(SSL_get_error(data->tls, r)) {
+	case SSL_ERROR_ZERO_RETURN:
+		return 0;
+	case SSL_ERROR_WANT_READ:
+		want = EV_READ;
+		break;
+	case SSL_ERROR_WANT_WRITE:
+		want = EV_WRITE;
+		break;
+	case SSL_ERROR_SYSCALL:
+		if(errno == 0)
+			return 0;
+		return -1;
+	default:
+		if(verbosity >= 2)
+			log_tls_err("tls connection failed");
+		ERR_clear_error();
+#ifdef ECONNRESET
+		errno = ECONNRESET;
+#else
+		errno = EIO;
+#endif
+		return -1;
+	}
+	if(want != (data->tls_want?data->tls_want:dir))
+		tcp_handler_wait(data, fd, want, cb);
+	data->tls_want = (want == dir)?0:want;
+	errno = EAGAIN;
+	return -1;
+}
+
+/* perform the TLS handshake, returns 1 when done, 0 to wait for the
+ * socket or when the connection is closed */
+static int
+tls_handshake(struct tcp_handler_data* data, int fd)
+{
+	int r;
+	ERR_clear_error();
+	r = SSL_do_handshake(data->tls);
+	if(tls_result(data, fd, r, EV_READ, handle_tcp_reading) > 0) {
+		data->tls_handshake_done = 1;
+		NSD_PROBE1(tls__handshake, SSL_session_reused(data->tls));
+		return 1;
+	}
+	if(errno != EAGAIN || r == 0) {
+		if(verbosity >= 2) {
+			char buf[48];
+			addr2str(&data->query->addr, buf, sizeof(buf));
+			log_msg(LOG_INFO, "tls handshake with %s failed", buf);
+		}
+		cleanup_tcp_handler(data);
+	}
+	return 0;
+}
+#endif /* HAVE_SSL */
+
+/* read from the TCP connection, through TLS on the tls-port */
+static ssize_t
+tcp_read(struct tcp_handler_data* data, int fd, void* buf, size_t len)
+{
+#ifdef HAVE_SSL
+	if(data->tls) {
+		ERR_clear_error();
+		return tls_result(data, fd, SSL_read(data->tls, buf, (int)len),
+			EV_READ, handle_tcp_reading);
+	}
+#endif
+	return read(fd, buf, len);
+}
+
+/* write to the TCP connection, through TLS on the tls-port */
+static ssize_t
+tcp_write(struct tcp_handler_data* data, int fd, const void* buf, size_t len)
+{
+#ifdef HAVE_SSL
+	if(data->tls) {
+		ERR_clear_error();
+		return tls_result(data, fd, SSL_write(data->tls, buf, (int)len),
+			EV_WRITE, handle_tcp_writing);
+	}
+#endif
+	return write(fd, buf, len);
+}
+
 static void
 handle_tcp_reading(int fd, short event, void* arg)
 {
@@ -2462,7 +3231,16 @@ handle_tcp_reading(int fd, short event, void* arg)
 		return;
 	}
 
+	if (data->proxy_pending && !tcp_read_proxy_header(data, fd))
+		return;
+
+#ifdef HAVE_SSL
+	assert((event & EV_READ) || data->tls_want == EV_WRITE);
+	if (data->tls && !data->tls_handshake_done && !tls_handshake(data, fd))
+		return;
+#else
 	assert((event & EV_READ));
+#endif
 
 	if (data->bytes_transmitted == 0) {
 		query_reset(data->query, TCP_MAX_MESSAGE_LEN, 1);
@@ -2472,7 +3250,7 @@ handle_tcp_reading(int fd, short event, void* arg)
 	 * Check if we received the leading packet length bytes yet.
 	 */
 	if (data->bytes_transmitted < sizeof(uint16_t)) {
-		received = read(fd,
+		received = tcp_read(data, fd,
 				(char *) &data->query->tcplen
 				+ data->bytes_transmitted,
 				sizeof(uint16_t) - data->bytes_transmitted);
@@ -2538,7 +3316,7 @@ handle_tcp_reading(int fd, short event, void* arg)
 	assert(buffer_remaining(data->query->packet) > 0);
 
 	/* Read the (remaining) query data.  */
-	received = read(fd,
+	received = tcp_read(data, fd,
 			buffer_current(data->query->packet),
 			buffer_remaining(data->query->packet));
 	if (received == -1) {
@@ -2587,6 +3365,16 @@ handle_tcp_reading(int fd, short event, void* arg)
 		STATUP(data->nsd, ctcp6);
 	}
 #endif
+#ifdef HAVE_SSL
+	if (data->tls) {
+#ifdef INET6
+		if (data->query->addr.ss_family == AF_INET6)
+			STATUP(data->nsd, ctls6);
+		else
+#endif
+			STATUP(data->nsd, ctls);
+	}
+#endif
 #endif /* BIND8_STATS */
 
 	/* We have a complete query, process it.  */
@@ -2623,6 +3411,16 @@ handle_tcp_reading(int fd, short event, void* arg)
 		ZTATUP(data->nsd, data->query->zone, ctcp6);
 	}
 #endif
+#ifdef HAVE_SSL
+	if (data->tls) {
+#ifdef INET6
+		if (data->query->addr.ss_family == AF_INET6)
+			ZTATUP(data->nsd, data->query->zone, ctls6);
+		else
+#endif
+			ZTATUP(data->nsd, data->query->zone, ctls);
+	}
+#endif
 #endif /* USE_ZONE_STATS */
 
 	query_add_optional(data->query, data->nsd);
@@ -2662,11 +3460,30 @@ handle_tcp_writing(int fd, short event, void* arg)
 		return;
 	}
 
+#ifdef HAVE_SSL
+	assert((event & EV_WRITE) || data->tls_want == EV_READ);
+#else
 	assert((event & EV_WRITE));
+#endif
 
 	if (data->bytes_transmitted < sizeof(q->tcplen)) {
 		/* Writing the response packet length.  */
 		uint16_t n_tcplen = htons(q->tcplen);
+#ifdef HAVE_SSL
+		size_t lenbytes = sizeof(n_tcplen) - data->bytes_transmitted;
+		if (data->tls) {
+			/* the length and the packet in one TLS record, a
+			 * retry of the write passes the same bytes */
+			memcpy(tls_write_buffer, (uint8_t*)&n_tcplen
+				+ data->bytes_transmitted, lenbytes);
+			memcpy(tls_write_buffer + lenbytes,
+				buffer_begin(q->packet),
+				buffer_limit(q->packet));
+			sent = tcp_write(data, fd, tls_write_buffer,
+				lenbytes + buffer_limit(q->packet));
+		} else
+#endif /* HAVE_SSL */
+		{
 #ifdef HAVE_WRITEV
 		struct iovec iov[2];
 		iov[0].iov_base = (uint8_t*)&n_tcplen + data->bytes_transmitted;
@@ -2679,6 +3496,7 @@ handle_tcp_writing(int fd, short event, void* arg)
 			     (const char *) &n_tcplen + data->bytes_transmitted,
 			     sizeof(n_tcplen) - data->bytes_transmitted);
 #endif /* HAVE_WRITEV */
+		}
 		if (sent == -1) {
 			if (errno == EAGAIN || errno == EINTR) {
 				/*
@@ -2708,6 +3526,12 @@ handle_tcp_writing(int fd, short event, void* arg)
 			return;
 		}
 
+#ifdef HAVE_SSL
+		if (data->tls) {
+			sent -= lenbytes;
+			goto packet_could_be_done;
+		}
+#endif
 #ifdef HAVE_WRITEV
 		sent -= sizeof(n_tcplen);
 		/* handle potential 'packet done' code */
@@ -2715,7 +3539,7 @@ handle_tcp_writing(int fd, short event, void* arg)
 #endif
  	}
  
-	sent = write(fd,
+	sent = tcp_write(data, fd,
 		     buffer_current(q->packet),
 		     buffer_remaining(q->packet));
 	if (sent == -1) {
@@ -2739,7 +3563,7 @@ handle_tcp_writing(int fd, short event, void* arg)
 	}
 
 	data->bytes_transmitted += sent;
-#ifdef HAVE_WRITEV
+#if defined(HAVE_WRITEV) || defined(HAVE_SSL)
   packet_could_be_done:
 #endif
 	buffer_skip(q->packet, sent);
@@ -2791,6 +3615,10 @@ handle_tcp_writing(int fd, short event, void* arg)
 	if (data->nsd->tcp_query_count > 0 &&
 		data->query_count >= data->nsd->tcp_query_count) {
 
+#ifdef HAVE_SSL
+		if (data->tls)
+			(void) SSL_shutdown(data->tls);
+#endif
 		(void) shutdown(fd, SHUT_WR);
 	}
 
@@ -2806,6 +3634,12 @@ handle_tcp_writing(int fd, short event, void* arg)
 		log_msg(LOG_ERR, "event base set tcpw failed");
 	if(event_add(&data->event, &timeout) != 0)
 		log_msg(LOG_ERR, "event add tcpw failed");
+#ifdef HAVE_SSL
+	/* the next query can be in the TLS record that was read, there is
+	 * no read event for the socket then */
+	if (data->tls && SSL_pending(data->tls) > 0)
+		handle_tcp_reading(fd, EV_READ, data);
+#endif
 }
 
 
@@ -2911,6 +3745,48 @@ handle_tcp_accept(int fd, short event, void* arg)
 	memcpy(&tcp_data->query->addr, &addr, addrlen);
 	tcp_data->query->addrlen = addrlen;
 
+	/* the client address is in the PROXYv2 header, from a proxy that
+	 * is trusted */
+	tcp_data->proxy_pending = 0;
+	if (data->proxy_protocol) {
+		if (!proxy_protocol_trusted(data->nsd, tcp_data->query)) {
+			close(s);
+			region_destroy(tcp_region);
+			return;
+		}
+		tcp_data->proxy_pending = 1;
+	}
+
+#ifdef HAVE_SSL
+	tcp_data->tls = NULL;
+	tcp_data->tls_handshake_done = 0;
+	tcp_data->tls_want = 0;
+	if (data->tls_accept) {
+		tcp_data->tls = SSL_new((SSL_CTX*)data->nsd->tls_ctx);
+		if (!tcp_data->tls || !SSL_set_fd(tcp_data->tls, s)) {
+			log_tls_err("cannot setup tls connection");
+			if (tcp_data->tls)
+				SSL_free(tcp_data->tls);
+			close(s);
+			region_destroy(tcp_region);
+			return;
+		}
+		SSL_set_accept_state(tcp_data->tls);
+#if defined(IPPROTO_TCP) && defined(TCP_NODELAY)
+		{
+			/* the handshake flights and the answer after the
+			 * session tickets are not held back by Nagle */
+			int on = 1;
+			if (setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &on,
+				sizeof(on)) < 0)
+				VERBOSITY(2, (LOG_WARNING, "setsockopt(..., "
+					"TCP_NODELAY, ...) failed: %s",
+					strerror(errno)));
+		}
+#endif
+	}
+#endif
+
 	tcp_data->tcp_timeout = data->nsd->tcp_timeout * 1000;
 	if (data->nsd->current_tcp_count > data->nsd->maximum_tcp_count/2) {
 		/* very busy, give smaller timeout */
@@ -2923,12 +3799,20 @@ handle_tcp_accept(int fd, short event, void* arg)
 		handle_tcp_reading, tcp_data);
 	if(event_base_set(data->event.ev_base, &tcp_data->event) != 0) {
 		log_msg(LOG_ERR, "cannot set tcp event base");
+#ifdef HAVE_SSL
+		if (tcp_data->tls)
+			SSL_free(tcp_data->tls);
+#endif
 		close(s);
 		region_destroy(tcp_region);
 		return;
 	}
 	if(event_add(&tcp_data->event, &timeout) != 0) {
 		log_msg(LOG_ERR, "cannot add tcp to event base");
+#ifdef HAVE_SSL
+		if (tcp_data->tls)
+			SSL_free(tcp_data->tls);
+#endif
 		close(s);
 		region_destroy(tcp_region);
 		return;
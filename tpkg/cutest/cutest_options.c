@@ -11,6 +11,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include "tpkg/cutest/cutest.h"
 #include "region-allocator.h"
 #include "options.h"
@@ -27,6 +28,8 @@ static void acl_6(CuTest *tc);
 static void replace_1(CuTest *tc);
 static void replace_2(CuTest *tc);
 static void zonelist_1(CuTest *tc);
+static void zonelist_2(CuTest *tc);
+static void zonelist_3(CuTest *tc);
 
 CuSuite* reg_cutest_options(void)
 {
@@ -41,6 +44,8 @@ CuSuite* reg_cutest_options(void)
 	SUITE_ADD_TEST(suite, replace_1); /* replace_str */
 	SUITE_ADD_TEST(suite, replace_2); /* make_zonefile */
 	SUITE_ADD_TEST(suite, zonelist_1); /* zonelist */
+	SUITE_ADD_TEST(suite, zonelist_2); /* zonelist snapshot */
+	SUITE_ADD_TEST(suite, zonelist_3); /* zonelist batch */
 	return suite;
 }
 
@@ -397,7 +402,7 @@ static void zonelist_1(CuTest *tc)
 {
 	struct zone_options* z1, *z2, *z3;
 	struct pattern_options* p1, *p2;
-	char zname[1024];
+	char zname[1024], sname[1024];
 	region_type* region = region_create_custom(xalloc, free,
 		DEFAULT_CHUNK_SIZE, DEFAULT_LARGE_OBJECT_SIZE,
 		DEFAULT_INITIAL_CLEANUP_SIZE, 1);
@@ -499,4 +504,155 @@ static void zonelist_1(CuTest *tc)
 	zone_list_close(opt);
 	region_destroy(region);
 	unlink(zname);
+	snprintf(sname, sizeof(sname), "/tmp/unitzlist%u.cfg.bin",
+		(unsigned)getpid());
+	unlink(sname); /* zonelist snapshot */
+}
+
+/* create options with master and slave patterns for zonelist tests */
+static struct nsd_options*
+zonelist_opt_create(const char* zname)
+{
+	struct pattern_options* p;
+	region_type* region = region_create_custom(xalloc, free,
+		DEFAULT_CHUNK_SIZE, DEFAULT_LARGE_OBJECT_SIZE,
+		DEFAULT_INITIAL_CLEANUP_SIZE, 1);
+	struct nsd_options* opt = nsd_options_create(region);
+	opt->region = region;
+	opt->zonelistfile = zname;
+	p = pattern_options_create(opt->region);
+	p->pname = region_strdup(opt->region, "master");
+	nsd_options_insert_pattern(opt, p);
+	p = pattern_options_create(opt->region);
+	p->pname = region_strdup(opt->region, "slave");
+	nsd_options_insert_pattern(opt, p);
+	return opt;
+}
+
+/* check that the zones are in the tree with the pattern */
+static void
+zonelist_check_zone(CuTest *tc, struct nsd_options* opt, const char* nm,
+	const char* pnm)
+{
+	region_type* tmp = region_create(xalloc, free);
+	struct zone_options* z = zone_options_find(opt,
+		dname_parse(tmp, nm));
+	CuAssertTrue(tc, z != NULL);
+	CuAssertStrEquals(tc, nm, z->name);
+	CuAssertStrEquals(tc, pnm, z->pattern->pname);
+	region_destroy(tmp);
+}
+
+static void zonelist_2(CuTest *tc)
+{
+	struct nsd_options* opt;
+	struct zone_options* z;
+	struct stat st1, st2;
+	char zname[1024], sname[1024];
+	snprintf(zname, sizeof(zname), "/tmp/unitzsnap%u.cfg",
+		(unsigned)getpid());
+	snprintf(sname, sizeof(sname), "/tmp/unitzsnap%u.cfg.bin",
+		(unsigned)getpid());
+
+	/* create a zonelist with a free entry in it */
+	opt = zonelist_opt_create(zname);
+	CuAssertTrue(tc, parse_zone_list_file(opt));
+	CuAssertTrue(tc, zone_list_add(opt, "example.com", "master") != NULL);
+	z = zone_list_add(opt, "example.net", "slave");
+	CuAssertTrue(tc, zone_list_add(opt, "foo.nl", "slave") != NULL);
+	CuAssertTrue(tc, zone_list_add(opt, "a.foo.nl", "master") != NULL);
+	zone_list_del(opt, z);
+	CuAssertTrue(tc, !opt->zonelist_snapshot_current);
+	zone_list_write_snapshot(opt);
+	CuAssertTrue(tc, opt->zonelist_snapshot_current);
+	zone_list_close(opt);
+	region_destroy(opt->region);
+
+	/* read it back from the snapshot, with a config zone in between */
+	opt = zonelist_opt_create(zname);
+	z = zone_options_create(opt->region);
+	z->name = region_strdup(opt->region, "bar.nl");
+	z->part_of_config = 1;
+	z->pattern = pattern_options_find(opt, "master");
+	CuAssertTrue(tc, nsd_options_insert_zone(opt, z));
+	CuAssertTrue(tc, stat(sname, &st1) == 0);
+	CuAssertTrue(tc, parse_zone_list_file(opt));
+	CuAssertTrue(tc, opt->zonelist_snapshot_current);
+	/* it was loaded, and not parsed and written again */
+	CuAssertTrue(tc, stat(sname, &st2) == 0);
+	CuAssertTrue(tc, st1.st_ino == st2.st_ino);
+	CuAssertTrue(tc, opt->zone_options->count == 4);
+	zonelist_check_zone(tc, opt, "example.com", "master");
+	zonelist_check_zone(tc, opt, "foo.nl", "slave");
+	zonelist_check_zone(tc, opt, "a.foo.nl", "master");
+	zonelist_check_zone(tc, opt, "bar.nl", "master");
+	check_zonelist_file(tc, opt, "# NSD zone list\n# name pattern\n"
+		"add example.com master\n" "del example.net slave\n"
+		"add foo.nl slave\n" "add a.foo.nl master\n");
+	/* the free entry is reused from the snapshot data */
+	CuAssertTrue(tc, zone_list_add(opt, "example.org", "slave") != NULL);
+	CuAssertTrue(tc, !opt->zonelist_snapshot_current);
+	check_zonelist_file(tc, opt, "# NSD zone list\n# name pattern\n"
+		"add example.com master\n" "add example.org slave\n"
+		"add foo.nl slave\n" "add a.foo.nl master\n");
+	zone_list_close(opt);
+	region_destroy(opt->region);
+
+	/* the zonelist changed, the snapshot is stale and the text is read */
+	opt = zonelist_opt_create(zname);
+	CuAssertTrue(tc, parse_zone_list_file(opt));
+	CuAssertTrue(tc, opt->zone_options->count == 4);
+	zonelist_check_zone(tc, opt, "example.org", "slave");
+	/* the parse does not write files, the daemon rewrites it */
+	CuAssertTrue(tc, !opt->zonelist_snapshot_current);
+	CuAssertTrue(tc, stat(sname, &st2) == 0);
+	CuAssertTrue(tc, st1.st_ino == st2.st_ino);
+	zone_list_write_snapshot(opt);
+	CuAssertTrue(tc, opt->zonelist_snapshot_current);
+	CuAssertTrue(tc, stat(sname, &st2) == 0);
+	CuAssertTrue(tc, st1.st_ino != st2.st_ino);
+	zone_list_close(opt);
+	region_destroy(opt->region);
+
+	unlink(zname);
+	unlink(sname);
+}
+
+static void zonelist_3(CuTest *tc)
+{
+	struct nsd_options* opt;
+	struct zone_options* z1, *z2, *z3;
+	char zname[1024], sname[1024];
+	snprintf(zname, sizeof(zname), "/tmp/unitzbatch%u.cfg",
+		(unsigned)getpid());
+	snprintf(sname, sizeof(sname), "/tmp/unitzbatch%u.cfg.bin",
+		(unsigned)getpid());
+
+	opt = zonelist_opt_create(zname);
+	CuAssertTrue(tc, parse_zone_list_file(opt));
+	zone_list_batch_begin(opt);
+	CuAssertTrue(tc, zone_list_add(opt, "example.com", "master") != NULL);
+	z1 = zone_list_add(opt, "example.net", "slave");
+	z2 = zone_list_add(opt, "foo.nl", "slave");
+	z3 = zone_list_add(opt, "bar.nl", "master");
+	CuAssertTrue(tc, z1 && z2 && z3);
+	zone_list_del(opt, z1);
+	zone_list_del(opt, z2);
+	zone_list_del(opt, z3);
+	/* no compaction during the batch */
+	CuAssertTrue(tc, opt->zonefree_number == 3);
+	check_zonelist_file(tc, opt, "# NSD zone list\n# name pattern\n"
+		"add example.com master\n" "del example.net slave\n"
+		"del foo.nl slave\n" "del bar.nl master\n");
+	/* compacted at the end of the batch */
+	zone_list_batch_end(opt);
+	CuAssertTrue(tc, !opt->zonelist_batch);
+	CuAssertTrue(tc, opt->zonefree_number == 0);
+	check_zonelist_file(tc, opt, "# NSD zone list\n# name pattern\n"
+		"add example.com master\n");
+	zone_list_close(opt);
+	region_destroy(opt->region);
+
+	unlink(zname);
+	unlink(sname);
 }
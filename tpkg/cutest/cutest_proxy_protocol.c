@@ -0,0 +1,105 @@
+/*
+	test proxy_protocol.h
+*/
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "tpkg/cutest/cutest.h"
+#include "proxy_protocol.h"
+
+static void proxy_protocol_1(CuTest *tc);
+
+CuSuite* reg_cutest_proxy_protocol(void)
+{
+        CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, proxy_protocol_1);
+	return suite;
+}
+
+/* make a header with the command, family and address block */
+static size_t
+make_header(uint8_t* buf, uint8_t cmd, uint8_t fam, const uint8_t* a,
+	size_t alen)
+{
+	memcpy(buf, PP2_SIG, PP2_SIG_LEN);
+	buf[12] = 0x20 | cmd;
+	buf[13] = fam;
+	buf[14] = (uint8_t)(alen>>8);
+	buf[15] = (uint8_t)(alen&0xff);
+	memcpy(buf+PP2_HEADER_SIZE, a, alen);
+	return PP2_HEADER_SIZE + alen;
+}
+
+static void proxy_protocol_1(CuTest *tc)
+{
+	uint8_t buf[512];
+	/* 192.0.2.1:5300 to 192.0.2.53:53, and a TLV */
+	uint8_t a4[] = { 192, 0, 2, 1, 192, 0, 2, 53, 0x14, 0xb4, 0, 53,
+		0x04, 0, 1, 0 };
+	struct sockaddr_storage ss;
+	struct sockaddr_in* sin = (struct sockaddr_in*)&ss;
+	socklen_t addrlen;
+	size_t len;
+
+	/* PROXY TCP4 */
+	len = make_header(buf, 1, 0x11, a4, sizeof(a4));
+	CuAssert(tc, "size", proxy_protocol_header_size(buf) == len);
+	CuAssert(tc, "parse4", proxy_protocol_parse(buf, len, &ss,
+		sizeof(ss), &addrlen));
+	CuAssert(tc, "addrlen4", addrlen == sizeof(struct sockaddr_in));
+	CuAssert(tc, "family4", sin->sin_family == AF_INET);
+	CuAssert(tc, "addr4", memcmp(&sin->sin_addr, a4, 4) == 0);
+	CuAssert(tc, "port4", ntohs(sin->sin_port) == 5300);
+	/* too small for the address block */
+	CuAssert(tc, "short4", !proxy_protocol_parse(buf, len-1, &ss,
+		sizeof(ss), &addrlen));
+	len = make_header(buf, 1, 0x12, a4, 8);
+	CuAssert(tc, "block4", !proxy_protocol_parse(buf, len, &ss,
+		sizeof(ss), &addrlen));
+
+	/* LOCAL keeps the peer address */
+	len = make_header(buf, 0, 0x00, a4, 0);
+	CuAssert(tc, "local", proxy_protocol_parse(buf, len, &ss,
+		sizeof(ss), &addrlen) && addrlen == 0);
+	/* unknown command */
+	len = make_header(buf, 2, 0x11, a4, sizeof(a4));
+	CuAssert(tc, "command", !proxy_protocol_parse(buf, len, &ss,
+		sizeof(ss), &addrlen));
+	/* version 1 and a DNS message are not version 2 */
+	buf[12] = 0x11;
+	CuAssert(tc, "version", proxy_protocol_header_size(buf) == 0);
+	memset(buf, 0, PP2_HEADER_SIZE);
+	CuAssert(tc, "signature", proxy_protocol_header_size(buf) == 0);
+
+#ifdef INET6
+	{
+		/* 2001:db8::1 port 53000 */
+		uint8_t a6[36];
+		struct sockaddr_in6* sin6 = (struct sockaddr_in6*)&ss;
+		memset(a6, 0, sizeof(a6));
+		a6[0] = 0x20; a6[1] = 0x01; a6[2] = 0x0d; a6[3] = 0xb8;
+		a6[15] = 1;
+		a6[32] = 0xcf; a6[33] = 0x08;
+		len = make_header(buf, 1, 0x22, a6, sizeof(a6));
+		CuAssert(tc, "parse6", proxy_protocol_parse(buf, len, &ss,
+			sizeof(ss), &addrlen));
+		CuAssert(tc, "addrlen6", addrlen == sizeof(*sin6));
+		CuAssert(tc, "family6", sin6->sin6_family == AF_INET6);
+		CuAssert(tc, "addr6", memcmp(&sin6->sin6_addr, a6, 16) == 0);
+		CuAssert(tc, "port6", ntohs(sin6->sin6_port) == 53000);
+		/* does not fit in a sockaddr_in */
+		CuAssert(tc, "fit6", !proxy_protocol_parse(buf, len, &ss,
+			sizeof(struct sockaddr_in), &addrlen));
+	}
+#endif
+}
@@ -26,6 +26,7 @@ static void rbtree_7(CuTest *tc);
 static void rbtree_8(CuTest *tc);
 static void rbtree_9(CuTest *tc);
 static void rbtree_10(CuTest *tc);
+static void rbtree_11(CuTest *tc);
 static int testcompare(const void *lhs, const void *rhs);
 
 CuSuite* reg_cutest_rbtree(void)
@@ -46,6 +47,7 @@ CuSuite* reg_cutest_rbtree(void)
 	SUITE_ADD_TEST(suite, rbtree_8);
 	SUITE_ADD_TEST(suite, rbtree_9);
 	SUITE_ADD_TEST(suite, rbtree_10);
+	SUITE_ADD_TEST(suite, rbtree_11);
         
 	return suite;
 }
@@ -744,3 +746,49 @@ static void rbtree_10(CuTest *tc)
 	/* last test remove region */
 	region_destroy(reg);
 }
+
+static void rbtree_11(CuTest *tc)
+{
+	/* build trees from sorted arrays of every size up to maxnum */
+	size_t maxnum = 300;
+	size_t n, i;
+	region_type* r = region_create(malloc, free);
+	struct testnode* nodes = (struct testnode*)region_alloc_array(r,
+		maxnum, sizeof(struct testnode));
+	rbnode_type** arr = (rbnode_type**)region_alloc_array(r,
+		maxnum, sizeof(rbnode_type*));
+	rbtree_type* t = rbtree_create(r, testcompare);
+
+	for(n=0; n<maxnum; n++) {
+		struct testnode* x;
+		for(i=0; i<n; i++) {
+			nodes[i].x = (int)i*2;
+			nodes[i].node.key = &nodes[i].x;
+			arr[i] = &nodes[i].node;
+		}
+		rbtree_build_sorted(t, arr, n);
+		CuAssert(tc, "count", t->count == n);
+		test_tree_integrity(tc, t);
+		i = 0;
+		RBTREE_FOR(x, struct testnode*, t) {
+			CuAssert(tc, "order", x->x == (int)i*2);
+			i++;
+		}
+		CuAssert(tc, "walk", i == n);
+		/* the result must keep working with insert and delete */
+		if(n > 2) {
+			struct testnode extra;
+			extra.x = 3;
+			extra.node.key = &extra.x;
+			CuAssert(tc, "insert", rbtree_insert(t, &extra.node)
+				!= NULL);
+			test_tree_integrity(tc, t);
+			CuAssert(tc, "delete", rbtree_delete(t, &nodes[0].x)
+				== &nodes[0].node);
+			CuAssert(tc, "delete", rbtree_delete(t, &extra.x)
+				== &extra.node);
+			test_tree_integrity(tc, t);
+		}
+	}
+	region_destroy(r);
+}
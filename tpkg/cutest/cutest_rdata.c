@@ -0,0 +1,222 @@
+/*
+	test the zone file text of RRs, rdata.c and print_rr
+*/
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tpkg/cutest/cutest.h"
+#include "namedb.h"
+#include "rdata.h"
+#include "util.h"
+
+static void rdata_print_1(CuTest *tc);
+
+CuSuite* reg_cutest_rdata(void)
+{
+        CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, rdata_print_1);
+	return suite;
+}
+
+/* rdata in hex wireformat, and the line that print_rr writes for it.  The
+ * lines are the output of the buffer_printf based converters that were
+ * used before, the direct writes into the buffer must print the same. */
+static const struct rdata_print_test {
+	uint16_t type;
+	const char* wire;
+	const char* text;
+} rdata_print_tests[] = {
+	{ TYPE_A,
+	  "c0000201",
+	  "www.example.com.\t3600\tIN\tA\t192.0.2.1\n" },
+	{ TYPE_A,
+	  "00000000",
+	  "www.example.com.\t3600\tIN\tA\t0.0.0.0\n" },
+	{ TYPE_AAAA,
+	  "20010db8000000000000000000000001",
+	  "www.example.com.\t3600\tIN\tAAAA\t2001:db8::1\n" },
+	{ TYPE_NS,
+	  "036e7331076578616d706c6503636f6d00",
+	  "www.example.com.\t3600\tIN\tNS\tns1.example.com.\n" },
+	{ TYPE_MX,
+	  "000a046d61696c076578616d706c6503636f6d00",
+	  "www.example.com.\t3600\tIN\tMX\t10 mail.example.com.\n" },
+	{ TYPE_SOA,
+	  "026e73076578616d706c6503636f6d0004686f7374066d6173746572076578616d"
+	  "706c6503636f6d0078c3dc2900000e100000038400093a8000015180",
+	  "www.example.com.\t3600\tIN\tSOA\tns.example.com. host.master.examp"
+	  "le.com. (\n\t\t2026101801 3600 900 604800 86400 )\n" },
+	{ TYPE_TXT,
+	  "19706c61696e202271756f74656422206261636b5c736c61736808007fff207461"
+	  "620900",
+	  "www.example.com.\t3600\tIN\tTXT\t\"plain \\\"quoted\\\" back\\\\sl"
+	  "ash\" \"\\000\\127\\255 tab\\009\" \"\"\n" },
+	{ TYPE_HINFO,
+	  "025043054c696e7578",
+	  "www.example.com.\t3600\tIN\tHINFO\t\"PC\" \"Linux\"\n" },
+	{ TYPE_SRV,
+	  "0000000513c403736970076578616d706c6503636f6d00",
+	  "www.example.com.\t3600\tIN\tSRV\t0 5 5060 sip.example.com.\n" },
+	{ TYPE_NAPTR,
+	  "0064000a0155074532552b7369701b215e2e2a24217369703a696e666f40657861"
+	  "6d706c652e636f6d2100",
+	  "www.example.com.\t3600\tIN\tNAPTR\t100 10 \"U\" \"E2U+sip\" \"!^.*"
+	  "$!sip:info@example.com!\" .\n" },
+	{ TYPE_CAA,
+	  "0005697373756563612e6578616d706c652e6e65743b20706f6c6963793d6576",
+	  "www.example.com.\t3600\tIN\tCAA\t0 issue \"ca.example.net; policy="
+	  "ev\"\n" },
+	{ TYPE_DS,
+	  "ec4505012bb183af5f22588179a53b0a98631fad1a292118",
+	  "www.example.com.\t3600\tIN\tDS\t60485 5 1 2bb183af5f22588179a53b0a"
+	  "98631fad1a292118\n" },
+	{ TYPE_SSHFP,
+	  "0101123456789abcdef67890123456789abcdef67890",
+	  "www.example.com.\t3600\tIN\tSSHFP\t1 1 123456789abcdef678901234567"
+	  "89abcdef67890\n" },
+	{ TYPE_DNSKEY,
+	  "010103080102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d"
+	  "1e1f2021222324252627",
+	  "www.example.com.\t3600\tIN\tDNSKEY\t257 3 8 AQIDBAUGBwgJCgsMDQ4PEB"
+	  "ESExQVFhcYGRobHB0eHyAhIiMkJSYn\n" },
+	/* base64 of 1, 2 and 4 octets, the printf code printed
+	 * these in unknown format */
+	{ TYPE_DNSKEY,
+	  "0100030801",
+	  "www.example.com.\t3600\tIN\tDNSKEY\t256 3 8 AQ==\n" },
+	{ TYPE_DNSKEY,
+	  "010003080102",
+	  "www.example.com.\t3600\tIN\tDNSKEY\t256 3 8 AQI=\n" },
+	{ TYPE_DNSKEY,
+	  "0100030801020304",
+	  "www.example.com.\t3600\tIN\tDNSKEY\t256 3 8 AQIDBA==\n" },
+	{ TYPE_RRSIG,
+	  "0001080200000e106b36ec7f38bb0c003039076578616d706c6503636f6d00c8c9"
+	  "cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedfe0e1e2e3e4e5e6e7e8e9ea"
+	  "ebecedeeeff0f1f2f3f4f5f6f7f8f9",
+	  "www.example.com.\t3600\tIN\tRRSIG\tA 8 2 3600 20261231235959 20000"
+	  "229000000 12345 example.com. yMnKy8zNzs/Q0dLT1NXW19jZ2tvc3d7f4OHi4"
+	  "+Tl5ufo6err7O3u7/Dx8vP09fb3+Pk=\n" },
+	{ TYPE_NSEC,
+	  "0162076578616d706c6503636f6d00000762000000000380010140ff2000000000"
+	  "00000000000000000000000000000000000000000000000000000002",
+	  "www.example.com.\t3600\tIN\tNSEC\tb.example.com. A NS SOA RRSIG NS"
+	  "EC DNSKEY CAA TYPE65534\n" },
+	{ TYPE_NSEC3,
+	  "0101000c04aabbccdd14000102030405060708090a0b0c0d0e0f10111213000640"
+	  "0000000002",
+	  "www.example.com.\t3600\tIN\tNSEC3\t1 1 12 aabbccdd 000g40o40k30e20"
+	  "9185go38e1s8124gj A RRSIG\n" },
+	{ TYPE_NSEC3,
+	  "0100000000141415161718191a1b1c1d1e1f202122232425262700072200000000"
+	  "0290",
+	  "www.example.com.\t3600\tIN\tNSEC3\t1 0 0 - 2gahc5oo34d1m70t3ofi089"
+	  "24ci2a9h7 NS SOA RRSIG DNSKEY NSEC3PARAM\n" },
+	{ TYPE_NSEC3PARAM,
+	  "0100000a021234",
+	  "www.example.com.\t3600\tIN\tNSEC3PARAM\t1 0 10 1234\n" },
+	{ TYPE_TLSA,
+	  "0301010c72ac70b745ac19998811b131d662c9ac69dbdbe7cb23e5b514b56664c5"
+	  "d3d6",
+	  "www.example.com.\t3600\tIN\tTLSA\t3 1 1 0c72ac70b745ac19998811b131"
+	  "d662c9ac69dbdbe7cb23e5b514b56664c5d3d6\n" },
+	{ TYPE_EUI48,
+	  "00005e0053ff",
+	  "www.example.com.\t3600\tIN\tEUI48\t00-00-5e-00-53-ff\n" },
+	{ TYPE_EUI64,
+	  "00005efffe0053ff",
+	  "www.example.com.\t3600\tIN\tEUI64\t00-00-5e-ff-fe-00-53-ff\n" },
+	{ TYPE_L64,
+	  "000a2001db8001000ff0",
+	  "www.example.com.\t3600\tIN\tL64\t10 2001:db80:0100:0ff0\n" },
+	{ TYPE_CERT,
+	  "00013039083c3d3e3f404142434445464748494a",
+	  "www.example.com.\t3600\tIN\tCERT\tPKIX 12345 8 PD0+P0BBQkNERUZHSEl"
+	  "K\n" },
+	{ TYPE_IPSECKEY,
+	  "0a0102c00002260708090a0b0c0d0e0f101112131415161718191a",
+	  "www.example.com.\t3600\tIN\tIPSECKEY\t10 1 2 192.0.2.38 BwgJCgsMDQ"
+	  "4PEBESExQVFhcYGRo=\n" },
+	{ TYPE_NS,
+	  "03612e620401782079076578616d706c6500",
+	  "www.example.com.\t3600\tIN\tNS\ta\\.b.\\001x\\032y.example.\n" },
+	{ TYPE_LOC,
+	  "001216138b2872007f24460000989c5c",
+	  "www.example.com.\t3600\tIN\tLOC \\# 16 001216138b2872007f244600009"
+	  "89c5c\n" },
+	{ TYPE_APL,
+	  "00011803c000020002408420010db8",
+	  "www.example.com.\t3600\tIN\tAPL\t1:192.0.2.0/24 !2:2001:db8::/64\n" },
+	{ 65000,
+	  "0102030405",
+	  "www.example.com.\t3600\tIN\tTYPE65000\t\\# 5 0102030405\n" },
+	{ 0, NULL, NULL }
+};
+
+/* print the RR with print_rr into buf, returns the length or -1 */
+static int
+rdata_print_rr(CuTest *tc, region_type* region, domain_table_type* table,
+	const struct rdata_print_test* t, char* buf, size_t max)
+{
+	uint8_t wire[1024];
+	size_t i, len = strlen(t->wire)/2, n;
+	buffer_type packet, *output = buffer_create(region, 1024);
+	ssize_t count;
+	rr_type rr;
+	FILE* f;
+	for(i=0; i<len; i++) {
+		unsigned int v;
+		if(sscanf(t->wire+2*i, "%2x", &v) != 1)
+			return -1;
+		wire[i] = (uint8_t)v;
+	}
+	buffer_create_from(&packet, wire, len);
+	memset(&rr, 0, sizeof(rr));
+	rr.owner = domain_table_insert(table,
+		dname_parse(region, "www.example.com."));
+	rr.type = t->type;
+	rr.klass = CLASS_IN;
+	rr.ttl = 3600;
+	count = rdata_wireformat_to_rdata_atoms(region, table, t->type, len,
+		&packet, &rr.rdatas);
+	CuAssert(tc, "rdata parses", count >= 0);
+	if(count < 0)
+		return -1;
+	rr.rdata_count = count;
+	f = tmpfile();
+	CuAssert(tc, "tmpfile", f != NULL);
+	if(!f)
+		return -1;
+	if(!print_rr(f, NULL, &rr, region, output)) {
+		fclose(f);
+		return -1;
+	}
+	rewind(f);
+	n = fread(buf, 1, max-1, f);
+	buf[n] = 0;
+	fclose(f);
+	return (int)n;
+}
+
+static void rdata_print_1(CuTest *tc)
+{
+	region_type* region = region_create(xalloc, free);
+	domain_table_type* table = domain_table_create(region);
+	const struct rdata_print_test* t;
+	char buf[4096];
+	for(t = rdata_print_tests; t->wire; t++) {
+		int r = rdata_print_rr(tc, region, table, t, buf, sizeof(buf));
+		if(r >= 0 && strcmp(buf, t->text) != 0)
+			printf("rdata print of type %d:\n%sexpected:\n%s",
+				(int)t->type, buf, t->text);
+		CuAssert(tc, "rdata print", r >= 0 && strcmp(buf, t->text) == 0);
+	}
+	region_destroy(region);
+}
@@ -24,6 +24,9 @@ CuSuite * reg_cutest_region(void);
 CuSuite * reg_cutest_udb(void);
 CuSuite * reg_cutest_udb_radtree(void);
 CuSuite * reg_cutest_namedb(void);
+CuSuite * reg_cutest_proxy_protocol(void);
+CuSuite * reg_cutest_udpsize(void);
+CuSuite * reg_cutest_rdata(void);
 #ifdef RATELIMIT
 CuSuite * reg_cutest_rrl(void);
 #endif
@@ -66,6 +69,9 @@ int runalltests(void)
 	CuSuiteAddSuite(suite, reg_cutest_rbtree());
 	CuSuiteAddSuite(suite, reg_cutest_util());
 	CuSuiteAddSuite(suite, reg_cutest_iterated_hash());
+	CuSuiteAddSuite(suite, reg_cutest_proxy_protocol());
+	CuSuiteAddSuite(suite, reg_cutest_udpsize());
+	CuSuiteAddSuite(suite, reg_cutest_rdata());
 #ifdef HAVE_MMAP
 	CuSuiteAddSuite(suite, reg_cutest_udb());
 	CuSuiteAddSuite(suite, reg_cutest_udb_radtree());
@@ -0,0 +1,102 @@
+/*
+	test udpsize.h
+*/
+
+#include "config.h"
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tpkg/cutest/cutest.h"
+#include "udpsize.h"
+#include "nsd.h"
+#include "packet.h"
+
+static void udpsize_1(CuTest *tc);
+
+CuSuite* reg_cutest_udpsize(void)
+{
+        CuSuite* suite = CuSuiteNew();
+
+	SUITE_ADD_TEST(suite, udpsize_1);
+	return suite;
+}
+
+static const dname_type* udpsize_qname;
+
+/* a query from the address, with the answer size and TC flag */
+static void
+udpsize_q(struct nsd* nsd, query_type* q, const char* addr, int tcp,
+	size_t answer, int tc)
+{
+	struct sockaddr_in* sin = (struct sockaddr_in*)&q->addr;
+	query_reset(q, tcp?65535:4096, tcp);
+	q->qname = udpsize_qname;
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_family = AF_INET;
+	inet_pton(AF_INET, addr, &sin->sin_addr);
+	udpsize_query(nsd, q);
+	if(tcp)
+		return;
+	buffer_set_position(q->packet, answer);
+	if(tc) TC_SET(q->packet);
+	else TC_CLR(q->packet);
+	udpsize_answer(nsd, q);
+}
+
+static void udpsize_1(CuTest *tc)
+{
+	region_type* region = region_create(xalloc, free);
+	query_type* q = query_create(region, NULL, 0);
+	struct nsd nsd;
+	memset(&nsd, 0, sizeof(nsd));
+	udpsize_init();
+	udpsize_qname = dname_parse(region, "big.example.");
+
+	/* large answer, then the same query from another address */
+	udpsize_q(&nsd, q, "192.0.2.1", 0, 2000, 0);
+	udpsize_q(&nsd, q, "192.0.2.2", 0, 2000, 0);
+	CuAssert(tc, "no cap", q->maxlen == 4096 && !q->maxlen_capped);
+	/* the same address repeats it, the answer was lost */
+	udpsize_q(&nsd, q, "192.0.2.2", 0, 40, 1);
+	CuAssert(tc, "capped", q->maxlen == UDPSIZE_SAFE && q->maxlen_capped);
+#ifdef BIND8_STATS
+	CuAssert(tc, "lowered", nsd.st.udpsize_lowered == 1 &&
+		nsd.st.udpsize_udp_retry == 1 && nsd.st.udpsize_truncated == 1);
+#endif
+	/* the rest of the prefix is capped, other prefixes are not */
+	udpsize_q(&nsd, q, "192.0.2.200", 0, 40, 1);
+	CuAssert(tc, "prefix", q->maxlen == UDPSIZE_SAFE);
+	udpsize_q(&nsd, q, "198.51.100.1", 0, 2000, 0);
+	CuAssert(tc, "other prefix", q->maxlen == 4096);
+
+	/* TCP retries after the truncated answers lift the cap */
+	udpsize_q(&nsd, q, "192.0.2.200", 1, 0, 0);
+#ifdef BIND8_STATS
+	CuAssert(tc, "tcp retry", nsd.st.udpsize_tcp_retry == 1);
+#endif
+	CuAssert(tc, "tcp not capped", q->maxlen == 65535);
+	udpsize_q(&nsd, q, "192.0.2.200", 1, 0, 0);
+#ifdef BIND8_STATS
+	CuAssert(tc, "tcp retry once", nsd.st.udpsize_tcp_retry == 1);
+#endif
+	{
+		int i;
+		char a[32];
+		for(i=1; i<UDPSIZE_TCP_LIFT; i++) {
+			snprintf(a, sizeof(a), "192.0.2.%d", 100+i);
+			udpsize_q(&nsd, q, a, 0, 40, 1);
+			CuAssert(tc, "still capped", q->maxlen_capped);
+			udpsize_q(&nsd, q, a, 1, 0, 0);
+		}
+	}
+	udpsize_q(&nsd, q, "192.0.2.50", 0, 2000, 0);
+	CuAssert(tc, "lifted", q->maxlen == 4096 && !q->maxlen_capped);
+#ifdef BIND8_STATS
+	CuAssert(tc, "raised", nsd.st.udpsize_raised == 1);
+#endif
+	region_destroy(region);
+}
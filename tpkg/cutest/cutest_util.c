@@ -10,6 +10,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "tpkg/cutest/cutest.h"
 #include "region-allocator.h"
 #include "util.h"
@@ -18,6 +20,7 @@ static void util_1(CuTest *tc);
 static void util_2(CuTest *tc);
 static void util_3(CuTest *tc);
 static void util_4(CuTest *tc);
+static void util_5(CuTest *tc);
 
 CuSuite* reg_cutest_util(void)
 {
@@ -27,6 +30,7 @@ CuSuite* reg_cutest_util(void)
 	SUITE_ADD_TEST(suite, util_2);
 	SUITE_ADD_TEST(suite, util_3);
 	SUITE_ADD_TEST(suite, util_4);
+	SUITE_ADD_TEST(suite, util_5);
 	return suite;
 }
 
@@ -158,3 +162,52 @@ static void util_4(CuTest *tc)
 	/* strings differ only in case */
 	CuAssert(tc, "test results of pton ntop", strcasecmp(buf, teststr)==0);
 }
+
+/* the messages written by the log queue */
+static int log5_written, log5_dup, log5_suppressed, log5_other;
+
+static void
+log5_function(int ATTR_UNUSED(priority), const char *message)
+{
+	unsigned n;
+	if(strncmp(message, "test message ", 13) == 0)
+		log5_written++;
+	else if(strcmp(message, "duplicate message") == 0)
+		log5_dup++;
+	else if(sscanf(message, "%u duplicate messages suppressed", &n) == 1)
+		log5_suppressed += n;
+	else if(strcmp(message, "other message") == 0)
+		log5_other++;
+}
+
+static void util_5(CuTest *tc)
+{
+	/* test the log queue, messages of another process */
+	pid_t pid;
+	int i;
+	log_queue_init();
+	if(!log_queue_active())
+		return; /* no shared memory */
+	log_set_log_function(log5_function);
+	pid = fork();
+	if(pid == 0) {
+		for(i=0; i<30; i++)
+			log_msg(LOG_ERR, "test message %d", i);
+		for(i=0; i<30; i++)
+			log_msg(LOG_ERR, "duplicate message");
+		log_msg(LOG_ERR, "other message");
+		_exit(0);
+	}
+	CuAssert(tc, "fork", pid != -1);
+	waitpid(pid, NULL, 0);
+	CuAssert(tc, "queued", log5_written == 0 && log5_other == 0);
+	log_queue_flush();
+	log_queue_stop();
+	log_set_log_function(log_file);
+	CuAssert(tc, "other", log5_other == 1);
+	/* messages of the same format with other text are all written */
+	CuAssert(tc, "distinct", log5_written == 30);
+	CuAssert(tc, "rate", log5_dup >= LOG_QUEUE_RATE && log5_dup < 30);
+	CuAssert(tc, "suppressed", log5_dup + log5_suppressed == 30);
+	CuAssert(tc, "stopped", !log_queue_active());
+}
@@ -0,0 +1,381 @@
+/* tlsbench - load test for the DNS over TLS service on the tls-port
+ * Copyright 2026, NLnet Labs.
+ * BSD, see LICENSE.
+ *
+ * Measures the handshakes per second, new and resumed with the session
+ * ticket, and the pipelined queries per second.  Run against an nsd
+ * with server-count: 1 for the numbers per core, tpkg/tls-bench.sh
+ * does that.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#ifdef HAVE_SSL
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+/** queries in flight on the query connection */
+#define PIPELINE 100
+/** query length, for the qname of at most 255 octets */
+#define QUERY_MAX (12+255+4)
+
+/** the settings, from the commandline */
+static const char* addr = "127.0.0.1";
+static const char* port = "853";
+static const char* qname = ".";
+static int procs = 1;
+static int conns = 1000;
+static int queries = 100000;
+
+/** the counts of a load process, summed in the parent */
+struct bench_result {
+	/* full handshakes and their time in usec */
+	long long full, full_usec;
+	/* attempted resumptions, resumed ones, and their time */
+	long long resume, resumed, resume_usec;
+	/* answers received, and the time in usec */
+	long long answers, answer_usec;
+};
+
+/** print usage text */
+static void
+usage(void)
+{
+	printf("usage:	tlsbench [options] <addr> <port>\n");
+	printf("-p num	load processes (1)\n");
+	printf("-n num	connections for the handshake test per process (1000)\n");
+	printf("-q num	queries on one connection per process (100000)\n");
+	printf("-z name	the query name, for type SOA (.)\n");
+	printf("The output is name=value lines: handshakes/s for full and\n");
+	printf("resumed handshakes, and queries/s for the pipelined queries.\n");
+	exit(1);
+}
+
+/** exit with the error and the crypto errors */
+static void
+fatal(const char* str)
+{
+	char buf[128];
+	unsigned long e;
+	fprintf(stderr, "tlsbench: %s\n", str);
+	while( (e=ERR_get_error()) ) {
+		ERR_error_string_n(e, buf, sizeof(buf));
+		fprintf(stderr, "crypto %s\n", buf);
+	}
+	exit(1);
+}
+
+/** microseconds since an arbitrary start */
+static long long
+now_usec(void)
+{
+	struct timeval tv;
+	if(gettimeofday(&tv, NULL) < 0)
+		fatal("gettimeofday failed");
+	return (long long)tv.tv_sec*1000000 + (long long)tv.tv_usec;
+}
+
+/** make the query in wireformat with the TCP length, returns length */
+static size_t
+make_query(uint8_t* q, const char* name)
+{
+	size_t len = 2+12, lablen;
+	const char* p = name;
+	memset(q, 0, 2+12);
+	q[2+5] = 1; /* qdcount */
+	while(*p && strcmp(p, ".") != 0) {
+		const char* dot = strchr(p, '.');
+		lablen = dot?(size_t)(dot-p):strlen(p);
+		if(lablen == 0 || lablen > 63 || len+lablen+1 > 2+QUERY_MAX-5)
+			fatal("bad query name");
+		q[len++] = (uint8_t)lablen;
+		memmove(q+len, p, lablen);
+		len += lablen;
+		p += lablen;
+		if(*p == '.')
+			p++;
+	}
+	q[len++] = 0;
+	q[len++] = 0; q[len++] = 6; /* SOA */
+	q[len++] = 0; q[len++] = 1; /* IN */
+	q[0] = (uint8_t)((len-2)>>8);
+	q[1] = (uint8_t)((len-2)&0xff);
+	return len;
+}
+
+/** connect the TCP socket */
+static int
+tcp_connect(struct addrinfo* ai)
+{
+	int one = 1;
+	int s = socket(ai->ai_family, SOCK_STREAM, 0);
+	if(s == -1)
+		fatal(strerror(errno));
+	if(connect(s, ai->ai_addr, ai->ai_addrlen) == -1) {
+		fprintf(stderr, "tlsbench: connect: %s\n", strerror(errno));
+		exit(1);
+	}
+	(void)setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	return s;
+}
+
+/** write all of the data, or exit */
+static void
+tls_write_all(SSL* ssl, const uint8_t* data, size_t len)
+{
+	if(SSL_write(ssl, data, (int)len) != (int)len)
+		fatal("SSL_write failed");
+}
+
+/** read an answer, the id is returned */
+static int
+tls_read_answer(SSL* ssl, uint8_t* buf, size_t bufsize)
+{
+	size_t len, got = 0;
+	int r;
+	while(got < 2) {
+		if((r = SSL_read(ssl, buf+got, (int)(2-got))) <= 0)
+			fatal("SSL_read of the length failed");
+		got += r;
+	}
+	len = ((size_t)buf[0]<<8) | buf[1];
+	if(len < 12 || len > bufsize)
+		fatal("bad answer length");
+	got = 0;
+	while(got < len) {
+		if((r = SSL_read(ssl, buf+got, (int)(len-got))) <= 0)
+			fatal("SSL_read of the answer failed");
+		got += r;
+	}
+	return ((int)buf[0]<<8) | buf[1];
+}
+
+/** a connection with a handshake and one query, returns if the session
+ * was resumed, the session for the next one is in *sess */
+static int
+handshake_query(SSL_CTX* ctx, struct addrinfo* ai, SSL_SESSION** sess,
+	uint8_t* q, size_t qlen)
+{
+	uint8_t buf[65536];
+	int s = tcp_connect(ai), resumed;
+	SSL* ssl = SSL_new(ctx);
+	if(!ssl || !SSL_set_fd(ssl, s))
+		fatal("SSL_new failed");
+	if(*sess && !SSL_set_session(ssl, *sess))
+		fatal("SSL_set_session failed");
+	if(SSL_connect(ssl) != 1)
+		fatal("SSL_connect failed");
+	tls_write_all(ssl, q, qlen);
+	(void)tls_read_answer(ssl, buf, sizeof(buf));
+	resumed = SSL_session_reused(ssl);
+	/* with TLS 1.3 the ticket arrives after the handshake, it has been
+	 * read with the answer */
+	if(*sess)
+		SSL_SESSION_free(*sess);
+	*sess = SSL_get1_session(ssl);
+	(void)SSL_shutdown(ssl);
+	SSL_free(ssl);
+	close(s);
+	return resumed;
+}
+
+/** pipelined queries on one connection, PIPELINE in flight */
+static void
+pipelined_queries(SSL_CTX* ctx, struct addrinfo* ai, uint8_t* q,
+	size_t qlen, struct bench_result* res)
+{
+	uint8_t buf[65536], batch[PIPELINE*(2+QUERY_MAX)];
+	int s = tcp_connect(ai), sent = 0, recv = 0, i, n;
+	long long start;
+	SSL* ssl = SSL_new(ctx);
+	if(!ssl || !SSL_set_fd(ssl, s))
+		fatal("SSL_new failed");
+	if(SSL_connect(ssl) != 1)
+		fatal("SSL_connect failed");
+	start = now_usec();
+	while(recv < queries) {
+		/* fill up the pipeline, in one write */
+		n = 0;
+		for(i=0; sent < queries && sent - recv < PIPELINE; i++) {
+			memmove(batch+n, q, qlen);
+			batch[n+2] = (uint8_t)(sent>>8);
+			batch[n+3] = (uint8_t)(sent&0xff);
+			n += qlen;
+			sent++;
+		}
+		if(n > 0)
+			tls_write_all(ssl, batch, n);
+		(void)tls_read_answer(ssl, buf, sizeof(buf));
+		recv++;
+	}
+	res->answer_usec = now_usec() - start;
+	res->answers = recv;
+	(void)SSL_shutdown(ssl);
+	SSL_free(ssl);
+	close(s);
+}
+
+/** the load of one process */
+static void
+bench_process(struct addrinfo* ai, struct bench_result* res)
+{
+	uint8_t q[2+QUERY_MAX];
+	size_t qlen = make_query(q, qname);
+	SSL_SESSION* sess = NULL;
+	long long start;
+	int i;
+	SSL_CTX* ctx = SSL_CTX_new(SSLv23_client_method());
+	if(!ctx)
+		fatal("SSL_CTX_new failed");
+	/* the test is for the server, the certificate is not checked */
+	SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, NULL);
+	memset(res, 0, sizeof(*res));
+
+	start = now_usec();
+	for(i=0; i<conns; i++) {
+		SSL_SESSION* none = NULL;
+		(void)handshake_query(ctx, ai, &none, q, qlen);
+		if(none) {
+			if(sess) SSL_SESSION_free(sess);
+			sess = none;
+		}
+	}
+	res->full = conns;
+	res->full_usec = now_usec() - start;
+
+	start = now_usec();
+	for(i=0; i<conns && sess; i++) {
+		res->resumed += handshake_query(ctx, ai, &sess, q, qlen);
+		res->resume++;
+	}
+	res->resume_usec = now_usec() - start;
+	if(sess)
+		SSL_SESSION_free(sess);
+
+	if(queries > 0)
+		pipelined_queries(ctx, ai, q, qlen, res);
+	SSL_CTX_free(ctx);
+}
+
+/** per second, from the count and the time in usec */
+static double
+rate(long long count, long long usec)
+{
+	if(usec <= 0)
+		return 0.0;
+	return (double)count * 1000000.0 / (double)usec;
+}
+
+int
+main(int argc, char* argv[])
+{
+	struct addrinfo hints, *ai;
+	struct bench_result total, res;
+	int c, i, r, status, fd[2];
+	long long start, wall;
+	pid_t pid;
+
+	while((c = getopt(argc, argv, "n:p:q:z:h")) != -1) {
+		switch(c) {
+		case 'n': conns = atoi(optarg); break;
+		case 'p': procs = atoi(optarg); break;
+		case 'q': queries = atoi(optarg); break;
+		case 'z': qname = optarg; break;
+		default: usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if(argc != 2 || procs < 1 || conns < 0 || queries < 0)
+		usage();
+	addr = argv[0];
+	port = argv[1];
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_NUMERICHOST;
+	if((r = getaddrinfo(addr, port, &hints, &ai)) != 0) {
+		fprintf(stderr, "tlsbench: %s: %s\n", addr, gai_strerror(r));
+		exit(1);
+	}
+	(void)signal(SIGPIPE, SIG_IGN);
+#if OPENSSL_VERSION_NUMBER < 0x10100000 || !defined(HAVE_OPENSSL_INIT_SSL)
+	ERR_load_SSL_strings();
+	(void)SSL_library_init();
+#else
+	OPENSSL_init_ssl(0, NULL);
+#endif
+
+	/* the processes write their results to the pipe */
+	if(pipe(fd) == -1)
+		fatal(strerror(errno));
+	start = now_usec();
+	for(i=0; i<procs; i++) {
+		if((pid = fork()) == -1)
+			fatal(strerror(errno));
+		if(pid == 0) {
+			close(fd[0]);
+			bench_process(ai, &res);
+			if(write(fd[1], &res, sizeof(res)) != (ssize_t)sizeof(res))
+				exit(1);
+			exit(0);
+		}
+	}
+	close(fd[1]);
+	memset(&total, 0, sizeof(total));
+	for(i=0; i<procs; i++) {
+		if(read(fd[0], &res, sizeof(res)) != (ssize_t)sizeof(res))
+			fatal("a load process failed");
+		total.full += res.full;
+		total.resume += res.resume;
+		total.resumed += res.resumed;
+		total.answers += res.answers;
+		/* the processes run at the same time, the rate is the sum */
+		if(res.full_usec > total.full_usec)
+			total.full_usec = res.full_usec;
+		if(res.resume_usec > total.resume_usec)
+			total.resume_usec = res.resume_usec;
+		if(res.answer_usec > total.answer_usec)
+			total.answer_usec = res.answer_usec;
+	}
+	while(wait(&status) > 0)
+		;
+	wall = now_usec() - start;
+	freeaddrinfo(ai);
+
+	printf("tls.procs=%d\n", procs);
+	printf("tls.handshake.full=%lld\n", total.full);
+	printf("tls.handshake.full.persec=%.1f\n",
+		rate(total.full, total.full_usec));
+	printf("tls.handshake.resumed=%lld\n", total.resumed);
+	printf("tls.handshake.resume.failed=%lld\n",
+		total.resume - total.resumed);
+	printf("tls.handshake.resume.persec=%.1f\n",
+		rate(total.resume, total.resume_usec));
+	printf("tls.queries=%lld\n", total.answers);
+	printf("tls.queries.persec=%.1f\n",
+		rate(total.answers, total.answer_usec));
+	printf("tls.time=%.3f\n", (double)wall/1000000.0);
+	return 0;
+}
+
+#else /* !HAVE_SSL */
+int
+main(void)
+{
+	fprintf(stderr, "tlsbench: compiled without SSL\n");
+	return 1;
+}
+#endif /* HAVE_SSL */
@@ -0,0 +1,336 @@
+/* zonegen - generate large synthetic zones for the scaling benchmark
+ * Copyright 2026, NLnet Labs.
+ * BSD, see LICENSE.
+ *
+ * The data is the same for the same arguments, so that the measurements
+ * of tpkg/scale-bench.sh can be compared across releases.
+ */
+
+#include "config.h"
+#include "dname.h"
+#include "iterated_hash.h"
+#include "region-allocator.h"
+#include "util.h"
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/** salt and iterations of the NSEC3 zone */
+#define NSEC3_SALT "aabbccdd"
+#define NSEC3_ITER 5
+/** delegations per packet of the IXFR answer */
+#define IXFR_PACKET_RRS 400
+
+/** print usage text */
+static void
+usage(void)
+{
+	printf("usage:	zonegen small <dir> <count>\n");
+	printf("	zonegen tld <file> <origin> <names>\n");
+	printf("	zonegen nsec3 <file> <origin> <names>\n");
+	printf("	zonegen ixfr <file> <origin> <names> <deltas> <changes>\n");
+	printf("small	count zones of about ten RRs, files <dir>/z<i>.bench.\n");
+	printf("	and the zonelist <dir>/zone.list with pattern small\n");
+	printf("tld	a TLD-like zone with names delegations, some with DS\n");
+	printf("	and glue\n");
+	printf("nsec3	a TLD-like zone signed with NSEC3 opt-out, one in ten\n");
+	printf("	delegations is secure\n");
+	printf("ixfr	ldns-testns answers with an IXFR from serial 1 in\n");
+	printf("	deltas, that each delete and add changes delegations\n");
+	printf("	of the tld zone\n");
+	exit(1);
+}
+
+/** open the output file, or exit */
+static FILE*
+open_out(const char* fname)
+{
+	FILE* out = fopen(fname, "w");
+	if(!out) {
+		fprintf(stderr, "cannot open %s: %s\n", fname, strerror(errno));
+		exit(1);
+	}
+	return out;
+}
+
+/** close the output file, or exit on write errors */
+static void
+close_out(FILE* out, const char* fname)
+{
+	if(ferror(out) || fclose(out) != 0) {
+		fprintf(stderr, "cannot write %s: %s\n", fname,
+			strerror(errno));
+		exit(1);
+	}
+}
+
+/** parse a count argument */
+static unsigned long
+get_count(const char* str)
+{
+	char* end;
+	unsigned long n = strtoul(str, &end, 10);
+	if(*end != 0) {
+		fprintf(stderr, "bad number '%s'\n", str);
+		exit(1);
+	}
+	return n;
+}
+
+/** print the SOA and apex records */
+static void
+print_apex(FILE* out, const char* origin, unsigned long serial)
+{
+	fprintf(out, "$ORIGIN %s\n$TTL 86400\n", origin);
+	fprintf(out, "@ IN SOA ns1 hostmaster %lu 1800 900 604800 86400\n",
+		serial);
+	fprintf(out, "@ IN NS ns1\n@ IN NS ns2\n");
+	fprintf(out, "ns1 IN A 192.0.2.1\nns2 IN A 192.0.2.2\n");
+}
+
+/** print the NS records of delegation i, the glue is not printed */
+static void
+print_delegation(FILE* out, const char* label, unsigned long i)
+{
+	fprintf(out, "%s%lu IN NS ns1.nsp%lu.net.\n", label, i, i%1000);
+	fprintf(out, "%s%lu IN NS ns2.nsp%lu.net.\n", label, i, i%1000);
+}
+
+/** print the DS record of delegation i */
+static void
+print_ds(FILE* out, unsigned long i)
+{
+	fprintf(out, "d%lu IN DS %lu 8 2 %08lx%056x\n", i, i%65536, i, 0);
+}
+
+static void
+gen_small(const char* dir, unsigned long count)
+{
+	char fname[1024];
+	FILE* list, *out;
+	unsigned long i;
+	snprintf(fname, sizeof(fname), "%s/zone.list", dir);
+	list = open_out(fname);
+	fprintf(list, "# NSD zone list\n# name pattern\n");
+	for(i=0; i<count; i++) {
+		fprintf(list, "add z%lu.bench. small\n", i);
+		snprintf(fname, sizeof(fname), "%s/z%lu.bench.", dir, i);
+		out = open_out(fname);
+		fprintf(out, "$ORIGIN z%lu.bench.\n$TTL 3600\n", i);
+		fprintf(out, "@ IN SOA ns1 hostmaster 1 3600 900 604800 3600\n");
+		fprintf(out, "@ IN NS ns1\n@ IN NS ns2.example.net.\n");
+		fprintf(out, "ns1 IN A 10.%lu.%lu.1\n", (i>>16)&0xff,
+			(i>>8)&0xff);
+		fprintf(out, "@ IN A 10.%lu.%lu.%lu\n", (i>>16)&0xff,
+			(i>>8)&0xff, i&0xff);
+		fprintf(out, "www IN CNAME @\n");
+		fprintf(out, "@ IN MX 10 mail\n");
+		fprintf(out, "mail IN A 10.%lu.%lu.2\n", (i>>16)&0xff,
+			(i>>8)&0xff);
+		fprintf(out, "@ IN TXT \"v=spf1 mx -all\"\n");
+		close_out(out, fname);
+	}
+	snprintf(fname, sizeof(fname), "%s/zone.list", dir);
+	close_out(list, fname);
+}
+
+static void
+gen_tld(const char* fname, const char* origin, unsigned long names)
+{
+	FILE* out = open_out(fname);
+	unsigned long i;
+	print_apex(out, origin, 1);
+	for(i=0; i<names; i++) {
+		print_delegation(out, "d", i);
+		if(i%10 == 0)
+			print_ds(out, i);
+		if(i%20 == 0) {
+			fprintf(out, "d%lu IN NS ns.d%lu\n", i, i);
+			fprintf(out, "ns.d%lu IN A 10.%lu.%lu.%lu\n", i,
+				(i>>16)&0xff, (i>>8)&0xff, i&0xff);
+		}
+	}
+	close_out(out, fname);
+}
+
+/** an NSEC3 hashed owner name */
+struct hashed {
+	unsigned char hash[SHA_DIGEST_LENGTH];
+	/* the delegation number, or -1 for the apex */
+	long num;
+};
+
+static int
+hashed_cmp(const void* a, const void* b)
+{
+	return memcmp(((const struct hashed*)a)->hash,
+		((const struct hashed*)b)->hash, SHA_DIGEST_LENGTH);
+}
+
+/** hash the owner name in canonical wire format */
+static void
+hash_name(region_type* region, struct hashed* h, const char* name,
+	const unsigned char* salt, int saltlen)
+{
+	const dname_type* dname = dname_parse(region, name);
+	if(!dname) {
+		fprintf(stderr, "cannot parse %s\n", name);
+		exit(1);
+	}
+	(void)iterated_hash(h->hash, salt, saltlen, dname_name(dname),
+		dname->name_size, NSEC3_ITER);
+	region_free_all(region);
+}
+
+/** fake signature, the server does not check it */
+static void
+print_rrsig(FILE* out, const char* owner, const char* type,
+	const char* origin, int labels)
+{
+	fprintf(out, "%s IN RRSIG %s 8 %d 86400 20300101000000 "
+		"20260101000000 12345 %s AwEAAcD1ZCzRZKy0Z1YZtdBSjsSSHXYAPn+Z"
+		"1ESKsc9t6dMDKjrHfO5yBDdqv9aL3z87V2nBxI5zAAAAAAAAAAAAAAA=\n",
+		owner, type, labels, origin);
+}
+
+static void
+gen_nsec3(const char* fname, const char* origin, unsigned long names)
+{
+	region_type* region = region_create(xalloc, free);
+	unsigned char salt[4] = {0xaa, 0xbb, 0xcc, 0xdd};
+	FILE* out = open_out(fname);
+	struct hashed* hashes;
+	unsigned long i, num = 0, secure = (names+9)/10;
+	char name[1024], b32[64], next[64];
+	int labels = 1;
+	const char* p;
+	for(p = origin; *p; p++)
+		if(*p == '.' && p[1] != 0)
+			labels++;
+
+	print_apex(out, origin, 1);
+	fprintf(out, "@ IN DNSKEY 257 3 8 AwEAAcD1ZCzRZKy0Z1YZtdBSjsSSHXYAPn+Z"
+		"1ESKsc9t6dMDKjrHfO5yBDdqv9aL3z87V2nBxI5z\n");
+	fprintf(out, "@ IN NSEC3PARAM 1 0 %d %s\n", NSEC3_ITER, NSEC3_SALT);
+	print_rrsig(out, "@", "SOA", origin, labels);
+	print_rrsig(out, "@", "NS", origin, labels);
+	print_rrsig(out, "@", "DNSKEY", origin, labels);
+	print_rrsig(out, "@", "NSEC3PARAM", origin, labels);
+
+	/* the apex and the secure delegations are in the NSEC3 chain, the
+	 * insecure delegations are covered by opt-out */
+	hashes = (struct hashed*)xalloc_array_zero(secure+1,
+		sizeof(struct hashed));
+	hash_name(region, &hashes[num], origin, salt, sizeof(salt));
+	hashes[num++].num = -1;
+	for(i=0; i<names; i++) {
+		print_delegation(out, "d", i);
+		if(i%10 != 0)
+			continue;
+		print_ds(out, i);
+		snprintf(name, sizeof(name), "d%lu", i);
+		print_rrsig(out, name, "DS", origin, labels+1);
+		snprintf(name, sizeof(name), "d%lu.%s", i, origin);
+		hash_name(region, &hashes[num], name, salt, sizeof(salt));
+		hashes[num++].num = (long)i;
+	}
+	qsort(hashes, num, sizeof(*hashes), hashed_cmp);
+	for(i=0; i<num; i++) {
+		if(b32_ntop(hashes[i].hash, SHA_DIGEST_LENGTH, b32,
+			sizeof(b32)) == -1 || b32_ntop(hashes[(i+1)%num].hash,
+			SHA_DIGEST_LENGTH, next, sizeof(next)) == -1) {
+			fprintf(stderr, "b32_ntop failed\n");
+			exit(1);
+		}
+		fprintf(out, "%s IN NSEC3 1 1 %d %s %s %s\n", b32, NSEC3_ITER,
+			NSEC3_SALT, next, hashes[i].num == -1 ?
+			"NS SOA RRSIG DNSKEY NSEC3PARAM" : "NS DS RRSIG");
+		print_rrsig(out, b32, "NSEC3", origin, labels+1);
+	}
+	free(hashes);
+	region_destroy(region);
+	close_out(out, fname);
+}
+
+/** print the SOA for the IXFR answer */
+static void
+print_ixfr_soa(FILE* out, unsigned long serial)
+{
+	fprintf(out, "@ 86400 IN SOA ns1 hostmaster %lu 1800 900 604800 86400\n",
+		serial);
+}
+
+/** start an ldns-testns entry, for the query type over the transport */
+static void
+print_entry_start(FILE* out, const char* qtype, const char* match,
+	const char* reply)
+{
+	fprintf(out, "ENTRY_BEGIN\nMATCH opcode qtype qname%s\n", match);
+	fprintf(out, "REPLY QUERY NOERROR%s\nADJUST copy_id\n", reply);
+	fprintf(out, "SECTION QUESTION\n@ IN %s\nSECTION ANSWER\n", qtype);
+}
+
+static void
+gen_ixfr(const char* fname, const char* origin, unsigned long names,
+	unsigned long deltas, unsigned long changes)
+{
+	FILE* out;
+	unsigned long d, i, j, rrs = 0, final = 1 + deltas;
+	if(deltas*changes > names) {
+		fprintf(stderr, "deltas*changes is more than the names\n");
+		exit(1);
+	}
+	out = open_out(fname);
+	fprintf(out, "; IXFR of %s from serial 1 to %lu\n", origin, final);
+	fprintf(out, "$ORIGIN %s\n$TTL 86400\n", origin);
+	/* the serial for the refresh */
+	print_entry_start(out, "SOA", "", " AA");
+	print_ixfr_soa(out, final);
+	fprintf(out, "ENTRY_END\n\n");
+	/* over UDP, go to TCP */
+	print_entry_start(out, "IXFR", " serial=1 UDP", " TC");
+	print_ixfr_soa(out, final);
+	fprintf(out, "ENTRY_END\n\n");
+	/* over TCP the deltas */
+	print_entry_start(out, "IXFR", " serial=1 TCP", "");
+	print_ixfr_soa(out, final);
+	for(d=0; d<deltas; d++) {
+		print_ixfr_soa(out, 1+d);
+		for(i=0; i<changes; i++) {
+			j = d*changes + i;
+			print_delegation(out, "d", j);
+			if(++rrs % IXFR_PACKET_RRS == 0)
+				fprintf(out, "EXTRA_PACKET\n");
+		}
+		print_ixfr_soa(out, 2+d);
+		for(i=0; i<changes; i++) {
+			j = d*changes + i;
+			print_delegation(out, "a", j);
+			if(++rrs % IXFR_PACKET_RRS == 0)
+				fprintf(out, "EXTRA_PACKET\n");
+		}
+	}
+	print_ixfr_soa(out, final);
+	fprintf(out, "ENTRY_END\n");
+	close_out(out, fname);
+}
+
+/** main program */
+int
+main(int argc, char* argv[])
+{
+	log_init("zonegen");
+	if(argc == 4 && strcmp(argv[1], "small") == 0)
+		gen_small(argv[2], get_count(argv[3]));
+	else if(argc == 5 && strcmp(argv[1], "tld") == 0)
+		gen_tld(argv[2], argv[3], get_count(argv[4]));
+	else if(argc == 5 && strcmp(argv[1], "nsec3") == 0)
+		gen_nsec3(argv[2], argv[3], get_count(argv[4]));
+	else if(argc == 7 && strcmp(argv[1], "ixfr") == 0)
+		gen_ixfr(argv[2], argv[3], get_count(argv[4]),
+			get_count(argv[5]), get_count(argv[6]));
+	else	usage();
+	return 0;
+}
@@ -0,0 +1,90 @@
+#!/bin/bash
+# dname-bench.sh - measure the queries per second of DNAME answers, with
+# the query answer speed test of cutest, against plain answers, for
+# IPv4 and IPv6 reverse-mapping zones.  BSD licensed (see LICENSE file).
+#
+# Run from the build directory, with make bench-dname, or with settings:
+#   DNAME_SPEED=1000 make bench-dname
+#
+# settings, from the environment:
+# DNAME_DIR	work directory, removed at the start (dnamebench.dir)
+# DNAME_SPEED	number of times the list of queries is answered (2000)
+# DNAME_KEEP	if set, the work directory is kept afterwards
+#
+# The zone bench. has a DNAME for 2.0.192.rev.bench. and for
+# 8.b.d.0.1.0.0.2.rev6.bench. with 254 PTR records below the targets.
+# Every list has a query for each of them, directly (plain) or via the
+# DNAME.  The results are printed as name=value lines, and stored in
+# DNAME_DIR/report.txt.
+
+. `dirname $0`/common.sh
+
+BUILD=`pwd`
+DIR=${DNAME_DIR:-dnamebench.dir}
+SPEED=${DNAME_SPEED:-2000}
+
+if test ! -x "$BUILD/cutest"; then
+	error "no cutest in `pwd`, run this with make bench-dname"
+fi
+rm -rf "$DIR"
+mkdir -p "$DIR" || error "cannot create $DIR"
+DIR=`cd "$DIR"; pwd`
+REPORT="$DIR/report.txt"
+: > "$REPORT"
+
+# the last two nibbles of an IPv6 address, for the host number
+nibbles () {
+	printf "%x.%x" $(($1 % 16)) $(($1 / 16))
+}
+V6="0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0.8.b.d.0.1.0.0.2"
+
+cat > "$DIR/bench.zone" <<EOF
+\$ORIGIN bench.
+\$TTL 3600
+@	IN	SOA	ns.bench. hostmaster.bench. 1 3600 900 604800 3600
+@	IN	NS	ns.bench.
+ns	IN	A	127.0.0.1
+2.0.192.rev	IN	DNAME	2.0.192.ptr.bench.
+8.b.d.0.1.0.0.2.rev6	IN	DNAME	8.b.d.0.1.0.0.2.ptr6.bench.
+EOF
+for q in plain dname4 dname6; do
+	printf "check 0\nwrite 0\nspeed %d\n" $SPEED > "$DIR/$q.q"
+done
+i=1
+while test $i -le 254; do
+	n=`nibbles $i`
+	echo "$i.2.0.192.ptr	IN	PTR	host$i.bench." >> "$DIR/bench.zone"
+	echo "$n.$V6.ptr6	IN	PTR	host$i.bench." >> "$DIR/bench.zone"
+	printf "query $i.2.0.192.ptr.bench. IN PTR\nend_reply\n" >> "$DIR/plain.q"
+	printf "query $i.2.0.192.rev.bench. IN PTR\nend_reply\n" >> "$DIR/dname4.q"
+	printf "query $n.$V6.rev6.bench. IN PTR\nend_reply\n" >> "$DIR/dname6.q"
+	i=$(($i + 1))
+done
+
+cat > "$DIR/nsd.conf" <<EOF
+server:
+	database: ""
+	zonesdir: "$DIR"
+	zonelistfile: "$DIR/zone.list"
+	xfrdfile: "$DIR/xfrd.state"
+	username: ""
+	chroot: ""
+zone:
+	name: "bench."
+	zonefile: "bench.zone"
+EOF
+
+cleanup () {
+	if test -z "$DNAME_KEEP"; then
+		rm -rf "$DIR"
+	fi
+}
+trap cleanup EXIT
+
+for q in plain dname4 dname6; do
+	qps=`"$BUILD/cutest" -c "$DIR/nsd.conf" -q "$DIR/$q.q" | \
+		sed -n -e 's/^did .* sec: \([0-9.]*\) qps$/\1/p'`
+	test -n "$qps" || error "cutest failed for $q"
+	echo "$q.qps=$qps" | tee -a "$REPORT"
+done
+exit 0
@@ -0,0 +1,245 @@
+#!/bin/bash
+# scale-bench.sh - measure nsd startup, reload, zone file write and IXFR
+# apply with large synthetic data.  BSD licensed (see LICENSE file).
+#
+# Run from the build directory, with make bench, or with smaller sizes:
+#   BENCH_ZONES=1000 BENCH_TLD=100000 BENCH_NSEC3=100000 make bench
+#
+# settings, from the environment:
+# BENCH_DIR	work directory, removed at the start (bench.dir)
+# BENCH_ZONES	number of small zones (1000000)
+# BENCH_TLD	delegations in the TLD-like zone tld. (100000000)
+# BENCH_NSEC3	delegations in the NSEC3 opt-out zone nsec3. (1000000)
+# BENCH_DELTAS	IXFR deltas for the tld. zone (10)
+# BENCH_CHANGES	delegations changed in every delta (10000)
+# BENCH_KEEP	if set, the work directory is kept afterwards
+#
+# The IXFR is served by ldns-testns, if it is not available the IXFR and
+# the zone file write of the changed zone are skipped.  The results are printed as name=value lines, and stored in
+# BENCH_DIR/report.txt.  Times are wall clock seconds, memory in kilobytes
+# from the VmHWM (peak) and VmRSS of the nsd processes.
+
+. `dirname $0`/common.sh
+
+BUILD=`pwd`
+DIR=${BENCH_DIR:-bench.dir}
+ZONES=${BENCH_ZONES:-1000000}
+TLD=${BENCH_TLD:-100000000}
+NSEC3=${BENCH_NSEC3:-1000000}
+DELTAS=${BENCH_DELTAS:-10}
+CHANGES=${BENCH_CHANGES:-10000}
+if test "$CHANGES" -gt 0 -a $(($DELTAS * $CHANGES)) -gt "$TLD"; then
+	CHANGES=$(($TLD / $DELTAS))
+fi
+
+for p in nsd nsd-control zonegen; do
+	if test ! -x "$BUILD/$p"; then
+		error "no $p in `pwd`, run this with make bench"
+	fi
+done
+rm -rf "$DIR"
+mkdir -p "$DIR/small" || error "cannot create $DIR"
+DIR=`cd "$DIR"; pwd`
+REPORT="$DIR/report.txt"
+LOG="$DIR/nsd.log"
+: > "$REPORT"
+
+# print name=value in the report
+report () {
+	echo "$1=$2" | tee -a "$REPORT"
+}
+
+now () {
+	date +%s.%N
+}
+
+# seconds since the start time $1
+elapsed () {
+	echo "$1 `now`" | awk '{ printf("%.3f\n", $2 - $1); }'
+}
+
+# memory of the nsd processes: $1 prefix for the names
+report_mem () {
+	local pid=`cat "$DIR/nsd.pid" 2>/dev/null`
+	local rss=0
+	local p
+	if test -z "$pid" -o ! -f /proc/$pid/status; then
+		report "$1.rss" "`ps -o rss= -p $pid 2>/dev/null`"
+		return
+	fi
+	report "$1.main.hwm" `awk '/^VmHWM:/ { print $2 }' /proc/$pid/status`
+	report "$1.main.rss" `awk '/^VmRSS:/ { print $2 }' /proc/$pid/status`
+	# main, xfrd and the server processes
+	for p in $pid `ps -o pid= --ppid $pid 2>/dev/null`; do
+		if test -f /proc/$p/status; then
+			rss=$(($rss + `awk '/^VmRSS:/ { print $2 }' /proc/$p/status`))
+		fi
+	done
+	report "$1.total.rss" $rss
+}
+
+# the serial that is served for zone $1
+served_serial () {
+	"$BUILD/nsd-control" -c "$DIR/nsd.conf" zonestatus $1 2>/dev/null | \
+		sed -n -e 's/^[ 	]*served-serial: "\([0-9]*\) .*$/\1/p'
+}
+
+# the server pid, changes after a reload
+server_pid () {
+	"$BUILD/nsd-control" -c "$DIR/nsd.conf" serverpid 2>/dev/null
+}
+
+# wait until the command $1 prints something else than $2
+wait_change () {
+	local try
+	for (( try=0 ; try < 36000 ; try++ )) ; do
+		if test "`$1`" != "$2"; then
+			return
+		fi
+		sleep 0.1
+	done
+	error "timeout waiting for $1"
+}
+
+# wait until the serial of zone $1 is $2
+wait_serial () {
+	local try
+	for (( try=0 ; try < 36000 ; try++ )) ; do
+		if test "`served_serial $1`" = "$2"; then
+			return
+		fi
+		sleep 0.1
+	done
+	error "timeout waiting for zone $1 serial $2"
+}
+
+report bench.zones $ZONES
+report bench.tld $TLD
+report bench.nsec3 $NSEC3
+report bench.deltas $DELTAS
+report bench.changes $CHANGES
+
+# generate the data
+start=`now`
+"$BUILD/zonegen" small "$DIR/small" $ZONES || error "zonegen small failed"
+report gen.small.time `elapsed $start`
+start=`now`
+"$BUILD/zonegen" tld "$DIR/tld.zone" tld. $TLD || error "zonegen tld failed"
+report gen.tld.time `elapsed $start`
+start=`now`
+"$BUILD/zonegen" nsec3 "$DIR/nsec3.zone" nsec3. $NSEC3 || \
+	error "zonegen nsec3 failed"
+report gen.nsec3.time `elapsed $start`
+mv "$DIR/small/zone.list" "$DIR/zone.list"
+
+get_random_port 2
+PORT=$RND_PORT
+MASTER_PORT=$(($RND_PORT + 1))
+get_ldns_testns
+if test -x "`which $LDNS_TESTNS 2>&1`" -a "$DELTAS" -gt 0; then
+	"$BUILD/zonegen" ixfr "$DIR/ixfr.data" tld. $TLD $DELTAS $CHANGES || \
+		error "zonegen ixfr failed"
+	$LDNS_TESTNS -p $MASTER_PORT "$DIR/ixfr.data" >"$DIR/testns.log" 2>&1 &
+	TESTNS_PID=$!
+	XFR="request-xfr: 127.0.0.1@$MASTER_PORT NOKEY
+	allow-notify: 127.0.0.1 NOKEY"
+else
+	TESTNS_PID=""
+	XFR=""
+fi
+
+cat > "$DIR/nsd.conf" <<EOF
+server:
+	ip-address: 127.0.0.1
+	port: $PORT
+	username: ""
+	chroot: ""
+	database: ""
+	zonesdir: "$DIR"
+	zonelistfile: "$DIR/zone.list"
+	xfrdfile: "$DIR/xfrd.state"
+	xfrdir: "$DIR"
+	pidfile: "$DIR/nsd.pid"
+	logfile: "$LOG"
+	verbosity: 1
+	xfrd-reload-timeout: 0
+remote-control:
+	control-enable: yes
+	control-interface: "$DIR/nsd.ctl"
+pattern:
+	name: "small"
+	zonefile: "small/%s"
+zone:
+	name: "tld."
+	zonefile: "tld.zone"
+	$XFR
+zone:
+	name: "nsec3."
+	zonefile: "nsec3.zone"
+EOF
+
+cleanup () {
+	if test -n "$TESTNS_PID"; then
+		kill $TESTNS_PID 2>/dev/null
+	fi
+	"$BUILD/nsd-control" -c "$DIR/nsd.conf" stop >/dev/null 2>&1
+	if test -z "$BENCH_KEEP"; then
+		rm -rf "$DIR"
+	fi
+}
+trap cleanup EXIT
+
+# startup, until the zones are read and the server processes run
+start=`now`
+"$BUILD/nsd" -c "$DIR/nsd.conf" || error "nsd failed to start"
+for (( try=0 ; try < 360000 ; try++ )) ; do
+	if fgrep " started (NSD " "$LOG" >/dev/null 2>&1; then
+		break
+	fi
+	sleep 0.01
+done
+report startup.time `elapsed $start`
+report_mem startup
+
+# a reload without changes, the fork of the database and the hand over
+# to the new server processes
+pid=`server_pid`
+start=`now`
+"$BUILD/nsd-control" -c "$DIR/nsd.conf" reload tld. >/dev/null
+wait_change server_pid "$pid"
+report reload.fork.time `elapsed $start`
+
+# a reload that reads the tld. zone file again
+touch "$DIR/tld.zone"
+pid=`server_pid`
+start=`now`
+"$BUILD/nsd-control" -c "$DIR/nsd.conf" reload tld. >/dev/null
+wait_change server_pid "$pid"
+report reload.tld.time `elapsed $start`
+report_mem reload
+
+# the IXFR from the ldns-testns master
+if test -n "$TESTNS_PID"; then
+	start=`now`
+	"$BUILD/nsd-control" -c "$DIR/nsd.conf" transfer tld. >/dev/null
+	wait_serial tld. $((1 + $DELTAS))
+	report ixfr.time `elapsed $start`
+	report_mem ixfr
+
+	# write the changed zone file
+	# the mtime before the write, the write can finish before the
+	# command returns
+	mtime=`stat -c %y $DIR/tld.zone`
+	start=`now`
+	"$BUILD/nsd-control" -c "$DIR/nsd.conf" write tld. >/dev/null
+	wait_change "stat -c %y $DIR/tld.zone" "$mtime"
+	report write.time `elapsed $start`
+else
+	report ixfr.skipped "no ldns-testns"
+fi
+
+start=`now`
+"$BUILD/nsd-control" -c "$DIR/nsd.conf" stop >/dev/null
+wait_change "test -f $DIR/nsd.pid && echo up" "up"
+report stop.time `elapsed $start`
+exit 0
@@ -0,0 +1,99 @@
+#!/bin/bash
+# tls-bench.sh - measure the DNS over TLS service, handshakes per second,
+# new and resumed, and pipelined queries per second, for one server
+# process.  BSD licensed (see LICENSE file).
+#
+# Run from the build directory, with make bench-tls, or with settings:
+#   TLS_PROCS=4 TLS_CONNS=5000 make bench-tls
+#
+# settings, from the environment:
+# TLS_DIR	work directory, removed at the start (tlsbench.dir)
+# TLS_PROCS	load processes of tlsbench (2)
+# TLS_CONNS	connections per load process, for the handshakes (2000)
+# TLS_QUERIES	pipelined queries per load process (200000)
+# TLS_KTLS	yes to enable tls-ktls (no)
+# TLS_KEEP	if set, the work directory is kept afterwards
+#
+# nsd runs with server-count: 1, so the numbers are for one core.  The
+# results are printed as name=value lines, and stored in
+# TLS_DIR/report.txt.
+
+. `dirname $0`/common.sh
+
+BUILD=`pwd`
+DIR=${TLS_DIR:-tlsbench.dir}
+PROCS=${TLS_PROCS:-2}
+CONNS=${TLS_CONNS:-2000}
+QUERIES=${TLS_QUERIES:-200000}
+KTLS=${TLS_KTLS:-no}
+
+for p in nsd nsd-control tlsbench; do
+	if test ! -x "$BUILD/$p"; then
+		error "no $p in `pwd`, run this with make bench-tls"
+	fi
+done
+test_tool_avail openssl
+rm -rf "$DIR"
+mkdir -p "$DIR" || error "cannot create $DIR"
+DIR=`cd "$DIR"; pwd`
+REPORT="$DIR/report.txt"
+LOG="$DIR/nsd.log"
+: > "$REPORT"
+
+# the service key and a self signed certificate
+openssl req -x509 -newkey rsa:2048 -nodes -days 2 -subj "/CN=nsd-bench" \
+	-keyout "$DIR/tls.key" -out "$DIR/tls.pem" >/dev/null 2>&1 || \
+	error "could not create the tls key"
+
+cat > "$DIR/bench.zone" <<EOF
+\$ORIGIN bench.
+\$TTL 3600
+@	IN	SOA	ns.bench. hostmaster.bench. 1 3600 900 604800 3600
+@	IN	NS	ns.bench.
+ns	IN	A	127.0.0.1
+EOF
+
+get_random_port 1
+PORT=$RND_PORT
+cat > "$DIR/nsd.conf" <<EOF
+server:
+	ip-address: 127.0.0.1@$PORT
+	tls-port: $PORT
+	tls-service-key: "$DIR/tls.key"
+	tls-service-pem: "$DIR/tls.pem"
+	tls-ktls: $KTLS
+	server-count: 1
+	username: ""
+	chroot: ""
+	database: ""
+	zonesdir: "$DIR"
+	zonelistfile: "$DIR/zone.list"
+	xfrdfile: "$DIR/xfrd.state"
+	xfrdir: "$DIR"
+	pidfile: "$DIR/nsd.pid"
+	logfile: "$LOG"
+	verbosity: 1
+remote-control:
+	control-enable: yes
+	control-interface: "$DIR/nsd.ctl"
+zone:
+	name: "bench."
+	zonefile: "bench.zone"
+EOF
+
+cleanup () {
+	"$BUILD/nsd-control" -c "$DIR/nsd.conf" stop >/dev/null 2>&1
+	if test -z "$TLS_KEEP"; then
+		rm -rf "$DIR"
+	fi
+}
+trap cleanup EXIT
+
+"$BUILD/nsd" -c "$DIR/nsd.conf" || error "nsd failed to start"
+wait_logfile "$LOG" " started (NSD " 60
+
+"$BUILD/tlsbench" -p $PROCS -n $CONNS -q $QUERIES -z bench. \
+	127.0.0.1 $PORT | tee -a "$REPORT" || error "tlsbench failed"
+"$BUILD/nsd-control" -c "$DIR/nsd.conf" stats_noreset 2>/dev/null | \
+	grep -E "^num\.(tcp|tls)=" | tee -a "$REPORT"
+exit 0
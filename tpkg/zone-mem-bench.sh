@@ -0,0 +1,142 @@
+#!/bin/bash
+# zone-mem-bench.sh - measure the memory per configured zone of nsd, for
+# primary and for secondary zones without zone data.
+# BSD licensed (see LICENSE file).
+#
+# Run from the build directory, with make bench-zonemem, or:
+#   BENCH_ZONES=10000 make bench-zonemem
+#
+# settings, from the environment:
+# BENCH_DIR	work directory, removed at the start (zonemem.dir)
+# BENCH_ZONES	number of zones that are added for a measurement (100000)
+# BENCH_KEEP	if set, the work directory is kept afterwards
+#
+# nsd is started three times, with no zones, with BENCH_ZONES primary
+# zones and with BENCH_ZONES secondary zones.  The secondary zones have
+# a master where nothing listens, their transfers fail and are retried
+# later.  The results are printed as name=value lines, and stored in
+# BENCH_DIR/report.txt.  Memory is the VmRSS in kilobytes of the main
+# process, that has the options and the zone data, and of xfrd, that has
+# the options and the transfer and notify state.  The per zone numbers
+# are in bytes, the growth from the run without zones.
+
+. `dirname $0`/common.sh
+
+BUILD=`pwd`
+DIR=${BENCH_DIR:-zonemem.dir}
+ZONES=${BENCH_ZONES:-100000}
+
+for p in nsd nsd-control; do
+	if test ! -x "$BUILD/$p"; then
+		error "no $p in `pwd`, run this with make bench-zonemem"
+	fi
+done
+rm -rf "$DIR"
+mkdir -p "$DIR" || error "cannot create $DIR"
+DIR=`cd "$DIR"; pwd`
+REPORT="$DIR/report.txt"
+LOG="$DIR/nsd.log"
+: > "$REPORT"
+
+# print name=value in the report
+report () {
+	echo "$1=$2" | tee -a "$REPORT"
+}
+
+# the VmRSS in kilobytes of process $1
+rss () {
+	awk '/^VmRSS:/ { print $2 }' /proc/$1/status 2>/dev/null
+}
+
+get_random_port 2
+PORT=$RND_PORT
+MASTER_PORT=$(($RND_PORT + 1))
+
+cat > "$DIR/nsd.conf" <<EOF
+server:
+	ip-address: 127.0.0.1
+	port: $PORT
+	server-count: 1
+	username: ""
+	chroot: ""
+	database: ""
+	zonesdir: "$DIR"
+	zonelistfile: "$DIR/zone.list"
+	xfrdfile: "$DIR/xfrd.state"
+	xfrdir: "$DIR"
+	pidfile: "$DIR/nsd.pid"
+	logfile: "$LOG"
+	verbosity: 0
+remote-control:
+	control-enable: yes
+	control-interface: "$DIR/nsd.ctl"
+pattern:
+	name: "primary"
+	zonefile: "%s.zone"
+	notify: 127.0.0.1@$MASTER_PORT NOKEY
+pattern:
+	name: "secondary"
+	zonefile: "%s.zone"
+	request-xfr: 127.0.0.1@$MASTER_PORT NOKEY
+	allow-notify: 127.0.0.1 NOKEY
+EOF
+
+cleanup () {
+	"$BUILD/nsd-control" -c "$DIR/nsd.conf" stop >/dev/null 2>&1
+	if test -z "$BENCH_KEEP"; then
+		rm -rf "$DIR"
+	fi
+}
+trap cleanup EXIT
+
+# run nsd with $2 zones of pattern $3 in the zone list, and report the
+# memory with prefix $1
+measure () {
+	local main xfrd try
+	printf "# NSD zone list\n# name pattern\n" > "$DIR/zone.list"
+	if test "$2" -gt 0; then
+		awk -v n=$2 -v p=$3 'BEGIN { for(i=0; i<n; i++)
+			printf("add z%d.bench. %s\n", i, p); }' >> "$DIR/zone.list"
+	fi
+	rm -f "$DIR/zone.list.bin" "$DIR/xfrd.state" "$LOG"
+	"$BUILD/nsd" -c "$DIR/nsd.conf" || error "nsd failed to start"
+	for (( try=0 ; try < 360000 ; try++ )) ; do
+		if fgrep " started (NSD " "$LOG" >/dev/null 2>&1; then
+			break
+		fi
+		sleep 0.01
+	done
+	# the pidfile has the pid of xfrd, serverpid is the main process
+	main=`"$BUILD/nsd-control" -c "$DIR/nsd.conf" serverpid` || \
+		error "nsd-control serverpid failed"
+	xfrd=`cat "$DIR/nsd.pid"`
+	report $1.main.rss `rss $main`
+	report $1.xfrd.rss `rss $xfrd`
+	"$BUILD/nsd-control" -c "$DIR/nsd.conf" stop >/dev/null
+	for (( try=0 ; try < 36000 ; try++ )) ; do
+		if kill -0 $xfrd >/dev/null 2>&1; then
+			sleep 0.1
+		else
+			return
+		fi
+	done
+	error "timeout waiting for nsd to stop"
+}
+
+# the growth per zone in bytes, of $2 kilobytes over $1 kilobytes
+per_zone () {
+	echo "$1 $2 $ZONES" | awk '{ printf("%d\n", ($2 - $1)*1024/$3); }'
+}
+
+report bench.zones $ZONES
+measure none 0 primary
+measure primary $ZONES primary
+measure secondary $ZONES secondary
+for p in main xfrd; do
+	base=`sed -n -e "s/^none.$p.rss=//p" "$REPORT"`
+	for t in primary secondary; do
+		report $t.$p.per_zone `per_zone $base \
+			\`sed -n -e "s/^$t.$p.rss=//p" "$REPORT"\``
+	done
+done
+exit 0
@@ -0,0 +1,214 @@
+/*
+ * udpsize.c -- adaptive UDP response size per source prefix.
+ *
+ * Copyright (c) 2026, NLnet Labs. All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+
+#include "config.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define MAP_ANONYMOUS   MAP_ANON
+#endif
+#endif /* HAVE_MMAP */
+#include "udpsize.h"
+#include "nsd.h"
+#include "util.h"
+#include "lookup3.h"
+#include "packet.h"
+
+/**
+ * The state of one source prefix.  The server processes update the
+ * buckets without locks, a bucket that is changed by two of them at the
+ * same time can get mixed up, that only disturbs the heuristics.
+ */
+struct udpsize_bucket {
+	/* the source prefix */
+	uint64_t source;
+	/* hash of the query of the last large answer, and when */
+	uint32_t large_hash;
+	int32_t large_time;
+	/* hash of the query of the last truncated answer, and when */
+	uint32_t tc_hash;
+	int32_t tc_time;
+	/* the answers are capped until this time, 0 if not capped */
+	int32_t until;
+	/* seconds the next cap holds */
+	int32_t hold;
+	/* TCP retries caused by the cap, since it was set */
+	uint16_t tcp_retries;
+	/* flags, for IPv6 and if the cap truncated the last answer */
+	uint16_t flags;
+};
+
+#define UDPSIZE_IP6 0x1
+#define UDPSIZE_TC_CAP 0x2
+
+static struct udpsize_bucket* udpsize_array = NULL;
+
+void
+udpsize_init(void)
+{
+	size_t size = sizeof(struct udpsize_bucket)*UDPSIZE_BUCKETS;
+	if(udpsize_array)
+		return;
+#ifdef HAVE_MMAP
+	udpsize_array = (struct udpsize_bucket*)mmap(NULL, size,
+		PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(udpsize_array == MAP_FAILED) {
+		log_msg(LOG_ERR, "adaptive-udp-size: mmap failed: %s",
+			strerror(errno));
+		exit(1);
+	}
+	memset(udpsize_array, 0, size);
+#else
+	/* every server process its own table */
+	udpsize_array = (struct udpsize_bucket*)xalloc_zero(size);
+#endif
+}
+
+/** the source prefix of the query, and flags for the family */
+static uint64_t
+udpsize_source(struct query* q, uint16_t* flags)
+{
+#ifdef INET6
+	if(q->addr.ss_family == AF_INET6) {
+		uint64_t s;
+		uint8_t* a = (uint8_t*)&s;
+		memmove(&s, &((struct sockaddr_in6*)&q->addr)->sin6_addr,
+			sizeof(s));
+		memset(a + UDPSIZE_IPV6_PREFIX_LENGTH/8, 0,
+			sizeof(s) - UDPSIZE_IPV6_PREFIX_LENGTH/8);
+		*flags = UDPSIZE_IP6;
+		return s;
+	}
+	*flags = 0;
+	return ((struct sockaddr_in*)&q->addr)->sin_addr.s_addr &
+		htonl(0xffffffff << (32-UDPSIZE_IPV4_PREFIX_LENGTH));
+#else
+	*flags = 0;
+	return q->addr.sin_addr.s_addr &
+		htonl(0xffffffff << (32-UDPSIZE_IPV4_PREFIX_LENGTH));
+#endif
+}
+
+/** the bucket for the prefix of the query */
+static struct udpsize_bucket*
+udpsize_bucket(struct query* q, uint64_t* source, uint16_t* flags)
+{
+	uint32_t h;
+	*source = udpsize_source(q, flags);
+	h = hashlittle(source, sizeof(*source), *flags);
+	return &udpsize_array[h % UDPSIZE_BUCKETS];
+}
+
+/** hash of the query, the address, name and type, to spot retries */
+static uint32_t
+udpsize_query_hash(struct query* q)
+{
+	uint32_t h = q->qtype;
+#ifdef INET6
+	if(q->addr.ss_family == AF_INET6)
+		h = hashlittle(&((struct sockaddr_in6*)&q->addr)->sin6_addr,
+			sizeof(struct in6_addr), h);
+	else
+#endif
+		h = hashlittle(&((struct sockaddr_in*)&q->addr)->sin_addr,
+			sizeof(struct in_addr), h);
+	return hashlittle(dname_name(q->qname), q->qname->name_size, h);
+}
+
+/** lift the cap of the prefix */
+static void
+udpsize_lift(struct nsd* nsd, struct udpsize_bucket* b)
+{
+	b->until = 0;
+	b->tcp_retries = 0;
+	STATUP(nsd, udpsize_raised);
+}
+
+void
+udpsize_query(struct nsd* nsd, struct query* q)
+{
+	struct udpsize_bucket* b;
+	uint64_t source;
+	uint16_t flags;
+	uint32_t h;
+	int32_t now;
+	if(!udpsize_array || !q->qname)
+		return;
+	b = udpsize_bucket(q, &source, &flags);
+	if(b->source != source || (b->flags&UDPSIZE_IP6) != flags)
+		return; /* nothing known about the prefix */
+	now = (int32_t)time(NULL);
+	h = udpsize_query_hash(q);
+	if(q->tcp) {
+		if(b->tc_hash != h || b->tc_time == 0 ||
+			now - b->tc_time > UDPSIZE_WINDOW)
+			return;
+		/* a TCP retry after a truncated answer */
+		b->tc_time = 0;
+		STATUP(nsd, udpsize_tcp_retry);
+		if((b->flags&UDPSIZE_TC_CAP) && b->until != 0 &&
+			++b->tcp_retries >= UDPSIZE_TCP_LIFT)
+			udpsize_lift(nsd, b);
+		return;
+	}
+	if(b->until != 0 && now >= b->until)
+		udpsize_lift(nsd, b);
+	if(b->large_hash == h && b->large_time != 0 &&
+		now - b->large_time <= UDPSIZE_WINDOW) {
+		/* the large answer did not arrive */
+		b->large_time = 0;
+		STATUP(nsd, udpsize_udp_retry);
+		if(b->until == 0) {
+			b->until = now + b->hold;
+			b->tcp_retries = 0;
+			if(b->hold < UDPSIZE_HOLD_MAX)
+				b->hold *= 2;
+			STATUP(nsd, udpsize_lowered);
+		}
+	}
+	if(b->until != 0 && q->maxlen > UDPSIZE_SAFE) {
+		q->maxlen = UDPSIZE_SAFE;
+		q->maxlen_capped = 1;
+	}
+}
+
+void
+udpsize_answer(struct nsd* nsd, struct query* q)
+{
+	struct udpsize_bucket* b;
+	uint64_t source;
+	uint16_t flags;
+	int tc = TC(q->packet);
+	if(!udpsize_array || !q->qname)
+		return;
+	if(!tc && buffer_position(q->packet) <= UDPSIZE_SAFE)
+		return;
+	b = udpsize_bucket(q, &source, &flags);
+	if(b->source != source || (b->flags&UDPSIZE_IP6) != flags) {
+		/* take over the bucket for this prefix */
+		memset(b, 0, sizeof(*b));
+		b->source = source;
+		b->flags = flags;
+		b->hold = UDPSIZE_HOLD;
+	}
+	if(tc) {
+		b->tc_hash = udpsize_query_hash(q);
+		b->tc_time = (int32_t)time(NULL);
+		if(q->maxlen_capped) {
+			b->flags |= UDPSIZE_TC_CAP;
+			STATUP(nsd, udpsize_truncated);
+		} else	b->flags &= ~UDPSIZE_TC_CAP;
+	} else {
+		b->large_hash = udpsize_query_hash(q);
+		b->large_time = (int32_t)time(NULL);
+	}
+}
@@ -0,0 +1,60 @@
+/*
+ * udpsize.h -- adaptive UDP response size per source prefix.
+ *
+ * Copyright (c) 2026, NLnet Labs. All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+
+#ifndef UDPSIZE_H
+#define UDPSIZE_H
+#include "query.h"
+
+/*
+ * With adaptive-udp-size the server learns, per source prefix, if large
+ * UDP answers get lost, probably because the fragments are dropped on
+ * the path.  The sign is that the same address asks the same query
+ * again, shortly after a large answer.  The prefix then gets answers of
+ * at most UDPSIZE_SAFE, and larger ones are truncated.  The cap holds for
+ * a while, that doubles every time it is needed again, or until the cap
+ * has caused a number of TCP retries, after truncated answers that would
+ * have fitted without the cap.
+ */
+
+/** number of prefixes in the table */
+#define UDPSIZE_BUCKETS 100000
+/** the prefix lengths */
+#define UDPSIZE_IPV4_PREFIX_LENGTH 24
+#define UDPSIZE_IPV6_PREFIX_LENGTH 56
+/** answers larger than this are not sent to a capped prefix; the size
+ * that avoids fragmentation on almost all paths */
+#define UDPSIZE_SAFE 1232
+/** seconds after an answer in which the same query is a retry */
+#define UDPSIZE_WINDOW 3
+/** seconds the first cap holds, and the maximum it doubles to */
+#define UDPSIZE_HOLD 300
+#define UDPSIZE_HOLD_MAX 76800
+/** TCP retries caused by the cap, that lift the cap before its time */
+#define UDPSIZE_TCP_LIFT 16
+
+/**
+ * Allocate the table, in memory that is shared by the server
+ * processes, so that they see the answers of each other.
+ */
+void udpsize_init(void);
+
+/**
+ * Look at the query, that has the question section and EDNS processed.
+ * Counts retries, caps or lifts the prefix, and lowers q->maxlen for a
+ * capped prefix.
+ */
+void udpsize_query(struct nsd* nsd, struct query* q);
+
+/**
+ * Look at the UDP answer that is sent, remember large and truncated
+ * answers for the prefix.
+ */
+void udpsize_answer(struct nsd* nsd, struct query* q);
+
+#endif /* UDPSIZE_H */
@@ -27,6 +27,7 @@
 #include "namedb.h"
 #include "rdata.h"
 #include "zonec.h"
+#include "lookup3.h"
 
 #ifdef USE_MMAP_ALLOC
 #include <sys/mman.h>
@@ -39,6 +40,14 @@
 
 #endif /* USE_MMAP_ALLOC */
 
+#if defined(HAVE_MMAP) && defined(__ATOMIC_ACQUIRE)
+#define USE_LOG_QUEUE 1
+#include <sys/mman.h>
+#if defined(MAP_ANON) && !defined(MAP_ANONYMOUS)
+#define	MAP_ANONYMOUS	MAP_ANON
+#endif
+#endif /* HAVE_MMAP && __ATOMIC_ACQUIRE */
+
 #ifndef NDEBUG
 unsigned nsd_debug_facilities = 0xffff;
 int nsd_debug_level = 0;
@@ -53,6 +62,54 @@ static log_function_type *current_log_function = log_file;
 static FILE *current_log_file = NULL;
 int log_time_asc = 1;
 
+#ifdef USE_LOG_QUEUE
+/* a message in the log queue */
+struct log_record {
+	/* sequence number, the record is free for position seq and full
+	 * for position seq-1 */
+	uint32_t seq;
+	int priority;
+	pid_t pid;
+	struct timeval tv;
+	char message[MAXSYSLOGMSGLEN];
+};
+
+/* the log queue, in memory shared by the processes */
+struct log_queue {
+	/* process that writes the log, 0 if every process writes its own */
+	pid_t writer;
+	/* messages dropped because the queue was full */
+	uint32_t dropped;
+	/* position to put the next message, and to take the next one */
+	uint32_t head;
+	uint32_t tail;
+	struct log_record records[LOG_QUEUE_SIZE];
+};
+
+/* the copies of a message, in the current second */
+struct log_similar {
+	/* if the entry counts a message */
+	int used;
+	/* hash of the message text */
+	uint32_t hash;
+	time_t sec;
+	unsigned count;
+	unsigned suppressed;
+	/* priority and pid of the last suppressed copy */
+	int priority;
+	pid_t pid;
+	char message[MAXSYSLOGMSGLEN];
+};
+
+static struct log_queue *log_queue = NULL;
+static struct log_similar *log_similar = NULL;
+/* pid and time of a queued message that is written, or NULL */
+static struct log_record *log_origin = NULL;
+/* the place in the queue that the reader waits for, and since when */
+static uint32_t log_wait_pos = 0;
+static time_t log_wait_since = 0;
+#endif /* USE_LOG_QUEUE */
+
 void
 log_init(const char *ident)
 {
@@ -126,6 +183,8 @@ log_file(int priority, const char *message)
 	size_t length;
 	lookup_table_type *priority_info;
 	const char *priority_text = "unknown";
+	struct timeval tv;
+	pid_t pid;
 
 	assert(global_ident);
 	assert(current_log_file);
@@ -135,26 +194,36 @@ log_file(int priority, const char *message)
 		priority_text = priority_info->name;
 	}
 
+#ifdef USE_LOG_QUEUE
+	if(log_origin) {
+		/* a queued message, of another process */
+		pid = log_origin->pid;
+		tv = log_origin->tv;
+	} else
+#endif
+	{
+		pid = getpid();
+		tv.tv_usec = 0;
+		if(gettimeofday(&tv, NULL) != 0)
+			tv.tv_sec = time(NULL);
+	}
+
 	/* Bug #104, add time_t timestamp */
 #if defined(HAVE_STRFTIME) && defined(HAVE_LOCALTIME_R)
 	if(log_time_asc) {
-		struct timeval tv;
 		char tmbuf[32];
+		struct tm tm;
+		time_t now = (time_t)tv.tv_sec;
 		tmbuf[0]=0;
-		tv.tv_usec = 0;
-		if(gettimeofday(&tv, NULL) == 0) {
-			struct tm tm;
-			time_t now = (time_t)tv.tv_sec;
-			strftime(tmbuf, sizeof(tmbuf), "%Y-%m-%d %H:%M:%S",
-				localtime_r(&now, &tm));
-		}
+		strftime(tmbuf, sizeof(tmbuf), "%Y-%m-%d %H:%M:%S",
+			localtime_r(&now, &tm));
 		fprintf(current_log_file, "[%s.%3.3d] %s[%d]: %s: %s",
 			tmbuf, (int)tv.tv_usec/1000,
-			global_ident, (int) getpid(), priority_text, message);
+			global_ident, (int) pid, priority_text, message);
  	} else
 #endif /* have time functions */
 		fprintf(current_log_file, "[%d] %s[%d]: %s: %s",
-		(int)time(NULL), global_ident, (int) getpid(), priority_text, message);
+		(int)tv.tv_sec, global_ident, (int) pid, priority_text, message);
 	length = strlen(message);
 	if (length == 0 || message[length - 1] != '\n') {
 		fprintf(current_log_file, "\n");
@@ -166,6 +235,13 @@ void
 log_syslog(int priority, const char *message)
 {
 #ifdef HAVE_SYSLOG_H
+#ifdef USE_LOG_QUEUE
+	if(log_origin) {
+		/* syslog has the pid of this process, name the process that
+		 * logged the queued message */
+		syslog(priority, "[%d] %s", (int)log_origin->pid, message);
+	} else
+#endif
 	syslog(priority, "%s", message);
 #endif /* !HAVE_SYSLOG_H */
 	log_file(priority, message);
@@ -186,14 +262,281 @@ log_msg(int priority, const char *format, ...)
 	va_end(args);
 }
 
+#ifdef USE_LOG_QUEUE
+/* put the message in the log queue, returns 0 if not queued */
+static int
+log_enqueue(int priority, const char *format, va_list args)
+{
+	struct log_record* r;
+	uint32_t pos, seq;
+	pid_t writer = __atomic_load_n(&log_queue->writer, __ATOMIC_ACQUIRE);
+	if(writer == 0 || writer == getpid())
+		return 0;
+	pos = __atomic_load_n(&log_queue->head, __ATOMIC_RELAXED);
+	for(;;) {
+		r = &log_queue->records[pos % LOG_QUEUE_SIZE];
+		seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		if(seq == pos) {
+			if(__atomic_compare_exchange_n(&log_queue->head, &pos,
+				pos+1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if((int32_t)(seq - pos) < 0) {
+			/* full, do not wait for the writer */
+			__atomic_add_fetch(&log_queue->dropped, 1,
+				__ATOMIC_RELAXED);
+			return 1;
+		} else {
+			pos = __atomic_load_n(&log_queue->head,
+				__ATOMIC_RELAXED);
+		}
+	}
+	r->priority = priority;
+	r->pid = getpid();
+	if(gettimeofday(&r->tv, NULL) != 0) {
+		r->tv.tv_sec = time(NULL);
+		r->tv.tv_usec = 0;
+	}
+	vsnprintf(r->message, sizeof(r->message), format, args);
+	seq = pos;
+	if(!__atomic_compare_exchange_n(&r->seq, &seq, pos+1, 0,
+		__ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		/* the reader waited too long for it and skipped the place */
+		__atomic_add_fetch(&log_queue->dropped, 1, __ATOMIC_RELAXED);
+	}
+	return 1;
+}
+
+/* see if the place at pos, that a writer has taken but not filled, is
+ * waited for LOG_QUEUE_WAIT seconds; the writer has died in between */
+static int
+log_wait_expired(uint32_t pos)
+{
+	time_t now = time(NULL);
+	if(log_wait_since == 0 || log_wait_pos != pos) {
+		log_wait_pos = pos;
+		log_wait_since = now;
+		return 0;
+	}
+	return now - log_wait_since >= LOG_QUEUE_WAIT;
+}
+
+/* take a message from the log queue, returns 0 if it is empty */
+static int
+log_dequeue(struct log_record* out)
+{
+	struct log_record* r;
+	uint32_t pos, seq;
+	pos = __atomic_load_n(&log_queue->tail, __ATOMIC_RELAXED);
+	for(;;) {
+		r = &log_queue->records[pos % LOG_QUEUE_SIZE];
+		seq = __atomic_load_n(&r->seq, __ATOMIC_ACQUIRE);
+		if(seq == pos+1) {
+			if(__atomic_compare_exchange_n(&log_queue->tail, &pos,
+				pos+1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if((int32_t)(seq - (pos+1)) < 0) {
+			/* empty, or a writer is busy with the message */
+			if(__atomic_load_n(&log_queue->head, __ATOMIC_RELAXED)
+				== pos || !log_wait_expired(pos))
+				return 0;
+			/* free the place for the next round, unless the
+			 * message is written just now */
+			if(!__atomic_compare_exchange_n(&r->seq, &seq,
+				pos+LOG_QUEUE_SIZE, 0, __ATOMIC_RELEASE,
+				__ATOMIC_RELAXED))
+				continue;
+			__atomic_compare_exchange_n(&log_queue->tail, &pos,
+				pos+1, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+			__atomic_add_fetch(&log_queue->dropped, 1,
+				__ATOMIC_RELAXED);
+			log_wait_since = 0;
+			pos = __atomic_load_n(&log_queue->tail,
+				__ATOMIC_RELAXED);
+		} else {
+			pos = __atomic_load_n(&log_queue->tail,
+				__ATOMIC_RELAXED);
+		}
+	}
+	log_wait_since = 0;
+	memcpy(out, r, sizeof(*out));
+	__atomic_store_n(&r->seq, pos+LOG_QUEUE_SIZE, __ATOMIC_RELEASE);
+	return 1;
+}
+
+/* write a queued message, with the pid and time of its process */
+static void
+log_write_record(struct log_record* r)
+{
+	log_origin = r;
+	current_log_function(r->priority, r->message);
+	log_origin = NULL;
+}
+
+/* write how many copies of the message were suppressed */
+static void
+log_similar_done(struct log_similar* s)
+{
+	struct log_record r;
+	if(s->suppressed != 0) {
+		r.priority = s->priority;
+		r.pid = s->pid;
+		r.tv.tv_sec = s->sec;
+		r.tv.tv_usec = 999999;
+		snprintf(r.message, sizeof(r.message),
+			"%u duplicate messages suppressed: %.400s",
+			s->suppressed, s->message);
+		log_write_record(&r);
+	}
+	s->used = 0;
+	s->count = 0;
+	s->suppressed = 0;
+}
+
+/* the count for the message text; its own entry, a free one, or the
+ * oldest of the places that are tried for it */
+static struct log_similar*
+log_similar_find(const char* message, uint32_t h)
+{
+	size_t i;
+	struct log_similar* s, *free_s = NULL, *old = NULL;
+	for(i=0; i<LOG_SIMILAR_PROBE; i++) {
+		s = &log_similar[(h+i) % LOG_SIMILAR_SIZE];
+		if(s->used && s->hash == h && strcmp(s->message, message) == 0)
+			return s;
+		if(!s->used) {
+			if(!free_s)
+				free_s = s;
+		} else if(!old || s->sec < old->sec) {
+			old = s;
+		}
+	}
+	if(free_s)
+		return free_s;
+	/* the count of another message is ended */
+	log_similar_done(old);
+	return old;
+}
+#endif /* USE_LOG_QUEUE */
+
 void
 log_vmsg(int priority, const char *format, va_list args)
 {
 	char message[MAXSYSLOGMSGLEN];
+#ifdef USE_LOG_QUEUE
+	if(log_queue && log_enqueue(priority, format, args))
+		return;
+#endif
 	vsnprintf(message, sizeof(message), format, args);
 	current_log_function(priority, message);
 }
 
+void
+log_queue_init(void)
+{
+#ifdef USE_LOG_QUEUE
+	uint32_t i;
+	if(log_queue)
+		return;
+	log_queue = (struct log_queue*)mmap(NULL, sizeof(*log_queue),
+		PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+	if(log_queue == MAP_FAILED) {
+		log_queue = NULL;
+		log_msg(LOG_ERR, "log queue: mmap failed: %s, processes "
+			"write their own log", strerror(errno));
+		return;
+	}
+	memset(log_queue, 0, sizeof(*log_queue));
+	for(i=0; i<LOG_QUEUE_SIZE; i++)
+		log_queue->records[i].seq = i;
+	log_similar = (struct log_similar*)xalloc_array_zero(
+		LOG_SIMILAR_SIZE, sizeof(*log_similar));
+	__atomic_store_n(&log_queue->writer, getpid(), __ATOMIC_RELEASE);
+#endif /* USE_LOG_QUEUE */
+}
+
+int
+log_queue_active(void)
+{
+#ifdef USE_LOG_QUEUE
+	return log_queue != NULL &&
+		__atomic_load_n(&log_queue->writer, __ATOMIC_ACQUIRE) != 0;
+#else
+	return 0;
+#endif
+}
+
+void
+log_queue_writer(void)
+{
+#ifdef USE_LOG_QUEUE
+	if(log_queue)
+		__atomic_store_n(&log_queue->writer, getpid(),
+			__ATOMIC_RELEASE);
+#endif
+}
+
+void
+log_queue_flush(void)
+{
+#ifdef USE_LOG_QUEUE
+	struct log_record r;
+	struct log_similar* s;
+	uint32_t dropped, h;
+	time_t now;
+	size_t i;
+	if(!log_queue)
+		return;
+	while(log_dequeue(&r)) {
+		/* only copies of the same text are counted, messages of
+		 * the same format about different zones are all written */
+		h = hashlittle(r.message, strlen(r.message), 0);
+		s = log_similar_find(r.message, h);
+		if(!s->used || s->sec != r.tv.tv_sec) {
+			log_similar_done(s);
+			s->used = 1;
+			s->hash = h;
+			s->sec = r.tv.tv_sec;
+			strlcpy(s->message, r.message, sizeof(s->message));
+		}
+		if(++s->count > LOG_QUEUE_RATE) {
+			/* more of the same in this second, count it */
+			s->suppressed++;
+			s->priority = r.priority;
+			s->pid = r.pid;
+			continue;
+		}
+		log_write_record(&r);
+	}
+	/* the counts of seconds that are over */
+	now = time(NULL);
+	for(i=0; i<LOG_SIMILAR_SIZE; i++) {
+		if(log_similar[i].used && log_similar[i].sec < now)
+			log_similar_done(&log_similar[i]);
+	}
+	dropped = __atomic_exchange_n(&log_queue->dropped, 0,
+		__ATOMIC_RELAXED);
+	if(dropped != 0)
+		log_msg(LOG_WARNING, "log queue: %u messages dropped",
+			(unsigned)dropped);
+#endif /* USE_LOG_QUEUE */
+}
+
+void
+log_queue_stop(void)
+{
+#ifdef USE_LOG_QUEUE
+	size_t i;
+	if(!log_queue)
+		return;
+	log_queue_flush();
+	/* from now on every process writes its own log */
+	__atomic_store_n(&log_queue->writer, 0, __ATOMIC_RELEASE);
+	log_queue_flush();
+	for(i=0; i<LOG_SIMILAR_SIZE; i++)
+		log_similar_done(&log_similar[i]);
+#endif
+}
+
 void
 set_bit(uint8_t bits[], size_t index)
 {
@@ -993,24 +1336,29 @@ print_rr(FILE *out,
 				|| dname_compare(state->previous_owner_origin,
 				   owner_origin) != 0);
 			if (origin_changed) {
-				buffer_printf(output, "$ORIGIN %s\n",
+				buffer_print_string(output, "$ORIGIN ");
+				buffer_print_string(output,
 					dname_to_string(owner_origin, NULL));
+				buffer_print_string(output, "\n");
 			}
 
 			set_previous_owner(state, owner);
-			buffer_printf(output, "%s",
+			buffer_print_string(output,
 				dname_to_string(owner,
 					state->previous_owner_origin));
 			region_free_all(rr_region);
 		}
 	} else {
-		buffer_printf(output, "%s", dname_to_string(owner, NULL));
+		buffer_print_string(output, dname_to_string(owner, NULL));
 	}
 
-	buffer_printf(output, "\t%lu\t%s\t%s",
-		(unsigned long) record->ttl,
-		rrclass_to_string(record->klass),
-		rrtype_to_string(record->type));
+	/* no buffer_printf, this is called for every RR of the zone */
+	buffer_print_string(output, "\t");
+	buffer_print_u32(output, record->ttl);
+	buffer_print_string(output, "\t");
+	buffer_print_string(output, rrclass_to_string(record->klass));
+	buffer_print_string(output, "\t");
+	buffer_print_string(output, rrtype_to_string(record->type));
 
 	result = print_rdata(output, descriptor, record);
 	if (!result) {
@@ -1023,7 +1371,7 @@ print_rr(FILE *out,
 	}
 
 	if (result) {
-		buffer_printf(output, "\n");
+		buffer_print_string(output, "\n");
 		buffer_flip(output);
 		result = write_data(out, buffer_current(output),
 		buffer_remaining(output));
@@ -86,6 +86,56 @@ void log_msg(int priority, const char *format, ...)
  */
 void log_vmsg(int priority, const char *format, va_list args);
 
+/*
+ * The log queue.  The server processes, xfrd and reload put their
+ * messages in a queue in shared memory, without blocking, and the main
+ * process writes them to the log.  When the queue is full the message is
+ * dropped and counted, as is a message that its process did not finish
+ * within LOG_QUEUE_WAIT seconds.  Of the copies of a message with the
+ * same text, LOG_QUEUE_RATE are written per second, the rest is counted
+ * and logged as duplicate messages suppressed.
+ */
+/* number of messages in the queue, a power of 2 */
+#define LOG_QUEUE_SIZE 1024
+/* copies of a message written per second */
+#define LOG_QUEUE_RATE 10
+/* number of message texts that are counted at the same time */
+#define LOG_SIMILAR_SIZE 64
+/* places in the count table that are tried for a message text */
+#define LOG_SIMILAR_PROBE 4
+/* seconds to wait for a message that has its place in the queue but is
+ * not written; after that its process is taken to be gone, and the place
+ * is skipped */
+#define LOG_QUEUE_WAIT 2
+
+/*
+ * Create the log queue, before the other processes are forked.  The
+ * caller writes the queued messages.
+ */
+void log_queue_init(void);
+
+/*
+ * True if there is a log queue and a process that writes it.
+ */
+int log_queue_active(void);
+
+/*
+ * Make the caller the process that writes the queued messages.
+ */
+void log_queue_writer(void);
+
+/*
+ * Write the queued messages, and the counts of suppressed messages of
+ * the seconds that are over.
+ */
+void log_queue_flush(void);
+
+/*
+ * Write the queued messages, and stop queueing, every process writes
+ * its own messages from now on.
+ */
+void log_queue_stop(void);
+
 /*
  * Verbose output switch
  */
@@ -280,6 +330,27 @@ extern int nsd_debug_level;
 	} while (0)
 #endif
 
+/*
+ * USDT static probes, in the nsd provider, for dtrace, bpftrace and perf.
+ * Configure with --enable-usdt, otherwise they are compiled out.  When
+ * enabled but not attached, a probe is a nop instruction.  The names
+ * use __ that is shown as - by the tools, nsd:query__done is query-done.
+ */
+#ifdef USE_USDT
+#include <sys/sdt.h>
+#define NSD_PROBE(name) DTRACE_PROBE(nsd, name)
+#define NSD_PROBE1(name, a) DTRACE_PROBE1(nsd, name, a)
+#define NSD_PROBE2(name, a, b) DTRACE_PROBE2(nsd, name, a, b)
+#define NSD_PROBE3(name, a, b, c) DTRACE_PROBE3(nsd, name, a, b, c)
+#define NSD_PROBE4(name, a, b, c, d) DTRACE_PROBE4(nsd, name, a, b, c, d)
+#else
+#define NSD_PROBE(name) ((void)0)
+#define NSD_PROBE1(name, a) ((void)0)
+#define NSD_PROBE2(name, a, b) ((void)0)
+#define NSD_PROBE3(name, a, b, c) ((void)0)
+#define NSD_PROBE4(name, a, b, c, d) ((void)0)
+#endif /* USE_USDT */
+
 /* set to true to log time prettyprinted, or false to print epoch */
 extern int log_time_asc;
 
@@ -91,6 +91,7 @@ xfrd_read_state_soa(FILE* in, const char* id_acquired,
 	const char* id, xfrd_soa_type* soa, time_t* soatime)
 {
 	char *p;
+	uint8_t name[MAXDOMAINLEN + 2];
 
 	if(!xfrd_read_check_str(in, id_acquired) ||
 	   !xfrd_read_time_t(in, soatime)) {
@@ -115,12 +116,14 @@ xfrd_read_state_soa(FILE* in, const char* id_acquired,
 	soa->rdata_count = htons(soa->rdata_count);
 
 	if(!(p=xfrd_read_token(in)) ||
-	   !(soa->prim_ns[0] = dname_parse_wire(soa->prim_ns+1, p)))
+	   !(name[0] = dname_parse_wire(name+1, p)))
 		return 0;
+	soa->prim_ns = xfrd_soa_name(name);
 
 	if(!(p=xfrd_read_token(in)) ||
-	   !(soa->email[0] = dname_parse_wire(soa->email+1, p)))
+	   !(name[0] = dname_parse_wire(name+1, p)))
 		return 0;
+	soa->email = xfrd_soa_name(name);
 
 	if(!xfrd_read_i32(in, &soa->serial) ||
 	   !xfrd_read_i32(in, &soa->refresh) ||
@@ -206,6 +209,10 @@ xfrd_read_state(struct xfrd_state* xfrd)
 		memset(&soa_nsd_read, 0, sizeof(soa_nsd_read));
 		memset(&soa_disk_read, 0, sizeof(soa_disk_read));
 		memset(&soa_notified_read, 0, sizeof(soa_notified_read));
+		soa_nsd_read.prim_ns = soa_nsd_read.email = xfrd_soa_root;
+		soa_disk_read.prim_ns = soa_disk_read.email = xfrd_soa_root;
+		soa_notified_read.prim_ns = soa_notified_read.email =
+			xfrd_soa_root;
 
 		if(!xfrd_read_check_str(in, "zone:") ||
 		   !xfrd_read_check_str(in, "name:")  ||
@@ -321,7 +328,7 @@ xfrd_read_state(struct xfrd_state* xfrd)
 		incoming_acquired = zone->soa_nsd_acquired;
 		zone->soa_nsd = soa_nsd_read;
 		zone->soa_disk = soa_disk_read;
-		zone->soa_notified = soa_notified_read;
+		zone->soa_notified_serial = soa_notified_read.serial;
 		zone->soa_nsd_acquired = soa_nsd_acquired_read;
 		/* we had better use what we got from starting NSD, not
 		 * what we store in this file, because the actual zone
@@ -375,9 +382,9 @@ neato_timeout(FILE* out, const char* str, time_t secs)
 	}
 }
 
-static void xfrd_write_dname(FILE* out, uint8_t* dname)
+static void xfrd_write_dname(FILE* out, const uint8_t* dname)
 {
-	uint8_t* d= dname+1;
+	const uint8_t* d= dname+1;
 	uint8_t len = *d++;
 	uint8_t i;
 
@@ -444,6 +451,15 @@ xfrd_write_state(struct xfrd_state* xfrd)
 	const char* statefile = xfrd->nsd->options->xfrdfile;
 	FILE *out;
 	time_t now = xfrd_time();
+	xfrd_soa_type soa_notified;
+
+	/* only the serial of the notified soa is kept in memory */
+	memset(&soa_notified, 0, sizeof(soa_notified));
+	soa_notified.type = htons(TYPE_SOA);
+	soa_notified.klass = htons(CLASS_IN);
+	soa_notified.rdata_count = htons(7);
+	soa_notified.prim_ns = xfrd_soa_root;
+	soa_notified.email = xfrd_soa_root;
 
 	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: write file %s", statefile));
 	out = fopen(statefile, "w");
@@ -497,7 +513,8 @@ xfrd_write_state(struct xfrd_state* xfrd)
 			zone->soa_nsd_acquired, zone->apex);
 		xfrd_write_state_soa(out, "soa_disk", &zone->soa_disk,
 			zone->soa_disk_acquired, zone->apex);
-		xfrd_write_state_soa(out, "soa_notify", &zone->soa_notified,
+		soa_notified.serial = zone->soa_notified_serial;
+		xfrd_write_state_soa(out, "soa_notify", &soa_notified,
 			zone->soa_notified_acquired, zone->apex);
 		fprintf(out, "\n");
 	}
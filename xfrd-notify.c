@@ -19,6 +19,11 @@
 
 #define XFRD_NOTIFY_RETRY_TIMOUT 15 /* seconds between retries sending NOTIFY */
 
+/* tsig state used to sign outgoing notifies.  The replies are not
+ * checked for tsig, so the state is not kept per zone and one record
+ * is shared by all the zones. */
+static tsig_record_type* notify_tsig = NULL;
+
 /* start sending notifies */
 static void notify_enable(struct notify_zone* zone,
 	struct xfrd_soa* new_soa);
@@ -95,11 +100,12 @@ init_notify_send(rbtree_type* tree, region_type* region,
 	not->current_soa = (struct xfrd_soa*)region_alloc(region,
 		sizeof(struct xfrd_soa));
 	memset(not->current_soa, 0, sizeof(struct xfrd_soa));
+	not->current_soa->prim_ns = xfrd_soa_root;
+	not->current_soa->email = xfrd_soa_root;
 
 	not->is_waiting = 0;
 
 	not->notify_send_enable = 0;
-	tsig_create_record_custom(&not->notify_tsig, NULL, 0, 0, 4);
 	not->notify_current = 0;
 	rbtree_insert(tree, (rbnode_type*)not);
 }
@@ -129,9 +135,6 @@ xfrd_del_notify(xfrd_state_type* xfrd, const dname_type* dname)
 		notify_disable(not);
 	}
 
-	/* del tsig */
-	tsig_delete_record(&not->notify_tsig, NULL);
-
 	/* free it */
 	region_recycle(xfrd->region, not->current_soa, sizeof(xfrd_soa_type));
 	/* the apex is recycled when the zone_options.node.key is removed */
@@ -203,7 +206,13 @@ xfrd_notify_send_udp(struct notify_zone* zone, buffer_type* packet)
 		xfrd_write_soa_buffer(packet, zone->apex, zone->current_soa);
 	}
 	if(zone->notify_current->key_options) {
-		xfrd_tsig_sign_request(packet, &zone->notify_tsig, zone->notify_current);
+		if(!notify_tsig) {
+			notify_tsig = (tsig_record_type*)region_alloc(
+				xfrd->region, sizeof(*notify_tsig));
+			tsig_create_record_custom(notify_tsig, NULL, 0, 0, 4);
+		}
+		xfrd_tsig_sign_request(packet, notify_tsig,
+			zone->notify_current);
 	}
 	buffer_flip(packet);
 	fd = xfrd_send_udp(zone->notify_current, packet,
@@ -298,9 +307,11 @@ notify_enable(struct notify_zone* zone, struct xfrd_soa* new_soa)
 		return; /* no notify acl, nothing to do */
 	}
 
-	if(new_soa == NULL)
+	if(new_soa == NULL) {
 		memset(zone->current_soa, 0, sizeof(xfrd_soa_type));
-	else
+		zone->current_soa->prim_ns = xfrd_soa_root;
+		zone->current_soa->email = xfrd_soa_root;
+	} else
 		memcpy(zone->current_soa, new_soa, sizeof(xfrd_soa_type));
 	if(zone->is_waiting)
 		return;
@@ -42,7 +42,6 @@ struct notify_zone {
 	const dname_type* apex;
 	const char* apex_str;
 
-	tsig_record_type notify_tsig; /* tsig state for notify */
 	struct zone_options* options;
 	struct xfrd_soa *current_soa; /* current SOA in NSD */
 
@@ -594,7 +594,7 @@ xfrd_tcp_setup_write_packet(struct xfrd_tcp_pipeline* tp, xfrd_zone_type* zone)
 	assert(zone->tcp_waiting == 0);
 	/* start AXFR or IXFR for the zone */
 	if(zone->soa_disk_acquired == 0 || zone->master->use_axfr_only ||
-		zone->master->ixfr_disabled ||
+		zone->master->ixfr_disabled || zone->axfr_next ||
 		/* if zone expired, after the first round, do not ask for
 		 * IXFR any more, but full AXFR (of any serial number) */
 		(zone->state == xfrd_zone_expired && zone->round_num != 0)) {
@@ -602,6 +602,7 @@ xfrd_tcp_setup_write_packet(struct xfrd_tcp_pipeline* tp, xfrd_zone_type* zone)
 						"(AXFR) for %s to %s",
 			zone->apex_str, zone->master->ip_address_spec));
 
+		zone->axfr_next = 0;
 		xfrd_setup_packet(tcp->packet, TYPE_AXFR, CLASS_IN, zone->apex,
 			zone->query_id);
 	} else {
@@ -620,7 +621,8 @@ xfrd_tcp_setup_write_packet(struct xfrd_tcp_pipeline* tp, xfrd_zone_type* zone)
 	zone->msg_seq_nr = 0;
 	zone->msg_rr_count = 0;
 	if(zone->master->key_options && zone->master->key_options->tsig_key) {
-		xfrd_tsig_sign_request(tcp->packet, &zone->tsig, zone->master);
+		xfrd_tsig_sign_request(tcp->packet, xfrd_zone_tsig(zone),
+			zone->master);
 	}
 	buffer_flip(tcp->packet);
 	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "sent tcp query with ID %d", zone->query_id));
@@ -937,6 +939,8 @@ xfrd_tcp_release(struct xfrd_tcp_set* set, xfrd_zone_type* zone)
 	assert(zone->tcp_waiting == 0);
 	zone->tcp_conn = -1;
 	zone->tcp_waiting = 0;
+	/* the transfer is done, its tsig state is not needed */
+	xfrd_zone_tsig_release(zone);
 
 	/* remove from tcp_send list */
 	tcp_pipe_sendlist_remove(tp, zone);
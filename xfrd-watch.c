@@ -0,0 +1,511 @@
+/*
+ * xfrd-watch.c - XFR (transfer) Daemon zone file watch source file.
+ *
+ * Copyright (c) 2001-2006, NLnet Labs. All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+
+/*
+ * The directories of the zone files are watched with inotify.  A change
+ * to a file in a watched directory puts the zones that use that file in
+ * the changed set.  On sighup and reload only the changed zones are
+ * checked, instead of a stat of every zone file.  When the kernel queue
+ * overflows, or a watched directory is removed, all zone files are
+ * checked and the watches are made again.
+ */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+#include "xfrd-watch.h"
+#include "xfrd.h"
+#include "nsd.h"
+#include "options.h"
+#include "difffile.h"
+
+#ifdef HAVE_SYS_INOTIFY_H
+/* events on the directory that change a zone file */
+#define WATCH_EVENTS (IN_CLOSE_WRITE|IN_MODIFY|IN_ATTRIB|IN_CREATE| \
+	IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF)
+/* if more than 1/WATCH_FULL_FRACTION of the zones have to be checked,
+ * one task checks them all */
+#define WATCH_FULL_FRACTION 4
+
+/* a watched directory, in the tree by path, key is the path */
+struct watch_dir {
+	rbnode_type node;
+	/* the directory, "" for the current directory */
+	char* path;
+};
+
+/* a watch descriptor, in the tree by watch descriptor, key is &wd */
+struct watch_wd {
+	rbnode_type node;
+	/* the inotify watch descriptor */
+	int wd;
+	/* the watched directory */
+	struct watch_dir* dir;
+};
+
+/* a zone that uses a zone file */
+struct watch_zone {
+	struct watch_zone* next;
+	/* copy of the zone apex */
+	const dname_type* apex;
+};
+
+/* a watched zone file, the key is the path as it is read by the server */
+struct watch_file {
+	rbnode_type node;
+	/* the zones that use this file */
+	struct watch_zone* zones;
+};
+
+/* a zone name in a set, the key is a copy of the apex */
+struct watch_name {
+	rbnode_type node;
+};
+
+struct xfrd_watch {
+	struct xfrd_state* xfrd;
+	/* region for the trees, replaced when the watch is made again */
+	region_type* region;
+	/* the inotify file descriptor is in the event */
+	struct event ev;
+	int event_added;
+	/* the watched directories, by path, and by watch descriptor */
+	rbtree_type* dirs;
+	rbtree_type* wds;
+	/* the watched files, by path, struct watch_file */
+	rbtree_type* files;
+	/* zones with changed zone files, struct watch_name */
+	rbtree_type* changed;
+	/* zones whose directory could not be watched, these are checked
+	 * on every reload, struct watch_name */
+	rbtree_type* unwatched;
+	/* if all zone files have to be checked at the next reload */
+	int full;
+	/* if the watches have to be made again, a directory was removed */
+	int rebuild;
+};
+
+static void xfrd_watch_callback(int fd, short event, void* arg);
+
+static int
+watch_strcmp(const void* a, const void* b)
+{
+	return strcmp((const char*)a, (const char*)b);
+}
+
+static int
+watch_wd_cmp(const void* a, const void* b)
+{
+	int x = *(const int*)a, y = *(const int*)b;
+	if(x < y) return -1;
+	if(x > y) return 1;
+	return 0;
+}
+
+/* add zone name to the set */
+static void
+watch_name_add(struct xfrd_watch* w, rbtree_type* set, const dname_type* apex)
+{
+	struct watch_name* n;
+	if(rbtree_search(set, apex))
+		return;
+	n = (struct watch_name*)region_alloc(w->region, sizeof(*n));
+	n->node.key = dname_copy(w->region, apex);
+	(void)rbtree_insert(set, &n->node);
+}
+
+/* remove zone name from the set */
+static void
+watch_name_del(struct xfrd_watch* w, rbtree_type* set, const dname_type* apex)
+{
+	struct watch_name* n = (struct watch_name*)rbtree_delete(set, apex);
+	if(!n)
+		return;
+	region_recycle(w->region, (void*)n->node.key,
+		dname_total_size((const dname_type*)n->node.key));
+	region_recycle(w->region, n, sizeof(*n));
+}
+
+/* remove all names from the set */
+static void
+watch_name_clear(struct xfrd_watch* w, rbtree_type* set)
+{
+	rbnode_type* n;
+	while((n = rbtree_first(set)) != RBTREE_NULL)
+		watch_name_del(w, set, (const dname_type*)n->key);
+}
+
+/* the zone file of the zone, or NULL if it has none */
+static const char*
+watch_zonefile(struct xfrd_watch* w, struct zone_options* zo)
+{
+	if(!zo->pattern->zonefile || !zo->pattern->zonefile[0])
+		return NULL;
+	return config_make_zonefile(zo, w->xfrd->nsd);
+}
+
+/* watch the directory of the file, returns NULL if that fails */
+static struct watch_dir*
+watch_dir_add(struct xfrd_watch* w, const char* fname)
+{
+	char path[1024];
+	const char* slash = strrchr(fname, '/');
+	struct watch_dir* d;
+	struct watch_wd* x;
+	int wd;
+	if(!slash)
+		path[0] = 0;
+	else if(slash == fname)
+		strlcpy(path, "/", sizeof(path));
+	else if((size_t)(slash-fname) < sizeof(path)) {
+		memmove(path, fname, slash-fname);
+		path[slash-fname] = 0;
+	} else	return NULL;
+	d = (struct watch_dir*)rbtree_search(w->dirs, path);
+	if(d)
+		return d;
+	wd = inotify_add_watch(w->ev.ev_fd, path[0]?path:".",
+		WATCH_EVENTS|IN_ONLYDIR);
+	if(wd == -1) {
+		VERBOSITY(2, (LOG_INFO, "zonefiles-watch: cannot watch %s: %s",
+			path[0]?path:".", strerror(errno)));
+		return NULL;
+	}
+	if(rbtree_search(w->wds, &wd)) {
+		/* the same directory with another path, the zone files
+		 * in it are checked on every reload */
+		return NULL;
+	}
+	d = (struct watch_dir*)region_alloc_zero(w->region, sizeof(*d));
+	d->path = region_strdup(w->region, path);
+	d->node.key = d->path;
+	(void)rbtree_insert(w->dirs, &d->node);
+	x = (struct watch_wd*)region_alloc_zero(w->region, sizeof(*x));
+	x->wd = wd;
+	x->dir = d;
+	x->node.key = &x->wd;
+	(void)rbtree_insert(w->wds, &x->node);
+	return d;
+}
+
+/* add the zone to the watched files */
+static void
+watch_zone_add(struct xfrd_watch* w, struct zone_options* zo)
+{
+	const char* fname = watch_zonefile(w, zo);
+	struct watch_file* f;
+	struct watch_zone* z;
+	if(!fname)
+		return;
+	if(!watch_dir_add(w, fname)) {
+		watch_name_add(w, w->unwatched,
+			(const dname_type*)zo->node.key);
+		return;
+	}
+	f = (struct watch_file*)rbtree_search(w->files, fname);
+	if(!f) {
+		f = (struct watch_file*)region_alloc_zero(w->region,
+			sizeof(*f));
+		f->node.key = region_strdup(w->region, fname);
+		(void)rbtree_insert(w->files, &f->node);
+	}
+	z = (struct watch_zone*)region_alloc(w->region, sizeof(*z));
+	z->apex = dname_copy(w->region, (const dname_type*)zo->node.key);
+	z->next = f->zones;
+	f->zones = z;
+}
+
+/* open the inotify descriptor and watch the zone files of all zones */
+static int
+watch_setup(struct xfrd_watch* w)
+{
+	struct zone_options* zo;
+	int fd = inotify_init();
+	if(fd == -1) {
+		log_msg(LOG_ERR, "zonefiles-watch: inotify_init: %s",
+			strerror(errno));
+		return 0;
+	}
+	if(fcntl(fd, F_SETFL, O_NONBLOCK) == -1)
+		log_msg(LOG_ERR, "zonefiles-watch: fcntl: %s", strerror(errno));
+	w->region = region_create(xalloc, free);
+	w->dirs = rbtree_create(w->region, watch_strcmp);
+	w->wds = rbtree_create(w->region, watch_wd_cmp);
+	w->files = rbtree_create(w->region, watch_strcmp);
+	w->changed = rbtree_create(w->region,
+		(int (*)(const void *, const void *)) dname_compare);
+	w->unwatched = rbtree_create(w->region,
+		(int (*)(const void *, const void *)) dname_compare);
+	w->rebuild = 0;
+	event_set(&w->ev, fd, EV_PERSIST|EV_READ, xfrd_watch_callback, w);
+	if(event_base_set(w->xfrd->event_base, &w->ev) != 0)
+		log_msg(LOG_ERR, "zonefiles-watch: event_base_set failed");
+	if(event_add(&w->ev, NULL) != 0)
+		log_msg(LOG_ERR, "zonefiles-watch: event_add failed");
+	else	w->event_added = 1;
+	RBTREE_FOR(zo, struct zone_options*, w->xfrd->nsd->options->zone_options)
+		watch_zone_add(w, zo);
+	VERBOSITY(2, (LOG_INFO, "zonefiles-watch: %d directories, %d files, "
+		"%d zones not watched", (int)w->dirs->count,
+		(int)w->files->count, (int)w->unwatched->count));
+	return 1;
+}
+
+/* close the inotify descriptor and remove the watch state */
+static void
+watch_teardown(struct xfrd_watch* w)
+{
+	if(w->event_added) {
+		event_del(&w->ev);
+		w->event_added = 0;
+	}
+	close(w->ev.ev_fd);
+	region_destroy(w->region);
+	w->region = NULL;
+}
+
+struct xfrd_watch*
+xfrd_watch_create(struct xfrd_state* xfrd)
+{
+	struct xfrd_watch* w = (struct xfrd_watch*)xalloc_zero(sizeof(*w));
+	w->xfrd = xfrd;
+	if(!watch_setup(w)) {
+		free(w);
+		return NULL;
+	}
+	/* changes in between the read of the zone files at start and the
+	 * watch setup are not seen, the first reload checks all files */
+	w->full = 1;
+	return w;
+}
+
+void
+xfrd_watch_close(struct xfrd_watch* w)
+{
+	if(!w)
+		return;
+	watch_teardown(w);
+	free(w);
+}
+
+void
+xfrd_watch_add_zone(struct xfrd_watch* w, struct zone_options* zo)
+{
+	if(!w)
+		return;
+	watch_zone_add(w, zo);
+	/* the zone is read from its file by the addzone */
+}
+
+void
+xfrd_watch_del_zone(struct xfrd_watch* w, struct zone_options* zo)
+{
+	const dname_type* apex = (const dname_type*)zo->node.key;
+	const char* fname;
+	struct watch_file* f;
+	struct watch_zone** zp;
+	if(!w)
+		return;
+	watch_name_del(w, w->unwatched, apex);
+	watch_name_del(w, w->changed, apex);
+	if(!(fname = watch_zonefile(w, zo)) ||
+		!(f = (struct watch_file*)rbtree_search(w->files, fname)))
+		return;
+	for(zp = &f->zones; *zp; zp = &(*zp)->next) {
+		struct watch_zone* z = *zp;
+		if(dname_compare(z->apex, apex) == 0) {
+			*zp = z->next;
+			region_recycle(w->region, (void*)z->apex,
+				dname_total_size(z->apex));
+			region_recycle(w->region, z, sizeof(*z));
+			break;
+		}
+	}
+	if(!f->zones) {
+		(void)rbtree_delete(w->files, f->node.key);
+		region_recycle(w->region, (void*)f->node.key,
+			strlen((const char*)f->node.key)+1);
+		region_recycle(w->region, f, sizeof(*f));
+	}
+}
+
+void
+xfrd_watch_reset(struct xfrd_watch* w)
+{
+	if(!w)
+		return;
+	w->full = 1;
+	w->rebuild = 1;
+}
+
+/* the zone files of the zones that use the file in the directory have
+ * changed */
+static void
+watch_file_changed(struct xfrd_watch* w, struct watch_dir* d,
+	const char* name)
+{
+	char path[1024];
+	struct watch_file* f;
+	struct watch_zone* z;
+	size_t len = strlen(d->path);
+	if(len == 0)
+		strlcpy(path, name, sizeof(path));
+	else if(d->path[len-1] == '/')
+		snprintf(path, sizeof(path), "%s%s", d->path, name);
+	else	snprintf(path, sizeof(path), "%s/%s", d->path, name);
+	f = (struct watch_file*)rbtree_search(w->files, path);
+	if(!f)
+		return; /* not a zone file */
+	for(z = f->zones; z; z = z->next)
+		watch_name_add(w, w->changed, z->apex);
+}
+
+static void
+xfrd_watch_callback(int fd, short event, void* arg)
+{
+	struct xfrd_watch* w = (struct xfrd_watch*)arg;
+	/* aligned for the struct inotify_event */
+	uint64_t buf64[512];
+	char* buf = (char*)buf64;
+	ssize_t len, i;
+	if(!(event&EV_READ))
+		return;
+	while(1) {
+		len = read(fd, buf, sizeof(buf64));
+		if(len == -1) {
+			if(errno == EINTR)
+				continue;
+			if(errno != EAGAIN && errno != EWOULDBLOCK) {
+				log_msg(LOG_ERR, "zonefiles-watch: read: %s",
+					strerror(errno));
+				w->full = 1;
+			}
+			return;
+		}
+		if(len <= 0)
+			return;
+		for(i = 0; i < len;
+			i += sizeof(struct inotify_event) +
+			((struct inotify_event*)(buf+i))->len) {
+			struct inotify_event* e =
+				(struct inotify_event*)(buf+i);
+			struct watch_wd* x;
+			if((e->mask&IN_Q_OVERFLOW)) {
+				VERBOSITY(2, (LOG_INFO, "zonefiles-watch: "
+					"event queue overflow, check all "
+					"zone files"));
+				w->full = 1;
+				continue;
+			}
+			x = (struct watch_wd*)rbtree_search(w->wds, &e->wd);
+			if(!x)
+				continue;
+			if((e->mask&(IN_DELETE_SELF|IN_MOVE_SELF|IN_IGNORED))) {
+				/* the directory itself is gone */
+				xfrd_watch_reset(w);
+				continue;
+			}
+			if(e->len > 0)
+				watch_file_changed(w, x->dir, e->name);
+		}
+	}
+}
+
+void
+xfrd_watch_check_zonefiles(struct xfrd_state* xfrd)
+{
+	struct xfrd_watch* w = xfrd->watch;
+	struct watch_name* n;
+	size_t num;
+	if(!w) {
+		task_new_check_zonefiles(xfrd->nsd->task[xfrd->nsd->mytask],
+			xfrd->last_task, NULL);
+		return;
+	}
+	num = w->changed->count + w->unwatched->count;
+	if(w->full || num > xfrd->nsd->options->zone_options->count /
+		WATCH_FULL_FRACTION) {
+		VERBOSITY(2, (LOG_INFO, "zonefiles-watch: check all zone "
+			"files"));
+		if(w->rebuild) {
+			watch_teardown(w);
+			if(!watch_setup(w)) {
+				/* continue without the watch */
+				free(w);
+				xfrd->watch = NULL;
+				task_new_check_zonefiles(xfrd->nsd->task[
+					xfrd->nsd->mytask], xfrd->last_task,
+					NULL);
+				return;
+			}
+		}
+		watch_name_clear(w, w->changed);
+		w->full = 0;
+		task_new_check_zonefiles(xfrd->nsd->task[xfrd->nsd->mytask],
+			xfrd->last_task, NULL);
+		return;
+	}
+	VERBOSITY(2, (LOG_INFO, "zonefiles-watch: check %d changed and %d "
+		"unwatched zone files", (int)w->changed->count,
+		(int)w->unwatched->count));
+	RBTREE_FOR(n, struct watch_name*, w->changed)
+		task_new_check_zonefiles(xfrd->nsd->task[xfrd->nsd->mytask],
+			xfrd->last_task, (const dname_type*)n->node.key);
+	RBTREE_FOR(n, struct watch_name*, w->unwatched)
+		task_new_check_zonefiles(xfrd->nsd->task[xfrd->nsd->mytask],
+			xfrd->last_task, (const dname_type*)n->node.key);
+	watch_name_clear(w, w->changed);
+}
+
+#else /* !HAVE_SYS_INOTIFY_H */
+
+struct xfrd_watch*
+xfrd_watch_create(struct xfrd_state* ATTR_UNUSED(xfrd))
+{
+	log_msg(LOG_ERR, "zonefiles-watch: no inotify on this system, "
+		"the zone files are checked with stat");
+	return NULL;
+}
+
+void
+xfrd_watch_close(struct xfrd_watch* ATTR_UNUSED(w))
+{
+}
+
+void
+xfrd_watch_add_zone(struct xfrd_watch* ATTR_UNUSED(w),
+	struct zone_options* ATTR_UNUSED(zo))
+{
+}
+
+void
+xfrd_watch_del_zone(struct xfrd_watch* ATTR_UNUSED(w),
+	struct zone_options* ATTR_UNUSED(zo))
+{
+}
+
+void
+xfrd_watch_reset(struct xfrd_watch* ATTR_UNUSED(w))
+{
+}
+
+void
+xfrd_watch_check_zonefiles(struct xfrd_state* xfrd)
+{
+	task_new_check_zonefiles(xfrd->nsd->task[xfrd->nsd->mytask],
+		xfrd->last_task, NULL);
+}
+#endif /* HAVE_SYS_INOTIFY_H */
@@ -0,0 +1,33 @@
+/*
+ * xfrd-watch.h - XFR (transfer) Daemon zone file watch header file.
+ *
+ * Copyright (c) 2001-2006, NLnet Labs. All rights reserved.
+ *
+ * See LICENSE for the license.
+ *
+ */
+
+#ifndef XFRD_WATCH_H
+#define XFRD_WATCH_H
+
+struct xfrd_state;
+struct zone_options;
+struct xfrd_watch;
+
+/* create the zone file watch, with the directories of the zone files of
+ * all zones. Returns NULL if not supported or it fails. */
+struct xfrd_watch* xfrd_watch_create(struct xfrd_state* xfrd);
+/* stop the watch, close the file descriptor */
+void xfrd_watch_close(struct xfrd_watch* watch);
+/* watch the zone file of a new zone */
+void xfrd_watch_add_zone(struct xfrd_watch* watch, struct zone_options* zo);
+/* stop to watch the zone file of a zone that is deleted */
+void xfrd_watch_del_zone(struct xfrd_watch* watch, struct zone_options* zo);
+/* the zone files can be different, patterns changed, watch them again and
+ * check all zone files at the next reload */
+void xfrd_watch_reset(struct xfrd_watch* watch);
+/* create the tasks that check the zone files, for the zone files that
+ * have changed, or all zone files if there is no watch */
+void xfrd_watch_check_zonefiles(struct xfrd_state* xfrd);
+
+#endif /* XFRD_WATCH_H */
@@ -19,6 +19,7 @@
 #include "xfrd-tcp.h"
 #include "xfrd-disk.h"
 #include "xfrd-notify.h"
+#include "xfrd-watch.h"
 #include "options.h"
 #include "util.h"
 #include "netio.h"
@@ -37,7 +38,10 @@
 #define XFRD_MAX_ROUNDS 1 /* max number of rounds along the masters */
 #define XFRD_TSIG_MAX_UNSIGNED 103 /* max number of packets without tsig in a tcp stream. */
 			/* rfc recommends 100, +3 for offbyone errors/interoperability. */
+#define XFRD_IXFR_COST_MIN_RRS 100 /* smaller IXFRs do not teach the cost per RR */
 #define XFRD_CHILD_REAP_TIMEOUT 60 /* seconds to wakeup and reap lost children */
+#define XFRD_SOA_NAMES_SWEEP 1024 /* interned SOA names before unused ones
+		are removed, and then twice the number in use */
 		/* these are reload processes that SIGCHILDed but the signal
 		 * was lost, and need waitpid to remove their process entry. */
 
@@ -61,6 +65,10 @@ static int xfrd_handle_incoming_notify(xfrd_zone_type* zone,
 
 /* call with buffer just after the soa dname. returns 0 on error. */
 static int xfrd_parse_soa_info(buffer_type* packet, xfrd_soa_type* soa);
+/* compare the interned SOA names */
+static int xfrd_soa_name_cmp(const void* a, const void* b);
+/* remove the interned SOA names that the zones do not use */
+static void xfrd_soa_names_sweep(void);
 /* set the zone state to a new state (takes care of expiry messages) */
 static void xfrd_set_zone_state(xfrd_zone_type* zone,
 	enum xfrd_zone_state new_zone_state);
@@ -135,6 +143,8 @@ xfrd_init(int socket, struct nsd* nsd, int shortsoa, int reload_active,
 	}
 	xfrd->nsd = nsd;
 	xfrd->packet = buffer_create(xfrd->region, QIOBUFSZ);
+	xfrd->soa_names = rbtree_create(xfrd->region, xfrd_soa_name_cmp);
+	xfrd->soa_names_sweep = XFRD_SOA_NAMES_SWEEP;
 	xfrd->udp_waiting_first = NULL;
 	xfrd->udp_waiting_last = NULL;
 	xfrd->udp_use_num = 0;
@@ -155,6 +165,7 @@ xfrd_init(int socket, struct nsd* nsd, int shortsoa, int reload_active,
 	xfrd->reload_cmd_last_sent = xfrd->xfrd_start_time;
 	xfrd->can_send_reload = !reload_active;
 	xfrd->reload_pid = nsd_pid;
+	xfrd->reload_stats = NULL;
 	xfrd->child_timer_added = 0;
 
 	xfrd->ipc_send_blocked = 0;
@@ -169,6 +180,14 @@ xfrd_init(int socket, struct nsd* nsd, int shortsoa, int reload_active,
 	/* not reading using ipc_conn yet */
 	xfrd->ipc_conn->is_reading = 0;
 	xfrd->ipc_conn->fd = socket;
+	if(nsd->xfrd_notify_fd != -1) {
+		event_set(&xfrd->notify_handler, nsd->xfrd_notify_fd,
+			EV_PERSIST|EV_READ, xfrd_handle_notify_batch, xfrd);
+		if(event_base_set(xfrd->event_base, &xfrd->notify_handler) != 0)
+			log_msg(LOG_ERR, "xfrd notify handler: event_base_set failed");
+		if(event_add(&xfrd->notify_handler, NULL) != 0)
+			log_msg(LOG_ERR, "xfrd notify handler: event_add failed");
+	}
 	xfrd->need_to_send_reload = 0;
 	xfrd->need_to_send_shutdown = 0;
 	xfrd->need_to_send_stats = 0;
@@ -193,6 +212,8 @@ xfrd_init(int socket, struct nsd* nsd, int shortsoa, int reload_active,
 
 	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd pre-startup"));
 	xfrd_init_zones();
+	if(nsd->options->zonefiles_watch)
+		xfrd->watch = xfrd_watch_create(xfrd);
 	xfrd_receive_soa(socket, shortsoa);
 	if(nsd->options->xfrdfile != NULL && nsd->options->xfrdfile[0]!=0)
 		xfrd_read_state(xfrd);
@@ -254,10 +275,8 @@ xfrd_sig_process(void)
 	} else if(xfrd->nsd->signal_hint_reload_hup) {
 		log_msg(LOG_WARNING, "SIGHUP received, reloading...");
 		xfrd->nsd->signal_hint_reload_hup = 0;
-		if(xfrd->nsd->options->zonefiles_check) {
-			task_new_check_zonefiles(xfrd->nsd->task[
-				xfrd->nsd->mytask], xfrd->last_task, NULL);
-		}
+		if(xfrd->nsd->options->zonefiles_check)
+			xfrd_watch_check_zonefiles(xfrd);
 		xfrd_set_reload_now(xfrd);
 	} else if(xfrd->nsd->signal_hint_statsusr) {
 		xfrd->nsd->signal_hint_statsusr = 0;
@@ -309,6 +328,7 @@ xfrd_main(void)
 			}
 		}
 		xfrd_sig_process();
+		xfrd_soa_names_sweep();
 	}
 	xfrd_shutdown();
 }
@@ -321,8 +341,12 @@ xfrd_shutdown()
 	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd shutdown"));
 	event_del(&xfrd->ipc_handler);
 	close(xfrd->ipc_handler.ev_fd); /* notifies parent we stop */
+	if(xfrd->nsd->xfrd_notify_fd != -1)
+		event_del(&xfrd->notify_handler);
 	if(xfrd->nsd->options->xfrdfile != NULL && xfrd->nsd->options->xfrdfile[0]!=0)
 		xfrd_write_state(xfrd);
+	/* zones added or deleted, store the zonelist for a fast start */
+	zone_list_write_snapshot(xfrd->nsd->options);
 	if(xfrd->reload_added) {
 		event_del(&xfrd->reload_handler);
 		xfrd->reload_added = 0;
@@ -334,6 +358,8 @@ xfrd_shutdown()
 	if(xfrd->nsd->options->zonefiles_write) {
 		event_del(&xfrd->write_timer);
 	}
+	xfrd_watch_close(xfrd->watch);
+	xfrd->watch = NULL;
 #ifdef HAVE_SSL
 	daemon_remote_close(xfrd->nsd->rc); /* close sockets of rc */
 #endif
@@ -421,13 +447,11 @@ xfrd_init_slave_zone(xfrd_state_type* xfrd, struct zone_options* zone_opt)
 	xzone->soa_nsd_acquired = 0;
 	xzone->soa_disk_acquired = 0;
 	xzone->soa_notified_acquired = 0;
-	/* [0]=1, [1]=0; "." domain name */
-	xzone->soa_nsd.prim_ns[0] = 1;
-	xzone->soa_nsd.email[0] = 1;
-	xzone->soa_disk.prim_ns[0]=1;
-	xzone->soa_disk.email[0]=1;
-	xzone->soa_notified.prim_ns[0]=1;
-	xzone->soa_notified.email[0]=1;
+	xzone->soa_nsd.prim_ns = xfrd_soa_root;
+	xzone->soa_nsd.email = xfrd_soa_root;
+	xzone->soa_disk.prim_ns = xfrd_soa_root;
+	xzone->soa_disk.email = xfrd_soa_root;
+	xzone->soa_notified_serial = 0;
 
 	xzone->zone_handler.ev_fd = -1;
 	xzone->zone_handler_flags = 0;
@@ -440,7 +464,10 @@ xfrd_init_slave_zone(xfrd_state_type* xfrd, struct zone_options* zone_opt)
 
 	xzone->multi_master_first_master = -1;
 	xzone->multi_master_update_check = -1;
-	tsig_create_record_custom(&xzone->tsig, NULL, 0, 0, 4);
+	xzone->tsig = NULL;
+	xzone->ixfr_cost = 0;
+	xzone->axfr_cost = 0;
+	xzone->axfr_next = 0;
 
 	/* set refreshing anyway, if we have data it may be old */
 	xfrd_set_refresh_now(xzone);
@@ -496,6 +523,7 @@ xfrd_process_soa_info_task(struct task_list_d* task)
 	} else {
 		uint8_t* p = (uint8_t*)task->zname + dname_total_size(
 			task->zname);
+		uint8_t name[MAXDOMAINLEN + 2];
 		/* read the soa info */
 		memset(&soa, 0, sizeof(soa));
 		/* left out type, klass, count for speed */
@@ -504,14 +532,16 @@ xfrd_process_soa_info_task(struct task_list_d* task)
 		memmove(&soa.ttl, p, sizeof(uint32_t));
 		p += sizeof(uint32_t);
 		soa.rdata_count = htons(7);
-		memmove(soa.prim_ns, p, sizeof(uint8_t));
+		memmove(name, p, sizeof(uint8_t));
 		p += sizeof(uint8_t);
-		memmove(soa.prim_ns+1, p, soa.prim_ns[0]);
-		p += soa.prim_ns[0];
-		memmove(soa.email, p, sizeof(uint8_t));
+		memmove(name+1, p, name[0]);
+		p += name[0];
+		soa.prim_ns = xfrd_soa_name(name);
+		memmove(name, p, sizeof(uint8_t));
 		p += sizeof(uint8_t);
-		memmove(soa.email+1, p, soa.email[0]);
-		p += soa.email[0];
+		memmove(name+1, p, name[0]);
+		p += name[0];
+		soa.email = xfrd_soa_name(name);
 		memmove(&soa.serial, p, sizeof(uint32_t));
 		p += sizeof(uint32_t);
 		memmove(&soa.refresh, p, sizeof(uint32_t));
@@ -679,7 +709,7 @@ xfrd_del_slave_zone(xfrd_state_type* xfrd, const dname_type* dname)
 		xfrd_unlink_xfrfile(xfrd->nsd, z->xfrfilenumber);
 
 	/* tsig */
-	tsig_delete_record(&z->tsig, NULL);
+	xfrd_zone_tsig_release(z);
 
 	/* z->dname is recycled when the zone_options is removed */
 	region_recycle(xfrd->region, z, sizeof(*z));
@@ -927,9 +957,12 @@ xfrd_make_request(xfrd_zone_type* zone)
 
 	DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd zone %s make request round %d mr %d nx %d",
 		zone->apex_str, zone->round_num, zone->master_num, zone->next_master));
+	NSD_PROBE3(xfr__start, zone->apex_str, zone->master->ip_address_spec,
+		(int)(!zone->master->use_axfr_only && zone->soa_disk_acquired > 0
+		&& !zone->master->ixfr_disabled && !zone->axfr_next));
 	/* perform xfr request */
 	if (!zone->master->use_axfr_only && zone->soa_disk_acquired > 0 &&
-		!zone->master->ixfr_disabled) {
+		!zone->master->ixfr_disabled && !zone->axfr_next) {
 
 		if (zone->master->allow_udp) {
 			xfrd_set_timer(zone, XFRD_UDP_TIMEOUT);
@@ -940,7 +973,8 @@ xfrd_make_request(xfrd_zone_type* zone)
 			xfrd_tcp_obtain(xfrd->tcp_set, zone);
 		}
 	}
-	else if (zone->master->use_axfr_only || zone->soa_disk_acquired <= 0) {
+	else if (zone->master->use_axfr_only || zone->soa_disk_acquired <= 0 ||
+		zone->axfr_next) {
 		xfrd_set_timer(zone, xfrd->tcp_set->tcp_timeout);
 		xfrd_tcp_obtain(xfrd->tcp_set, zone);
 	}
@@ -1014,6 +1048,7 @@ xfrd_copy_soa(xfrd_soa_type* soa, rr_type* rr)
 	uint8_t rr_ns_len = domain_dname(rdata_atom_domain(rr->rdatas[0]))->name_size;
 	const uint8_t* rr_em_wire = dname_name(domain_dname(rdata_atom_domain(rr->rdatas[1])));
 	uint8_t rr_em_len = domain_dname(rdata_atom_domain(rr->rdatas[1]))->name_size;
+	uint8_t name[MAXDOMAINLEN + 2];
 
 	if(rr->type != TYPE_SOA || rr->rdata_count != 7) {
 		log_msg(LOG_ERR, "xfrd: copy_soa called with bad rr, type %d rrs %u.",
@@ -1028,10 +1063,12 @@ xfrd_copy_soa(xfrd_soa_type* soa, rr_type* rr)
 	soa->rdata_count = htons(rr->rdata_count);
 
 	/* copy dnames */
-	soa->prim_ns[0] = rr_ns_len;
-	memcpy(soa->prim_ns+1, rr_ns_wire, rr_ns_len);
-	soa->email[0] = rr_em_len;
-	memcpy(soa->email+1, rr_em_wire, rr_em_len);
+	name[0] = rr_ns_len;
+	memcpy(name+1, rr_ns_wire, rr_ns_len);
+	soa->prim_ns = xfrd_soa_name(name);
+	name[0] = rr_em_len;
+	memcpy(name+1, rr_em_wire, rr_em_len);
+	soa->email = xfrd_soa_name(name);
 
 	/* already in network format */
 	memcpy(&soa->serial, rdata_atom_data(rr->rdatas[2]), sizeof(uint32_t));
@@ -1045,6 +1082,92 @@ xfrd_copy_soa(xfrd_soa_type* soa, rr_type* rr)
 		(unsigned)ntohl(soa->retry), (unsigned)ntohl(soa->expire)));
 }
 
+/* an interned SOA name, the key is the name */
+struct xfrd_soa_name {
+	rbnode_type node;
+	/* set while the names in use are marked */
+	uint8_t mark;
+	/* 1 octet length + wireformat dname */
+	uint8_t name[1];
+};
+
+const uint8_t xfrd_soa_root[2] = { 1, 0 };
+
+static int
+xfrd_soa_name_cmp(const void* a, const void* b)
+{
+	const uint8_t* x = (const uint8_t*)a;
+	const uint8_t* y = (const uint8_t*)b;
+	if(x[0] != y[0])
+		return x[0] < y[0] ? -1 : 1;
+	return memcmp(x+1, y+1, x[0]);
+}
+
+const uint8_t*
+xfrd_soa_name(const uint8_t* name)
+{
+	struct xfrd_soa_name* n;
+	if(name[0] == 1 && name[1] == 0)
+		return xfrd_soa_root;
+	n = (struct xfrd_soa_name*)rbtree_search(xfrd->soa_names, name);
+	if(n)
+		return n->name;
+	n = (struct xfrd_soa_name*)region_alloc(xfrd->region,
+		sizeof(*n) + name[0]);
+	n->mark = 0;
+	memcpy(n->name, name, (size_t)name[0] + 1);
+	n->node.key = n->name;
+	rbtree_insert(xfrd->soa_names, &n->node);
+	return n->name;
+}
+
+/* mark the interned SOA name as in use */
+static void
+xfrd_soa_name_mark(const uint8_t* name)
+{
+	struct xfrd_soa_name* n;
+	if(!name || name == xfrd_soa_root)
+		return;
+	n = (struct xfrd_soa_name*)rbtree_search(xfrd->soa_names, name);
+	if(n)
+		n->mark = 1;
+}
+
+/* the names are kept by the SOAs of the zones and of the notifies, when
+ * the masters change names the old ones are removed here, between the
+ * events, when no SOA is held elsewhere */
+static void
+xfrd_soa_names_sweep(void)
+{
+	xfrd_zone_type* zone;
+	struct notify_zone* nz;
+	rbnode_type* n, *next;
+	if(xfrd->soa_names->count < xfrd->soa_names_sweep)
+		return;
+	RBTREE_FOR(zone, xfrd_zone_type*, xfrd->zones) {
+		xfrd_soa_name_mark(zone->soa_nsd.prim_ns);
+		xfrd_soa_name_mark(zone->soa_nsd.email);
+		xfrd_soa_name_mark(zone->soa_disk.prim_ns);
+		xfrd_soa_name_mark(zone->soa_disk.email);
+	}
+	RBTREE_FOR(nz, struct notify_zone*, xfrd->notify_zones) {
+		xfrd_soa_name_mark(nz->current_soa->prim_ns);
+		xfrd_soa_name_mark(nz->current_soa->email);
+	}
+	for(n = rbtree_first(xfrd->soa_names); n != RBTREE_NULL; n = next) {
+		struct xfrd_soa_name* s = (struct xfrd_soa_name*)n;
+		next = rbtree_next(n);
+		if(s->mark) {
+			s->mark = 0;
+			continue;
+		}
+		(void)rbtree_delete(xfrd->soa_names, s->name);
+		region_recycle(xfrd->region, s, sizeof(*s) + s->name[0]);
+	}
+	xfrd->soa_names_sweep = xfrd->soa_names->count*2 +
+		XFRD_SOA_NAMES_SWEEP;
+}
+
 static void
 xfrd_set_zone_state(xfrd_zone_type* zone, enum xfrd_zone_state s)
 {
@@ -1165,9 +1288,9 @@ xfrd_handle_incoming_soa(xfrd_zone_type* zone,
 		}
 
 		if(zone->soa_notified_acquired != 0 &&
-			(zone->soa_notified.serial == 0 ||
+			(zone->soa_notified_serial == 0 ||
 		   	compare_serial(ntohl(zone->soa_disk.serial),
-				ntohl(zone->soa_notified.serial)) >= 0))
+				ntohl(zone->soa_notified_serial)) >= 0))
 		{	/* read was in response to this notification */
 			zone->soa_notified_acquired = 0;
 		}
@@ -1190,9 +1313,9 @@ xfrd_handle_incoming_soa(xfrd_zone_type* zone,
 	zone->soa_nsd_acquired = acquired;
 	zone->soa_disk_acquired = acquired;
 	if(zone->soa_notified_acquired != 0 &&
-		(zone->soa_notified.serial == 0 ||
+		(zone->soa_notified_serial == 0 ||
 	   	compare_serial(ntohl(zone->soa_disk.serial),
-			ntohl(zone->soa_notified.serial)) >= 0))
+			ntohl(zone->soa_notified_serial)) >= 0))
 	{	/* user provided in response to this notification */
 		zone->soa_notified_acquired = 0;
 	}
@@ -1236,6 +1359,8 @@ xfrd_udp_release(xfrd_zone_type* zone)
 	if(zone->zone_handler.ev_fd != -1) {
 		close(zone->zone_handler.ev_fd);
 	}
+	/* the request is done, its tsig state is not needed */
+	xfrd_zone_tsig_release(zone);
 	zone->zone_handler.ev_fd = -1;
 	zone->zone_handler_flags = 0;
 	zone->event_added = 0;
@@ -1489,6 +1614,26 @@ xfrd_bind_local_interface(int sockd, struct acl_options* ifc,
 	return ret;
 }
 
+tsig_record_type*
+xfrd_zone_tsig(xfrd_zone_type* zone)
+{
+	if(!zone->tsig) {
+		zone->tsig = (tsig_record_type*)xalloc(sizeof(*zone->tsig));
+		tsig_create_record_custom(zone->tsig, NULL, 0, 0, 4);
+	}
+	return zone->tsig;
+}
+
+void
+xfrd_zone_tsig_release(xfrd_zone_type* zone)
+{
+	if(!zone->tsig)
+		return;
+	tsig_delete_record(zone->tsig, NULL);
+	free(zone->tsig);
+	zone->tsig = NULL;
+}
+
 void
 xfrd_tsig_sign_request(buffer_type* packet, tsig_record_type* tsig,
 	struct acl_options* acl)
@@ -1541,7 +1686,8 @@ xfrd_send_ixfr_request_udp(xfrd_zone_type* zone)
 	xfrd_write_soa_buffer(xfrd->packet, zone->apex, &zone->soa_disk);
 	/* if we have tsig keys, sign the ixfr query */
 	if(zone->master->key_options && zone->master->key_options->tsig_key) {
-		xfrd_tsig_sign_request(xfrd->packet, &zone->tsig, zone->master);
+		xfrd_tsig_sign_request(xfrd->packet, xfrd_zone_tsig(zone),
+			zone->master);
 	}
 	buffer_flip(xfrd->packet);
 	xfrd_set_timer(zone, XFRD_UDP_TIMEOUT);
@@ -1559,6 +1705,7 @@ xfrd_send_ixfr_request_udp(xfrd_zone_type* zone)
 
 static int xfrd_parse_soa_info(buffer_type* packet, xfrd_soa_type* soa)
 {
+	uint8_t ns[MAXDOMAINLEN + 2], em[MAXDOMAINLEN + 2];
 	if(!buffer_available(packet, 10))
 		return 0;
 	soa->type = htons(buffer_read_u16(packet));
@@ -1570,11 +1717,13 @@ static int xfrd_parse_soa_info(buffer_type* packet, xfrd_soa_type* soa)
 	}
 
 	if(!buffer_available(packet, buffer_read_u16(packet)) /* rdata length */ ||
-		!(soa->prim_ns[0] = dname_make_wire_from_packet(soa->prim_ns+1, packet, 1)) ||
-		!(soa->email[0] = dname_make_wire_from_packet(soa->email+1, packet, 1)))
+		!(ns[0] = dname_make_wire_from_packet(ns+1, packet, 1)) ||
+		!(em[0] = dname_make_wire_from_packet(em+1, packet, 1)))
 	{
 		return 0;
 	}
+	soa->prim_ns = xfrd_soa_name(ns);
+	soa->email = xfrd_soa_name(em);
 	soa->rdata_count = 7; /* rdata in SOA */
 	soa->serial = htonl(buffer_read_u32(packet));
 	soa->refresh = htonl(buffer_read_u32(packet));
@@ -1704,32 +1853,39 @@ static int
 xfrd_xfr_process_tsig(xfrd_zone_type* zone, buffer_type* packet)
 {
 	int have_tsig = 0;
+	tsig_record_type* tsig = zone->tsig;
 	assert(zone && zone->master && zone->master->key_options
 		&& zone->master->key_options->tsig_key && packet);
-	if(!tsig_find_rr(&zone->tsig, packet)) {
+	if(!tsig) {
+		log_msg(LOG_ERR, "xfrd: zone %s, from %s: reply to a request "
+			"that was not signed", zone->apex_str,
+			zone->master->ip_address_spec);
+		return 0;
+	}
+	if(!tsig_find_rr(tsig, packet)) {
 		log_msg(LOG_ERR, "xfrd: zone %s, from %s: malformed tsig RR",
 			zone->apex_str, zone->master->ip_address_spec);
 		return 0;
 	}
-	if(zone->tsig.status == TSIG_OK) {
+	if(tsig->status == TSIG_OK) {
 		have_tsig = 1;
-		if (zone->tsig.error_code != TSIG_ERROR_NOERROR) {
+		if (tsig->error_code != TSIG_ERROR_NOERROR) {
 			log_msg(LOG_ERR, "xfrd: zone %s, from %s: tsig error "
 				"(%s)", zone->apex_str,
 				zone->master->ip_address_spec,
-				tsig_error(zone->tsig.error_code));
+				tsig_error(tsig->error_code));
 		}
 	}
 	if(have_tsig) {
 		/* strip the TSIG resource record off... */
-		buffer_set_limit(packet, zone->tsig.position);
+		buffer_set_limit(packet, tsig->position);
 		ARCOUNT_SET(packet, ARCOUNT(packet) - 1);
 	}
 
 	/* keep running the TSIG hash */
-	tsig_update(&zone->tsig, packet, buffer_limit(packet));
+	tsig_update(tsig, packet, buffer_limit(packet));
 	if(have_tsig) {
-		if (!tsig_verify(&zone->tsig)) {
+		if (!tsig_verify(tsig)) {
 			log_msg(LOG_ERR, "xfrd: zone %s, from %s: bad tsig signature",
 				zone->apex_str, zone->master->ip_address_spec);
 			return 0;
@@ -1737,9 +1893,9 @@ xfrd_xfr_process_tsig(xfrd_zone_type* zone, buffer_type* packet)
 		DEBUG(DEBUG_XFRD,1, (LOG_INFO, "xfrd: zone %s, from %s: good tsig signature",
 			zone->apex_str, zone->master->ip_address_spec));
 		/* prepare for next tsigs */
-		tsig_prepare(&zone->tsig);
+		tsig_prepare(tsig);
 	}
-	else if(zone->tsig.updates_since_last_prepare > XFRD_TSIG_MAX_UNSIGNED) {
+	else if(tsig->updates_since_last_prepare > XFRD_TSIG_MAX_UNSIGNED) {
 		/* we allow a number of non-tsig signed packets */
 		log_msg(LOG_INFO, "xfrd: zone %s, from %s: too many consecutive "
 			"packets without TSIG", zone->apex_str,
@@ -1917,10 +2073,10 @@ xfrd_parse_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet,
 			/* single record means it is like a notify */
 			(void)xfrd_handle_incoming_notify(zone, soa);
 		}
-		else if(zone->soa_notified_acquired && zone->soa_notified.serial &&
-			compare_serial(ntohl(zone->soa_notified.serial), ntohl(soa->serial)) < 0) {
+		else if(zone->soa_notified_acquired && zone->soa_notified_serial &&
+			compare_serial(ntohl(zone->soa_notified_serial), ntohl(soa->serial)) < 0) {
 			/* this AXFR/IXFR notifies me that an even newer serial exists */
-			zone->soa_notified.serial = soa->serial;
+			zone->soa_notified_serial = soa->serial;
 		}
 		zone->msg_new_serial = ntohl(soa->serial);
 		zone->msg_rr_count = 1;
@@ -1964,8 +2120,8 @@ xfrd_parse_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet,
 	}
 	if(done == 0)
 		return xfrd_packet_more;
-	if(zone->master->key_options) {
-		if(zone->tsig.updates_since_last_prepare != 0) {
+	if(zone->master->key_options && zone->tsig) {
+		if(zone->tsig->updates_since_last_prepare != 0) {
 			log_msg(LOG_INFO, "xfrd: last packet of reply has no "
 					 		  "TSIG");
 			return xfrd_packet_bad;
@@ -1984,6 +2140,20 @@ xfrd_pretty_time(time_t v)
 	return buf;
 }
 
+/** see if the IXFR that comes in costs more to apply than an AXFR */
+static int
+xfrd_ixfr_too_costly(xfrd_zone_type* zone)
+{
+	if(!zone->msg_is_ixfr || zone->ixfr_cost == 0 || zone->axfr_cost == 0)
+		return 0;
+	if(!xfrd->nsd->options->xfrd_ixfr_cost ||
+		!zone->zone_options->pattern->allow_axfr_fallback)
+		return 0;
+	/* the RRs so far, the cost of the IXFR only goes up */
+	return (uint64_t)zone->msg_rr_count*zone->ixfr_cost/1000 >
+		(uint64_t)zone->axfr_cost;
+}
+
 enum xfrd_packet_result
 xfrd_handle_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet)
 {
@@ -2032,6 +2202,23 @@ xfrd_handle_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet)
 		}
 	}
 
+	if(res == xfrd_packet_more && xfrd_ixfr_too_costly(zone)) {
+		VERBOSITY(1, (LOG_INFO, "xfrd: zone %s IXFR %u from %s has "
+			"%u RRs so far, an AXFR is quicker to apply, "
+			"request AXFR", zone->apex_str,
+			(unsigned)zone->msg_new_serial,
+			zone->master->ip_address_spec,
+			(unsigned)zone->msg_rr_count));
+		if(zone->msg_seq_nr > 0) {
+			xfrd_unlink_xfrfile(xfrd->nsd, zone->xfrfilenumber);
+			zone->msg_seq_nr = 0;
+		}
+		/* ask the same master again */
+		zone->axfr_next = 1;
+		zone->next_master = zone->master_num;
+		return xfrd_packet_drop;
+	}
+
 	/* dump reply on disk to diff file */
 	/* if first part, get new filenumber.  Numbers can wrap around, 64bit
 	 * is enough so we do not collide with older-transfers-in-progress */
@@ -2076,6 +2263,8 @@ xfrd_handle_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet)
 		(char*)buffer_begin(packet), xfrd->nsd, zone->xfrfilenumber);
 	VERBOSITY(1, (LOG_INFO, "xfrd: zone %s committed \"%s\"",
 		zone->apex_str, (char*)buffer_begin(packet)));
+	NSD_PROBE3(xfr__done, zone->apex_str, zone->msg_old_serial,
+		zone->msg_new_serial);
 	/* reset msg seq nr, so if that is nonnull we know xfr file exists */
 	zone->msg_seq_nr = 0;
 	/* now put apply_xfr task on the tasklist */
@@ -2091,9 +2280,9 @@ xfrd_handle_received_xfr_packet(xfrd_zone_type* zone, buffer_type* packet)
 	zone->soa_disk_acquired = xfrd_time();
 	zone->soa_disk = soa;
 	if(zone->soa_notified_acquired && (
-		zone->soa_notified.serial == 0 ||
+		zone->soa_notified_serial == 0 ||
 		compare_serial(htonl(zone->soa_disk.serial),
-		htonl(zone->soa_notified.serial)) >= 0))
+		htonl(zone->soa_notified_serial)) >= 0))
 	{
 		zone->soa_notified_acquired = 0;
 	}
@@ -2261,14 +2450,14 @@ xfrd_handle_incoming_notify(xfrd_zone_type* zone, xfrd_soa_type* soa)
 		return 0; /* ignore notify with old serial, we have a valid zone */
 	}
 	if(soa == 0) {
-		zone->soa_notified.serial = 0;
+		zone->soa_notified_serial = 0;
 	}
 	else if (zone->soa_notified_acquired == 0 ||
-		 zone->soa_notified.serial == 0 ||
+		 zone->soa_notified_serial == 0 ||
 		 compare_serial(ntohl(soa->serial),
-			ntohl(zone->soa_notified.serial)) > 0)
+			ntohl(zone->soa_notified_serial)) > 0)
 	{
-		zone->soa_notified = *soa;
+		zone->soa_notified_serial = soa->serial;
 	}
 	zone->soa_notified_acquired = xfrd_time();
 	if(zone->state == xfrd_zone_ok) {
@@ -2405,19 +2594,92 @@ static void
 xfrd_process_zonestat_inc_task(xfrd_state_type* xfrd, struct task_list_d* task)
 {
 	xfrd->zonestat_safe = (unsigned)task->oldserial;
-	zonestat_remap(xfrd->nsd, 0, xfrd->zonestat_safe*sizeof(struct nsdst));
+	zonestat_remap(xfrd->nsd, 0, ZONESTAT_SIZE(xfrd->nsd,
+		xfrd->zonestat_safe));
 	xfrd->nsd->zonestatsize[0] = xfrd->zonestat_safe;
-	zonestat_remap(xfrd->nsd, 1, xfrd->zonestat_safe*sizeof(struct nsdst));
+	zonestat_remap(xfrd->nsd, 1, ZONESTAT_SIZE(xfrd->nsd,
+		xfrd->zonestat_safe));
 	xfrd->nsd->zonestatsize[1] = xfrd->zonestat_safe;
 }
 #endif /* USE_ZONE_STATS */
 
+/** process reload timing task, add it to the reload statistics */
+static void
+xfrd_process_reload_timing_task(xfrd_state_type* xfrd,
+	struct task_list_d* task)
+{
+	struct reload_timing t;
+	struct reload_stats* s;
+	int i, b;
+	memcpy(&t, task->zname, sizeof(t));
+	if(!xfrd->reload_stats)
+		xfrd->reload_stats = (struct reload_stats*)region_alloc_zero(
+			xfrd->region, sizeof(struct reload_stats));
+	s = xfrd->reload_stats;
+	s->count++;
+	s->last = t;
+	s->sum.zones += t.zones;
+	s->sum.rrs += t.rrs;
+	if(t.zones > s->max.zones)
+		s->max.zones = t.zones;
+	if(t.rrs > s->max.rrs)
+		s->max.rrs = t.rrs;
+	for(i=0; i<RELOAD_PHASES; i++) {
+		s->sum.phase[i] += t.phase[i];
+		if(t.phase[i] > s->max.phase[i])
+			s->max.phase[i] = t.phase[i];
+		/* bucket b has durations below 2^b msec */
+		for(b=0; b<RELOAD_HIST_BUCKETS-1; b++)
+			if(t.phase[i] < ((uint64_t)1000<<b))
+				break;
+		s->hist[i][b]++;
+	}
+	VERBOSITY(2, (LOG_INFO, "reload took %u msec, tasks %u msec, "
+		"%u zones and %u RRs applied",
+		(unsigned)(t.phase[reload_phase_total]/1000),
+		(unsigned)(t.phase[reload_phase_tasks]/1000),
+		(unsigned)t.zones, (unsigned)t.rrs));
+}
+
+/** the running average of the apply cost, with the new measurement */
+static uint32_t
+xfrd_cost_average(uint32_t cost, uint64_t sample)
+{
+	if(sample == 0)
+		sample = 1; /* known, and cheap */
+	else if(sample > 0xffffffff)
+		sample = 0xffffffff;
+	if(cost == 0)
+		return (uint32_t)sample;
+	return (uint32_t)(((uint64_t)cost*3 + sample)/4);
+}
+
+/** process xfr timing task, learn the apply cost of IXFR and AXFR */
+static void
+xfrd_process_xfr_timing_task(xfrd_state_type* xfrd,
+	struct task_list_d* task)
+{
+	xfrd_zone_type* zone = (xfrd_zone_type*)rbtree_search(xfrd->zones,
+		task->zname);
+	if(!zone)
+		return;
+	if(task->newserial) {
+		zone->axfr_cost = xfrd_cost_average(zone->axfr_cost,
+			task->yesno);
+	} else if(task->oldserial >= XFRD_IXFR_COST_MIN_RRS) {
+		zone->ixfr_cost = xfrd_cost_average(zone->ixfr_cost,
+			task->yesno*1000/task->oldserial);
+	}
+	VERBOSITY(3, (LOG_INFO, "xfrd: zone %s %s of %u RRs applied in %u "
+		"msec, cost ixfr %u nsec per RR, axfr %u msec", zone->apex_str,
+		task->newserial?"AXFR":"IXFR", (unsigned)task->oldserial,
+		(unsigned)(task->yesno/1000), (unsigned)zone->ixfr_cost,
+		(unsigned)(zone->axfr_cost/1000)));
+}
+
 static void
 xfrd_handle_taskresult(xfrd_state_type* xfrd, struct task_list_d* task)
 {
-#ifndef BIND8_STATS
-	(void)xfrd;
-#endif
 	switch(task->task_type) {
 	case task_soa_info:
 		xfrd_process_soa_info_task(task);
@@ -2432,6 +2694,18 @@ xfrd_handle_taskresult(xfrd_state_type* xfrd, struct task_list_d* task)
 		xfrd_process_zonestat_inc_task(xfrd, task);
 		break;
 #endif
+	case task_mem_report:
+#ifdef HAVE_SSL
+		daemon_remote_process_memory(xfrd->nsd->rc,
+			(char*)task->zname, task->oldserial);
+#endif
+		break;
+	case task_reload_timing:
+		xfrd_process_reload_timing_task(xfrd, task);
+		break;
+	case task_xfr_timing:
+		xfrd_process_xfr_timing_task(xfrd, task);
+		break;
 	default:
 		log_msg(LOG_WARNING, "unhandled task result in xfrd from "
 			"reload type %d", (int)task->task_type);
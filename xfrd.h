@@ -32,8 +32,10 @@ struct region;
 struct buffer;
 struct xfrd_tcp;
 struct xfrd_tcp_set;
+struct xfrd_watch;
 struct notify_zone;
 struct udb_ptr;
+struct reload_stats;
 typedef struct xfrd_state xfrd_state_type;
 typedef struct xfrd_zone xfrd_zone_type;
 typedef struct xfrd_soa xfrd_soa_type;
@@ -80,10 +82,15 @@ struct xfrd_state {
 	time_t reload_cmd_last_sent;
 	uint8_t can_send_reload;
 	pid_t reload_pid;
+	/* timing of the reloads, NULL until the first reload is done */
+	struct reload_stats* reload_stats;
 	/* timeout for lost sigchild and reaping children */
 	struct event child_timer;
 	int child_timer_added;
 
+	/* watch of the zone files, or NULL if not enabled */
+	struct xfrd_watch* watch;
+
 	/* timeout event for zonefiles_write events */
 	struct event write_timer;
 	/* set to 1 if zones have received xfrs since the last write_timer */
@@ -101,6 +108,8 @@ struct xfrd_state {
 	uint8_t need_to_send_quit;
 	uint8_t	ipc_send_blocked;
 	struct udb_ptr* last_task;
+	/* NOTIFYs from the server processes */
+	struct event notify_handler;
 
 	/* xfrd shutdown flag */
 	uint8_t shutdown;
@@ -110,6 +119,10 @@ struct xfrd_state {
 
 	/* tree of zones, by apex name, contains notify_zone*. All zones. */
 	rbtree_type *notify_zones;
+	/* interned names of the SOAs, the unused names are removed when
+	 * the tree has grown to soa_names_sweep names */
+	rbtree_type *soa_names;
+	size_t soa_names_sweep;
 	/* number of notify_zone active using UDP socket */
 	int notify_udp_num;
 	/* first and last notify_zone* entries waiting for a UDP socket */
@@ -127,10 +140,10 @@ struct xfrd_soa {
 	uint32_t ttl;
 	uint16_t rdata_count; /* = 7 */
 	/* format is 1 octet length, + wireformat dname.
-	   one more octet since parse_dname_wire_from_packet needs it.
-	   maximum size is allocated to avoid memory alloc/free. */
-	uint8_t prim_ns[MAXDOMAINLEN + 2];
-	uint8_t email[MAXDOMAINLEN + 2];
+	   the names are interned with xfrd_soa_name, zones with the
+	   same primary and email share them. */
+	const uint8_t* prim_ns;
+	const uint8_t* email;
 	uint32_t serial;
 	uint32_t refresh;
 	uint32_t retry;
@@ -160,7 +173,9 @@ struct xfrd_zone {
 	time_t soa_nsd_acquired;
 	xfrd_soa_type soa_disk;
 	time_t soa_disk_acquired;
-	xfrd_soa_type soa_notified;
+	/* of the notified soa only the serial is used, kept in network
+	 * order, not a full soa, that saves memory for every zone */
+	uint32_t soa_notified_serial;
 	time_t soa_notified_acquired;
 
 	enum xfrd_zone_state {
@@ -214,11 +229,19 @@ struct xfrd_zone {
 	uint32_t msg_old_serial, msg_new_serial; /* host byte order */
 	size_t msg_rr_count;
 	uint8_t msg_is_ixfr; /* 1:IXFR detected. 2:middle IXFR SOA seen. */
-	tsig_record_type tsig; /* tsig state for IXFR/AXFR */
+	/* tsig state for IXFR/AXFR, allocated when a signed request is
+	 * made and freed when the udp or tcp connection is released, so
+	 * that only zones that are transferring carry it. */
+	tsig_record_type* tsig;
 	uint64_t xfrfilenumber; /* identifier for file to store xfr into,
 				valid if msg_seq_nr nonzero */
 	int multi_master_first_master; /* >0: first check master_num */
 	int multi_master_update_check; /* -1: not update >0: last update master_num */
+	/* apply time learned from the reloads, of an IXFR in nsec per RR
+	 * and of an AXFR of the zone in usec, 0 if not known yet */
+	uint32_t ixfr_cost, axfr_cost;
+	/* an IXFR was aborted because an AXFR is cheaper, request AXFR */
+	uint8_t axfr_next;
 };
 
 enum xfrd_packet_result {
@@ -312,6 +335,16 @@ void xfrd_udp_release(xfrd_zone_type* zone);
  */
 struct buffer* xfrd_get_temp_buffer(void);
 
+/*
+ * Get the tsig state for the transfer of the zone, allocated if needed.
+ */
+tsig_record_type* xfrd_zone_tsig(xfrd_zone_type* zone);
+
+/*
+ * Free the tsig state of the zone, when its transfer connection is released.
+ */
+void xfrd_zone_tsig_release(xfrd_zone_type* zone);
+
 /*
  * TSIG sign outgoing request. Call if acl has a key.
  */
@@ -338,6 +371,11 @@ void xfrd_free_namedb(struct nsd* nsd);
 /* copy SOA info from rr to soa struct. */
 void xfrd_copy_soa(xfrd_soa_type* soa, rr_type* rr);
 
+/* the interned copy of the SOA name, 1 octet length + wireformat */
+const uint8_t* xfrd_soa_name(const uint8_t* name);
+/* the root name, for the names of an empty SOA */
+extern const uint8_t xfrd_soa_root[2];
+
 /* check for failed updates - it is assumed that now the reload has
    finished, and all zone SOAs have been sent. */
 void xfrd_check_failed_updates(void);
@@ -52,6 +52,9 @@ domain_type *error_domain;
 
 static time_t startzonec = 0;
 static long int totalrrs = 0;
+/* index of the large RRsets for the duplicate checks, while parsing */
+static region_type* zone_rr_region = NULL;
+static struct rr_index* zone_rr_index = NULL;
 
 extern uint8_t nsecbits[NSEC_WINDOW_COUNT][NSEC_WINDOW_BITS_SIZE];
 extern uint16_t nsec_highest_rcode;
@@ -1444,9 +1447,16 @@ process_rr(void)
 		}
 
 		/* Search for possible duplicates... */
-		for (i = 0; i < rrset->rr_count; i++) {
-			if (!zrdatacmp(rr->type, rr, &rrset->rrs[i])) {
-				break;
+		if (zone_rr_index && rrset->rr_count >= RR_INDEX_MIN) {
+			i = rr_index_find(zone_rr_index, rrset, rr->klass,
+				rr->rdatas, rr->rdata_count);
+			if (i == -1)
+				i = rrset->rr_count;
+		} else {
+			for (i = 0; i < rrset->rr_count; i++) {
+				if (!zrdatacmp(rr->type, rr, &rrset->rrs[i])) {
+					break;
+				}
 			}
 		}
 
@@ -1468,6 +1478,8 @@ process_rr(void)
 			(rrset->rr_count) * sizeof(rr_type));
 		rrset->rrs[rrset->rr_count] = *rr;
 		++rrset->rr_count;
+		if (zone_rr_index)
+			rr_index_add(zone_rr_index, rrset);
 	}
 
 	if(rr->type == TYPE_DNAME && rrset->rr_count > 1) {
@@ -1563,6 +1575,23 @@ check_dname(zone_type* zone)
 	}
 }
 
+/* start the index of the large RRsets for the parse */
+static void
+zonec_index_start(void)
+{
+	zone_rr_region = region_create(xalloc, free);
+	zone_rr_index = rr_index_create(zone_rr_region);
+}
+
+/* the parse is done, free the index */
+static void
+zonec_index_end(void)
+{
+	region_destroy(zone_rr_region);
+	zone_rr_region = NULL;
+	zone_rr_index = NULL;
+}
+
 /*
  * Reads the specified zone into the memory
  * nsd_options can be NULL if no config file is passed.
@@ -1598,7 +1627,9 @@ zonec_read(const char* name, const char* zonefile, zone_type* zone)
 	parser->current_zone = zone;
 
 	/* Parse and process all RRs.  */
+	zonec_index_start();
 	yyparse();
+	zonec_index_end();
 
 	/* remove origin if it was unused */
 	if(parser->origin != error_domain)
@@ -1627,6 +1658,33 @@ zonec_read(const char* name, const char* zonefile, zone_type* zone)
 	return parser->errors;
 }
 
+unsigned int
+zonec_read_part(const char* zonefile, zone_type* zone, char* text,
+	unsigned int line)
+{
+	totalrrs = 0;
+	startzonec = time(NULL)+100000; /* disable, yyin is not used */
+	parser->errors = 0;
+
+	zparser_init(zonefile, 3600, CLASS_IN, domain_dname(zone->apex));
+	parser->current_zone = zone;
+	parser->line = line;
+	parser_push_stringbuf(text);
+	zonec_index_start();
+	yyparse();
+	zonec_index_end();
+	parser_pop_stringbuf();
+
+	/* remove origin if it was unused */
+	if(parser->origin != error_domain)
+		domain_table_deldomain(parser->db, parser->origin);
+	/* data below a DNAME within the part, other parts are checked
+	 * by the caller */
+	if(!zone_is_slave(zone->opts))
+		check_dname(zone);
+	parser->filename = NULL;
+	return parser->errors;
+}
 
 /*
  * setup parse
@@ -1688,6 +1746,12 @@ zonec_desetup_string_parser(void)
 	parser->db->region = orig_dbregion;
 }
 
+long int
+zonec_num_rrs(void)
+{
+	return totalrrs;
+}
+
 /** parse a string into temporary storage */
 int
 zonec_parse_string(region_type* region, domain_table_type* domains,
@@ -1700,7 +1764,9 @@ zonec_parse_string(region_type* region, domain_table_type* domains,
 	totalrrs = 0;
 	startzonec = time(NULL)+100000; /* disable */
 	parser_push_stringbuf(str);
+	zonec_index_start();
 	yyparse();
+	zonec_index_end();
 	parser_pop_stringbuf();
 	errors = parser->errors;
 	*num_rrs = totalrrs;
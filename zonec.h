@@ -136,6 +136,14 @@ void zonec_desetup_parser(void);
 /* parse a zone into memory. name is origin. zonefile is file to read.
  * returns number of errors; failure may have read a partial zone */
 unsigned int zonec_read(const char *name, const char *zonefile, zone_type* zone);
+/* parse a part of a zone file, the text, into memory. line is the line
+ * number of the start of the text in zonefile. The checks of the whole
+ * zone, for the SOA record and data below DNAMEs, are not done.
+ * returns number of errors. */
+unsigned int zonec_read_part(const char *zonefile, zone_type* zone,
+	char* text, unsigned int line);
+/* number of RRs read by the last zonec_read or zonec_read_part */
+long int zonec_num_rrs(void);
 /* parse a string into the region. and with given domaintable. global parser
  * is restored afterwards. zone needs apex set. returns last domain name
  * parsed and the number rrs parse. return number of errors, 0 is success.